@@ -0,0 +1,277 @@
+#include "attributes.h" // Include the attribute columns header
+
+#include <algorithm> // Include the algorithm library for sorting and searching
+
+namespace {
+
+// Write an array of plain values
+template <typename T>
+void writeArray(std::ostream& out, const std::vector<T>& values) {
+    out.write(reinterpret_cast<const char*>(values.data()), static_cast<std::streamsize>(sizeof(T) * values.size()));
+}
+
+void pad(std::ostream& out) { // Pad the stream to an 8-byte boundary
+    static const char zeros[8] = {};
+    std::streamoff remainder = static_cast<std::streamoff>(out.tellp()) % 8;
+    if (remainder != 0) {
+        out.write(zeros, 8 - remainder);
+    }
+}
+
+// Value of the digits of text, or -1 if any character is not a digit
+int digits(std::string_view text) {
+    int value = 0;
+    for (char c : text) {
+        if (c < '0' || c > '9') {
+            return -1;
+        }
+        value = value * 10 + (c - '0');
+    }
+    return value;
+}
+
+// Add the files whose value in a column, mapped then added, matches to an empty set, one chunk of 65536 ids at a time
+template <typename Match>
+void scan(Match match, const uint32_t* mappedColumn, uint32_t mapped, const std::vector<uint32_t>& column, Roaring& files) {
+    uint64_t words[Roaring::BITMAP_WORDS]; // Matches of the chunk, added as one container
+    uint64_t total = mapped + column.size();
+    auto fill = [&](const uint32_t* values, uint64_t base, uint64_t from, uint64_t to, uint64_t first) { // Branch-free, so the compiler can vectorize it
+        for (uint64_t id = from; id < to; ++id) {
+            words[(id - first) >> 6] |= match(values[id - base]) << ((id - first) & 63);
+        }
+    };
+    for (uint64_t first = 0; first < total; first += 65536) {
+        std::fill(words, words + Roaring::BITMAP_WORDS, 0);
+        uint64_t last = std::min<uint64_t>(total, first + 65536), split = std::clamp<uint64_t>(mapped, first, last);
+        fill(mappedColumn, 0, first, split, first);
+        fill(column.data(), mapped, split, last, first);
+        files.addBitmap(static_cast<uint16_t>(first >> 16), words);
+    }
+}
+
+}
+
+Attributes::Attributes() : mappedDates(nullptr), mappedSites(nullptr), mappedSiteTable(nullptr), mappedSiteNames(nullptr), mappedSiteCount(0), mappedEntityOffsets{}, mappedEntityTerms{}, mapped(0) {}
+
+uint32_t Attributes::parseDate(std::string_view text) {
+    if (text.size() < 10 || text[4] != '-' || text[7] != '-') {
+        return NO_DATE;
+    }
+    int year = digits(text.substr(0, 4)), month = digits(text.substr(5, 2)), day = digits(text.substr(8, 2));
+    if (year <= 0 || month < 1 || month > 12 || day < 1 || day > 31) {
+        return NO_DATE;
+    }
+    return static_cast<uint32_t>(year * 10000 + month * 100 + day);
+}
+
+void Attributes::attach(const char* base, const indexfile::Header& header) {
+    clear();
+    mapped = header.fileCount;
+    mappedDates = reinterpret_cast<const uint32_t*>(base + header.datesOffset);
+    mappedSites = reinterpret_cast<const uint32_t*>(base + header.sitesOffset);
+    mappedSiteTable = reinterpret_cast<const indexfile::SiteEntry*>(base + header.siteTableOffset);
+    mappedSiteNames = base + header.siteNamesOffset;
+    mappedSiteCount = header.siteCount;
+    for (uint32_t field = 0; field < ENTITY_FIELDS; ++field) {
+        mappedEntityOffsets[field] = reinterpret_cast<const uint32_t*>(base + header.entities[field].offsetsOffset);
+        mappedEntityTerms[field] = reinterpret_cast<const uint32_t*>(base + header.entities[field].termsOffset);
+    }
+}
+
+void Attributes::clear() {
+    *this = Attributes();
+}
+
+void Attributes::setFile(uint32_t id, uint32_t date, std::string_view site) {
+    if (id < mapped) { // Mapped files keep their attributes
+        return;
+    }
+    size_t index = id - mapped;
+    if (dates.size() <= index) {
+        dates.resize(index + 1, NO_DATE);
+        sites.resize(index + 1, indexfile::NO_SITE);
+    }
+    dates[index] = date;
+    uint32_t siteId = site.empty() ? indexfile::NO_SITE : findSite(site);
+    if (!site.empty() && siteId == indexfile::NO_SITE) { // First file of a site
+        siteId = mappedSiteCount + static_cast<uint32_t>(siteNames.size());
+        siteNames.emplace_back(site);
+        siteIds.emplace(siteNames.back(), siteId);
+    }
+    sites[index] = siteId;
+}
+
+void Attributes::addEntity(indexfile::Field field, uint32_t id, uint32_t term) {
+    if (field < ENTITY_FIELDS && id >= mapped) {
+        pending[field].push_back({id, term});
+    }
+}
+
+void Attributes::finalize() {
+    for (uint32_t field = 0; field < ENTITY_FIELDS; ++field) {
+        std::vector<std::pair<uint32_t, uint32_t>>& entities = pending[field];
+        if (entities.empty()) {
+            continue;
+        }
+        std::sort(entities.begin(), entities.end());
+        entities.erase(std::unique(entities.begin(), entities.end()), entities.end());
+        std::vector<uint32_t>& offsets = entityOffsets[field];
+        std::vector<uint32_t>& terms = entityTerms[field];
+        if (offsets.empty()) {
+            offsets.push_back(0);
+        }
+        for (size_t i = 0; i < entities.size();) {
+            uint32_t id = entities[i].first;
+            size_t index = id - mapped;
+            if (index + 1 < offsets.size()) { // Columns of earlier files are complete
+                for (; i < entities.size() && entities[i].first == id; ++i) {}
+                continue;
+            }
+            offsets.resize(index + 1, static_cast<uint32_t>(terms.size())); // Files in between have no entities
+            for (; i < entities.size() && entities[i].first == id; ++i) {
+                terms.push_back(entities[i].second);
+            }
+            offsets.push_back(static_cast<uint32_t>(terms.size()));
+        }
+        std::vector<std::pair<uint32_t, uint32_t>>().swap(entities);
+    }
+}
+
+uint32_t Attributes::date(uint32_t id) const {
+    if (id < mapped) {
+        return mappedDates[id];
+    }
+    return id - mapped < dates.size() ? dates[id - mapped] : NO_DATE;
+}
+
+uint32_t Attributes::site(uint32_t id) const {
+    if (id < mapped) {
+        return mappedSites[id];
+    }
+    return id - mapped < sites.size() ? sites[id - mapped] : indexfile::NO_SITE;
+}
+
+uint32_t Attributes::findSite(std::string_view name) const {
+    const indexfile::SiteEntry* end = mappedSiteTable + mappedSiteCount;
+    const indexfile::SiteEntry* found = std::lower_bound(mappedSiteTable, end, name, [this](const indexfile::SiteEntry& entry, std::string_view value) {
+        return std::string_view(mappedSiteNames + entry.nameOffset, entry.nameLength) < value;
+    });
+    if (found != end && std::string_view(mappedSiteNames + found->nameOffset, found->nameLength) == name) {
+        return static_cast<uint32_t>(found - mappedSiteTable);
+    }
+    auto added = siteIds.find(std::string(name));
+    return added != siteIds.end() ? added->second : indexfile::NO_SITE;
+}
+
+std::string_view Attributes::siteName(uint32_t site) const {
+    if (site < mappedSiteCount) {
+        return std::string_view(mappedSiteNames + mappedSiteTable[site].nameOffset, mappedSiteTable[site].nameLength);
+    }
+    return site - mappedSiteCount < siteNames.size() ? std::string_view(siteNames[site - mappedSiteCount]) : std::string_view();
+}
+
+Attributes::Terms Attributes::entities(indexfile::Field field, uint32_t id) const {
+    if (field >= ENTITY_FIELDS) {
+        return {nullptr, 0};
+    }
+    if (id < mapped) {
+        const uint32_t* offsets = mappedEntityOffsets[field];
+        return {mappedEntityTerms[field] + offsets[id], offsets[id + 1] - offsets[id]};
+    }
+    const std::vector<uint32_t>& offsets = entityOffsets[field];
+    size_t index = id - mapped;
+    if (index + 1 >= offsets.size()) { // Added without entities
+        return {nullptr, 0};
+    }
+    return {entityTerms[field].data() + offsets[index], offsets[index + 1] - offsets[index]};
+}
+
+void Attributes::matchDates(uint32_t from, uint32_t to, Roaring& files) const {
+    if (from > to) {
+        return;
+    }
+    scan([from, to](uint32_t date) -> uint64_t { return (date != NO_DATE) & (date - from <= to - from); }, mappedDates, mapped, dates, files);
+}
+
+void Attributes::matchSite(uint32_t site, Roaring& files) const {
+    if (site == indexfile::NO_SITE) {
+        return;
+    }
+    scan([site](uint32_t value) -> uint64_t { return value == site; }, mappedSites, mapped, sites, files);
+}
+
+size_t Attributes::memoryUsage() const {
+    size_t bytes = (dates.capacity() + sites.capacity()) * sizeof(uint32_t);
+    for (const std::string& name : siteNames) {
+        bytes += name.capacity() * 2; // Also the key of siteIds
+    }
+    for (uint32_t field = 0; field < ENTITY_FIELDS; ++field) {
+        bytes += (entityOffsets[field].capacity() + entityTerms[field].capacity()) * sizeof(uint32_t) + pending[field].capacity() * sizeof(pending[field][0]);
+    }
+    return bytes;
+}
+
+bool Attributes::write(std::ostream& out, const std::vector<uint32_t>& kept, const std::vector<uint32_t>& newTerms, indexfile::Header& header) const {
+    std::vector<uint32_t> column; // Column being written, by saved id
+    for (uint32_t id : kept) {
+        column.push_back(date(id));
+    }
+    header.datesOffset = static_cast<uint64_t>(out.tellp());
+    writeArray(out, column);
+    pad(out);
+
+    std::vector<std::string_view> names; // Sites of the kept files, sorted so saved ids follow name order
+    for (uint32_t id : kept) {
+        if (site(id) != indexfile::NO_SITE) {
+            names.push_back(siteName(site(id)));
+        }
+    }
+    std::sort(names.begin(), names.end());
+    names.erase(std::unique(names.begin(), names.end()), names.end());
+    column.clear();
+    for (uint32_t id : kept) {
+        uint32_t old = site(id);
+        column.push_back(old == indexfile::NO_SITE ? old : static_cast<uint32_t>(std::lower_bound(names.begin(), names.end(), siteName(old)) - names.begin()));
+    }
+    header.sitesOffset = static_cast<uint64_t>(out.tellp());
+    writeArray(out, column);
+    pad(out);
+    std::vector<indexfile::SiteEntry> table; // Saved site table
+    std::string blob; // Saved site names
+    for (std::string_view name : names) {
+        table.push_back({blob.size(), static_cast<uint32_t>(name.size()), 0});
+        blob += name;
+    }
+    header.siteCount = static_cast<uint32_t>(table.size());
+    header.siteTableOffset = static_cast<uint64_t>(out.tellp());
+    writeArray(out, table);
+    header.siteNamesOffset = static_cast<uint64_t>(out.tellp());
+    out.write(blob.data(), static_cast<std::streamsize>(blob.size()));
+    pad(out);
+
+    for (uint32_t field = 0; field < ENTITY_FIELDS; ++field) {
+        std::vector<uint32_t> offsets(1, 0); // Start of each saved file's terms
+        std::vector<uint32_t> terms; // Saved term ids
+        for (uint32_t id : kept) {
+            Terms entities = this->entities(static_cast<indexfile::Field>(field), id);
+            size_t start = terms.size();
+            for (uint32_t i = 0; i < entities.count; ++i) {
+                uint32_t term = entities.ids[i] < newTerms.size() ? newTerms[entities.ids[i]] : indexfile::NO_TERM;
+                if (term != indexfile::NO_TERM) { // Kept with the file's postings, unless disassociated since
+                    terms.push_back(term);
+                }
+            }
+            std::sort(terms.begin() + static_cast<std::ptrdiff_t>(start), terms.end()); // Saved ids follow term order
+            offsets.push_back(static_cast<uint32_t>(terms.size()));
+        }
+        indexfile::EntityColumn& section = header.entities[field];
+        section.termCount = terms.size();
+        section.offsetsOffset = static_cast<uint64_t>(out.tellp());
+        writeArray(out, offsets);
+        pad(out);
+        section.termsOffset = static_cast<uint64_t>(out.tellp());
+        writeArray(out, terms);
+        pad(out);
+    }
+    return static_cast<bool>(out);
+}
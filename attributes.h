@@ -0,0 +1,76 @@
+#ifndef ATTRIBUTES_H // Include guard to prevent multiple inclusions of this header file
+#define ATTRIBUTES_H // Define the include guard
+
+#include "indexFile.h" // Include the layout of the attribute columns
+#include "roaring.h" // Include the sets filters are scanned into
+#include <cstddef> // Include cstddef library for size_t
+#include <cstdint> // Include cstdint library for fixed width integers
+#include <ostream> // Include ostream library for saving
+#include <string> // Include string library
+#include <string_view> // Include string_view library
+#include <unordered_map> // Include unordered_map library for the ids of added sites
+#include <utility> // Include utility library for std::pair
+#include <vector> // Include vector library
+
+// Attributes of the files of a WordMap that queries filter and count by, as columns indexed by file id.
+//
+// Each file has a publish date, kept as the number yyyymmdd so a range of dates is a range of numbers,
+// a site, kept as the id of its name in a table of sites, and the distinct organization and person
+// term ids of its entities. Filters scan a column into a set of file ids, and facets read the columns
+// of each match, so neither touches the stored documents or the posting lists of other words.
+// Files added after the index was mapped keep their attributes in memory until the next save.
+class Attributes {
+public:
+    static constexpr uint32_t NO_DATE = 0; // Date of a file without one
+    static constexpr uint32_t ENTITY_FIELDS = indexfile::ENTITY_FIELDS; // Fields with entity columns, ORG and NAME
+
+    struct Terms { // Entity term ids of one file, ascending
+        const uint32_t* ids; // First term id
+        uint32_t count; // Number of term ids
+    };
+
+    Attributes(); // Constructor
+
+    static uint32_t parseDate(std::string_view text); // yyyymmdd of text starting with a YYYY-MM-DD date, or NO_DATE
+
+    void attach(const char* base, const indexfile::Header& header); // Serve the columns of a mapped index, forgetting every added file
+    void clear(); // Forget every file and any mapped index
+
+    void setFile(uint32_t id, uint32_t date, std::string_view site); // Date and site of a file added after the mapped ones; an empty site is none
+    void addEntity(indexfile::Field field, uint32_t id, uint32_t term); // Organization or person term of a file added after the mapped ones
+    void finalize(); // Add the entities given since the last call to the columns; they are for files after every earlier one
+
+    uint32_t date(uint32_t id) const; // Publish date of a file as yyyymmdd, or NO_DATE
+    uint32_t site(uint32_t id) const; // Site id of a file, or indexfile::NO_SITE
+    uint32_t findSite(std::string_view name) const; // Id of a site name, or indexfile::NO_SITE
+    std::string_view siteName(uint32_t site) const; // Name of a site id
+    Terms entities(indexfile::Field field, uint32_t id) const; // Organization or person term ids of a file
+
+    void matchDates(uint32_t from, uint32_t to, Roaring& files) const; // Add every file dated from to to, inclusive, to an empty set
+    void matchSite(uint32_t site, Roaring& files) const; // Add every file of a site to an empty set
+    size_t memoryUsage() const; // Heap bytes held by the columns of added files
+
+    // Write the attribute sections of a saved index for kept, the old file ids in saved order, with newTerms giving
+    // the saved id of every old term id; fills in the attribute offsets of header. The stream must be at an 8-byte boundary.
+    bool write(std::ostream& out, const std::vector<uint32_t>& kept, const std::vector<uint32_t>& newTerms, indexfile::Header& header) const;
+
+private:
+    const uint32_t* mappedDates; // Date column of the mapped index
+    const uint32_t* mappedSites; // Site column of the mapped index
+    const indexfile::SiteEntry* mappedSiteTable; // Site names of the mapped index, sorted
+    const char* mappedSiteNames; // Site name blob of the mapped index
+    uint32_t mappedSiteCount; // Number of sites in the mapped index
+    const uint32_t* mappedEntityOffsets[ENTITY_FIELDS]; // Start of each file's terms in each entity column, fileCount + 1 of them
+    const uint32_t* mappedEntityTerms[ENTITY_FIELDS]; // Term ids of each entity column
+    uint32_t mapped; // Number of files in the mapped index
+
+    std::vector<uint32_t> dates; // Date of each added file, indexed by id minus mapped
+    std::vector<uint32_t> sites; // Site id of each added file
+    std::vector<std::string> siteNames; // Names of the sites added after the mapped ones, by site id minus mappedSiteCount
+    std::unordered_map<std::string, uint32_t> siteIds; // Id of each added site name
+    std::vector<uint32_t> entityOffsets[ENTITY_FIELDS]; // Start of each added file's terms, one more than the files with entities
+    std::vector<uint32_t> entityTerms[ENTITY_FIELDS]; // Term ids of the added files
+    std::vector<std::pair<uint32_t, uint32_t>> pending[ENTITY_FIELDS]; // Entities not yet in the columns, as (id, term)
+};
+
+#endif // ATTRIBUTES_H // End of include guard
@@ -0,0 +1,445 @@
+#include "searchEngine.h" // Include the search engine header
+#include "protocol.h" // Include the socketSearch wire format
+#include "metrics.h" // Include the stage timers
+#include "tokenizer.h" // Include the tokenizer, to report its instruction set
+
+#include <algorithm> // Include algorithm for sorting latencies
+#include <atomic> // Include atomic for the driver stop flag
+#include <chrono> // Include chrono for timing
+#include <cmath> // Include cmath for the Zipf weights
+#include <cstdio> // Include cstdio for file names
+#include <cstdlib> // Include cstdlib for malloc in the counting operator new
+#include <cstring> // Include cstring for strerror
+#include <filesystem> // Include filesystem for corpus folders
+#include <fstream> // Include fstream for writing documents and reading /proc
+#include <new> // Include new for the replaced allocation functions
+#include <iostream> // Include iostream for reports
+#include <random> // Include random for the generators
+#include <string> // Include string library
+#include <thread> // Include thread for the client driver
+#include <vector> // Include vector library
+#include <arpa/inet.h> // Include inet_pton for the server address
+#include <netinet/in.h> // Include internet address family
+#include <sys/socket.h> // Include socket library
+#include <unistd.h> // Include POSIX operating system API
+
+// Benchmarks for the engine and socketSearch.
+//
+//   benchmark generate <folder> [documents] [vocabulary] [seed]   write a synthetic news corpus
+//   benchmark engine <folder> [queries] [threads] [vocabulary]    build, save, load and query an index of the corpus
+//   benchmark server [port] [clients] [seconds] [vocabulary]      closed-loop load against a running socketSearch
+//
+// Results are printed as "name value" lines so runs can be diffed and compared against a baseline.
+// Queries are drawn from the generator's vocabulary with Zipfian frequencies, so the engine and server
+// benchmarks should run against a generated corpus and be given the vocabulary size it was generated with.
+
+namespace fs = std::filesystem; // Create an alias for the std::filesystem namespace
+using Clock = std::chrono::steady_clock; // Clock used for every measurement
+
+std::atomic<uint64_t> allocations(0); // Calls to operator new in this process, counted by the replacements below
+
+// Counting replacements of the global allocation functions; the array and nothrow forms call these
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size > 0 ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+    std::free(memory);
+}
+
+namespace {
+
+const uint64_t QUERY_SEED = 42; // Seed of the query mix, fixed so runs are comparable
+const size_t DEFAULT_VOCABULARY = 50000; // Distinct words in a generated corpus
+const size_t PAGE_SIZE = 10; // Results requested per query, like one page of a typical results list
+const size_t GUI_PAGE_SIZE = 100; // Results the GUI shows per page
+
+// Pronounceable synthetic word for a vocabulary rank; distinct ranks give distinct words
+std::string syntheticWord(size_t rank) {
+    static const char* syllables[] = {"ba", "ke", "lo", "mi", "nu", "ra", "si", "to", "ve", "da", "fi", "go", "ha", "ju", "pe", "zo"};
+    std::string word;
+    for (size_t value = rank + 16; value > 0; value /= 16) { // At least two syllables
+        word += syllables[value % 16];
+    }
+    return word;
+}
+
+std::string capitalized(std::string word) { // Upper case the first letter, like a name
+    word[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(word[0])));
+    return word;
+}
+
+// Draws ranks 0..n-1 with probability proportional to 1 / (rank + 1)^exponent
+class ZipfSampler {
+public:
+    ZipfSampler(size_t n, double exponent) : cumulative(n) {
+        double total = 0;
+        for (size_t i = 0; i < n; ++i) {
+            total += 1.0 / std::pow(static_cast<double>(i + 1), exponent);
+            cumulative[i] = total;
+        }
+    }
+
+    template <typename Random>
+    size_t operator()(Random& random) const {
+        double target = std::uniform_real_distribution<double>(0, cumulative.back())(random);
+        return std::min(cumulative.size() - 1, static_cast<size_t>(std::lower_bound(cumulative.begin(), cumulative.end(), target) - cumulative.begin()));
+    }
+
+private:
+    std::vector<double> cumulative; // Running sum of the weights
+};
+
+// Zipfian mix of one to three word queries, some restricted to organizations or persons
+std::vector<std::string> makeQueries(size_t count, size_t vocabulary) {
+    std::mt19937_64 random(QUERY_SEED);
+    ZipfSampler words(vocabulary, 1.0);
+    ZipfSampler names(vocabulary / 10 + 1, 1.0);
+    std::vector<std::string> queries;
+    for (size_t i = 0; i < count; ++i) {
+        unsigned kind = random() % 10;
+        if (kind < 5) { // Single word
+            queries.push_back(syntheticWord(words(random)));
+        } else if (kind < 8) { // Two or three words, implicitly ORed
+            std::string query = syntheticWord(words(random)) + " " + syntheticWord(words(random));
+            if (kind == 7) {
+                query += " " + syntheticWord(words(random));
+            }
+            queries.push_back(query);
+        } else if (kind == 8) { // Word AND organization
+            queries.push_back(syntheticWord(words(random)) + " AND org:" + syntheticWord(names(random)));
+        } else { // Person
+            queries.push_back("person:" + syntheticWord(names(random)));
+        }
+    }
+    return queries;
+}
+
+// Latency summary in microseconds
+void reportLatencies(const std::string& prefix, std::vector<double> micros) {
+    if (micros.empty()) {
+        std::cout << prefix << "_count 0" << std::endl;
+        return;
+    }
+    std::sort(micros.begin(), micros.end());
+    auto percentile = [&micros](double p) {
+        return micros[std::min(micros.size() - 1, static_cast<size_t>(p * static_cast<double>(micros.size())))];
+    };
+    double sum = 0;
+    for (double micro : micros) {
+        sum += micro;
+    }
+    std::cout << prefix << "_count " << micros.size() << "\n"
+              << prefix << "_mean_us " << sum / static_cast<double>(micros.size()) << "\n"
+              << prefix << "_p50_us " << percentile(0.50) << "\n"
+              << prefix << "_p99_us " << percentile(0.99) << "\n"
+              << prefix << "_p999_us " << percentile(0.999) << "\n"
+              << prefix << "_max_us " << micros.back() << std::endl;
+}
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Resident memory of this process in kB from /proc/self/status, split into anonymous and file-backed pages
+void readRss(long& anonKb, long& fileKb) {
+    anonKb = fileKb = -1;
+    std::ifstream status("/proc/self/status");
+    std::string key;
+    long value;
+    while (status >> key) {
+        if (key == "RssAnon:" && status >> value) {
+            anonKb = value;
+        } else if (key == "RssFile:" && status >> value) {
+            fileKb = value;
+        }
+    }
+}
+
+void reportRss(const std::string& prefix) {
+    long anonKb, fileKb;
+    readRss(anonKb, fileKb);
+    std::cout << prefix << "_rss_anon_kb " << anonKb << "\n" << prefix << "_rss_file_kb " << fileKb << std::endl;
+}
+
+// Silences the engine's own progress and timing prints while measuring
+class QuietStdout {
+public:
+    QuietStdout() : saved(std::cout.rdbuf(nullptr)) {}
+    ~QuietStdout() { std::cout.rdbuf(saved); }
+
+private:
+    std::streambuf* saved; // Restored on destruction
+};
+
+// Delete an index with its manifest and write-ahead log
+void removeIndex(const std::string& path) {
+    for (const char* suffix : {"", ".manifest", ".wal"}) {
+        std::remove((path + suffix).c_str());
+    }
+}
+
+int generate(const std::string& folder, size_t documents, size_t vocabulary, uint64_t seed) {
+    static const char* sites[] = {"reuters.com", "cnbc.com", "wsj.com", "bloomberg.com", "ft.com"};
+    static const char* suffixes[] = {"Inc", "Group", "Bank", "Holdings", "Capital"};
+
+    auto start = Clock::now();
+    std::mt19937_64 random(seed);
+    ZipfSampler words(vocabulary, 1.0); // Text follows Zipf's law
+    ZipfSampler names(vocabulary / 10 + 1, 1.0); // Organizations and persons come from a smaller, also skewed pool
+    std::uniform_int_distribution<size_t> textLength(50, 400);
+    std::uniform_int_distribution<int> entityCount(0, 3);
+    std::uniform_int_distribution<int> month(1, 12), day(1, 28);
+
+    for (size_t i = 0; i < documents; ++i) {
+        fs::path directory = fs::path(folder) / ("batch" + std::to_string(i / 10000)); // Spread files over folders like the news dataset
+        if (i % 10000 == 0) {
+            fs::create_directories(directory);
+        }
+
+        std::string text;
+        size_t length = textLength(random);
+        for (size_t w = 0; w < length; ++w) {
+            text += (w == 0 ? capitalized(syntheticWord(words(random))) : " " + syntheticWord(words(random)));
+            if (w + 1 == length || random() % 15 == 0) {
+                text += ".";
+            }
+        }
+        std::string title = text.substr(0, text.find(' ', std::min(text.size(), static_cast<size_t>(40))));
+
+        char date[32];
+        std::snprintf(date, sizeof(date), "2018-%02d-%02dT10:00:00.000+03:00", month(random), day(random));
+        const char* site = sites[random() % 5];
+
+        std::string persons, organizations;
+        for (int e = entityCount(random); e > 0; --e) {
+            persons += std::string(persons.empty() ? "" : ",") + "{\"name\":\"" + capitalized(syntheticWord(names(random))) + " " + capitalized(syntheticWord(names(random))) + "\",\"sentiment\":\"none\"}";
+        }
+        for (int e = entityCount(random); e > 0; --e) {
+            organizations += std::string(organizations.empty() ? "" : ",") + "{\"name\":\"" + capitalized(syntheticWord(names(random))) + " " + suffixes[random() % 5] + "\",\"sentiment\":\"none\"}";
+        }
+
+        char name[32];
+        std::snprintf(name, sizeof(name), "news_%07zu.json", i);
+        std::ofstream file(directory / name);
+        file << "{\"uuid\":\"" << seed << "-" << i << "\","
+             << "\"thread\":{\"site\":\"" << site << "\",\"published\":\"" << date << "\",\"title\":\"" << title << "\"},"
+             << "\"author\":\"" << capitalized(syntheticWord(names(random))) << "\","
+             << "\"url\":\"https://" << site << "/" << i << "\","
+             << "\"title\":\"" << title << "\","
+             << "\"text\":\"" << text << "\","
+             << "\"published\":\"" << date << "\","
+             << "\"entities\":{\"persons\":[" << persons << "],\"organizations\":[" << organizations << "],\"locations\":[]}}";
+        if (!file) {
+            std::cerr << "Failed to write " << (directory / name).string() << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << "generate_documents " << documents << "\n"
+              << "generate_vocabulary " << vocabulary << "\n"
+              << "generate_seconds " << secondsSince(start) << std::endl;
+    return 0;
+}
+
+int engine(const std::string& folder, size_t queryCount, unsigned threads, size_t vocabulary) {
+    const std::string builtPath = "benchmark_built.bin"; // Written by the build
+    const std::string savedPath = "benchmark_saved.bin"; // Written by the timed save
+    removeIndex(builtPath); // Start from nothing, so the engine builds
+    removeIndex(savedPath);
+    reportRss("start");
+
+    {
+        auto start = Clock::now();
+        std::unique_ptr<SearchEngine> built;
+        uint64_t buildAllocations;
+        {
+            QuietStdout quiet;
+            uint64_t before = allocations.load();
+            built = std::make_unique<SearchEngine>(folder, builtPath, threads); // Build from the corpus, then save
+            buildAllocations = allocations.load() - before;
+        }
+        std::cout << "build_seconds " << secondsSince(start) << "\n"
+                  << "build_allocations " << buildAllocations << "\n"
+                  << "build_tokenizer " << tokenizer::implementation() << std::endl;
+        reportRss("built");
+
+        start = Clock::now();
+        bool saved;
+        {
+            QuietStdout quiet;
+            saved = built->saveIndex(savedPath);
+        }
+        if (!saved) {
+            std::cerr << "Failed to save " << savedPath << std::endl;
+            return 1;
+        }
+        std::cout << "save_seconds " << secondsSince(start) << "\n"
+                  << "index_bytes " << fs::file_size(savedPath) << std::endl;
+    }
+
+    auto start = Clock::now();
+    std::unique_ptr<SearchEngine> loaded;
+    {
+        QuietStdout quiet;
+        loaded = std::make_unique<SearchEngine>(folder, savedPath, threads); // Maps the saved index
+    }
+    std::cout << "load_seconds " << secondsSince(start) << std::endl;
+
+    std::vector<std::string> queries = makeQueries(queryCount, vocabulary);
+    std::vector<double> micros;
+    micros.reserve(queries.size());
+    size_t results = 0;
+    uint64_t queryAllocations;
+    {
+        QuietStdout quiet;
+        std::vector<std::string> page; // Reused by every query, as a server worker would
+        uint64_t before = allocations.load();
+        for (const auto& query : queries) {
+            auto queryStart = Clock::now();
+            loaded->search(query, page, PAGE_SIZE);
+            results += page.size();
+            micros.push_back(std::chrono::duration<double, std::micro>(Clock::now() - queryStart).count());
+        }
+        queryAllocations = allocations.load() - before;
+    }
+    reportLatencies("query", micros);
+    std::cout << "query_results " << results << "\n"
+              << "query_allocations_per_query " << static_cast<double>(queryAllocations) / static_cast<double>(std::max<size_t>(1, queries.size())) << std::endl;
+    ResultCache::Counters cache = {};
+    loaded->cacheCounters(cache);
+    std::cout << "cache_hits " << cache.hits << "\n"
+              << "cache_misses " << cache.misses << "\n"
+              << "cache_bytes " << cache.bytes << std::endl;
+    metrics::Snapshot stages = metrics::collect(); // Where the query time went, from the engine's own timers
+    for (metrics::Stage stage : {metrics::PARSE, metrics::FETCH, metrics::SCORE, metrics::SORT}) {
+        const metrics::Distribution& d = stages.stages[stage];
+        std::cout << "stage_" << metrics::stageName(stage) << "_p50_us " << d.quantile(0.5) * 1e6 << "\n"
+                  << "stage_" << metrics::stageName(stage) << "_p99_us " << d.quantile(0.99) * 1e6 << "\n";
+    }
+    reportRss("loaded");
+
+    uint64_t flipHits; // Pages after the first answered by the first page's cache entry
+    {
+        QuietStdout quiet;
+        std::string query = syntheticWord(0) + " " + syntheticWord(1) + " " + syntheticWord(2) + " " + syntheticWord(3); // Four words, never in the mix
+        std::vector<std::string> page;
+        loaded->search(query, page, GUI_PAGE_SIZE + 1); // One more result tells the GUI a next page exists
+        ResultCache::Counters before = {}, after = {};
+        loaded->cacheCounters(before);
+        for (size_t offset = GUI_PAGE_SIZE; offset <= 2 * GUI_PAGE_SIZE; offset += GUI_PAGE_SIZE) {
+            loaded->search(query, page, GUI_PAGE_SIZE + 1, offset);
+        }
+        loaded->cacheCounters(after);
+        flipHits = after.hits - before.hits;
+    }
+    std::cout << "cache_page_flip_hits " << flipHits << std::endl; // 2 when the cache holds the GUI's next pages
+
+    loaded.reset();
+    removeIndex(builtPath);
+    removeIndex(savedPath);
+    return 0;
+}
+
+int server(int port, unsigned clients, double seconds, size_t vocabulary) {
+    std::vector<std::string> queries = makeQueries(100000, vocabulary);
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> failures(0);
+    std::atomic<size_t> partial(0); // Answers cut short by the server's deadline
+    std::atomic<size_t> rejected(0); // Requests refused by the server's admission control
+    std::vector<std::vector<double>> micros(clients); // Latencies per client, merged at the end
+
+    auto client = [&](unsigned index) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+        if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+            std::cerr << "Connect failed: " << std::strerror(errno) << std::endl;
+            ++failures;
+            if (fd >= 0) {
+                close(fd);
+            }
+            return;
+        }
+
+        std::string buffer, response;
+        for (size_t i = index; !stop; i += clients) { // Closed loop: one request in flight per client
+            auto start = Clock::now();
+            if (!protocol::writeFrame(fd, protocol::encodeQuery(queries[i % queries.size()], 0, PAGE_SIZE)) || !protocol::readFrame(fd, buffer, response)) {
+                ++failures;
+                break;
+            }
+            if (!response.empty() && response[0] == protocol::PARTIAL) {
+                ++partial;
+            } else if (!response.empty() && response[0] == protocol::OVERLOADED) {
+                ++rejected;
+            } else if (response.empty() || response[0] != protocol::OK) {
+                ++failures;
+            }
+            micros[index].push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+        }
+        close(fd);
+    };
+
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < clients; ++i) {
+        threads.emplace_back(client, i);
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double elapsed = secondsSince(start);
+
+    std::vector<double> all;
+    for (auto& latencies : micros) {
+        all.insert(all.end(), latencies.begin(), latencies.end());
+    }
+    std::cout << "server_clients " << clients << "\n"
+              << "server_seconds " << elapsed << "\n"
+              << "server_qps " << static_cast<double>(all.size()) / elapsed << "\n"
+              << "server_partial " << partial << "\n"
+              << "server_rejected " << rejected << "\n"
+              << "server_failures " << failures << std::endl;
+    reportLatencies("server", all);
+    return failures == 0 ? 0 : 1;
+}
+
+int usage() {
+    std::cerr << "Usage:\n"
+              << "  benchmark generate <folder> [documents=10000] [vocabulary=" << DEFAULT_VOCABULARY << "] [seed=1]\n"
+              << "  benchmark engine <folder> [queries=10000] [threads=0] [vocabulary=" << DEFAULT_VOCABULARY << "]\n"
+              << "  benchmark server [port=12345] [clients=8] [seconds=10] [vocabulary=" << DEFAULT_VOCABULARY << "]" << std::endl;
+    return 2;
+}
+
+}
+
+int main(int argc, char* argv[]) {
+    std::string mode = argc > 1 ? argv[1] : "";
+    std::string vocabulary = std::to_string(DEFAULT_VOCABULARY);
+    auto arg = [argc, argv](int index, const char* fallback) { return std::string(argc > index ? argv[index] : fallback); };
+
+    if (mode == "generate" && argc > 2) {
+        return generate(argv[2], std::stoul(arg(3, "10000")), std::stoul(arg(4, vocabulary.c_str())), std::stoull(arg(5, "1")));
+    }
+    if (mode == "engine" && argc > 2) {
+        return engine(argv[2], std::stoul(arg(3, "10000")), static_cast<unsigned>(std::stoul(arg(4, "0"))), std::stoul(arg(5, vocabulary.c_str())));
+    }
+    if (mode == "server") {
+        return server(std::stoi(arg(2, "12345")), static_cast<unsigned>(std::stoul(arg(3, "8"))), std::stod(arg(4, "10")), std::stoul(arg(5, vocabulary.c_str())));
+    }
+    return usage();
+}
@@ -0,0 +1,136 @@
+#include "compression.h" // Include the compression header
+
+#include <algorithm> // Include the algorithm library for std::min
+#include <cstdint> // Include the cstdint library for fixed width integers
+#include <cstring> // Include the cstring library for memcpy
+
+namespace compression {
+
+namespace {
+
+constexpr size_t MIN_MATCH = 4; // Shortest match, the length a token's low nibble counts from
+constexpr size_t MAX_DISTANCE = 65535; // Farthest match, so distances fit in two bytes
+constexpr uint32_t HASH_BITS = 13; // Slots of the match finder's hash table, as a power of two
+
+uint32_t read32(const char* data) { // Four bytes at any alignment
+    uint32_t value;
+    std::memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+uint32_t slotOf(uint32_t prefix) { // Hash table slot of a 4-byte prefix
+    return (prefix * 2654435761u) >> (32 - HASH_BITS);
+}
+
+void putLength(std::string& out, size_t length) { // Bytes continuing a nibble of 15
+    while (length >= 255) {
+        out += static_cast<char>(255);
+        length -= 255;
+    }
+    out += static_cast<char>(length);
+}
+
+void putSequence(std::string& out, const char* literals, size_t literalCount, size_t matchLength, size_t distance) { // One sequence; matchLength 0 for the last
+    size_t extra = matchLength > 0 ? matchLength - MIN_MATCH : 0;
+    out += static_cast<char>((std::min<size_t>(literalCount, 15) << 4) | std::min<size_t>(extra, 15));
+    if (literalCount >= 15) {
+        putLength(out, literalCount - 15);
+    }
+    out.append(literals, literalCount);
+    if (matchLength == 0) {
+        return;
+    }
+    out += static_cast<char>(distance & 0xff);
+    out += static_cast<char>(distance >> 8);
+    if (extra >= 15) {
+        putLength(out, extra - 15);
+    }
+}
+
+bool getLength(const unsigned char*& in, const unsigned char* end, size_t& length) { // Add the bytes continuing a nibble of 15
+    if (length != 15) {
+        return true;
+    }
+    unsigned char byte;
+    do {
+        if (in == end) {
+            return false;
+        }
+        byte = *in++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+}
+
+void compress(const char* data, size_t size, std::string& out) {
+    uint32_t table[1u << HASH_BITS] = {}; // Position plus one of the last prefix with each slot, 0 when there is none
+    size_t anchor = 0; // First byte not yet emitted
+    size_t i = 0; // Position being matched
+    while (i + MIN_MATCH <= size) {
+        uint32_t prefix = read32(data + i);
+        uint32_t slot = slotOf(prefix);
+        size_t candidate = table[slot];
+        table[slot] = static_cast<uint32_t>(i + 1);
+        if (candidate == 0 || i + 1 - candidate > MAX_DISTANCE || read32(data + candidate - 1) != prefix) { // No earlier copy of these 4 bytes in reach
+            ++i;
+            continue;
+        }
+        --candidate;
+        size_t length = MIN_MATCH;
+        while (i + length < size && data[candidate + length] == data[i + length]) {
+            ++length;
+        }
+        putSequence(out, data + anchor, i - anchor, length, i - candidate);
+        i += length;
+        anchor = i;
+    }
+    putSequence(out, data + anchor, size - anchor, 0, 0); // The rest as literals
+}
+
+bool decompress(const char* data, size_t size, size_t rawSize, std::string& out) {
+    out.resize(rawSize);
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(data);
+    const unsigned char* end = in + size;
+    size_t written = 0; // Bytes of out filled
+    while (in < end) {
+        unsigned token = *in++;
+        size_t literals = token >> 4;
+        if (!getLength(in, end, literals) || literals > static_cast<size_t>(end - in) || literals > rawSize - written) {
+            return false;
+        }
+        std::memcpy(&out[0] + written, in, literals);
+        in += literals;
+        written += literals;
+        if (in == end) { // The last sequence has no match
+            break;
+        }
+        if (end - in < 2) {
+            return false;
+        }
+        size_t distance = static_cast<size_t>(in[0]) | (static_cast<size_t>(in[1]) << 8);
+        in += 2;
+        size_t length = token & 15;
+        if (!getLength(in, end, length)) {
+            return false;
+        }
+        length += MIN_MATCH;
+        if (distance == 0 || distance > written || length > rawSize - written) {
+            return false;
+        }
+        char* target = &out[0] + written;
+        const char* source = target - distance;
+        if (distance >= length) {
+            std::memcpy(target, source, length);
+        } else { // The match overlaps the bytes it produces, as in a run
+            for (size_t k = 0; k < length; ++k) {
+                target[k] = source[k];
+            }
+        }
+        written += length;
+    }
+    return written == rawSize;
+}
+
+}
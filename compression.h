@@ -0,0 +1,24 @@
+#ifndef COMPRESSION_H // Include guard to prevent multiple inclusions of this header file
+#define COMPRESSION_H // Define the include guard
+
+#include <cstddef> // Include cstddef library for size_t
+#include <string> // Include string library
+
+// LZ77 block compression in the style of LZ4, for the document store.
+//
+// A compressed block is a run of sequences, each a token byte, the literal bytes and a match copied
+// from earlier output. The token's high nibble is the number of literals and its low nibble the match
+// length minus 4; a nibble of 15 continues in bytes of 255 ending with a smaller one. The match is
+// given by a 2-byte little-endian distance back into the output, so blocks are at most 64 KB apart
+// from where they refer. The last sequence has literals only. Matches are found through a hash table
+// of 4-byte prefixes with one candidate per slot: compression favors speed over ratio, and
+// decompression is a loop of copies. Decompression checks every length and distance, so a damaged
+// block fails instead of reading or writing out of bounds.
+namespace compression {
+
+void compress(const char* data, size_t size, std::string& out); // Append the compressed form of data to out
+bool decompress(const char* data, size_t size, size_t rawSize, std::string& out); // Replace out with the rawSize bytes data decompresses to, returns false if it is damaged
+
+}
+
+#endif // COMPRESSION_H // End of include guard
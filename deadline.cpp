@@ -0,0 +1,38 @@
+#include "deadline.h" // Include the deadline header
+
+#include <algorithm> // Include the algorithm library for std::min and std::max
+
+namespace {
+
+thread_local Deadline* active = nullptr; // Deadline of the request the thread works on
+
+}
+
+Deadline::Deadline(std::chrono::milliseconds budget) : start(Clock::now()), at(start + budget) {}
+
+void Deadline::limit(std::chrono::milliseconds budget) {
+    at = std::min(at, start + budget);
+}
+
+bool Deadline::expired() const {
+    return cancelled.load(std::memory_order_relaxed) || Clock::now() >= at;
+}
+
+std::chrono::milliseconds Deadline::remaining() const {
+    if (cancelled.load(std::memory_order_relaxed)) {
+        return std::chrono::milliseconds(0);
+    }
+    return std::max(std::chrono::duration_cast<std::chrono::milliseconds>(at - Clock::now()), std::chrono::milliseconds(0));
+}
+
+Deadline* Deadline::current() {
+    return active;
+}
+
+Deadline::Scope::Scope(Deadline* deadline) : previous(active) {
+    active = deadline;
+}
+
+Deadline::Scope::~Scope() {
+    active = previous;
+}
@@ -0,0 +1,74 @@
+#ifndef DEADLINE_H // Include guard to prevent multiple inclusions of this header file
+#define DEADLINE_H // Define the include guard
+
+#include <atomic> // Include the atomic library for flags read by other threads
+#include <chrono> // Include the chrono library for the time limit
+#include <cstdint> // Include the cstdint library for the step counter
+
+// Time limit of one request, and the way to cancel it.
+//
+// The server gives every request a Deadline when it arrives and opens a Deadline::Scope for it on the
+// thread that evaluates it; TaskPool::forEach opens the same scope on the threads running its shards.
+// Query evaluation looks at expired() through a DeadlineCheck every few hundred steps of any loop over
+// postings or the vocabulary, and once it is true stops walking them, returns the best matches found so
+// far and records it with cut(), so the server can tell the client the results are partial and the
+// result cache does not keep them. Cancelling a request, when its client goes away, expires it at once.
+// Outside a scope current() is nullptr and nothing expires.
+class Deadline {
+public:
+    using Clock = std::chrono::steady_clock; // Clock of the time limit
+
+    explicit Deadline(std::chrono::milliseconds budget); // Expire budget from now
+
+    void limit(std::chrono::milliseconds budget); // Expire budget after construction instead, if that is sooner
+    bool expired() const; // Whether the time is up or the request was cancelled
+    std::chrono::milliseconds remaining() const; // Time left, 0 once expired
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); } // Expire now; safe from any thread
+    void cut() { truncated.store(true, std::memory_order_relaxed); } // Record that evaluation stopped early because of it
+    bool wasCut() const { return truncated.load(std::memory_order_relaxed); } // Whether any evaluation stopped early
+
+    static Deadline* current(); // Deadline of the request the calling thread works on, or nullptr
+
+    // Makes a deadline the calling thread's current one for its lifetime; scopes nest
+    class Scope {
+    public:
+        explicit Scope(Deadline* deadline); // Install deadline, which may be nullptr
+        ~Scope(); // Restore the previous one
+        Scope(const Scope&) = delete; // Scopes are not copyable
+        Scope& operator=(const Scope&) = delete; // Scopes are not copyable
+
+    private:
+        Deadline* previous; // Current deadline before the scope
+    };
+
+private:
+    Clock::time_point start; // When the request arrived
+    Clock::time_point at; // When it expires
+    std::atomic<bool> cancelled{false}; // Whether it was cancelled
+    std::atomic<bool> truncated{false}; // Whether evaluation stopped early
+};
+
+// Cooperative check of the calling thread's Deadline inside a loop over postings or terms: past it, the
+// loop stops and what it found so far is used, recorded as cut short
+class DeadlineCheck {
+public:
+    static constexpr uint32_t STEPS = 256; // Steps between two looks at the clock
+
+    bool expired() { // Called once per step; reads the clock every STEPS steps
+        if (++steps < STEPS) {
+            return false;
+        }
+        steps = 0;
+        if (!deadline || !deadline->expired()) {
+            return false;
+        }
+        deadline->cut();
+        return true;
+    }
+
+private:
+    Deadline* deadline = Deadline::current(); // Deadline of the request, or nullptr
+    uint32_t steps = 0; // Steps since the last look
+};
+
+#endif // DEADLINE_H // End of include guard
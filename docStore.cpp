@@ -0,0 +1,284 @@
+#include "docStore.h" // Include the document store header
+#include "compression.h" // Include the block compression
+#include "durableFile.h" // Include the block checksums
+#include "manifest.h" // Include the path hash used as document id
+
+#include <algorithm> // Include the algorithm library for sorting and searching ids
+#include <cstring> // Include the cstring library for memcpy
+#include <iostream> // Include the iostream library for error messages
+
+namespace {
+
+void putVarint(std::string& bytes, uint64_t value) { // Append a variable-byte integer
+    while (value >= 0x80) {
+        bytes += static_cast<char>((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    bytes += static_cast<char>(value);
+}
+
+bool getVarint(std::string_view& bytes, uint64_t& value) { // Read a variable-byte integer off the front of bytes
+    value = 0;
+    for (uint32_t shift = 0; shift < 64 && !bytes.empty(); shift += 7) {
+        uint8_t byte = static_cast<uint8_t>(bytes.front());
+        bytes.remove_prefix(1);
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (byte < 0x80) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string encodeRecord(const Document& document) { // Record of a document's stored fields
+    std::string record;
+    for (const std::string* field : {&document.title, &document.date, &document.url, &document.text}) {
+        putVarint(record, field->size());
+        record += *field;
+    }
+    return record;
+}
+
+void pad(std::ostream& out, uint64_t& written) { // Pad the blocks to an 8-byte boundary
+    static const char zeros[8] = {};
+    size_t padding = (8 - written % 8) % 8;
+    out.write(zeros, static_cast<std::streamsize>(padding));
+    written += padding;
+}
+
+}
+
+DocStore::DocStore() : mappedEntries(nullptr), mappedKeys(nullptr), mappedBlocks(nullptr), mappedBytes(0), mapped(0) {}
+
+uint64_t DocStore::documentId(std::string_view path) {
+    return Manifest::hash(path.data(), path.size()); // Also decides the shard of the file, see Shard::owns
+}
+
+std::shared_ptr<const std::string> DocStore::pack(const Document& document) {
+    std::string record = encodeRecord(document);
+    uint32_t rawSize = static_cast<uint32_t>(record.size());
+    std::string packed(reinterpret_cast<const char*>(&rawSize), sizeof(rawSize));
+    compression::compress(record.data(), record.size(), packed);
+    packed.shrink_to_fit(); // Kept until the next save
+    return std::make_shared<const std::string>(std::move(packed));
+}
+
+bool DocStore::unpack(std::string_view packed, Document& document) {
+    uint32_t rawSize;
+    if (packed.size() < sizeof(rawSize)) {
+        return false;
+    }
+    std::memcpy(&rawSize, packed.data(), sizeof(rawSize));
+    thread_local std::string record; // Reused by every document read on this thread
+    return compression::decompress(packed.data() + sizeof(rawSize), packed.size() - sizeof(rawSize), rawSize, record) && decodeRecord(record, document);
+}
+
+bool DocStore::decodeRecord(std::string_view record, Document& document) {
+    for (std::string* field : {&document.title, &document.date, &document.url, &document.text}) {
+        uint64_t length;
+        if (!getVarint(record, length) || length > record.size()) {
+            return false;
+        }
+        field->assign(record.data(), static_cast<size_t>(length));
+        record.remove_prefix(static_cast<size_t>(length));
+    }
+    return record.empty();
+}
+
+void DocStore::attach(const char* base, const indexfile::Header& header) {
+    clear();
+    mappedEntries = reinterpret_cast<const indexfile::DocEntry*>(base + header.docTableOffset);
+    mappedKeys = reinterpret_cast<const indexfile::DocKey*>(base + header.docKeysOffset);
+    mappedBlocks = base + header.docBlocksOffset;
+    mappedBytes = header.docBytes;
+    mapped = header.fileCount;
+}
+
+void DocStore::clear() {
+    mappedEntries = nullptr;
+    mappedKeys = nullptr;
+    mappedBlocks = nullptr;
+    mappedBytes = 0;
+    mapped = 0;
+    keys.clear();
+    records.clear();
+}
+
+void DocStore::addFile(uint32_t id, std::string_view path) {
+    if (id < mapped) { // Mapped files already have their id
+        return;
+    }
+    if (id - mapped >= keys.size()) { // Save files may list ids in any order
+        keys.resize(id - mapped + 1, 0);
+        records.resize(id - mapped + 1);
+    }
+    keys[id - mapped] = documentId(path);
+}
+
+void DocStore::setRecord(uint32_t id, std::shared_ptr<const std::string> packed) {
+    if (id < mapped || id - mapped >= records.size()) { // Only files added with addFile
+        return;
+    }
+    records[id - mapped] = std::move(packed);
+}
+
+bool DocStore::get(uint32_t id, Document& document) const {
+    if (id >= mapped) {
+        return id - mapped < records.size() && records[id - mapped] && unpack(*records[id - mapped], document);
+    }
+    const indexfile::DocEntry& entry = mappedEntries[id];
+    if (entry.blockOffset == indexfile::NO_DOCUMENT) {
+        return false;
+    }
+    thread_local std::string raw; // Decompressed block, reused by every document read on this thread
+    if (!readBlock(entry.blockOffset, raw) || static_cast<uint64_t>(entry.recordOffset) + entry.recordLength > raw.size()) {
+        std::cerr << "Damaged document block for file " << id << std::endl; // Print error message
+        return false;
+    }
+    return decodeRecord(std::string_view(raw).substr(entry.recordOffset, entry.recordLength), document);
+}
+
+bool DocStore::readBlock(uint64_t offset, std::string& raw) const {
+    if (offset > mappedBytes || mappedBytes - offset < sizeof(indexfile::DocBlock)) {
+        return false;
+    }
+    const indexfile::DocBlock& block = *reinterpret_cast<const indexfile::DocBlock*>(mappedBlocks + offset);
+    const char* bytes = mappedBlocks + offset + sizeof(block);
+    if (block.compressedSize > mappedBytes - offset - sizeof(block) || durable::checksum(bytes, block.compressedSize) != block.checksum) {
+        return false;
+    }
+    return compression::decompress(bytes, block.compressedSize, block.rawSize, raw);
+}
+
+void DocStore::find(uint64_t key, std::vector<uint32_t>& ids) const {
+    if (mapped > 0) {
+        const indexfile::DocKey* end = mappedKeys + mapped;
+        const indexfile::DocKey* it = std::lower_bound(mappedKeys, end, key, [](const indexfile::DocKey& entry, uint64_t id) { return entry.id < id; });
+        for (; it != end && it->id == key; ++it) {
+            ids.push_back(it->file);
+        }
+    }
+    for (size_t i = 0; i < keys.size(); ++i) { // Added files are few: the index is compacted before they grow large
+        if (keys[i] == key) {
+            ids.push_back(static_cast<uint32_t>(mapped + i));
+        }
+    }
+}
+
+size_t DocStore::memoryUsage() const {
+    size_t bytes = keys.capacity() * sizeof(uint64_t) + records.capacity() * sizeof(std::shared_ptr<const std::string>);
+    for (const auto& record : records) {
+        bytes += record ? record->capacity() : 0;
+    }
+    return bytes;
+}
+
+bool DocStore::write(std::ostream& out, const std::vector<uint32_t>& kept, const std::vector<uint64_t>& ids, indexfile::Header& header) const {
+    std::vector<indexfile::DocEntry> entries(kept.size(), {indexfile::NO_DOCUMENT, 0, 0}); // Filled in as blocks are written
+    header.docTableOffset = static_cast<uint64_t>(out.tellp());
+    out.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(sizeof(indexfile::DocEntry) * entries.size())); // Reserve the table
+
+    std::vector<indexfile::DocKey> sorted; // Document ids in id order
+    for (uint32_t file = 0; file < ids.size(); ++file) {
+        sorted.push_back({ids[file], file, 0});
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const indexfile::DocKey& a, const indexfile::DocKey& b) { return a.id < b.id || (a.id == b.id && a.file < b.file); });
+    header.docKeysOffset = static_cast<uint64_t>(out.tellp());
+    out.write(reinterpret_cast<const char*>(sorted.data()), static_cast<std::streamsize>(sizeof(indexfile::DocKey) * sorted.size()));
+
+    header.docBlocksOffset = static_cast<uint64_t>(out.tellp());
+    uint64_t written = 0; // Bytes of blocks written
+    std::string raw; // Records of the block being filled
+    std::string compressed; // Compressed form of a block
+    uint32_t recordCount = 0; // Records in raw
+    size_t firstEntry = 0; // Saved id of the first record in raw
+    auto flush = [&]() { // Compress and write the block being filled
+        if (recordCount == 0) {
+            return;
+        }
+        compressed.clear();
+        compression::compress(raw.data(), raw.size(), compressed);
+        indexfile::DocBlock block = {static_cast<uint32_t>(compressed.size()), static_cast<uint32_t>(raw.size()), recordCount, 0, durable::checksum(compressed.data(), compressed.size())};
+        for (size_t entry = firstEntry; entry < entries.size(); ++entry) { // Records of the block that have one
+            if (entries[entry].blockOffset == UINT64_MAX - 1) {
+                entries[entry].blockOffset = written;
+            }
+        }
+        out.write(reinterpret_cast<const char*>(&block), sizeof(block));
+        out.write(compressed.data(), static_cast<std::streamsize>(compressed.size()));
+        written += sizeof(block) + compressed.size();
+        pad(out, written);
+        raw.clear();
+        recordCount = 0;
+    };
+
+    std::string mappedRaw; // Last mapped block decompressed, shared by its records
+    uint64_t mappedRawOffset = indexfile::NO_DOCUMENT; // Offset of that block
+    Document document; // Fields of an added file's record
+    for (size_t saved = 0; saved < kept.size(); ++saved) {
+        uint32_t id = kept[saved];
+        std::string_view record; // Uncompressed record of the file
+        std::string added; // Storage of an added file's record
+        if (id < mapped) {
+            const indexfile::DocEntry& entry = mappedEntries[id];
+            if (entry.blockOffset == indexfile::NO_DOCUMENT) {
+                continue;
+            }
+            if (entry.blockOffset > mappedBytes || mappedBytes - entry.blockOffset < sizeof(indexfile::DocBlock)) {
+                std::cerr << "Dropping the damaged stored document of file " << id << std::endl; // Print warning
+                continue;
+            }
+            const indexfile::DocBlock& block = *reinterpret_cast<const indexfile::DocBlock*>(mappedBlocks + entry.blockOffset);
+            uint32_t count = block.recordCount;
+            bool whole = entry.recordOffset == 0 && count > 0 && saved + count <= kept.size() && kept[saved + count - 1] == id + count - 1; // The block's records are ids id to id + count - 1 when all of them are in it
+            for (uint32_t k = 1; whole && k < count; ++k) {
+                whole = mappedEntries[id + k].blockOffset == entry.blockOffset;
+            }
+            if (whole && block.compressedSize <= mappedBytes - entry.blockOffset - sizeof(block)) { // Every record is kept, copy the block as it is
+                flush();
+                for (uint32_t k = 0; k < count; ++k) {
+                    entries[saved + k] = {written, mappedEntries[id + k].recordOffset, mappedEntries[id + k].recordLength};
+                }
+                out.write(mappedBlocks + entry.blockOffset, static_cast<std::streamsize>(sizeof(block) + block.compressedSize));
+                written += sizeof(block) + block.compressedSize;
+                pad(out, written);
+                saved += count - 1;
+                continue;
+            }
+            if (mappedRawOffset != entry.blockOffset) {
+                mappedRawOffset = entry.blockOffset;
+                if (!readBlock(entry.blockOffset, mappedRaw)) {
+                    mappedRaw.clear();
+                }
+            }
+            if (static_cast<uint64_t>(entry.recordOffset) + entry.recordLength > mappedRaw.size()) {
+                std::cerr << "Dropping the damaged stored document of file " << id << std::endl; // Print warning
+                continue;
+            }
+            record = std::string_view(mappedRaw).substr(entry.recordOffset, entry.recordLength);
+        } else {
+            if (id - mapped >= records.size() || !records[id - mapped] || !unpack(*records[id - mapped], document)) { // Files without a document, like those loaded from save files
+                continue;
+            }
+            added = encodeRecord(document);
+            record = added;
+        }
+        if (recordCount == 0) {
+            firstEntry = saved;
+        }
+        entries[saved] = {UINT64_MAX - 1, static_cast<uint32_t>(raw.size()), static_cast<uint32_t>(record.size())}; // Offset set when the block is written
+        raw += record;
+        ++recordCount;
+        if (raw.size() >= BLOCK_SIZE) {
+            flush();
+        }
+    }
+    flush();
+    header.docBytes = written;
+
+    std::streampos end = out.tellp();
+    out.seekp(static_cast<std::streamoff>(header.docTableOffset));
+    out.write(reinterpret_cast<const char*>(entries.data()), static_cast<std::streamsize>(sizeof(indexfile::DocEntry) * entries.size())); // The completed table
+    out.seekp(end);
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,71 @@
+#ifndef DOCSTORE_H // Include guard to prevent multiple inclusions of this header file
+#define DOCSTORE_H // Define the include guard
+
+#include "indexFile.h" // Include the layout of the stored documents
+#include <cstddef> // Include cstddef library for size_t
+#include <cstdint> // Include cstdint library for fixed width integers
+#include <memory> // Include memory library for records shared between snapshots
+#include <ostream> // Include ostream library for saving
+#include <string> // Include string library
+#include <string_view> // Include string_view library
+#include <vector> // Include vector library
+
+// Fields of an indexed file kept for showing it without reading the file again
+struct Document {
+    uint64_t id = 0; // Document id, see DocStore::documentId
+    std::string path; // File the document was read from
+    std::string title; // Value of the "title" key
+    std::string date; // Value of "thread.published", or of "published" when there is none
+    std::string url; // Value of the "url" key
+    std::string text; // Value of the "text" key
+};
+
+// Stored documents of the files of a WordMap, by file id.
+//
+// A document is stored as a record of its title, date, URL and text, each a variable-byte length and
+// its bytes. The binary index keeps records back to back in blocks of about BLOCK_SIZE bytes, each
+// compressed on its own (see compression.h), and a table giving each file's block and the record's
+// place in it, so fetching a document decompresses one block. Files added after the index was mapped
+// keep their record compressed on its own in memory, shared between snapshots, until the next save
+// packs them into blocks. Saving copies a mapped block as it is when all of its files are kept.
+//
+// Documents are also found by id: the hash of their path, which is the same in every snapshot and
+// shard and across rebuilds, unlike file ids.
+class DocStore {
+public:
+    static constexpr size_t BLOCK_SIZE = 32 * 1024; // Records gathered into one block before it is compressed
+
+    DocStore(); // Constructor
+
+    static uint64_t documentId(std::string_view path); // Document id of a file path
+    static std::shared_ptr<const std::string> pack(const Document& document); // Record of a document, compressed on its own: 4-byte raw size, then the compressed record
+    static bool unpack(std::string_view packed, Document& document); // Fields of a packed record, returns false if it is damaged
+
+    void attach(const char* base, const indexfile::Header& header); // Serve the documents of a mapped index, forgetting every added one
+    void clear(); // Forget every document and any mapped index
+
+    void addFile(uint32_t id, std::string_view path); // Record the document id of a file added after the mapped ones
+    void setRecord(uint32_t id, std::shared_ptr<const std::string> packed); // Stored document of a file added after the mapped ones, as given by pack
+    bool get(uint32_t id, Document& document) const; // Stored fields of a file, leaving its id and path; false if it has none
+    void find(uint64_t key, std::vector<uint32_t>& ids) const; // Append the file ids with a document id, mapped ones first, then in order of addition
+    size_t memoryUsage() const; // Heap bytes held by added records and ids
+
+    // Write the document sections of a saved index for kept, the old file ids in saved order, with keys their
+    // document ids; fills in the document offsets of header. The stream must be at an 8-byte boundary.
+    bool write(std::ostream& out, const std::vector<uint32_t>& kept, const std::vector<uint64_t>& keys, indexfile::Header& header) const;
+
+private:
+    static bool decodeRecord(std::string_view record, Document& document); // Fields of an uncompressed record
+    bool readBlock(uint64_t offset, std::string& raw) const; // Decompress a mapped block into raw, returns false if it is damaged
+
+    const indexfile::DocEntry* mappedEntries; // Document table of the mapped index
+    const indexfile::DocKey* mappedKeys; // Sorted document ids of the mapped index
+    const char* mappedBlocks; // Document blocks of the mapped index
+    uint64_t mappedBytes; // Size of the mapped blocks
+    uint32_t mapped; // Number of files in the mapped index
+
+    std::vector<uint64_t> keys; // Document id of each added file, indexed by id minus mapped
+    std::vector<std::shared_ptr<const std::string>> records; // Packed record of each added file, or nullptr
+};
+
+#endif // DOCSTORE_H // End of include guard
@@ -0,0 +1,77 @@
+#include "durableFile.h" // Include the durable file header
+
+#include <cerrno> // Include the cerrno library for EINTR
+#include <cstdio> // Include the cstdio library for rename
+#include <cstring> // Include the cstring library for memcpy
+#include <fcntl.h> // Include open
+#include <iostream> // Include the iostream library for error messages
+#include <unistd.h> // Include fsync and close
+
+namespace {
+
+const uint64_t FNV_OFFSET = 14695981039346656037ULL; // FNV-1a offset basis
+const uint64_t FNV_PRIME = 1099511628211ULL; // FNV-1a prime
+
+// Flush the file or folder at path
+bool syncPath(const std::string& path, int flags) {
+    int fd = ::open(path.c_str(), flags | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool synced = durable::syncFile(fd);
+    ::close(fd);
+    return synced;
+}
+
+}
+
+namespace durable {
+
+bool syncFile(int fd) {
+    while (::fsync(fd) != 0) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool replaceFile(const std::string& tempPath, const std::string& path) {
+    if (!syncPath(tempPath, O_RDONLY)) { // The contents must be on disk before the name points at them
+        std::cerr << "Failed to flush " << tempPath << std::endl; // Print error message
+        return false;
+    }
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0) { // Atomic; a mapping of the old file stays valid
+        std::cerr << "Failed to rename " << tempPath << " to " << path << std::endl; // Print error message
+        return false;
+    }
+    size_t slash = path.find_last_of('/');
+    std::string folder = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    if (!syncPath(folder, O_RDONLY | O_DIRECTORY)) { // Make the rename itself survive a crash
+        std::cerr << "Failed to flush folder " << folder << std::endl; // Print error message
+        return false;
+    }
+    return true;
+}
+
+uint64_t checksum(const char* data, size_t size) {
+    uint64_t lanes[4] = {FNV_OFFSET, FNV_OFFSET ^ 1, FNV_OFFSET ^ 2, FNV_OFFSET ^ 3}; // Independent lanes keep the multiplier busy
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; ++lane) {
+            uint64_t word;
+            std::memcpy(&word, data + i + 8 * lane, sizeof(word));
+            lanes[lane] = (lanes[lane] ^ word) * FNV_PRIME;
+        }
+    }
+    uint64_t hash = FNV_OFFSET ^ size; // Length first, so trailing zero bytes are not lost
+    for (uint64_t lane : lanes) {
+        hash = (hash ^ lane) * FNV_PRIME;
+    }
+    for (; i < size; ++i) { // Remaining bytes one at a time
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * FNV_PRIME;
+    }
+    return hash;
+}
+
+}
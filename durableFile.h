@@ -0,0 +1,22 @@
+#ifndef DURABLEFILE_H // Include guard to prevent multiple inclusions of this header file
+#define DURABLEFILE_H // Define the include guard
+
+#include <cstddef> // Include the cstddef library for size_t
+#include <cstdint> // Include the cstdint library for fixed width integers
+#include <string> // Include the string library
+
+// Crash-safe file replacement. Saved files are written next to their target under a temporary name,
+// flushed to disk, renamed over the target and the folder flushed too, so after a crash the target
+// holds either its old contents or its new ones, never a mix of both or a prefix of the new ones.
+namespace durable {
+
+bool syncFile(int fd); // Flush a file's data to disk, retrying on EINTR
+bool replaceFile(const std::string& tempPath, const std::string& path); // Flush tempPath, rename it to path and flush the folder; prints an error and returns false on failure
+
+// Checksum of saved data, stored with it and compared when it is read back to catch torn or damaged files.
+// FNV-1a over 8-byte words in four interleaved lanes, so long files are checked at memory speed.
+uint64_t checksum(const char* data, size_t size);
+
+}
+
+#endif // DURABLEFILE_H // End of include guard
@@ -0,0 +1,148 @@
+#include "folderWatcher.h" // Include the folder watcher header
+
+#include <algorithm> // Include the algorithm library for std::min and std::max
+#include <chrono> // Include the chrono library for batching events
+#include <cerrno> // Include errno for interrupted calls
+#include <cstring> // Include cstring for strerror
+#include <filesystem> // Include the filesystem library for walking folders
+#include <iostream> // Include iostream for error messages
+#include <set> // Include set for collecting unique paths
+#include <poll.h> // Include poll for waiting on inotify and stop
+#include <sys/eventfd.h> // Include eventfd for stopping the thread
+#include <sys/inotify.h> // Include inotify
+#include <unistd.h> // Include POSIX operating system API
+
+namespace fs = std::filesystem; // Create an alias for the std::filesystem namespace
+
+namespace {
+
+const uint32_t WATCH_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE; // Events that change the indexed files
+const int QUIET_MILLISECONDS = 200; // Report a batch once no event arrived for this long
+const int MAX_BATCH_MILLISECONDS = 2000; // Report a batch at least this often during a steady stream of events
+
+}
+
+FolderWatcher::FolderWatcher() : inotifyFd(-1), stopFd(-1) {} // Constructor
+
+FolderWatcher::~FolderWatcher() { stop(); } // Destructor
+
+bool FolderWatcher::start(const std::string& folder, Callback onChange) {
+    stop(); // Restart cleanly if already watching
+    root = folder;
+    while (root.size() > 1 && root.back() == '/') { // Paths are built as folder + "/" + name
+        root.pop_back();
+    }
+    callback = std::move(onChange);
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (inotifyFd < 0 || stopFd < 0) {
+        std::cerr << "Failed to start watching " << root << ": " << std::strerror(errno) << std::endl; // Print error message
+        stop();
+        return false;
+    }
+    watchTree(root);
+    thread = std::thread(&FolderWatcher::run, this);
+    return true;
+}
+
+void FolderWatcher::stop() {
+    if (thread.joinable()) {
+        uint64_t one = 1;
+        if (write(stopFd, &one, sizeof(one)) < 0) { // Wake the thread
+            std::cerr << "Failed to stop folder watcher" << std::endl; // Print error message
+        }
+        thread.join();
+    }
+    for (int* fd : {&inotifyFd, &stopFd}) {
+        if (*fd >= 0) {
+            close(*fd); // Closing inotify removes every watch
+            *fd = -1;
+        }
+    }
+    directories.clear();
+}
+
+void FolderWatcher::watchTree(const std::string& directory) {
+    int wd = inotify_add_watch(inotifyFd, directory.c_str(), WATCH_EVENTS | IN_ONLYDIR);
+    if (wd < 0) {
+        std::cerr << "Failed to watch " << directory << ": " << std::strerror(errno) << std::endl; // Print error message
+        return;
+    }
+    directories[wd] = directory;
+    std::error_code error; // Folders may disappear while they are walked
+    for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+        if (it->is_directory(error) && !it->is_symlink(error)) {
+            watchTree(it->path().string());
+        }
+    }
+}
+
+void FolderWatcher::run() {
+    using Clock = std::chrono::steady_clock;
+    std::set<std::string> changed; // Paths of the current batch
+    Clock::time_point batchStart; // When the first event of the batch arrived
+    alignas(inotify_event) char buffer[65536]; // Events read at once
+
+    while (true) {
+        int timeout = -1; // Wait for the first event of a batch indefinitely
+        if (!changed.empty()) {
+            int elapsed = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - batchStart).count());
+            timeout = std::max(0, std::min(QUIET_MILLISECONDS, MAX_BATCH_MILLISECONDS - elapsed));
+        }
+        pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {stopFd, POLLIN, 0}};
+        int ready = poll(fds, 2, timeout);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready < 0 || (fds[1].revents & POLLIN)) { // Stopped, or poll failed
+            break;
+        }
+        if (ready == 0) { // Quiet, or the batch is old enough: report it
+            callback(std::vector<std::string>(changed.begin(), changed.end()));
+            changed.clear();
+            continue;
+        }
+
+        ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            continue;
+        }
+        if (changed.empty()) {
+            batchStart = Clock::now();
+        }
+        for (char* p = buffer; p < buffer + length; ) { // For each event
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+            p += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) { // Events were lost, rescan everything
+                changed.insert(root);
+                continue;
+            }
+            if (event->mask & IN_IGNORED) { // The folder is gone
+                directories.erase(event->wd);
+                continue;
+            }
+            auto directory = directories.find(event->wd);
+            if (directory == directories.end() || event->len == 0) {
+                continue;
+            }
+            std::string path = directory->second + "/" + event->name;
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) { // Watch new folders; files created before the watch are found by rescanning them
+                    watchTree(path);
+                } else if (event->mask & IN_MOVED_FROM) { // Watches of a moved folder would report its old paths
+                    for (auto it = directories.begin(); it != directories.end(); ) {
+                        if (it->second == path || it->second.compare(0, path.size() + 1, path + "/") == 0) {
+                            inotify_rm_watch(inotifyFd, it->first);
+                            it = directories.erase(it);
+                        } else {
+                            ++it;
+                        }
+                    }
+                }
+                changed.insert(path);
+            } else if (!(event->mask & IN_CREATE)) { // New files are reported once written and closed
+                changed.insert(path);
+            }
+        }
+    }
+}
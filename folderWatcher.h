@@ -0,0 +1,39 @@
+#ifndef FOLDERWATCHER_H // Include guard to prevent multiple inclusions of this header file
+#define FOLDERWATCHER_H // Define the include guard
+
+#include <functional> // Include the functional library for the change callback
+#include <string> // Include the string library
+#include <thread> // Include the thread library
+#include <unordered_map> // Include the unordered_map library
+#include <vector> // Include the vector library
+
+// Watches a folder and its subfolders with inotify and reports changed paths from a background thread.
+//
+// Events are collected until the folder has been quiet for a short while, so a burst of writes
+// is reported as one batch. Reported paths are files that were written, moved or deleted,
+// and folders that were created, moved in or need a full rescan because events were lost.
+class FolderWatcher {
+public:
+    using Callback = std::function<void(const std::vector<std::string>& paths)>; // Receives each batch of changed paths
+
+    FolderWatcher(); // Constructor
+    ~FolderWatcher(); // Destructor, stops watching
+    FolderWatcher(const FolderWatcher&) = delete; // Watchers are not copyable
+    FolderWatcher& operator=(const FolderWatcher&) = delete; // Watchers are not copyable
+
+    bool start(const std::string& folder, Callback callback); // Start watching, returns false if inotify is unavailable
+    void stop(); // Stop watching and wait for the background thread
+
+private:
+    void run(); // Body of the background thread
+    void watchTree(const std::string& directory); // Watch a folder and every folder below it
+
+    std::string root; // Watched folder
+    Callback callback; // Receives changed paths
+    int inotifyFd; // inotify instance
+    int stopFd; // eventfd signalled by stop
+    std::unordered_map<int, std::string> directories; // Path of each watch descriptor
+    std::thread thread; // Background thread
+};
+
+#endif // FOLDERWATCHER_H // End of include guard
@@ -0,0 +1,85 @@
+#include "impact.h" // Include the impact header
+
+#include <cmath> // Include the cmath library for std::ceil
+#include <cstdlib> // Include the cstdlib library for std::getenv and std::strtod
+#include <iostream> // Include the iostream library for warnings
+#include <sstream> // Include the sstream library for reading the weights
+#include <string> // Include the string library
+
+namespace impact {
+
+const Weights& configuredWeights() {
+    static const Weights weights = [] {
+        Weights configured = {2.0f, 1.0f, 1.5f, 0.5f}; // Title, text, entities, other
+        const char* env = std::getenv("SEARCH_ZONE_WEIGHTS");
+        if (!env) {
+            return configured;
+        }
+        static const char* const NAMES[indexfile::ZONE_COUNT] = {"title", "text", "entities", "other"};
+        std::istringstream list(env); // Comma-separated zone=weight entries
+        std::string entry;
+        while (std::getline(list, entry, ',')) {
+            size_t equals = entry.find('=');
+            std::string name = entry.substr(0, equals);
+            char* end = nullptr;
+            double weight = equals == std::string::npos ? -1 : std::strtod(entry.c_str() + equals + 1, &end);
+            uint32_t zone = 0;
+            while (zone < indexfile::ZONE_COUNT && name != NAMES[zone]) {
+                ++zone;
+            }
+            if (zone == indexfile::ZONE_COUNT || !(weight >= 0 && weight <= 1000) || *end != '\0') {
+                std::cerr << "Ignoring zone weight " << entry << " in SEARCH_ZONE_WEIGHTS" << std::endl; // Print warning
+                continue;
+            }
+            configured[zone] = static_cast<float>(weight);
+        }
+        return configured;
+    }();
+    return weights;
+}
+
+uint8_t encodeLength(uint32_t length) {
+    if (length < 16) {
+        return static_cast<uint8_t>(length);
+    }
+    uint32_t shift = 0; // Bits dropped, so that 8 <= length >> shift < 16
+    while ((length >> shift) >= 16) {
+        ++shift;
+    }
+    return static_cast<uint8_t>(16 + (shift - 1) * 8 + ((length >> shift) - 8));
+}
+
+uint32_t decodeLength(uint8_t norm) {
+    if (norm < 16) {
+        return norm;
+    }
+    uint32_t shift = (norm - 16u) / 8 + 1;
+    uint64_t length = static_cast<uint64_t>((norm - 16u) % 8 + 8) << shift;
+    return length > UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(length); // Bytes above every encoded length
+}
+
+Norms encode(const Lengths& lengths) {
+    Norms norms;
+    for (uint32_t zone = 0; zone < indexfile::ZONE_COUNT; ++zone) {
+        norms[zone] = encodeLength(lengths[zone]);
+    }
+    return norms;
+}
+
+uint32_t compute(const Counts& counts, const Norms& norms, const std::array<double, indexfile::ZONE_COUNT>& averages, const Weights& weights) {
+    double tf = 0; // Weighted, normalized count over every zone
+    for (uint32_t zone = 0; zone < indexfile::ZONE_COUNT; ++zone) {
+        if (counts[zone] == 0) {
+            continue;
+        }
+        double normalization = averages[zone] > 0 ? 1 - B + B * decodeLength(norms[zone]) / averages[zone] : 1.0;
+        tf += weights[zone] * counts[zone] / normalization;
+    }
+    if (tf <= 0) {
+        return 0;
+    }
+    double value = std::ceil(MAX * tf / (K1 + tf)); // Round up, so any occurrence with a weight scores
+    return value > MAX ? MAX : static_cast<uint32_t>(value);
+}
+
+}
@@ -0,0 +1,52 @@
+#ifndef IMPACT_H // Include guard to prevent multiple inclusions of this header file
+#define IMPACT_H // Define the include guard
+
+#include "indexFile.h" // Include the zones of a document
+#include <array> // Include array library
+#include <cstdint> // Include cstdint library for fixed width integers
+
+// Field-weighted BM25 (BM25F) precomputed into one small integer per posting.
+//
+// A word is counted separately in each zone of a file: its title, its text, the names of its entities
+// and everything else. When a file is indexed, the counts are normalized by the length of their zone
+// against the average over the index, weighted by zone, summed and saturated:
+//
+//   tf = sum over zones z of weight[z] * count[z] / (1 - B + B * length[z] / average[z])
+//   impact = ceil(MAX * tf / (K1 + tf))
+//
+// The impact is stored as the posting's frequency, so a search scores a posting by multiplying its
+// impact by the word's idf, boost and (K1 + 1) / MAX, which are the same for the whole posting list.
+// Impacts keep the averages of the time their file was indexed; the index is compacted before they
+// drift far. Zone lengths are stored with each file in one byte per zone, like Lucene's norms.
+namespace impact {
+
+constexpr double K1 = 1.2; // Frequency saturation
+constexpr double B = 0.75; // Strength of length normalization
+constexpr uint32_t MAX = 127; // Largest impact, so every impact is one byte of an encoded posting
+
+using Counts = std::array<uint8_t, indexfile::ZONE_COUNT>; // Occurrences of a word in each zone of a file, saturating at 255
+using Lengths = std::array<uint32_t, indexfile::ZONE_COUNT>; // Number of words in each zone of a file
+using Norms = std::array<uint8_t, indexfile::ZONE_COUNT>; // Lengths as stored, see encodeLength
+using Weights = std::array<float, indexfile::ZONE_COUNT>; // Weight of each zone
+
+// Weights of this process: title 2, text 1, entities 1.5 and other 0.5, each replaced by an entry of
+// SEARCH_ZONE_WEIGHTS such as "title=3,other=0". An index keeps the weights it was built with.
+const Weights& configuredWeights();
+
+inline void add(Counts& counts, indexfile::Zone zone) { // Count one occurrence in a zone
+    if (counts[zone] < UINT8_MAX) {
+        ++counts[zone];
+    }
+}
+
+uint8_t encodeLength(uint32_t length); // Length in one byte: exact up to 15, then rounded down to 4 significant bits
+uint32_t decodeLength(uint8_t norm); // Length a byte stands for
+Norms encode(const Lengths& lengths); // Encode the length of every zone
+
+// Impact of a word in a file from its counts, the file's norms and the average length of each zone
+// (0 when unknown, which skips normalization); 0 only when no zone with a weight has the word
+uint32_t compute(const Counts& counts, const Norms& norms, const std::array<double, indexfile::ZONE_COUNT>& averages, const Weights& weights);
+
+}
+
+#endif // IMPACT_H // End of include guard
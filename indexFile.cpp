@@ -0,0 +1,45 @@
+#include "indexFile.h" // Include the index file header
+
+#include <iostream> // Include iostream library for error messages
+#include <fcntl.h> // Include fcntl library for open
+#include <sys/mman.h> // Include mman library for mmap
+#include <sys/stat.h> // Include stat library for fstat
+#include <unistd.h> // Include POSIX operating system API for close
+
+MappedFile::MappedFile() : base(nullptr), length(0) {} // Constructor
+
+MappedFile::~MappedFile() { close(); } // Destructor
+
+bool MappedFile::open(const std::string& path) {
+    close(); // Drop any previous mapping
+
+    int fd = ::open(path.c_str(), O_RDONLY); // Open the file read-only
+    if (fd < 0) { // If the file cannot be opened
+        return false;
+    }
+
+    struct stat st; // File status
+    if (fstat(fd, &st) < 0 || st.st_size == 0) { // If the size cannot be read or the file is empty
+        ::close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0); // Map the whole file
+    ::close(fd); // The mapping keeps its own reference to the file
+    if (mapping == MAP_FAILED) { // If the mapping failed
+        std::cerr << "Failed to map file: " << path << std::endl; // Print error message
+        return false;
+    }
+
+    base = static_cast<const char*>(mapping); // Remember the mapping
+    length = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (base != nullptr) { // If a file is mapped
+        munmap(const_cast<char*>(base), length); // Unmap it
+        base = nullptr;
+        length = 0;
+    }
+}
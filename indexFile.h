@@ -0,0 +1,187 @@
+#ifndef INDEXFILE_H // Include guard to prevent multiple inclusions of this header file
+#define INDEXFILE_H // Define the include guard
+
+#include <cstddef> // Include cstddef library for size_t
+#include <cstdint> // Include cstdint library for fixed width integers
+#include <string> // Include string library
+#include "postingList.h" // Include PostingSkip, stored as-is in the file
+
+// On-disk layout of the binary index written by WordMap::saveBinary.
+// All integers are little-endian and every section starts on an 8-byte boundary,
+// so a mapped file can be read in place through these structs.
+//
+//   Header
+//   FileEntry[fileCount]            file id -> path
+//   char[]                          path strings
+//   TermEntry[termCount]            term id -> term, sorted by term, shared by every field
+//   char[]                          term strings
+//   TermSlot[slotCount]             open-addressing hash table from term to term id, see TermDictionary
+//   for each field (org, name, word):
+//     PostingEntry[postingCount]    one per term found in the field
+//     PostingSkip[skipCount]        per-term skip tables
+//     uint8_t[postingBytes]         per-term compressed posting lists, see PostingView
+//     PostingSkip[positionSkipCount] per-term skip tables of the position lists
+//     uint8_t[positionBytes]        per-term compressed position lists, see PositionView
+//     Roaring sets                  file ids of the terms found in many files, see Roaring
+//     PresenceEntry[presenceCount]  posting index -> its file id set, sorted by posting index
+//   uint32_t[fileCount]             file id -> publish date as yyyymmdd, see Attributes
+//   uint32_t[fileCount]             file id -> site id
+//   SiteEntry[siteCount]            site id -> site name, sorted by name
+//   char[]                          site names
+//   for each entity field (org, name):
+//     uint32_t[fileCount + 1]       file id -> start of its term ids
+//     uint32_t[entityCount]         distinct term ids of each file's entities, ascending
+//   DocEntry[fileCount]             file id -> stored document, see DocStore
+//   DocKey[fileCount]               document ids sorted, for fetching a document by id
+//   DocBlock headers and bytes      compressed blocks of document records, last in the file
+//
+// The header's checksum covers everything up to the document blocks. Each block carries its own
+// checksum, checked when it is read, so mapping an index does not read every stored document.
+namespace indexfile {
+
+constexpr char MAGIC[8] = {'S', 'E', 'I', 'N', 'D', 'E', 'X', '\0'}; // Identifies an index file
+constexpr uint32_t VERSION = 10; // Bumped whenever the layout changes
+constexpr uint32_t NO_TERM = UINT32_MAX; // Term id of an empty hash slot, and posting index of a term missing from a field
+constexpr uint64_t NO_DOCUMENT = UINT64_MAX; // Block offset of a file without a stored document
+constexpr uint32_t NO_SITE = UINT32_MAX; // Site id of a file without a site
+constexpr uint32_t PRESENCE_DENSITY = 16; // A term's files are also saved as a set when at least one file in this many has it
+
+enum Field : uint32_t { ORG = 0, NAME = 1, WORD = 2, FIELD_COUNT = 3 }; // Posting sections in file order
+constexpr uint32_t ENTITY_FIELDS = 2; // Fields with entity columns: ORG and NAME, the first ones
+enum Zone : uint32_t { TITLE = 0, TEXT = 1, ENTITIES = 2, OTHER = 3, ZONE_COUNT = 4 }; // Parts of a document whose words are weighted apart, see impact.h
+
+struct FieldSection { // Location of one field's postings
+    uint64_t postingTableOffset; // Offset of the PostingEntry array
+    uint64_t skipsOffset; // Offset of the PostingSkip array
+    uint64_t postingsOffset; // Offset of the encoded postings
+    uint64_t skipCount; // Number of skip entries in the field
+    uint64_t postingBytes; // Size of the encoded postings
+    uint32_t postingCount; // Number of terms in the field
+    uint32_t presenceCount; // Number of terms whose files are also saved as a set
+    uint64_t positionSkipsOffset; // Offset of the position PostingSkip array
+    uint64_t positionsOffset; // Offset of the encoded position lists
+    uint64_t positionSkipCount; // Number of position skip entries in the field
+    uint64_t positionBytes; // Size of the encoded position lists
+    uint64_t presenceTableOffset; // Offset of the PresenceEntry array
+};
+
+struct EntityColumn { // Location of one field's entity column
+    uint64_t offsetsOffset; // Offset of the per-file start array
+    uint64_t termsOffset; // Offset of the term id array
+    uint64_t termCount; // Number of term ids
+};
+
+struct Header { // First bytes of the file
+    char magic[8]; // MAGIC
+    uint32_t version; // VERSION
+    uint32_t fileCount; // Number of files
+    uint64_t fileSize; // Total size of the index file, used to detect truncation
+    uint64_t fileTableOffset; // Offset of the FileEntry array
+    uint64_t pathsOffset; // Offset of the path string blob
+    uint64_t zoneLengths[ZONE_COUNT]; // Sum of the decoded lengths of each zone over every file
+    float zoneWeights[ZONE_COUNT]; // Zone weights the impacts were computed with
+    uint32_t termCount; // Number of terms in the dictionary
+    uint32_t reserved; // Padding
+    uint64_t termTableOffset; // Offset of the TermEntry array
+    uint64_t termStringsOffset; // Offset of the term string blob
+    uint64_t slotTableOffset; // Offset of the TermSlot array
+    uint64_t slotCount; // Number of hash slots, a power of two larger than termCount
+    FieldSection fields[FIELD_COUNT]; // One section per field
+    uint64_t datesOffset; // Offset of the date column
+    uint64_t sitesOffset; // Offset of the site column
+    uint64_t siteTableOffset; // Offset of the SiteEntry array
+    uint64_t siteNamesOffset; // Offset of the site name blob
+    uint32_t siteCount; // Number of sites
+    uint32_t reserved2; // Padding
+    EntityColumn entities[ENTITY_FIELDS]; // One column per entity field
+    uint64_t docTableOffset; // Offset of the DocEntry array
+    uint64_t docKeysOffset; // Offset of the DocKey array
+    uint64_t docBlocksOffset; // Offset of the document blocks
+    uint64_t docBytes; // Size of the document blocks
+    uint64_t sequence; // Last write-ahead log record included in the index, see WriteAheadLog
+    uint64_t checksum; // durable::checksum of everything after the header and before the document blocks
+};
+
+struct FileEntry { // One indexed file
+    uint64_t pathOffset; // Offset of the path in the path blob
+    uint32_t pathLength; // Length of the path
+    uint8_t norms[ZONE_COUNT]; // Number of words in each zone of the file, encoded by impact::encodeLength
+};
+
+struct SiteEntry { // One site
+    uint64_t nameOffset; // Offset of the name in the site name blob
+    uint32_t nameLength; // Length of the name
+    uint32_t reserved; // Padding
+};
+
+struct DocEntry { // Stored document of one file
+    uint64_t blockOffset; // Offset of the DocBlock holding it from the start of the blocks, or NO_DOCUMENT
+    uint32_t recordOffset; // Offset of the record in the decompressed block
+    uint32_t recordLength; // Length of the record
+};
+
+struct DocKey { // One document id
+    uint64_t id; // Document id, see DocStore::documentId
+    uint32_t file; // File id
+    uint32_t reserved; // Padding
+};
+
+struct DocBlock { // Header of one block of document records, followed by its compressed bytes padded to 8
+    uint32_t compressedSize; // Compressed bytes after the header
+    uint32_t rawSize; // Bytes of records once decompressed
+    uint32_t recordCount; // Number of records in the block
+    uint32_t reserved; // Padding
+    uint64_t checksum; // durable::checksum of the compressed bytes
+};
+
+struct PresenceEntry { // File ids of one common term in one field, as a set
+    uint32_t postingIndex; // Index of the term's PostingEntry
+    uint32_t reserved; // Padding
+    uint64_t offset; // Offset of the saved Roaring set
+    uint64_t size; // Size of the saved set
+};
+
+struct TermEntry { // One dictionary entry
+    uint64_t stringOffset; // Offset of the term in the term blob
+    uint32_t stringLength; // Length of the term
+    uint32_t postings[FIELD_COUNT]; // Index of the term's PostingEntry in each field, or NO_TERM
+};
+
+struct TermSlot { // One hash table slot
+    uint32_t term; // Term id, or NO_TERM when the slot is empty
+    uint32_t tag; // High half of the term's hash, compared before the string
+};
+
+struct PostingEntry { // Postings of one term in one field
+    uint64_t postingOffset; // Byte offset of the term's encoded postings
+    uint64_t skipOffset; // Index of the term's first skip entry
+    uint32_t postingCount; // Number of files containing the term
+    uint32_t maxFrequency; // Largest impact in the term's postings
+    uint64_t positionOffset; // Byte offset of the term's encoded positions
+    uint64_t positionSkipOffset; // Index of the term's first position skip entry
+    uint32_t positionCount; // Number of files with positions of the term, 0 for indexes built without them
+    uint32_t reserved; // Padding
+};
+
+}
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile(); // Constructor
+    ~MappedFile(); // Destructor, unmaps the file
+    MappedFile(const MappedFile&) = delete; // Mappings are not copyable
+    MappedFile& operator=(const MappedFile&) = delete; // Mappings are not copyable
+
+    bool open(const std::string& path); // Map a file, returns false on failure
+    void close(); // Unmap the file
+    const char* data() const { return base; } // Start of the mapping
+    size_t size() const { return length; } // Length of the mapping
+    bool isOpen() const { return base != nullptr; } // Whether a file is mapped
+
+private:
+    const char* base; // Start of the mapping
+    size_t length; // Length of the mapping
+};
+
+#endif // INDEXFILE_H // End of include guard
@@ -0,0 +1,95 @@
+#include "logger.h" // Include the logger header
+#include "metrics.h" // Include the dropped line counter
+
+#include <atomic> // Include the atomic library for the started flag
+#include <condition_variable> // Include the condition_variable library to wake the writer
+#include <iostream> // Include the iostream library for standard output
+#include <mutex> // Include the mutex library for the queue
+#include <thread> // Include the thread library for the writer
+#include <vector> // Include the vector library
+
+namespace logger {
+
+namespace {
+
+struct State {
+    std::atomic<bool> started{false}; // Whether lines are accepted
+    std::mutex mutex; // Guards the fields below
+    std::condition_variable wake; // Signalled when lines are queued or the log stops
+    std::vector<std::string> queued; // Lines waiting to be written
+    bool stopping = false; // Whether the writer should finish
+    std::thread writer; // Background thread writing the lines
+};
+
+State& state() {
+    static State instance;
+    return instance;
+}
+
+void run(State& s) {
+    std::vector<std::string> lines; // Batch taken from the queue
+    std::unique_lock<std::mutex> lock(s.mutex);
+    while (true) {
+        s.wake.wait(lock, [&s]() { return s.stopping || !s.queued.empty(); });
+        if (s.queued.empty()) { // Stopping with nothing left
+            break;
+        }
+        lines.swap(s.queued);
+        lock.unlock(); // Write without holding up searches queuing more lines
+        for (const auto& line : lines) {
+            std::cout << line << '\n';
+        }
+        std::cout.flush();
+        lines.clear();
+        lock.lock();
+    }
+}
+
+}
+
+void start() {
+    State& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.started.load()) {
+        return;
+    }
+    s.stopping = false;
+    s.writer = std::thread(run, std::ref(s));
+    s.started.store(true);
+}
+
+void stop() {
+    State& s = state();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.started.load()) {
+            return;
+        }
+        s.started.store(false);
+        s.stopping = true;
+    }
+    s.wake.notify_one();
+    s.writer.join();
+}
+
+bool enabled() {
+    return state().started.load(std::memory_order_relaxed);
+}
+
+void write(std::string line) {
+    State& s = state();
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        if (!s.started.load(std::memory_order_relaxed)) {
+            return;
+        }
+        if (s.queued.size() >= MAX_QUEUED) {
+            metrics::add(metrics::LOG_DROPPED);
+            return;
+        }
+        s.queued.push_back(std::move(line));
+    }
+    s.wake.notify_one();
+}
+
+}
@@ -0,0 +1,23 @@
+#ifndef LOGGER_H // Include guard to prevent multiple inclusions of this header file
+#define LOGGER_H // Define the include guard
+
+#include <cstddef> // Include the cstddef library for size_t
+#include <string> // Include the string library
+
+// Optional console log written by a background thread.
+//
+// Searches only queue a line, and only while the log is started, so a slow or blocked terminal never
+// holds up a query. When the queue already holds MAX_QUEUED lines new ones are dropped and counted
+// in the search_log_dropped_total metric.
+namespace logger {
+
+constexpr size_t MAX_QUEUED = 10000; // Lines waiting to be written before new ones are dropped
+
+void start(); // Start writing queued lines to standard output
+void stop(); // Write the lines still queued and stop the background thread
+bool enabled(); // Whether the log is started; check before building a line
+void write(std::string line); // Queue a line, without its newline
+
+}
+
+#endif // LOGGER_H // End of include guard
@@ -1,10 +1,12 @@
 #include "searchEngine.h" // Include the search engine header file
 
+#include <chrono> // Include the chrono library for timing searches
 #include <iostream> // Include the iostream library for input and output
 #include <string> // Include the string library for string manipulation
 
-int main() { // Main function
-    SearchEngine searchEngine("docs", "fnsavefile.csv", "osavefile.csv", "nsavefile.csv", "wsavefile.csv", "fsavefile.csv"); // Create a SearchEngine object with specified parameters
+int main(int argc, char* argv[]) { // Main function
+    std::unique_ptr<Searcher> engine = openSearchEngine(argc, argv); // Map, migrate or build the index chosen on the command line, or reach its shard servers
+    const Searcher& searchEngine = *engine; // Search engine used below
 
     std::string query; // Declare a string to hold the search query
     char choice; // Declare a char to hold the user's choice
@@ -13,9 +15,11 @@ int main() { // Main function
         std::cout << "Enter search query: "; // Prompt the user to enter a search query
         std::getline(std::cin, query); // Get the search query from the user
 
+        auto start = std::chrono::steady_clock::now(); // Time the search
         auto results = searchEngine.search(query); // Perform the search and store the results
+        std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
 
-        std::cout << results.size() << " search results:\n"; // Output the number of search results
+        std::cout << results.size() << " search results in " << duration.count() << " seconds:\n"; // Output the number of search results
         for (const auto& result : results) { // Loop through the search results
             std::cout << result << std::endl; // Output each search result
         }
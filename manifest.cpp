@@ -0,0 +1,126 @@
+#include "manifest.h" // Include the manifest header
+#include "durableFile.h" // Include the crash-safe save helpers
+
+#include <fstream> // Include the fstream library for reading and writing files
+#include <iostream> // Include the iostream library for error messages
+#include <iterator> // Include the iterator library for reading the whole file
+#include <sstream> // Include the sstream library for parsing lines
+#include <sys/stat.h> // Include stat for file sizes and modification times
+
+bool Manifest::load(const std::string& path, uint64_t* sequence) {
+    std::ifstream ifs(path, std::ios::binary); // Open the manifest
+    std::string text((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>()); // Whole file, to check it before parsing
+    size_t trailer = text.rfind("end "); // Checksum line, last in the file
+    if (!ifs.is_open() || text.compare(0, 13, "SEMANIFEST 2 ") != 0) { // Missing or written by another version
+        return false;
+    }
+    if (trailer == std::string::npos || (trailer > 0 && text[trailer - 1] != '\n') || std::to_string(durable::checksum(text.data(), trailer)) + "\n" != text.substr(trailer + 4)) { // Torn or damaged
+        std::cerr << "Manifest failed its checksum: " << path << std::endl; // Print error message
+        return false;
+    }
+
+    std::istringstream iss(text.substr(0, trailer)); // Checked contents
+    std::string line; // Line being read
+    std::getline(iss, line);
+    uint64_t saved = std::stoull(line.substr(13)); // Log sequence the manifest was saved at
+    std::unordered_map<std::string, FileState> loaded; // Replaces the entries only if the whole file is valid
+    while (std::getline(iss, line)) { // Read each file
+        std::istringstream fields(line);
+        FileState state;
+        std::string filePath;
+        if (!(fields >> state.size >> state.mtime >> state.hash) || fields.get() != ' ' || !std::getline(fields, filePath)) { // The path is the rest of the line
+            std::cerr << "Invalid manifest line in " << path << ": " << line << std::endl; // Print error message
+            return false;
+        }
+        loaded[filePath] = state;
+    }
+    entries.swap(loaded);
+    if (sequence) {
+        *sequence = saved;
+    }
+    return true;
+}
+
+bool Manifest::save(const std::string& path, uint64_t sequence) const {
+    std::ostringstream oss; // Contents, checksummed before they are written
+    oss << "SEMANIFEST 2 " << sequence << "\n";
+    for (const auto& pair : entries) { // Save each file
+        oss << pair.second.size << " " << pair.second.mtime << " " << pair.second.hash << " " << pair.first << "\n";
+    }
+    std::string text = oss.str();
+    text += "end " + std::to_string(durable::checksum(text.data(), text.size())) + "\n";
+
+    std::string temppath = path + ".tmp"; // Write to a temporary file and move it into place
+    std::ofstream ofs(temppath, std::ios::binary); // Open file for saving the manifest
+    if (!ofs.is_open()) {
+        std::cerr << "Failed to open file for saving: " << temppath << std::endl; // Print error message
+        return false;
+    }
+    ofs.write(text.data(), static_cast<std::streamsize>(text.size()));
+    ofs.close();
+    if (!ofs || !durable::replaceFile(temppath, path)) { // If writing or moving the file failed
+        std::cerr << "Failed to write manifest: " << path << std::endl; // Print error message
+        return false;
+    }
+    return true;
+}
+
+const FileState* Manifest::find(const std::string& filePath) const {
+    auto it = entries.find(filePath);
+    return it == entries.end() ? nullptr : &it->second;
+}
+
+void Manifest::set(const std::string& filePath, const FileState& state) {
+    entries[filePath] = state;
+}
+
+void Manifest::erase(const std::string& filePath) {
+    entries.erase(filePath);
+}
+
+void Manifest::clear() {
+    entries.clear();
+}
+
+bool Manifest::stat(const std::string& filePath, FileState& state) {
+    struct stat st; // File status
+    if (::stat(filePath.c_str(), &st) != 0) { // If the file is gone
+        return false;
+    }
+    state.size = static_cast<uint64_t>(st.st_size);
+    state.mtime = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+namespace {
+
+const uint64_t FNV_OFFSET = 14695981039346656037ULL; // FNV-1a offset basis
+const uint64_t FNV_PRIME = 1099511628211ULL; // FNV-1a prime
+
+// Continue an FNV-1a hash over size bytes
+uint64_t fnv(uint64_t hash, const char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * FNV_PRIME;
+    }
+    return hash;
+}
+
+}
+
+uint64_t Manifest::hash(const std::string& filePath) {
+    std::ifstream ifs(filePath, std::ios::binary); // Open the file
+    if (!ifs.is_open()) {
+        return 0;
+    }
+    uint64_t hash = FNV_OFFSET;
+    char buffer[65536]; // Read buffer
+    while (ifs.read(buffer, sizeof(buffer)) || ifs.gcount() > 0) { // Hash the file in chunks
+        hash = fnv(hash, buffer, static_cast<size_t>(ifs.gcount()));
+    }
+    return hash == 0 ? 1 : hash; // 0 means unknown
+}
+
+uint64_t Manifest::hash(const char* data, size_t size) {
+    uint64_t hash = fnv(FNV_OFFSET, data, size);
+    return hash == 0 ? 1 : hash; // 0 means unknown
+}
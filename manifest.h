@@ -0,0 +1,41 @@
+#ifndef MANIFEST_H // Include guard to prevent multiple inclusions of this header file
+#define MANIFEST_H // Define the include guard
+
+#include <cstddef> // Include the cstddef library for size_t
+#include <cstdint> // Include the cstdint library for fixed width integers
+#include <string> // Include the string library
+#include <unordered_map> // Include the unordered_map library
+
+// State of a file when it was indexed
+struct FileState {
+    uint64_t size = 0; // Size in bytes
+    int64_t mtime = 0; // Modification time in nanoseconds
+    uint64_t hash = 0; // FNV-1a hash of the contents, 0 when unknown
+};
+
+// Indexed files with their state, saved next to the binary index so a restart or a folder
+// change only reindexes files whose size, modification time and contents differ.
+//
+// File format: a "SEMANIFEST 2 sequence" line, then one "size mtime hash path" line per file, then an
+// "end checksum" line over everything before it. sequence is the last write-ahead log record the
+// manifest includes, see WriteAheadLog.
+class Manifest {
+public:
+    bool load(const std::string& path, uint64_t* sequence = nullptr); // Read a manifest file and its log sequence, returns false if it is missing, invalid or fails its checksum
+    bool save(const std::string& path, uint64_t sequence = 0) const; // Write a manifest file through a temporary file, crash-safely
+
+    const FileState* find(const std::string& filePath) const; // State of an indexed file, or nullptr
+    void set(const std::string& filePath, const FileState& state); // Record the state of an indexed file
+    void erase(const std::string& filePath); // Forget a file
+    void clear(); // Forget every file
+    const std::unordered_map<std::string, FileState>& files() const { return entries; } // Every indexed file
+
+    static bool stat(const std::string& filePath, FileState& state); // Read the size and modification time of a file, leaving the hash
+    static uint64_t hash(const std::string& filePath); // Hash the contents of a file, 0 if it cannot be read
+    static uint64_t hash(const char* data, size_t size); // Hash contents already in memory, equal to the hash of a file holding them
+
+private:
+    std::unordered_map<std::string, FileState> entries; // State of each indexed file by path
+};
+
+#endif // MANIFEST_H // End of include guard
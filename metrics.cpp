@@ -0,0 +1,243 @@
+#include "metrics.h" // Include the metrics header
+
+#include <algorithm> // Include algorithm library for std::find
+#include <cmath> // Include cmath library for std::ceil
+#include <mutex> // Include mutex library for the registry of thread blocks
+#include <sstream> // Include sstream library for the text exposition
+
+namespace metrics {
+
+namespace {
+
+// Records of one thread
+struct Block {
+    Histogram stages[STAGE_COUNT]; // Latency of each stage
+    std::atomic<uint64_t> counters[COUNTER_COUNT] = {}; // Value of each counter
+};
+
+// Blocks of live threads, and the sum of the blocks of threads that have exited
+struct Registry {
+    std::mutex mutex; // Guards live and the retired totals
+    std::vector<Block*> live; // Blocks of running threads
+    Block retired; // Records of threads that have exited
+};
+
+Registry& registry() {
+    static Registry* instance = new Registry; // Never destroyed, so threads ending during static destruction can still retire
+    return *instance;
+}
+
+// Owner of the calling thread's block: registers it on first use and retires it when the thread exits
+struct Local {
+    Block* block; // Records of this thread
+
+    Local() : block(new Block) {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        r.live.push_back(block);
+    }
+
+    ~Local() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+            r.retired.stages[stage].absorb(block->stages[stage]);
+        }
+        for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+            r.retired.counters[counter].fetch_add(block->counters[counter].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        r.live.erase(std::find(r.live.begin(), r.live.end(), block));
+        delete block;
+    }
+};
+
+Block& local() {
+    thread_local Local owner;
+    return *owner.block;
+}
+
+// Increase a value only the calling thread writes: a plain load and store, no locked instruction
+inline void bump(std::atomic<uint64_t>& value, uint64_t amount) {
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+// Upper bounds of the exported histogram buckets, in seconds
+const struct { const char* label; double seconds; } BOUNDS[] = {
+    {"1e-06", 1e-6}, {"2.5e-06", 2.5e-6}, {"5e-06", 5e-6},
+    {"1e-05", 1e-5}, {"2.5e-05", 2.5e-5}, {"5e-05", 5e-5},
+    {"0.0001", 1e-4}, {"0.00025", 2.5e-4}, {"0.0005", 5e-4},
+    {"0.001", 1e-3}, {"0.0025", 2.5e-3}, {"0.005", 5e-3},
+    {"0.01", 1e-2}, {"0.025", 2.5e-2}, {"0.05", 5e-2},
+    {"0.1", 0.1}, {"0.25", 0.25}, {"0.5", 0.5},
+    {"1", 1.0}, {"2.5", 2.5}, {"5", 5.0}, {"10", 10.0},
+};
+
+const struct { const char* name; const char* help; } COUNTERS[COUNTER_COUNT] = {
+    {"search_queries_total", "Searches run"},
+    {"search_results_total", "Paths returned by searches"},
+    {"search_requests_total", "Requests received by the server"},
+    {"search_bad_requests_total", "Requests answered with BAD_REQUEST"},
+    {"search_rejected_total", "Requests refused with OVERLOADED"},
+    {"search_partial_total", "Requests answered with PARTIAL results"},
+    {"search_connections_total", "Connections accepted by the server"},
+    {"search_sent_bytes_total", "Response bytes written to sockets"},
+    {"search_log_dropped_total", "Log lines dropped because the log queue was full"},
+};
+
+// Write gauges or counters, with one HELP and TYPE line per name
+void writeSamples(std::ostringstream& out, std::vector<Gauge> samples, const char* type) {
+    std::stable_sort(samples.begin(), samples.end(), [](const Gauge& a, const Gauge& b) { return a.name < b.name; }); // Samples of a metric must be adjacent
+    for (size_t i = 0; i < samples.size(); ++i) {
+        const Gauge& sample = samples[i];
+        if (i == 0 || samples[i - 1].name != sample.name) {
+            out << "# HELP " << sample.name << ' ' << sample.help << '\n';
+            out << "# TYPE " << sample.name << ' ' << type << '\n';
+        }
+        out << sample.name;
+        if (!sample.labels.empty()) {
+            out << '{' << sample.labels << '}';
+        }
+        out << ' ' << sample.value << '\n';
+    }
+}
+
+}
+
+uint32_t Histogram::bucket(uint64_t nanos) {
+    if (nanos < (1u << SUB_BITS)) { // Small values have a bucket each
+        return static_cast<uint32_t>(nanos);
+    }
+    uint32_t exponent = 63 - static_cast<uint32_t>(__builtin_clzll(nanos));
+    if (exponent >= MAX_BITS) { // Clamp to the last bucket
+        return BUCKETS - 1;
+    }
+    uint32_t sub = static_cast<uint32_t>(nanos >> (exponent - SUB_BITS)) & ((1u << SUB_BITS) - 1);
+    return ((exponent - SUB_BITS + 1) << SUB_BITS) + sub;
+}
+
+uint64_t Histogram::upperBound(uint32_t bucket) {
+    if (bucket < (1u << SUB_BITS)) {
+        return bucket;
+    }
+    uint32_t shift = (bucket >> SUB_BITS) - 1; // Width of the bucket is 2^shift
+    uint64_t lower = static_cast<uint64_t>((1u << SUB_BITS) + (bucket & ((1u << SUB_BITS) - 1))) << shift;
+    return lower + (uint64_t(1) << shift) - 1;
+}
+
+void Histogram::record(uint64_t nanos) {
+    bump(counts[bucket(nanos)], 1);
+    bump(count, 1);
+    bump(sum, nanos);
+}
+
+void Histogram::addTo(std::vector<uint64_t>& totals, uint64_t& totalCount, uint64_t& totalSum) const {
+    for (uint32_t i = 0; i < BUCKETS; ++i) {
+        totals[i] += counts[i].load(std::memory_order_relaxed);
+    }
+    totalCount += count.load(std::memory_order_relaxed);
+    totalSum += sum.load(std::memory_order_relaxed);
+}
+
+void Histogram::absorb(const Histogram& other) {
+    for (uint32_t i = 0; i < BUCKETS; ++i) {
+        counts[i].fetch_add(other.counts[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    count.fetch_add(other.count.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    sum.fetch_add(other.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+double Distribution::quantile(double q) const {
+    if (count == 0) {
+        return 0.0;
+    }
+    uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(count))));
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < Histogram::BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return static_cast<double>(Histogram::upperBound(i)) / 1e9;
+        }
+    }
+    return static_cast<double>(Histogram::upperBound(Histogram::BUCKETS - 1)) / 1e9;
+}
+
+uint64_t Distribution::countBelow(double seconds) const {
+    double limit = seconds * 1e9;
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < Histogram::BUCKETS && static_cast<double>(Histogram::upperBound(i)) <= limit; ++i) {
+        total += counts[i];
+    }
+    return total;
+}
+
+void record(Stage stage, uint64_t nanos) {
+    local().stages[stage].record(nanos);
+    trace().nanos[stage] += nanos;
+}
+
+Trace& trace() {
+    thread_local Trace current;
+    return current;
+}
+
+std::string describe(const Trace& trace) {
+    std::string text;
+    for (Stage stage : {PARSE, FETCH, SCORE, SORT}) { // Stages inside a search
+        text += (text.empty() ? "" : ", ") + std::string(stageName(stage)) + " " + std::to_string(trace.nanos[stage] / 1000) + " us";
+    }
+    return text;
+}
+
+void add(Counter counter, uint64_t amount) {
+    bump(local().counters[counter], amount);
+}
+
+Snapshot collect() {
+    Snapshot snapshot;
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    std::vector<const Block*> blocks(r.live.begin(), r.live.end());
+    blocks.push_back(&r.retired);
+    for (const Block* block : blocks) {
+        for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+            Distribution& d = snapshot.stages[stage];
+            block->stages[stage].addTo(d.counts, d.count, d.sum);
+        }
+        for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+            snapshot.counters[counter] += block->counters[counter].load(std::memory_order_relaxed);
+        }
+    }
+    return snapshot;
+}
+
+const char* stageName(Stage stage) {
+    static const char* const NAMES[STAGE_COUNT] = {"parse", "fetch", "score", "sort", "send", "search", "documents"};
+    return NAMES[stage];
+}
+
+std::string prometheus(const Snapshot& snapshot, const std::vector<Gauge>& gauges, const std::vector<Gauge>& counters) {
+    std::ostringstream out;
+    out.precision(15); // Byte counts print in full
+    out << "# HELP search_stage_seconds Time spent in each stage of a search\n";
+    out << "# TYPE search_stage_seconds histogram\n";
+    for (int stage = 0; stage < STAGE_COUNT; ++stage) {
+        const Distribution& d = snapshot.stages[stage];
+        const char* name = stageName(static_cast<Stage>(stage));
+        for (const auto& bound : BOUNDS) {
+            out << "search_stage_seconds_bucket{stage=\"" << name << "\",le=\"" << bound.label << "\"} " << d.countBelow(bound.seconds) << '\n';
+        }
+        out << "search_stage_seconds_bucket{stage=\"" << name << "\",le=\"+Inf\"} " << d.count << '\n';
+        out << "search_stage_seconds_sum{stage=\"" << name << "\"} " << static_cast<double>(d.sum) / 1e9 << '\n';
+        out << "search_stage_seconds_count{stage=\"" << name << "\"} " << d.count << '\n';
+    }
+    for (int counter = 0; counter < COUNTER_COUNT; ++counter) {
+        out << "# HELP " << COUNTERS[counter].name << ' ' << COUNTERS[counter].help << '\n';
+        out << "# TYPE " << COUNTERS[counter].name << " counter\n";
+        out << COUNTERS[counter].name << ' ' << snapshot.counters[counter] << '\n';
+    }
+    writeSamples(out, counters, "counter");
+    writeSamples(out, gauges, "gauge");
+    return out.str();
+}
+
+}
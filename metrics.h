@@ -0,0 +1,126 @@
+#ifndef METRICS_H // Include guard to prevent multiple inclusions of this header file
+#define METRICS_H // Define the include guard
+
+#include <atomic> // Include the atomic library for counters read by other threads
+#include <chrono> // Include the chrono library for stage timers
+#include <cstddef> // Include the cstddef library for size_t
+#include <cstdint> // Include the cstdint library for fixed width integers
+#include <string> // Include the string library
+#include <vector> // Include the vector library
+
+// Low-overhead instrumentation of the search path.
+//
+// Every thread records into its own block of counters and latency histograms, registered once on first
+// use, so recording is a few relaxed stores with no shared cache lines. Readers sum the blocks of every
+// live thread plus the totals of threads that have exited. Histograms are log-linear like HdrHistogram:
+// 16 buckets per power of two of nanoseconds, so any quantile is within about 6% of the true value.
+namespace metrics {
+
+enum Stage { // Timed parts of a search
+    PARSE, // Parsing the query text
+    FETCH, // Looking up posting lists and building iterators
+    SCORE, // Walking postings and scoring matches
+    SORT, // Ordering the best matches, and merging shard results
+    SEND, // Writing responses to sockets
+    SEARCH, // A whole search, from query text to paths
+    DOCUMENTS, // Reading the stored documents of results and making their snippets
+    STAGE_COUNT,
+};
+
+enum Counter { // Counted events
+    QUERIES, // Searches run
+    RESULTS, // Paths returned by searches
+    REQUESTS, // Requests received by the server
+    BAD_REQUESTS, // Requests answered with BAD_REQUEST
+    REJECTED, // Requests answered with OVERLOADED
+    PARTIAL, // Requests answered with PARTIAL
+    CONNECTIONS, // Connections accepted by the server
+    BYTES_SENT, // Response bytes written to sockets
+    LOG_DROPPED, // Log lines dropped because the log queue was full
+    COUNTER_COUNT,
+};
+
+// Latency histogram written by one thread and read by any
+class Histogram {
+public:
+    static constexpr uint32_t SUB_BITS = 4; // 2^SUB_BITS buckets per power of two
+    static constexpr uint32_t MAX_BITS = 40; // Largest value recorded is about 2^40 ns, 18 minutes; larger ones are clamped
+    static constexpr uint32_t BUCKETS = (MAX_BITS - SUB_BITS + 1) << SUB_BITS; // Number of buckets
+
+    static uint32_t bucket(uint64_t nanos); // Bucket holding a value
+    static uint64_t upperBound(uint32_t bucket); // Largest value in a bucket
+
+    void record(uint64_t nanos); // Count one value; only the owning thread may call it
+    void addTo(std::vector<uint64_t>& counts, uint64_t& count, uint64_t& sum) const; // Add the histogram to a running total
+    void absorb(const Histogram& other); // Add another histogram, used when its thread exits
+
+private:
+    std::atomic<uint64_t> counts[BUCKETS] = {}; // Values per bucket
+    std::atomic<uint64_t> count{0}; // Number of values
+    std::atomic<uint64_t> sum{0}; // Sum of the values
+};
+
+// Sum of every thread's histogram for one stage
+struct Distribution {
+    std::vector<uint64_t> counts = std::vector<uint64_t>(Histogram::BUCKETS, 0); // Values per bucket
+    uint64_t count = 0; // Number of values
+    uint64_t sum = 0; // Sum of the values in nanoseconds
+
+    double quantile(double q) const; // Value in seconds below which a fraction q of the values fall
+    uint64_t countBelow(double seconds) const; // Number of values at most seconds, counting whole buckets
+};
+
+// Everything recorded so far
+struct Snapshot {
+    Distribution stages[STAGE_COUNT]; // Latency of each stage
+    uint64_t counters[COUNTER_COUNT] = {}; // Value of each counter
+};
+
+// A value sampled when metrics are read, such as the size of an index
+struct Gauge {
+    std::string name; // Metric name
+    std::string help; // One line description
+    std::string labels; // Prometheus labels without braces, e.g. field="org", or empty
+    double value; // Current value
+};
+
+// Durations recorded by one thread since its trace was last cleared, to report the stages of a single query
+struct Trace {
+    uint64_t nanos[STAGE_COUNT] = {}; // Time spent in each stage
+};
+
+void record(Stage stage, uint64_t nanos); // Record one duration of a stage
+Trace& trace(); // Trace of the calling thread; assign {} to clear it
+std::string describe(const Trace& trace); // Stages of a trace in microseconds, e.g. "parse 12 us, fetch 40 us, score 310 us, sort 5 us"
+void add(Counter counter, uint64_t amount = 1); // Increase a counter
+Snapshot collect(); // Sum the records of every thread
+
+const char* stageName(Stage stage); // Label of a stage, e.g. "parse"
+
+// Prometheus text exposition of a snapshot, the given gauges and any extra counters
+std::string prometheus(const Snapshot& snapshot, const std::vector<Gauge>& gauges, const std::vector<Gauge>& counters);
+
+// Records the time from construction to stop() or destruction as one duration of a stage
+class Timer {
+public:
+    explicit Timer(Stage stage) : stage(stage), start(std::chrono::steady_clock::now()), running(true) {}
+    ~Timer() { stop(); }
+    Timer(const Timer&) = delete; // Timers are not copyable
+    Timer& operator=(const Timer&) = delete; // Timers are not copyable
+
+    void stop() { // Record now, instead of at destruction
+        if (running) {
+            running = false;
+            record(stage, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()));
+        }
+    }
+
+private:
+    Stage stage; // Stage being timed
+    std::chrono::steady_clock::time_point start; // When timing began
+    bool running; // Whether the duration is still to be recorded
+};
+
+}
+
+#endif // METRICS_H // End of include guard
@@ -0,0 +1,167 @@
+#include "positionList.h" // Include the position list header
+
+#include <algorithm> // Include algorithm library for std::partition_point and merging positions
+#include <iterator> // Include iterator library for std::back_inserter
+#include <utility> // Include utility library for std::pair
+
+namespace {
+
+// Number of bytes writeVarint uses for a value
+uint32_t varintSize(uint32_t value) {
+    uint32_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+}
+
+PositionView::Cursor PositionView::cursor() const {
+    return Cursor(*this);
+}
+
+PositionView::Cursor::Cursor(const PositionView& view) : view(view), position(nullptr), current(nullptr), block(0), remaining(0), currentId(0), currentCount(0), exhausted(view.count == 0) {
+    if (!exhausted) { // Decode the first entry
+        enterBlock(0);
+    }
+}
+
+void PositionView::Cursor::enterBlock(uint32_t target) {
+    block = target;
+    position = view.data + view.skips[block].offset; // Jump to the start of the block
+    currentId = block == 0 ? 0 : view.skips[block - 1].lastId; // Ids in the block are relative to the previous block
+    uint32_t blockStart = block * PositionList::BLOCK_SIZE;
+    remaining = std::min(PositionList::BLOCK_SIZE, view.count - blockStart); // Entries in this block
+    decode();
+}
+
+void PositionView::Cursor::decode() {
+    currentId += readVarint(position); // Id delta
+    currentCount = readVarint(position); // Number of positions
+    uint32_t length = readVarint(position); // Bytes of positions
+    current = position;
+    position += length; // Positions are decoded only when asked for
+    --remaining;
+}
+
+void PositionView::Cursor::next() {
+    if (exhausted) { // Nothing left to read
+        return;
+    }
+    if (remaining > 0) { // More entries in this block
+        decode();
+    } else if (block + 1 < view.skipCount) { // Continue with the next block
+        enterBlock(block + 1);
+    } else { // Past the last entry
+        exhausted = true;
+    }
+}
+
+void PositionView::Cursor::advance(uint32_t target) {
+    if (exhausted || currentId >= target) { // Already there
+        return;
+    }
+    if (view.skips[block].lastId < target) { // The target is past this block, find the first block that can hold it
+        const PostingSkip* first = view.skips + block + 1;
+        const PostingSkip* last = view.skips + view.skipCount;
+        const PostingSkip* found = std::partition_point(first, last, [target](const PostingSkip& skip) { return skip.lastId < target; });
+        if (found == last) { // No block holds the target
+            exhausted = true;
+            return;
+        }
+        enterBlock(static_cast<uint32_t>(found - view.skips));
+    }
+    while (!exhausted && currentId < target) { // Scan within the block
+        next();
+    }
+}
+
+void PositionView::Cursor::positions(std::vector<uint32_t>& out) const {
+    out.resize(currentCount);
+    decodePositions(out.data());
+}
+
+void PositionView::Cursor::positions(std::pmr::vector<uint32_t>& out) const {
+    out.resize(currentCount);
+    decodePositions(out.data());
+}
+
+void PositionView::Cursor::decodePositions(uint32_t* out) const {
+    const uint8_t* read = current;
+    uint32_t value = 0;
+    for (uint32_t i = 0; i < currentCount; ++i) { // Positions are stored as gaps
+        value += readVarint(read);
+        out[i] = value;
+    }
+}
+
+PositionList::PositionList() : count(0), last(0) {} // Constructor
+
+void PositionList::add(uint32_t id, const uint32_t* positions, uint32_t positionCount) {
+    uint32_t previous = last; // Ids are stored relative to the previous one
+    if (count % BLOCK_SIZE == 0) { // Start a new block
+        skips.push_back({id, static_cast<uint32_t>(bytes.size())});
+        previous = skips.size() > 1 ? skips[skips.size() - 2].lastId : 0;
+    }
+    uint32_t length = 0; // Bytes of the positions, written before them
+    for (uint32_t i = 0; i < positionCount; ++i) {
+        length += varintSize(positions[i] - (i == 0 ? 0 : positions[i - 1]));
+    }
+    writeVarint(bytes, id - previous);
+    writeVarint(bytes, positionCount);
+    writeVarint(bytes, length);
+    for (uint32_t i = 0; i < positionCount; ++i) {
+        writeVarint(bytes, positions[i] - (i == 0 ? 0 : positions[i - 1]));
+    }
+    skips.back().lastId = id;
+    last = id;
+    ++count;
+}
+
+void PositionList::merge(uint32_t id, const uint32_t* positions, uint32_t positionCount) {
+    if (count == 0 || id > last) { // Goes after the current entries
+        add(id, positions, positionCount);
+        return;
+    }
+
+    std::vector<std::pair<uint32_t, std::vector<uint32_t>>> entries; // Otherwise decode, insert and re-encode
+    entries.reserve(count + 1);
+    for (PositionView::Cursor cursor = view().cursor(); !cursor.atEnd(); cursor.next()) {
+        entries.emplace_back(cursor.id(), std::vector<uint32_t>());
+        cursor.positions(entries.back().second);
+    }
+    auto it = std::lower_bound(entries.begin(), entries.end(), id, [](const auto& entry, uint32_t target) { return entry.first < target; });
+    if (it != entries.end() && it->first == id) { // Same file, join the positions
+        std::vector<uint32_t> joined;
+        std::merge(it->second.begin(), it->second.end(), positions, positions + positionCount, std::back_inserter(joined));
+        joined.erase(std::unique(joined.begin(), joined.end()), joined.end());
+        it->second = std::move(joined);
+    } else {
+        entries.emplace(it, id, std::vector<uint32_t>(positions, positions + positionCount));
+    }
+
+    *this = PositionList();
+    for (const auto& entry : entries) {
+        add(entry.first, entry.second.data(), static_cast<uint32_t>(entry.second.size()));
+    }
+}
+
+void PositionList::shrink() {
+    bytes.shrink_to_fit();
+    skips.shrink_to_fit();
+}
+
+size_t PositionList::memoryUsage() const {
+    return bytes.capacity() + skips.capacity() * sizeof(PostingSkip);
+}
+
+PositionView PositionList::view() const {
+    PositionView result;
+    result.data = bytes.data();
+    result.skips = skips.data();
+    result.count = count;
+    result.skipCount = static_cast<uint32_t>(skips.size());
+    return result;
+}
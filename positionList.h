@@ -0,0 +1,80 @@
+#ifndef POSITIONLIST_H // Include guard to prevent multiple inclusions of this header file
+#define POSITIONLIST_H // Define the include guard
+
+#include <cstddef> // Include cstddef library for size_t
+#include <cstdint> // Include cstdint library for fixed width integers
+#include <memory_resource> // Include memory_resource library for arena-backed position buffers
+#include <vector> // Include vector library
+#include "postingList.h" // Include PostingSkip, shared by both kinds of lists
+
+// Read-only view of an encoded position list, either owned by a PositionList or inside a mapped index file.
+//
+// A position list holds, for every file containing a word in one field, the positions of the word's
+// occurrences in that field, sorted by file id and grouped into blocks of PositionList::BLOCK_SIZE files.
+// Each entry is the id minus the previous id in the list, the number of positions, the byte length of
+// the positions, then the positions as variable-byte gaps. The byte length lets a cursor step over the
+// positions of files it does not need, and the skip entries let it jump over whole blocks.
+struct PositionView {
+    const uint8_t* data = nullptr; // Encoded entries
+    const PostingSkip* skips = nullptr; // One skip entry per block
+    uint32_t count = 0; // Number of files
+    uint32_t skipCount = 0; // Number of blocks
+
+    class Cursor; // Iterator over the files
+    Cursor cursor() const; // Cursor positioned on the first file
+};
+
+// Decodes a PositionView one file at a time; positions are only decoded when asked for
+class PositionView::Cursor {
+public:
+    explicit Cursor(const PositionView& view); // Position the cursor on the first file
+
+    bool atEnd() const { return exhausted; } // Whether every file has been read
+    uint32_t id() const { return currentId; } // File id of the current entry
+    void next(); // Move to the next file
+    void advance(uint32_t target); // Move to the first file with an id >= target, skipping whole blocks
+    void positions(std::vector<uint32_t>& out) const; // Decode the positions of the current file into out
+    void positions(std::pmr::vector<uint32_t>& out) const; // Same, into a buffer of query scratch memory
+
+private:
+    void enterBlock(uint32_t block); // Start decoding at the first entry of a block
+    void decode(); // Decode the entry header at the read position
+    void decodePositions(uint32_t* out) const; // Write the currentCount positions of the current file to out
+
+    PositionView view; // Entries being read
+    const uint8_t* position; // Read position, just past the current entry
+    const uint8_t* current; // Positions of the current entry
+    uint32_t block; // Current block
+    uint32_t remaining; // Entries left in the current block after the current one
+    uint32_t currentId; // File id of the current entry
+    uint32_t currentCount; // Number of positions of the current entry
+    bool exhausted; // Whether the current entry is past the end
+};
+
+// Compressed, append-only list of (file id, positions) entries sorted by file id
+class PositionList {
+public:
+    static constexpr uint32_t BLOCK_SIZE = PostingList::BLOCK_SIZE; // Files per block
+
+    PositionList(); // Constructor
+
+    void add(uint32_t id, const uint32_t* positions, uint32_t count); // Append an entry; ids must be strictly increasing and positions sorted
+    void merge(uint32_t id, const uint32_t* positions, uint32_t count); // Add an entry anywhere in the list, joining the positions of an existing id
+    void shrink(); // Release spare capacity once the list is complete
+
+    uint32_t size() const { return count; } // Number of files
+    bool empty() const { return count == 0; } // Whether the list has no entries
+    uint32_t lastId() const { return last; } // Largest id in the list
+    size_t memoryUsage() const; // Heap bytes held by the list
+    const std::vector<uint8_t>& encoded() const { return bytes; } // Encoded entries, for saving
+    const std::vector<PostingSkip>& skipTable() const { return skips; } // Skip entries, for saving
+    PositionView view() const; // View of the list for reading
+
+private:
+    std::vector<uint8_t> bytes; // Encoded entries
+    std::vector<PostingSkip> skips; // One skip entry per block
+    uint32_t count; // Number of files
+    uint32_t last; // Largest id in the list
+};
+
+#endif // POSITIONLIST_H // End of include guard
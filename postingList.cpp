@@ -0,0 +1,152 @@
+#include "postingList.h" // Include the posting list header
+
+#include <algorithm> // Include algorithm library for std::partition_point
+
+PostingView::Cursor PostingView::cursor() const {
+    return Cursor(*this);
+}
+
+PostingView::Cursor::Cursor(const PostingView& view) : view(view), position(nullptr), block(0), remaining(0), currentId(0), currentFrequency(0), exhausted(view.count == 0) {
+    if (!exhausted) { // Decode the first posting
+        enterBlock(0);
+    }
+}
+
+void PostingView::Cursor::enterBlock(uint32_t target) {
+    block = target;
+    position = view.data + view.skips[block].offset; // Jump to the start of the block
+    currentId = block == 0 ? 0 : view.skips[block - 1].lastId; // Ids in the block are relative to the previous block
+    uint32_t blockStart = block * PostingList::BLOCK_SIZE;
+    remaining = std::min(PostingList::BLOCK_SIZE, view.count - blockStart); // Postings in this block
+    decode();
+}
+
+void PostingView::Cursor::decode() {
+    currentId += readVarint(position); // Id delta
+    currentFrequency = readVarint(position); // Frequency
+    --remaining;
+}
+
+void PostingView::Cursor::next() {
+    if (exhausted) { // Nothing left to read
+        return;
+    }
+    if (remaining > 0) { // More postings in this block
+        decode();
+    } else if (block + 1 < view.skipCount) { // Continue with the next block
+        enterBlock(block + 1);
+    } else { // Past the last posting
+        exhausted = true;
+    }
+}
+
+void PostingView::Cursor::advance(uint32_t target) {
+    if (exhausted || currentId >= target) { // Already there
+        return;
+    }
+    if (view.skips[block].lastId < target) { // The target is past this block, find the first block that can hold it
+        const PostingSkip* first = view.skips + block + 1;
+        const PostingSkip* last = view.skips + view.skipCount;
+        const PostingSkip* found = std::partition_point(first, last, [target](const PostingSkip& skip) { return skip.lastId < target; });
+        if (found == last) { // No block holds the target
+            exhausted = true;
+            return;
+        }
+        enterBlock(static_cast<uint32_t>(found - view.skips));
+    }
+    while (!exhausted && currentId < target) { // Scan within the block
+        next();
+    }
+}
+
+PostingList::PostingList() : count(0), last(0), maxFreq(0) {} // Constructor
+
+void PostingList::add(uint32_t id, uint32_t frequency) {
+    uint32_t previous = last; // Ids are stored relative to the previous one
+    if (count % BLOCK_SIZE == 0) { // Start a new block
+        skips.push_back({id, static_cast<uint32_t>(bytes.size())});
+        previous = skips.size() > 1 ? skips[skips.size() - 2].lastId : 0;
+    }
+    writeVarint(bytes, id - previous);
+    writeVarint(bytes, frequency);
+    skips.back().lastId = id;
+    last = id;
+    maxFreq = std::max(maxFreq, frequency);
+    ++count;
+}
+
+void PostingList::merge(const std::vector<std::pair<uint32_t, uint32_t>>& postings) {
+    if (postings.empty()) {
+        return;
+    }
+    if (count == 0 || postings.front().first > last) { // Everything goes after the current postings
+        for (const auto& posting : postings) {
+            add(posting.first, posting.second);
+        }
+        return;
+    }
+
+    std::vector<std::pair<uint32_t, uint32_t>> current = decodeAll(); // Otherwise merge and re-encode
+    std::vector<std::pair<uint32_t, uint32_t>> merged;
+    merged.reserve(current.size() + postings.size());
+    size_t i = 0, j = 0;
+    while (i < current.size() || j < postings.size()) {
+        if (j == postings.size() || (i < current.size() && current[i].first < postings[j].first)) {
+            merged.push_back(current[i++]);
+        } else if (i == current.size() || postings[j].first < current[i].first) {
+            merged.push_back(postings[j++]);
+        } else { // Same id in both, keep the larger frequency
+            merged.push_back({current[i].first, std::max(current[i].second, postings[j].second)});
+            ++i;
+            ++j;
+        }
+    }
+
+    *this = PostingList();
+    for (const auto& posting : merged) {
+        add(posting.first, posting.second);
+    }
+}
+
+bool PostingList::remove(uint32_t id) {
+    std::vector<std::pair<uint32_t, uint32_t>> current = decodeAll();
+    auto it = std::lower_bound(current.begin(), current.end(), std::make_pair(id, 0u));
+    if (it == current.end() || it->first != id) { // The id is not in the list
+        return false;
+    }
+    current.erase(it);
+    *this = PostingList(); // Re-encode without the id
+    for (const auto& posting : current) {
+        add(posting.first, posting.second);
+    }
+    shrink();
+    return true;
+}
+
+void PostingList::shrink() {
+    bytes.shrink_to_fit();
+    skips.shrink_to_fit();
+}
+
+size_t PostingList::memoryUsage() const {
+    return bytes.capacity() + skips.capacity() * sizeof(PostingSkip);
+}
+
+PostingView PostingList::view() const {
+    PostingView result;
+    result.data = bytes.data();
+    result.skips = skips.data();
+    result.count = count;
+    result.skipCount = static_cast<uint32_t>(skips.size());
+    result.maxFrequency = maxFreq;
+    return result;
+}
+
+std::vector<std::pair<uint32_t, uint32_t>> PostingList::decodeAll() const {
+    std::vector<std::pair<uint32_t, uint32_t>> postings;
+    postings.reserve(count);
+    for (PostingView::Cursor cursor = view().cursor(); !cursor.atEnd(); cursor.next()) {
+        postings.push_back({cursor.id(), cursor.frequency()});
+    }
+    return postings;
+}
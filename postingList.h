@@ -0,0 +1,105 @@
+#ifndef POSTINGLIST_H // Include guard to prevent multiple inclusions of this header file
+#define POSTINGLIST_H // Define the include guard
+
+#include <cstddef> // Include cstddef library for size_t
+#include <cstdint> // Include cstdint library for fixed width integers
+#include <utility> // Include utility library for std::pair
+#include <vector> // Include vector library
+
+// Append an unsigned integer 7 bits at a time, high bit set on every byte except the last
+inline void writeVarint(std::vector<uint8_t>& bytes, uint32_t value) {
+    while (value >= 0x80) {
+        bytes.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    bytes.push_back(static_cast<uint8_t>(value));
+}
+
+// Read an unsigned integer written by writeVarint and move past it
+inline uint32_t readVarint(const uint8_t*& position) {
+    uint32_t value = *position & 0x7f;
+    for (int shift = 7; *position++ & 0x80; shift += 7) {
+        value |= static_cast<uint32_t>(*position & 0x7f) << shift;
+    }
+    return value;
+}
+
+// Skip entry for one block of postings
+struct PostingSkip {
+    uint32_t lastId; // Largest file id in the block
+    uint32_t offset; // Byte offset of the block in the encoded postings
+};
+
+// Read-only view of an encoded posting list, either owned by a PostingList or inside a mapped index file.
+//
+// Postings are sorted by file id and grouped into blocks of PostingList::BLOCK_SIZE.
+// Each posting is two variable-byte integers: the id minus the previous id in the list, then the frequency,
+// which for the WordMap is the word's impact in the file (see impact.h) and fits one byte.
+// The first posting of a block is relative to the last id of the previous block, so decoding can
+// start at any block using only its skip entry.
+struct PostingView {
+    const uint8_t* data = nullptr; // Encoded postings
+    const PostingSkip* skips = nullptr; // One skip entry per block
+    uint32_t count = 0; // Number of postings
+    uint32_t skipCount = 0; // Number of blocks
+    uint32_t maxFrequency = 0; // Largest frequency in the list, bounds the score of any posting
+
+    class Cursor; // Iterator over the postings
+    Cursor cursor() const; // Cursor positioned on the first posting
+};
+
+// Decodes a PostingView one posting at a time
+class PostingView::Cursor {
+public:
+    explicit Cursor(const PostingView& view); // Position the cursor on the first posting
+
+    bool atEnd() const { return exhausted; } // Whether every posting has been read
+    uint32_t id() const { return currentId; } // File id of the current posting
+    uint32_t frequency() const { return currentFrequency; } // Frequency of the current posting
+    void next(); // Move to the next posting
+    void advance(uint32_t target); // Move to the first posting with an id >= target, skipping whole blocks
+
+private:
+    void enterBlock(uint32_t block); // Start decoding at the first posting of a block
+    void decode(); // Decode the posting at the read position
+
+    PostingView view; // Postings being read
+    const uint8_t* position; // Read position in the encoded postings
+    uint32_t block; // Current block
+    uint32_t remaining; // Postings left in the current block after the current one
+    uint32_t currentId; // File id of the current posting
+    uint32_t currentFrequency; // Frequency of the current posting
+    bool exhausted; // Whether the current posting is past the end
+};
+
+// Compressed, append-only list of (file id, frequency) postings sorted by file id
+class PostingList {
+public:
+    static constexpr uint32_t BLOCK_SIZE = 128; // Postings per block
+
+    PostingList(); // Constructor
+
+    void add(uint32_t id, uint32_t frequency); // Append a posting; ids must be strictly increasing
+    void merge(const std::vector<std::pair<uint32_t, uint32_t>>& postings); // Add sorted postings anywhere in the list, keeping the larger frequency of existing ids
+    bool remove(uint32_t id); // Remove a posting, returns false if the id is not in the list
+    void shrink(); // Release spare capacity once the list is complete
+
+    uint32_t size() const { return count; } // Number of postings
+    bool empty() const { return count == 0; } // Whether the list has no postings
+    uint32_t lastId() const { return last; } // Largest id in the list
+    uint32_t maxFrequency() const { return maxFreq; } // Largest frequency in the list
+    size_t memoryUsage() const; // Heap bytes held by the list
+    const std::vector<uint8_t>& encoded() const { return bytes; } // Encoded postings, for saving
+    const std::vector<PostingSkip>& skipTable() const { return skips; } // Skip entries, for saving
+    PostingView view() const; // View of the list for reading
+    std::vector<std::pair<uint32_t, uint32_t>> decodeAll() const; // Decode every posting
+
+private:
+    std::vector<uint8_t> bytes; // Encoded postings
+    std::vector<PostingSkip> skips; // One skip entry per block
+    uint32_t count; // Number of postings
+    uint32_t last; // Largest id in the list
+    uint32_t maxFreq; // Largest frequency in the list
+};
+
+#endif // POSTINGLIST_H // End of include guard
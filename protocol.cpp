@@ -0,0 +1,384 @@
+#include "protocol.h" // Include the protocol header
+
+#include <cerrno> // Include the cerrno library for EINTR
+#include <cstdio> // Include the cstdio library for hexadecimal floats
+#include <cstdlib> // Include the cstdlib library for strtod
+#include <sstream> // Include the sstream library for parsing query headers
+#include <sys/socket.h> // Include socket library
+#include <unistd.h> // Include POSIX operating system API
+
+namespace protocol {
+
+namespace {
+
+// Header fields after the required ones, " <facets>[ <budget>]", with facets written as 0 when only a budget is given
+std::string optionalFields(size_t facets, size_t budget) {
+    if (budget > 0) {
+        return " " + std::to_string(facets) + " " + std::to_string(budget);
+    }
+    return facets > 0 ? " " + std::to_string(facets) : "";
+}
+
+// Read the optional header fields; each left out reads as 0
+void readOptionalFields(std::istringstream& header, size_t* facets, size_t* budget) {
+    size_t wanted = 0; // Facet values of each kind
+    size_t milliseconds = 0; // Time budget
+    if (header >> wanted) {
+        if (!(header >> milliseconds)) { // No budget given
+            milliseconds = 0;
+        }
+    } else { // No facets asked for
+        wanted = 0;
+    }
+    if (facets) {
+        *facets = wanted;
+    }
+    if (budget) {
+        *budget = milliseconds;
+    }
+}
+
+}
+
+std::string frame(const std::string& payload) {
+    uint32_t length = static_cast<uint32_t>(payload.size());
+    std::string result(4, '\0'); // Big-endian length prefix
+    result[0] = static_cast<char>(length >> 24);
+    result[1] = static_cast<char>(length >> 16);
+    result[2] = static_cast<char>(length >> 8);
+    result[3] = static_cast<char>(length);
+    result += payload;
+    return result;
+}
+
+bool extractFrame(std::string& buffer, std::string& payload, bool& tooLarge) {
+    tooLarge = false;
+    if (buffer.size() < 4) { // Length not complete yet
+        return false;
+    }
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(buffer.data());
+    uint32_t length = (static_cast<uint32_t>(bytes[0]) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) | (static_cast<uint32_t>(bytes[2]) << 8) | bytes[3];
+    if (length > MAX_FRAME) { // Refuse oversized frames before buffering them
+        tooLarge = true;
+        return false;
+    }
+    if (buffer.size() < 4 + static_cast<size_t>(length)) { // Payload not complete yet
+        return false;
+    }
+    payload.assign(buffer, 4, length);
+    buffer.erase(0, 4 + static_cast<size_t>(length));
+    return true;
+}
+
+std::string encodeQuery(const std::string& query, size_t offset, size_t k, RequestType type, size_t facets, size_t budget) {
+    return std::string(1, type) + std::to_string(offset) + " " + std::to_string(k) + optionalFields(facets, budget) + "\n" + query;
+}
+
+bool decodeQuery(const std::string& body, std::string& query, size_t& offset, size_t& k, size_t* facets, size_t* budget) {
+    size_t newline = body.find('\n');
+    if (newline == std::string::npos) { // Missing header line
+        return false;
+    }
+    std::istringstream header(body.substr(0, newline));
+    if (!(header >> offset >> k)) { // Malformed header line
+        return false;
+    }
+    readOptionalFields(header, facets, budget);
+    query = body.substr(newline + 1);
+    return true;
+}
+
+namespace {
+
+// Read the line starting at position and move position past its newline
+bool nextLine(const std::string& body, size_t& position, std::string& line) {
+    size_t newline = body.find('\n', position);
+    if (newline == std::string::npos) {
+        return false;
+    }
+    line.assign(body, position, newline - position);
+    position = newline + 1;
+    return true;
+}
+
+// Append a document id in hexadecimal
+void appendId(std::string& out, uint64_t id) {
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(id));
+    out += hex;
+}
+
+// Append a field, escaping the characters that separate fields and lines
+void appendField(std::string& out, const std::string& field) {
+    out += '\t';
+    for (char c : field) {
+        if (c == '\\') {
+            out += "\\\\";
+        } else if (c == '\t') {
+            out += "\\t";
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out += c;
+        }
+    }
+}
+
+// Split a line into its tab-separated fields, undoing appendField
+void splitFields(const std::string& line, std::vector<std::string>& fields) {
+    fields.assign(1, std::string());
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (c == '\t') {
+            fields.emplace_back();
+        } else if (c == '\\' && i + 1 < line.size()) {
+            char next = line[++i];
+            fields.back() += next == 't' ? '\t' : next == 'n' ? '\n' : next;
+        } else {
+            fields.back() += c;
+        }
+    }
+}
+
+// Append one document line: id, path, title, date and URL, then last
+void appendDocument(std::string& out, const Document& document, const std::string& last) {
+    appendId(out, document.id);
+    for (const std::string* field : {&document.path, &document.title, &document.date, &document.url, &last}) {
+        appendField(out, *field);
+    }
+    out += '\n';
+}
+
+}
+
+std::string encodeResults(const std::vector<SearchResult>& results) {
+    std::string body;
+    for (const auto& result : results) {
+        appendDocument(body, result.document, result.snippet);
+    }
+    return body;
+}
+
+std::string encodeDocumentRequest(const std::vector<uint64_t>& ids) {
+    std::string payload(1, DOCUMENTS);
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (i > 0) {
+            payload += ' ';
+        }
+        appendId(payload, ids[i]);
+    }
+    return payload;
+}
+
+bool decodeDocumentRequest(const std::string& body, std::vector<uint64_t>& ids) {
+    ids.clear();
+    std::istringstream list(body);
+    std::string id;
+    while (list >> id) {
+        char* end = nullptr;
+        ids.push_back(std::strtoull(id.c_str(), &end, 16));
+        if (id.size() > 16 || *end != '\0') { // Not a hexadecimal id
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string encodeDocuments(const std::vector<Document>& documents) {
+    std::string body;
+    for (const auto& document : documents) {
+        if (!document.path.empty()) {
+            appendDocument(body, document, document.text);
+        }
+    }
+    return body;
+}
+
+bool decodeDocuments(const std::string& body, std::vector<Document>& documents) {
+    documents.clear();
+    size_t position = 0;
+    std::string line;
+    std::vector<std::string> fields;
+    while (nextLine(body, position, line)) {
+        splitFields(line, fields);
+        if (fields.size() != 6) {
+            return false;
+        }
+        Document document;
+        char* end = nullptr;
+        document.id = std::strtoull(fields[0].c_str(), &end, 16);
+        document.path = std::move(fields[1]);
+        document.title = std::move(fields[2]);
+        document.date = std::move(fields[3]);
+        document.url = std::move(fields[4]);
+        document.text = std::move(fields[5]);
+        documents.push_back(std::move(document));
+    }
+    return position == body.size(); // No partial line left over
+}
+
+std::string encodeStats(const CollectionStats& stats) {
+    std::string body = std::to_string(stats.fileCount) + " " + std::to_string(stats.documentFrequencies.size()) + "\n";
+    for (const auto& pair : stats.documentFrequencies) { // Terms never hold newlines
+        body += std::to_string(pair.second) + " " + pair.first + "\n";
+    }
+    return body;
+}
+
+bool decodeStats(const std::string& body, size_t& position, CollectionStats& stats) {
+    std::string line;
+    size_t termCount = 0;
+    if (!nextLine(body, position, line)) {
+        return false;
+    }
+    std::istringstream header(line);
+    if (!(header >> stats.fileCount >> termCount)) { // Malformed header line
+        return false;
+    }
+    stats.documentFrequencies.clear();
+    for (size_t i = 0; i < termCount; ++i) {
+        if (!nextLine(body, position, line)) {
+            return false;
+        }
+        size_t space = line.find(' ');
+        if (space == std::string::npos) {
+            return false;
+        }
+        stats.documentFrequencies[line.substr(space + 1)] = static_cast<uint32_t>(std::strtoul(line.c_str(), nullptr, 10));
+    }
+    return true;
+}
+
+std::string encodeTop(const std::string& query, const CollectionStats& stats, size_t count, size_t facets, size_t budget) {
+    return std::string(1, TOP) + std::to_string(count) + optionalFields(facets, budget) + "\n" + encodeStats(stats) + query;
+}
+
+bool decodeTop(const std::string& body, std::string& query, CollectionStats& stats, size_t& count, size_t* facets, size_t* budget) {
+    size_t position = 0;
+    std::string line;
+    if (!nextLine(body, position, line)) { // Missing count line
+        return false;
+    }
+    std::istringstream header(line);
+    if (!(header >> count)) {
+        return false;
+    }
+    readOptionalFields(header, facets, budget);
+    if (!decodeStats(body, position, stats)) {
+        return false;
+    }
+    query = body.substr(position);
+    return true;
+}
+
+std::string encodeScored(const std::vector<ScoredFile>& matches) {
+    std::string body;
+    char score[64];
+    for (const auto& match : matches) {
+        std::snprintf(score, sizeof(score), "%a", match.score); // Exact, so merged order matches a single engine
+        body += score;
+        body += ' ';
+        body += match.path;
+        body += '\n';
+    }
+    return body;
+}
+
+bool decodeScored(const std::string& body, std::vector<ScoredFile>& matches, size_t position) {
+    matches.clear();
+    std::string line;
+    while (nextLine(body, position, line)) {
+        size_t space = line.find(' ');
+        if (space == std::string::npos) {
+            return false;
+        }
+        matches.push_back({std::strtod(line.c_str(), nullptr), line.substr(space + 1)});
+    }
+    return position == body.size(); // No partial line left over
+}
+
+std::string encodeFacets(const Facets& facets) {
+    size_t count = 0;
+    for (const auto& values : facets.values) {
+        count += values.size();
+    }
+    std::string body = std::to_string(facets.matches) + " " + std::to_string(count) + "\n";
+    for (size_t kind = 0; kind < Facets::KIND_COUNT; ++kind) {
+        for (const auto& value : facets.values[kind]) {
+            body += Facets::NAMES[kind];
+            body += '\t';
+            body += std::to_string(value.second);
+            appendField(body, value.first); // Site names come from the indexed files
+            body += '\n';
+        }
+    }
+    return body;
+}
+
+bool decodeFacets(const std::string& body, size_t& position, Facets& facets) {
+    std::string line;
+    size_t count = 0;
+    if (!nextLine(body, position, line)) {
+        return false;
+    }
+    std::istringstream header(line);
+    if (!(header >> facets.matches >> count)) { // Malformed header line
+        return false;
+    }
+    for (auto& values : facets.values) {
+        values.clear();
+    }
+    std::vector<std::string> fields;
+    for (size_t i = 0; i < count; ++i) {
+        if (!nextLine(body, position, line)) {
+            return false;
+        }
+        splitFields(line, fields);
+        size_t kind = 0;
+        while (kind < Facets::KIND_COUNT && fields[0] != Facets::NAMES[kind]) {
+            ++kind;
+        }
+        if (fields.size() != 3 || kind == Facets::KIND_COUNT) {
+            return false;
+        }
+        facets.values[kind].emplace_back(std::move(fields[2]), static_cast<uint32_t>(std::strtoul(fields[1].c_str(), nullptr, 10)));
+    }
+    return true;
+}
+
+bool writeFrame(int fd, const std::string& payload) {
+    std::string data = frame(payload);
+    size_t sent = 0;
+    while (sent < data.size()) { // Send until the whole frame is written
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool readFrame(int fd, std::string& buffer, std::string& payload) {
+    char chunk[65536];
+    bool tooLarge = false;
+    while (!extractFrame(buffer, payload, tooLarge)) { // Read until a whole frame has arrived
+        if (tooLarge) {
+            return false;
+        }
+        ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+    return true;
+}
+
+}
@@ -0,0 +1,85 @@
+#ifndef PROTOCOL_H // Include guard to prevent multiple inclusions of this header file
+#define PROTOCOL_H // Define the include guard
+
+#include <cstddef> // Include the cstddef library for size_t
+#include <cstdint> // Include the cstdint library for fixed width integers
+#include <string> // Include the string library
+#include <vector> // Include the vector library
+#include "searcher.h" // Include scored matches and collection statistics
+
+// Wire format between socketSearch and its clients.
+//
+// Every message is a frame: a 4-byte big-endian payload length followed by the payload.
+// A connection stays open for any number of frames, and a client may send several requests
+// before reading the responses, which come back in request order.
+//
+// Request payload:  type byte, then the body
+//   'Q'  query       "<offset> <k>[ 0 <budget>]\n<query text>"
+//   'R'  results     "<offset> <k>[ <facets>[ <budget>]]\n<query text>"  (facets: values wanted of each kind, none when left out or 0)
+//   'D'  documents   "<id> <id> ..."                          (document ids in hexadecimal)
+//   'S'  stats       "<query text>"                          (first phase of a sharded search)
+//   'T'  top         "<count>[ <facets>[ <budget>]]\n<stats><query text>" (second phase, scored with the summed stats)
+//   'M'  metrics     empty
+//   budget: milliseconds the client will wait, bounding the server's own deadline; none when left out or 0
+// Response payload: status byte, then the body
+//   OK               'Q': newline-separated file paths
+//                    'R': "<id>\t<path>\t<title>\t<date>\t<url>\t<snippet>\n" per match, best first
+//                    'D': "<id>\t<path>\t<title>\t<date>\t<url>\t<text>\n" per document found, in request order
+//                    'S': stats, "<fileCount> <terms>\n" then "<df> <term>\n" per term
+//                    'T': "<score> <path>\n" per match, best first, scores as hexadecimal floats so they survive exactly
+//                    'M': counters, stage latency histograms and index sizes in the Prometheus text format
+//                    'R' and 'T' asked for facets start with them: "<matches> <values>\n" then
+//                    "<kind>\t<count>\t<clause>\n" per value, kind being org, person, site or month, most first
+//   PARTIAL          as OK, from the matches found before the request's deadline passed
+//   BAD_REQUEST      error message
+//   OVERLOADED       error message; the request was refused before it ran, its queue being full or its
+//                    deadline passed while it waited, and may be sent again later
+// Document fields escape backslashes, tabs and newlines as \\, \t and \n. Snippets mark highlighted
+// words with the bytes snippet::HIGHLIGHT_START and snippet::HIGHLIGHT_END.
+namespace protocol {
+
+constexpr uint32_t MAX_FRAME = 16 * 1024 * 1024; // Largest payload accepted, larger frames close the connection
+
+enum RequestType : char { // First byte of a request payload
+    QUERY = 'Q',
+    RESULTS = 'R',
+    DOCUMENTS = 'D',
+    STATS = 'S',
+    TOP = 'T',
+    METRICS = 'M',
+};
+
+enum Status : char { // First byte of a response payload
+    OK = 0,
+    BAD_REQUEST = 1,
+    PARTIAL = 2,
+    OVERLOADED = 3,
+};
+
+std::string frame(const std::string& payload); // Prefix a payload with its length
+bool extractFrame(std::string& buffer, std::string& payload, bool& tooLarge); // Remove the first complete frame from buffer, returns false if there is none yet
+
+std::string encodeQuery(const std::string& query, size_t offset, size_t k, RequestType type = QUERY, size_t facets = 0, size_t budget = 0); // Build a query or results request payload, asking for facets values of each kind within budget milliseconds
+bool decodeQuery(const std::string& body, std::string& query, size_t& offset, size_t& k, size_t* facets = nullptr, size_t* budget = nullptr); // Parse the body of a query or results request; facets and budget get 0 when left out
+std::string encodeResults(const std::vector<SearchResult>& results); // Serialize results with their snippets
+
+std::string encodeDocumentRequest(const std::vector<uint64_t>& ids); // Build a documents request payload
+bool decodeDocumentRequest(const std::string& body, std::vector<uint64_t>& ids); // Parse the body of a documents request
+std::string encodeDocuments(const std::vector<Document>& documents); // Serialize documents, leaving out those with an empty path
+bool decodeDocuments(const std::string& body, std::vector<Document>& documents); // Parse documents
+
+std::string encodeStats(const CollectionStats& stats); // Serialize collection statistics
+bool decodeStats(const std::string& body, size_t& position, CollectionStats& stats); // Parse statistics starting at position, which is moved past them
+std::string encodeTop(const std::string& query, const CollectionStats& stats, size_t count, size_t facets = 0, size_t budget = 0); // Build a top request payload, asking for facets values of each kind within budget milliseconds
+bool decodeTop(const std::string& body, std::string& query, CollectionStats& stats, size_t& count, size_t* facets = nullptr, size_t* budget = nullptr); // Parse the body of a top request; facets and budget get 0 when left out
+std::string encodeScored(const std::vector<ScoredFile>& matches); // Serialize scored matches
+bool decodeScored(const std::string& body, std::vector<ScoredFile>& matches, size_t position = 0); // Parse scored matches from position to the end
+std::string encodeFacets(const Facets& facets); // Serialize facet counts
+bool decodeFacets(const std::string& body, size_t& position, Facets& facets); // Parse facet counts starting at position, which is moved past them
+
+bool writeFrame(int fd, const std::string& payload); // Send a frame on a blocking socket
+bool readFrame(int fd, std::string& buffer, std::string& payload); // Receive a frame from a blocking socket; buffer keeps bytes of later frames between calls
+
+}
+
+#endif // PROTOCOL_H // End of include guard
@@ -0,0 +1,1532 @@
+#include "query.h" // Include the query header
+
+#include <algorithm> // Include the algorithm library
+#include <cctype> // Include the cctype library for std::isspace
+#include <charconv> // Include the charconv library for writing distances without allocating
+#include <cmath> // Include the cmath library for std::log
+#include <cstdio> // Include the cstdio library for writing boosts
+#include <cstdlib> // Include the cstdlib library for reading boosts
+#include <numeric> // Include the numeric library for std::iota
+#include <optional> // Include the optional library for groups without filters
+#include <unordered_map> // Include the unordered_map library for facet counts
+#include "deadline.h" // Include the request deadline checked while walking postings
+#include "metrics.h" // Include the stage timers
+#include "tokenizer.h" // Include the word splitter shared with ingestion
+
+namespace {
+
+using Tokens = std::pmr::vector<std::pmr::string>; // Tokens of a query, in query scratch memory
+using Operands = std::pmr::vector<std::unique_ptr<DocIterator>>; // Iterators combined by another, in query scratch memory
+
+constexpr uint32_t OPEN_END = 99999999; // Last date of a range left open at the end
+
+// Split a query into terms, operators and parentheses; a '-' at the start of a token becomes NOT,
+// and quoted text stays in one token with its quotes
+Tokens tokenize(const std::string& query) {
+    Tokens tokens(QueryArena::current()); // Tokens in order
+    std::pmr::string current(QueryArena::current()); // Token being read
+    bool quoted = false; // Whether an opening quote has not been closed yet
+    auto flush = [&]() { // Finish the current token
+        if (!current.empty()) {
+            tokens.push_back(current);
+            current.clear();
+        }
+    };
+    for (char ch : query) { // Iterate over each character
+        if (ch == '"') { // Quotes toggle, a missing closing quote runs to the end
+            quoted = !quoted;
+            current += ch;
+        } else if (quoted) { // Spaces and parentheses are part of a phrase
+            current += ch;
+        } else if (std::isspace(static_cast<unsigned char>(ch))) {
+            flush();
+        } else if (ch == '(' || ch == ')') { // Parentheses are tokens on their own
+            flush();
+            tokens.emplace_back(size_t(1), ch);
+        } else if (ch == '-' && current.empty()) { // Leading minus excludes the next operand
+            tokens.emplace_back("NOT");
+        } else {
+            current += ch;
+        }
+    }
+    flush();
+    return tokens; // Return the tokens
+}
+
+// Recursive descent parser over the tokens of one query
+class Parser {
+public:
+    explicit Parser(Tokens tokens) : tokens(std::move(tokens)), position(0) {}
+
+    // query := or { ")" or }, stray closing parentheses are ignored
+    std::unique_ptr<QueryNode> parseQuery() {
+        auto root = std::make_unique<QueryNode>();
+        root->type = QueryNode::OR;
+        while (position < tokens.size()) {
+            if (tokens[position] == ")") {
+                ++position;
+                continue;
+            }
+            add(*root, parseOr());
+        }
+        return simplify(std::move(root));
+    }
+
+private:
+    // or := and { ["OR"] and }, adjacent operands are ORed
+    std::unique_ptr<QueryNode> parseOr() {
+        auto node = std::make_unique<QueryNode>();
+        node->type = QueryNode::OR;
+        add(*node, parseAnd());
+        while (position < tokens.size() && tokens[position] != ")") {
+            if (tokens[position] == "OR") {
+                ++position;
+                continue;
+            }
+            add(*node, parseAnd());
+        }
+        return simplify(std::move(node));
+    }
+
+    // and := near { "AND" near }
+    std::unique_ptr<QueryNode> parseAnd() {
+        auto node = std::make_unique<QueryNode>();
+        node->type = QueryNode::AND;
+        add(*node, parseNear());
+        while (position < tokens.size() && tokens[position] == "AND") {
+            ++position;
+            add(*node, parseNear());
+        }
+        return simplify(std::move(node));
+    }
+
+    // near := unary { "NEAR/k" unary }, a chain of NEARs takes the largest k
+    std::unique_ptr<QueryNode> parseNear() {
+        std::unique_ptr<QueryNode> first = parseUnary();
+        uint32_t distance;
+        if (position >= tokens.size() || !nearDistance(tokens[position], distance)) { // Not a NEAR
+            return first;
+        }
+        auto node = std::make_unique<QueryNode>();
+        node->type = QueryNode::NEAR;
+        addNear(*node, std::move(first));
+        while (position < tokens.size() && nearDistance(tokens[position], distance)) {
+            ++position;
+            node->distance = std::max(node->distance, distance);
+            addNear(*node, parseUnary());
+        }
+        bool positional = true; // NEAR needs terms of one field, anything else is an AND
+        for (const auto& child : node->children) {
+            positional = positional && child->type == QueryNode::TERM && child->field == node->children.front()->field;
+        }
+        if (!positional) {
+            auto flattened = std::make_unique<QueryNode>(); // Flatten AND operands into the new AND
+            flattened->type = QueryNode::AND;
+            for (auto& child : node->children) {
+                add(*flattened, std::move(child));
+            }
+            return simplify(std::move(flattened));
+        }
+        return simplify(std::move(node));
+    }
+
+    // Add an operand to a NEAR, flattening a nested NEAR into it with the larger distance
+    static void addNear(QueryNode& parent, std::unique_ptr<QueryNode> child) {
+        if (child && child->type == QueryNode::NEAR) {
+            parent.distance = std::max(parent.distance, child->distance);
+        }
+        add(parent, std::move(child));
+    }
+
+    // Read the k of a "NEAR/k" operator, returns false for any other token
+    static bool nearDistance(std::string_view token, uint32_t& distance) {
+        if (token.size() <= 5 || token.compare(0, 5, "NEAR/") != 0 || token.size() > 14) {
+            return false;
+        }
+        distance = 0;
+        for (size_t i = 5; i < token.size(); ++i) {
+            if (!std::isdigit(static_cast<unsigned char>(token[i]))) {
+                return false;
+            }
+            distance = distance * 10 + static_cast<uint32_t>(token[i] - '0');
+        }
+        return distance > 0;
+    }
+
+    // unary := "NOT" unary | "(" or ")" | term
+    std::unique_ptr<QueryNode> parseUnary() {
+        if (position >= tokens.size()) { // Dangling operator
+            return nullptr;
+        }
+        const std::pmr::string& token = tokens[position++];
+        if (token == "NOT") {
+            std::unique_ptr<QueryNode> operand = parseUnary();
+            if (!operand) {
+                return nullptr;
+            }
+            auto node = std::make_unique<QueryNode>();
+            node->type = QueryNode::NOT;
+            node->children.push_back(std::move(operand));
+            return node;
+        }
+        if (token == "(") {
+            std::unique_ptr<QueryNode> node = parseOr();
+            if (position < tokens.size() && tokens[position] == ")") { // A missing closing parenthesis is tolerated
+                ++position;
+            }
+            return node;
+        }
+        uint32_t distance;
+        if (token == "AND" || token == "OR" || token == ")" || nearDistance(token, distance)) { // Operator without a left operand
+            return nullptr;
+        }
+        return makeTerm(token);
+    }
+
+    // Lowercase a term and split off its field prefix; quoted text becomes a phrase of its words
+    static std::unique_ptr<QueryNode> makeTerm(std::string_view token) {
+        std::pmr::string term(token, QueryArena::current());
+        tokenizer::fold(&term[0], term.size()); // Lowercase the term as indexed words are
+        if (term.rfind("date:", 0) == 0) {
+            return makeDate(std::string_view(term).substr(5));
+        }
+        if (term.rfind("site:", 0) == 0) {
+            if (term.size() == 5) { // A bare prefix matches nothing
+                return nullptr;
+            }
+            auto node = std::make_unique<QueryNode>();
+            node->type = QueryNode::SITE;
+            node->term.assign(term, 5);
+            return node;
+        }
+        if (term.rfind("org=", 0) == 0 || term.rfind("person=", 0) == 0) {
+            return makeEntity(term);
+        }
+        auto node = std::make_unique<QueryNode>();
+        node->type = QueryNode::TERM;
+        size_t caret = term.rfind('^');
+        if (caret != std::string::npos && caret > 0 && parseBoost(std::string_view(term).substr(caret + 1), node->boost)) {
+            term.resize(caret);
+        }
+        if (term.rfind("org:", 0) == 0) {
+            node->field = indexfile::ORG;
+            term.erase(0, 4);
+        } else if (term.rfind("person:", 0) == 0) {
+            node->field = indexfile::NAME;
+            term.erase(0, 7);
+        }
+        if (term.find('"') != std::string::npos) { // Split a phrase into words the way files are split
+            node->type = QueryNode::PHRASE;
+            std::pmr::vector<tokenizer::Word> words(QueryArena::current());
+            tokenizer::split(&term[0], term.size(), words); // Quotes are punctuation, trimmed like any other
+            for (const tokenizer::Word& word : words) {
+                if (word.text.empty()) {
+                    continue;
+                }
+                auto child = std::make_unique<QueryNode>();
+                child->type = QueryNode::TERM;
+                child->field = node->field;
+                child->boost = node->boost;
+                child->term.assign(word.text.data(), word.text.size());
+                node->children.push_back(std::move(child));
+            }
+            if (node->children.size() == 1) { // A quoted word is just the word
+                return std::move(node->children.front());
+            }
+            return node->children.empty() ? nullptr : std::move(node);
+        }
+        if (term.empty()) { // A bare prefix matches nothing
+            return nullptr;
+        }
+        if (term.find('*') != std::string::npos) { // A pattern
+            if (term.find_first_not_of('*') == std::string::npos) { // Every word, too broad to expand
+                return nullptr;
+            }
+            node->type = QueryNode::WILDCARD;
+            node->term = term;
+            return node;
+        }
+        size_t tilde = term.rfind('~');
+        if (tilde != std::string::npos && tilde > 0 && term.find_first_not_of("0123456789", tilde + 1) == std::string::npos) { // A fuzzy word, with the default distance if none is given
+            size_t digits = term.size() - tilde - 1;
+            uint32_t edits = 0;
+            for (size_t i = tilde + 1; i < term.size() && digits <= 2; ++i) {
+                edits = edits * 10 + static_cast<uint32_t>(term[i] - '0');
+            }
+            node->distance = digits == 0 || digits > 2 ? MAX_EDITS : std::min<uint32_t>(MAX_EDITS, edits);
+            node->type = node->distance == 0 ? QueryNode::TERM : QueryNode::FUZZY;
+            term.resize(tilde);
+        }
+        node->term = term;
+        return node;
+    }
+
+    // An ENTITY filter for each word of "org=..." or "person=...", ANDed when there are several
+    static std::unique_ptr<QueryNode> makeEntity(std::pmr::string& term) {
+        size_t equals = term.find('=');
+        indexfile::Field field = term[0] == 'o' ? indexfile::ORG : indexfile::NAME;
+        std::pmr::vector<tokenizer::Word> words(QueryArena::current());
+        tokenizer::split(&term[equals + 1], term.size() - equals - 1, words); // Quotes and other punctuation are trimmed like indexed words
+        auto all = std::make_unique<QueryNode>();
+        all->type = QueryNode::AND;
+        for (const tokenizer::Word& word : words) {
+            if (word.text.empty()) {
+                continue;
+            }
+            auto node = std::make_unique<QueryNode>();
+            node->type = QueryNode::ENTITY;
+            node->field = field;
+            node->term.assign(word.text.data(), word.text.size());
+            all->children.push_back(std::move(node));
+        }
+        return simplify(std::move(all));
+    }
+
+    // A DATE filter of "from..to", either end of which may be left open, or of the one period "date"
+    static std::unique_ptr<QueryNode> makeDate(std::string_view value) {
+        auto node = std::make_unique<QueryNode>();
+        node->type = QueryNode::DATE;
+        size_t dots = value.find("..");
+        bool range = dots != std::string_view::npos;
+        std::string_view low = range ? value.substr(0, dots) : value;
+        std::string_view high = range ? value.substr(dots + 2) : value;
+        node->from = 0;
+        node->to = OPEN_END;
+        if ((!range && value.empty()) || (!low.empty() && !parseDate(low, false, node->from)) || (!high.empty() && !parseDate(high, true, node->to)) || node->from > node->to) {
+            return nullptr; // Not a date, filters nothing
+        }
+        return node;
+    }
+
+    // Read a YYYY, YYYY-MM or YYYY-MM-DD date as yyyymmdd, or the eight digits of one as written by toString;
+    // a missing month or day is 00, or 99 at the end of a range, so the range covers the whole period
+    static bool parseDate(std::string_view text, bool end, uint32_t& date) {
+        if (text.size() == 8 && text.find_first_not_of("0123456789") == std::string_view::npos) {
+            date = 0;
+            for (char c : text) {
+                date = date * 10 + static_cast<uint32_t>(c - '0');
+            }
+            return true;
+        }
+        uint32_t parts[3] = {0, end ? 99u : 0u, end ? 99u : 0u}; // Year, month and day
+        for (size_t part = 0; part < 3; ++part) {
+            size_t dash = text.find('-');
+            std::string_view digits = text.substr(0, dash);
+            if (digits.empty() || digits.size() > (part == 0 ? 4u : 2u) || (part == 0 && digits.size() != 4) || digits.find_first_not_of("0123456789") != std::string_view::npos) {
+                return false;
+            }
+            parts[part] = 0;
+            for (char c : digits) {
+                parts[part] = parts[part] * 10 + static_cast<uint32_t>(c - '0');
+            }
+            if ((part == 1 && (parts[1] < 1 || parts[1] > 12)) || (part == 2 && (parts[2] < 1 || parts[2] > 31))) {
+                return false;
+            }
+            if (dash == std::string_view::npos) {
+                date = parts[0] * 10000 + parts[1] * 100 + parts[2];
+                return true;
+            }
+            text.remove_prefix(dash + 1);
+        }
+        return false; // More than three parts
+    }
+
+    // Read the number of a "^boost" suffix: digits with at most one decimal point, above 0 and at most 1000
+    static bool parseBoost(std::string_view digits, double& boost) {
+        if (digits.empty() || digits.size() > 16 || digits.find_first_not_of("0123456789.") != std::string_view::npos || digits.find('.') != digits.rfind('.') || digits == ".") {
+            return false;
+        }
+        char text[17]; // Null-terminated copy for strtod
+        digits.copy(text, digits.size());
+        text[digits.size()] = '\0';
+        double value = std::strtod(text, nullptr);
+        if (!(value > 0 && value <= 1000)) {
+            return false;
+        }
+        boost = value;
+        return true;
+    }
+
+    // Add an operand, flattening nested nodes of the same type
+    static void add(QueryNode& parent, std::unique_ptr<QueryNode> child) {
+        if (!child) {
+            return;
+        }
+        if (child->type == parent.type) {
+            for (auto& grandchild : child->children) {
+                parent.children.push_back(std::move(grandchild));
+            }
+            return;
+        }
+        parent.children.push_back(std::move(child));
+    }
+
+    // Drop duplicate operands and collapse nodes with a single operand; operands are ordered by their canonical text
+    static std::unique_ptr<QueryNode> simplify(std::unique_ptr<QueryNode> node) {
+        size_t count = node->children.size();
+        std::pmr::vector<std::pmr::string> keys(count, QueryArena::current()); // Canonical text of each operand, written once
+        for (size_t i = 0; i < count; ++i) {
+            node->children[i]->appendString(keys[i]);
+        }
+        std::pmr::vector<size_t> order(count, QueryArena::current());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a] < keys[b]; });
+        std::pmr::vector<std::unique_ptr<QueryNode>> children(QueryArena::current());
+        for (size_t i = 0; i < count; ++i) {
+            if (i == 0 || keys[order[i]] != keys[order[i - 1]]) {
+                children.push_back(std::move(node->children[order[i]]));
+            }
+        }
+        node->children.swap(children);
+        if (node->children.empty()) {
+            return nullptr;
+        }
+        if (node->children.size() == 1) {
+            return std::move(node->children.front());
+        }
+        return node;
+    }
+
+    Tokens tokens; // Tokens of the query
+    size_t position; // Next token to read
+};
+
+// Matches nothing
+class EmptyIterator : public DocIterator {
+public:
+    bool atEnd() const override { return true; }
+    uint32_t id() const override { return 0; }
+    void next() override {}
+    void advance(uint32_t) override {}
+    double score() const override { return 0; }
+    uint32_t cost() const override { return 0; }
+};
+
+// Files in one posting list, scored by their impacts; removed files are skipped
+class TermIterator : public DocIterator {
+public:
+    TermIterator(const PostingView& postings, const WordMap& wordMap, double weight) : cursor(postings.cursor()), count(postings.count), wordMap(wordMap), weight(weight) {
+        skipRemoved();
+    }
+
+    bool atEnd() const override { return cursor.atEnd(); }
+    uint32_t id() const override { return cursor.id(); }
+    void next() override {
+        cursor.next();
+        skipRemoved();
+    }
+    void advance(uint32_t target) override {
+        cursor.advance(target);
+        skipRemoved();
+    }
+    double score() const override { return weight * cursor.frequency(); }
+    uint32_t cost() const override { return count; }
+
+private:
+    void skipRemoved() { // Move past tombstoned files
+        if (wordMap.removedCount() == 0) {
+            return;
+        }
+        while (!cursor.atEnd() && wordMap.isRemoved(cursor.id())) {
+            cursor.next();
+        }
+    }
+
+    PostingView::Cursor cursor; // Position in the posting list
+    uint32_t count; // Number of postings
+    const WordMap& wordMap; // Source of removed files
+    double weight; // Score of one unit of impact
+};
+
+// Files matching every operand, scored by the sum of their scores.
+// Operands are ordered rarest first, and the others skip straight to each candidate,
+// so the rarest operand bounds the work.
+class AndIterator : public DocIterator {
+public:
+    explicit AndIterator(Operands operands) : operands(std::move(operands)) {
+        std::sort(this->operands.begin(), this->operands.end(), [](const auto& a, const auto& b) { return a->cost() < b->cost(); });
+        align();
+    }
+
+    bool atEnd() const override { return ended || operands.front()->atEnd(); }
+    uint32_t id() const override { return operands.front()->id(); }
+    void next() override {
+        if (ended) {
+            return;
+        }
+        operands.front()->next();
+        align();
+    }
+    void advance(uint32_t target) override {
+        if (ended) {
+            return;
+        }
+        operands.front()->advance(target);
+        align();
+    }
+    double score() const override {
+        double total = 0;
+        for (const auto& operand : operands) {
+            total += operand->score();
+        }
+        return total;
+    }
+    uint32_t cost() const override { return operands.front()->cost(); }
+
+private:
+    // Move forward until every operand is on the same id
+    void align() {
+        DocIterator& lead = *operands.front();
+        while (!lead.atEnd()) {
+            if (deadline.expired()) { // Out of time; the matches found so far are returned
+                ended = true;
+                return;
+            }
+            uint32_t candidate = lead.id();
+            bool matched = true;
+            for (size_t i = 1; i < operands.size(); ++i) {
+                DocIterator& other = *operands[i];
+                other.advance(candidate);
+                if (other.atEnd()) { // No more matches are possible
+                    ended = true;
+                    return;
+                }
+                if (other.id() != candidate) { // Skip the lead to the other operand's id
+                    lead.advance(other.id());
+                    matched = false;
+                    break;
+                }
+            }
+            if (matched) {
+                return;
+            }
+        }
+    }
+
+    Operands operands; // Operands, rarest first
+    bool ended = false; // Whether an operand ran out or the deadline passed, so nothing else is returned
+    DeadlineCheck deadline; // Deadline of the request
+};
+
+// Files matching any operand, scored by the sum of the scores of the operands that match
+class OrIterator : public DocIterator {
+public:
+    explicit OrIterator(Operands operands) : operands(std::move(operands)) {
+        findCurrent();
+    }
+
+    bool atEnd() const override { return ended; }
+    uint32_t id() const override { return current; }
+    void next() override {
+        for (auto& operand : operands) {
+            if (!operand->atEnd() && operand->id() == current) {
+                operand->next();
+            }
+        }
+        findCurrent();
+    }
+    void advance(uint32_t target) override {
+        for (auto& operand : operands) {
+            operand->advance(target);
+        }
+        findCurrent();
+    }
+    double score() const override {
+        double total = 0;
+        for (const auto& operand : operands) {
+            if (!operand->atEnd() && operand->id() == current) {
+                total += operand->score();
+            }
+        }
+        return total;
+    }
+    uint32_t cost() const override {
+        uint32_t total = 0;
+        for (const auto& operand : operands) {
+            total += operand->cost();
+        }
+        return total;
+    }
+
+private:
+    // The current match is the smallest id of any operand
+    void findCurrent() {
+        ended = true;
+        for (const auto& operand : operands) {
+            if (!operand->atEnd() && (ended || operand->id() < current)) {
+                current = operand->id();
+                ended = false;
+            }
+        }
+    }
+
+    Operands operands; // Operands
+    uint32_t current = 0; // Current match
+    bool ended = true; // Whether every operand is exhausted
+};
+
+// Files matching one iterator but not another; only ids the first produces are looked up in the second
+class AndNotIterator : public DocIterator {
+public:
+    AndNotIterator(std::unique_ptr<DocIterator> include, std::unique_ptr<DocIterator> exclude) : include(std::move(include)), exclude(std::move(exclude)) {
+        skipExcluded();
+    }
+
+    bool atEnd() const override { return ended || include->atEnd(); }
+    uint32_t id() const override { return include->id(); }
+    void next() override {
+        if (ended) {
+            return;
+        }
+        include->next();
+        skipExcluded();
+    }
+    void advance(uint32_t target) override {
+        if (ended) {
+            return;
+        }
+        include->advance(target);
+        skipExcluded();
+    }
+    double score() const override { return include->score(); }
+    uint32_t cost() const override { return include->cost(); }
+
+private:
+    void skipExcluded() {
+        while (!include->atEnd()) {
+            if (deadline.expired()) { // Out of time, as when every remaining file is excluded
+                ended = true;
+                return;
+            }
+            exclude->advance(include->id());
+            if (exclude->atEnd() || exclude->id() != include->id()) {
+                return;
+            }
+            include->next();
+        }
+    }
+
+    std::unique_ptr<DocIterator> include; // Files to return
+    std::unique_ptr<DocIterator> exclude; // Files to leave out
+    bool ended = false; // Whether the deadline passed, so nothing else is returned
+    DeadlineCheck deadline; // Deadline of the request
+};
+
+// Files matching every word of a phrase or NEAR whose positions line up; positions are only read for files
+// that have every word, so the posting lists do the skipping
+class PositionalIterator : public DocIterator {
+public:
+    PositionalIterator(std::unique_ptr<DocIterator> inner, const std::pmr::vector<PositionView>& views, bool phrase, uint32_t distance) : inner(std::move(inner)), phrase(phrase), distance(distance), positions(views.size(), QueryArena::current()) {
+        for (const PositionView& view : views) {
+            cursors.push_back(view.cursor());
+        }
+        skipMismatches();
+    }
+
+    bool atEnd() const override { return ended || inner->atEnd(); }
+    uint32_t id() const override { return inner->id(); }
+    void next() override {
+        if (ended) {
+            return;
+        }
+        inner->next();
+        skipMismatches();
+    }
+    void advance(uint32_t target) override {
+        if (ended) {
+            return;
+        }
+        inner->advance(target);
+        skipMismatches();
+    }
+    double score() const override { return inner->score(); }
+    uint32_t cost() const override { return inner->cost(); }
+
+private:
+    void skipMismatches() {
+        while (!inner->atEnd() && !matches(inner->id())) {
+            if (deadline.expired()) { // Out of time; the matches found so far are returned
+                ended = true;
+                return;
+            }
+            inner->next();
+        }
+    }
+
+    // Whether the words' positions in a file that has all of them line up
+    bool matches(uint32_t id) {
+        for (size_t i = 0; i < cursors.size(); ++i) {
+            cursors[i].advance(id);
+            if (cursors[i].atEnd() || cursors[i].id() != id) { // Positions were not recorded for the file
+                return false;
+            }
+            cursors[i].positions(positions[i]);
+        }
+        if (phrase) { // Word i must be at the first word's position plus i
+            for (uint32_t start : positions.front()) {
+                bool found = true;
+                for (size_t i = 1; i < positions.size() && found; ++i) {
+                    found = std::binary_search(positions[i].begin(), positions[i].end(), start + static_cast<uint32_t>(i));
+                }
+                if (found) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        heads.assign(positions.size(), 0); // Smallest window holding one position of each word: move the lowest word forward until the span fits
+        for (;;) {
+            size_t lowest = 0;
+            uint32_t highest = 0;
+            for (size_t i = 0; i < positions.size(); ++i) {
+                uint32_t position = positions[i][heads[i]];
+                if (position < positions[lowest][heads[lowest]]) {
+                    lowest = i;
+                }
+                highest = std::max(highest, position);
+            }
+            if (highest - positions[lowest][heads[lowest]] <= distance) {
+                return true;
+            }
+            if (++heads[lowest] == positions[lowest].size()) {
+                return false;
+            }
+        }
+    }
+
+    std::unique_ptr<DocIterator> inner; // Files with every word
+    bool phrase; // Whether the words must be adjacent and in order, rather than within distance of each other
+    uint32_t distance; // Largest span of a NEAR
+    std::pmr::vector<PositionView::Cursor> cursors{QueryArena::current()}; // Position lists of the words, in query order
+    std::pmr::vector<std::pmr::vector<uint32_t>> positions; // Positions of each word in the current file
+    std::pmr::vector<size_t> heads{QueryArena::current()}; // Window position in each list, reused for every file
+    bool ended = false; // Whether the deadline passed, so nothing else is returned
+    DeadlineCheck deadline; // Deadline of the request
+};
+
+// Files containing any of the words a WILDCARD or FUZZY node expands to. The words' posting lists are
+// merged through a heap ordered by their current ids, so no list is materialized, and a file scores as
+// its best word.
+class ExpansionIterator : public DocIterator {
+public:
+    struct Word {
+        PostingView::Cursor cursor; // Position in the word's postings
+        double weight; // Score of one unit of impact, lower for more distant fuzzy words
+    };
+
+    ExpansionIterator(std::pmr::vector<Word> words, uint32_t count, const WordMap& wordMap) : words(std::move(words)), count(count), wordMap(wordMap) {
+        for (size_t i = 0; i < this->words.size(); ++i) {
+            push(i);
+        }
+        settle();
+        skipRemoved();
+    }
+
+    bool atEnd() const override { return ended; }
+    uint32_t id() const override { return current; }
+    void next() override {
+        step();
+        skipRemoved();
+    }
+    void advance(uint32_t target) override {
+        if (ended || current >= target) {
+            return;
+        }
+        for (size_t i : matching) { // Words on the current file
+            words[i].cursor.advance(target);
+            push(i);
+        }
+        while (!heap.empty() && words[heap.front()].cursor.id() < target) { // Words still before the target
+            size_t i = pop();
+            words[i].cursor.advance(target);
+            push(i);
+        }
+        settle();
+        skipRemoved();
+    }
+    double score() const override {
+        double best = 0;
+        for (size_t i : matching) {
+            best = std::max(best, words[i].weight * words[i].cursor.frequency());
+        }
+        return best;
+    }
+    uint32_t cost() const override { return count; }
+
+private:
+    // Heap order: the word with the smallest current id on top
+    bool later(size_t a, size_t b) const { return words[a].cursor.id() > words[b].cursor.id(); }
+
+    void push(size_t i) { // Queue a word unless its postings are exhausted
+        if (!words[i].cursor.atEnd()) {
+            heap.push_back(i);
+            std::push_heap(heap.begin(), heap.end(), [this](size_t a, size_t b) { return later(a, b); });
+        }
+    }
+
+    size_t pop() { // Take the word with the smallest id
+        std::pop_heap(heap.begin(), heap.end(), [this](size_t a, size_t b) { return later(a, b); });
+        size_t i = heap.back();
+        heap.pop_back();
+        return i;
+    }
+
+    void settle() { // Take every word on the smallest id off the heap
+        matching.clear();
+        if (heap.empty()) {
+            ended = true;
+            return;
+        }
+        current = words[heap.front()].cursor.id();
+        while (!heap.empty() && words[heap.front()].cursor.id() == current) {
+            matching.push_back(pop());
+        }
+    }
+
+    void step() { // Move every word on the current file forward
+        for (size_t i : matching) {
+            words[i].cursor.next();
+            push(i);
+        }
+        settle();
+    }
+
+    void skipRemoved() { // Move past tombstoned files
+        if (wordMap.removedCount() == 0) {
+            return;
+        }
+        while (!ended && wordMap.isRemoved(current)) {
+            step();
+        }
+    }
+
+    std::pmr::vector<Word> words; // Words of the expansion
+    uint32_t count; // Total number of postings
+    const WordMap& wordMap; // Source of removed files
+    std::pmr::vector<size_t> heap{QueryArena::current()}; // Words not on the current file, by current id
+    std::pmr::vector<size_t> matching{QueryArena::current()}; // Words on the current file
+    uint32_t current = 0; // Current file
+    bool ended = false; // Whether every word is exhausted
+};
+
+// Add the files having a term to an empty set, read as saved when the term is common
+void termFiles(indexfile::Field field, std::string_view term, const WordMap& wordMap, Roaring& files) {
+    uint32_t id = wordMap.findTerm(term);
+    if (wordMap.getPresence(field, id, files)) {
+        return;
+    }
+    for (PostingView::Cursor cursor = wordMap.getPostings(field, id).cursor(); !cursor.atEnd(); cursor.next()) {
+        files.add(cursor.id());
+    }
+    files.optimize();
+}
+
+// Add the files passing a filter node to an empty set
+void filterFiles(const QueryNode& node, const WordMap& wordMap, Roaring& files) {
+    if (node.type == QueryNode::DATE) {
+        wordMap.matchDates(node.from, node.to, files);
+    } else if (node.type == QueryNode::SITE) {
+        wordMap.matchSite(node.term, files);
+    } else { // The files whose names in the field have the word
+        termFiles(node.field, node.term, wordMap, files);
+    }
+}
+
+// Files passing every filter operand of a group, or nothing when it has none
+std::optional<Roaring> groupFilter(const QueryNode& node, const WordMap& wordMap) {
+    std::optional<Roaring> files;
+    for (const auto& child : node.children) {
+        if (!child->isFilter()) {
+            continue;
+        }
+        if (!files) {
+            files.emplace(QueryArena::current());
+            filterFiles(*child, wordMap, *files);
+        } else {
+            Roaring more(QueryArena::current());
+            filterFiles(*child, wordMap, more);
+            *files = Roaring::intersect(*files, more, QueryArena::current());
+        }
+    }
+    return files;
+}
+
+// Matches of an iterator that are in a set of files; the set drives the skipping as much as the iterator
+class FilteredIterator : public DocIterator {
+public:
+    FilteredIterator(std::unique_ptr<DocIterator> inner, Roaring files) : inner(std::move(inner)), files(std::move(files)), total(static_cast<uint32_t>(this->files.cardinality())) {
+        align();
+    }
+
+    bool atEnd() const override { return ended || inner->atEnd(); }
+    uint32_t id() const override { return inner->id(); }
+    void next() override {
+        if (ended) {
+            return;
+        }
+        inner->next();
+        align();
+    }
+    void advance(uint32_t target) override {
+        if (ended) {
+            return;
+        }
+        inner->advance(target);
+        align();
+    }
+    double score() const override { return inner->score(); }
+    uint32_t cost() const override { return std::min(inner->cost(), total); }
+
+private:
+    // Move forward until the inner iterator is on a file of the set
+    void align() {
+        while (!inner->atEnd()) {
+            if (deadline.expired()) { // Out of time, as when the set runs out
+                ended = true;
+                return;
+            }
+            uint32_t target = files.next(inner->id());
+            if (target == Roaring::END) { // No file of the set is left
+                ended = true;
+                return;
+            }
+            if (target == inner->id()) {
+                return;
+            }
+            inner->advance(target);
+        }
+    }
+
+    std::unique_ptr<DocIterator> inner; // Matches to filter
+    Roaring files; // Files to keep
+    uint32_t total; // Number of files in the set
+    bool ended = false; // Whether the set ran out or the deadline passed, so nothing else is returned
+    DeadlineCheck deadline; // Deadline of the request
+};
+
+// Every file of a set that has not been removed, scored 0
+class FileSetIterator : public DocIterator {
+public:
+    FileSetIterator(Roaring files, const WordMap& wordMap) : files(std::move(files)), wordMap(wordMap), total(static_cast<uint32_t>(this->files.cardinality())) {
+        current = skipRemoved(this->files.next(0));
+    }
+
+    bool atEnd() const override { return current == Roaring::END; }
+    uint32_t id() const override { return current; }
+    void next() override {
+        if (current != Roaring::END) {
+            current = skipRemoved(files.next(current + 1));
+        }
+    }
+    void advance(uint32_t target) override {
+        if (current != Roaring::END && target > current) {
+            current = skipRemoved(files.next(target));
+        }
+    }
+    double score() const override { return 0; }
+    uint32_t cost() const override { return total; }
+
+private:
+    uint32_t skipRemoved(uint32_t id) const { // First file from id that has not been removed
+        while (id != Roaring::END && wordMap.isRemoved(id)) {
+            id = files.next(id + 1);
+        }
+        return id;
+    }
+
+    Roaring files; // Files to return
+    const WordMap& wordMap; // Source of removed files
+    uint32_t total; // Number of files in the set
+    uint32_t current; // Current file, or END
+};
+
+// Append the text of a term in a field, as QueryNode::toString() writes it
+void appendTermKey(std::pmr::string& text, indexfile::Field field, std::string_view word) {
+    text += field == indexfile::ORG ? "org:" : field == indexfile::NAME ? "person:" : "";
+    text += word;
+}
+
+// Append a number in decimal
+void appendNumber(std::pmr::string& text, uint32_t number) {
+    char digits[10]; // Enough for any uint32_t
+    text.append(digits, std::to_chars(digits, digits + sizeof(digits), number).ptr);
+}
+
+// Append a date as its eight digits yyyymmdd
+void appendDate(std::pmr::string& text, uint32_t date) {
+    char digits[8];
+    for (int i = 7; i >= 0; --i, date /= 10) {
+        digits[i] = static_cast<char>('0' + date % 10);
+    }
+    text.append(digits, sizeof(digits));
+}
+
+// Append a boost, as a "^boost" suffix when it is not 1
+void appendBoost(std::pmr::string& text, double boost) {
+    if (boost != 1) {
+        char digits[32]; // Enough for any %g
+        text += '^';
+        text.append(digits, static_cast<size_t>(std::snprintf(digits, sizeof(digits), "%g", boost)));
+    }
+}
+
+// One word a WILDCARD or FUZZY node expands to
+struct Expansion {
+    uint32_t term; // Term id
+    uint32_t edits; // Distance from the fuzzy word, 0 for patterns
+    PostingView postings; // Postings of the word in the node's field
+};
+
+// Words of the node's field a WILDCARD or FUZZY node stands for: the closest, then the most common, at most MAX_EXPANSIONS
+std::pmr::vector<Expansion> expand(const QueryNode& node, const WordMap& wordMap) {
+    std::pmr::vector<std::pair<uint32_t, uint32_t>> matches(QueryArena::current()); // Term ids with their distances
+    if (node.type == QueryNode::WILDCARD) {
+        std::pmr::vector<uint32_t> ids(QueryArena::current());
+        wordMap.matchWildcard(node.term, ids);
+        for (uint32_t id : ids) {
+            matches.push_back({id, 0});
+        }
+    } else {
+        wordMap.matchFuzzy(node.term, node.distance, matches);
+    }
+    std::pmr::vector<Expansion> expansions(QueryArena::current());
+    DeadlineCheck deadline;
+    for (const auto& match : matches) { // Words are shared by the fields, keep those in the node's field
+        if (deadline.expired()) { // Out of time; the words found so far are used
+            break;
+        }
+        PostingView postings = wordMap.getPostings(node.field, match.first);
+        if (postings.count > 0) {
+            expansions.push_back({match.first, match.second, postings});
+        }
+    }
+    std::sort(expansions.begin(), expansions.end(), [&wordMap](const Expansion& a, const Expansion& b) {
+        if (a.edits != b.edits) {
+            return a.edits < b.edits;
+        }
+        if (a.postings.count != b.postings.count) {
+            return a.postings.count > b.postings.count;
+        }
+        return wordMap.getTerm(a.term) < wordMap.getTerm(b.term); // Same choice on every shard for equal counts
+    });
+    if (expansions.size() > MAX_EXPANSIONS) {
+        expansions.resize(MAX_EXPANSIONS);
+    }
+    return expansions;
+}
+
+}
+
+std::string QueryNode::toString() const {
+    std::pmr::string text(QueryArena::current());
+    appendString(text);
+    return std::string(text);
+}
+
+void QueryNode::appendString(std::pmr::string& text) const {
+    if (type == TERM || type == WILDCARD || type == FUZZY) {
+        appendTermKey(text, field, term);
+        if (type == FUZZY) {
+            text += '~';
+            appendNumber(text, distance);
+        }
+        appendBoost(text, boost);
+        return;
+    }
+    if (type == DATE) { // Open ends are left empty
+        text += "date:";
+        if (from != 0) {
+            appendDate(text, from);
+        }
+        text += "..";
+        if (to != OPEN_END) {
+            appendDate(text, to);
+        }
+        return;
+    }
+    if (type == SITE || type == ENTITY) {
+        text += type == SITE ? "site:" : field == indexfile::ORG ? "org=" : "person=";
+        text += term;
+        return;
+    }
+    text += type == AND ? "(AND" : type == OR ? "(OR" : type == NOT ? "(NOT" : type == PHRASE ? "(PHRASE" : "(NEAR/";
+    if (type == NEAR) {
+        appendNumber(text, distance);
+    }
+    for (const auto& child : children) {
+        text += ' ';
+        child->appendString(text);
+    }
+    text += ')';
+}
+
+std::string QueryNode::toQuery() const {
+    if (type == TERM || type == WILDCARD || type == FUZZY || isFilter()) { // Their canonical text parses back
+        return toString();
+    }
+    if (type == NOT) {
+        return "NOT " + children.front()->toQuery();
+    }
+    if (type == PHRASE) {
+        std::string text = field == indexfile::ORG ? "org:\"" : field == indexfile::NAME ? "person:\"" : "\"";
+        for (size_t i = 0; i < children.size(); ++i) {
+            text += i == 0 ? "" : " ";
+            text += children[i]->term;
+        }
+        std::pmr::string boost(QueryArena::current());
+        appendBoost(boost, children.front()->boost);
+        return text + "\"" + std::string(boost);
+    }
+    std::string separator = type == AND ? " AND " : type == OR ? " OR " : " NEAR/" + std::to_string(distance) + " ";
+    std::string text = "(";
+    for (size_t i = 0; i < children.size(); ++i) {
+        text += (i == 0 ? "" : separator) + children[i]->toQuery();
+    }
+    return text + ")";
+}
+
+std::unique_ptr<QueryNode> parseQuery(const std::string& query) {
+    metrics::Timer parse(metrics::PARSE);
+    return Parser(tokenize(query)).parseQuery();
+}
+
+namespace {
+
+std::unique_ptr<DocIterator> buildScoredIterator(const QueryNode& node, const WordMap& wordMap, const Bm25& bm25);
+
+// Files an excluded node leaves out, scores unused; common words are looked up in their saved set instead of decoding their postings
+std::unique_ptr<DocIterator> buildExclusion(const QueryNode& node, const WordMap& wordMap, const Bm25& bm25) {
+    if (node.type == QueryNode::TERM) {
+        Roaring files(QueryArena::current());
+        if (wordMap.getPresence(node.field, wordMap.findTerm(node.term), files)) {
+            return std::make_unique<FileSetIterator>(std::move(files), wordMap);
+        }
+    }
+    return buildScoredIterator(node, wordMap, bm25);
+}
+
+std::unique_ptr<DocIterator> buildScoredIterator(const QueryNode& node, const WordMap& wordMap, const Bm25& bm25) {
+    if (node.type == QueryNode::TERM) {
+        PostingView postings = wordMap.getPostings(node.field, node.term);
+        if (postings.count == 0) {
+            return std::make_unique<EmptyIterator>();
+        }
+        return std::make_unique<TermIterator>(postings, wordMap, Bm25::weight(bm25.termIdf(node, postings.count), node.boost));
+    }
+    if (node.type == QueryNode::NOT) { // An exclusion on its own matches nothing
+        return std::make_unique<EmptyIterator>();
+    }
+    if (node.isFilter()) { // A filter on its own keeps every file passing it
+        Roaring files(QueryArena::current());
+        filterFiles(node, wordMap, files);
+        return std::make_unique<FileSetIterator>(std::move(files), wordMap);
+    }
+    if (node.type == QueryNode::WILDCARD || node.type == QueryNode::FUZZY) { // Merge the postings of the words it expands to
+        std::pmr::vector<ExpansionIterator::Word> words(QueryArena::current());
+        std::pmr::string key(QueryArena::current()); // Statistics key of each word
+        uint32_t count = 0;
+        for (const Expansion& expansion : expand(node, wordMap)) {
+            key.clear();
+            appendTermKey(key, node.field, wordMap.getTerm(expansion.term));
+            double idf = bm25.termIdf(key, expansion.postings.count);
+            words.push_back({expansion.postings.cursor(), Bm25::weight(idf, node.boost) / (1 + expansion.edits)});
+            count += expansion.postings.count;
+        }
+        if (words.empty()) {
+            return std::make_unique<EmptyIterator>();
+        }
+        return std::make_unique<ExpansionIterator>(std::move(words), count, wordMap);
+    }
+    if (node.type == QueryNode::PHRASE || node.type == QueryNode::NEAR) { // Every word, then their positions
+        Operands words(QueryArena::current());
+        std::pmr::vector<PositionView> views(QueryArena::current());
+        bool positioned = true; // Whether every word has positions; words indexed without them are only ANDed
+        for (const auto& child : node.children) {
+            words.push_back(buildScoredIterator(*child, wordMap, bm25));
+            views.push_back(wordMap.getPositions(child->field, wordMap.findTerm(child->term)));
+            positioned = positioned && views.back().count > 0;
+        }
+        auto all = std::make_unique<AndIterator>(std::move(words));
+        if (!positioned) {
+            return all;
+        }
+        return std::make_unique<PositionalIterator>(std::move(all), views, node.type == QueryNode::PHRASE, node.distance);
+    }
+
+    Operands included(QueryArena::current()); // Operands to combine
+    Operands excluded(QueryArena::current()); // Operands of NOT children, removed from the result
+    for (const auto& child : node.children) {
+        if (child->type == QueryNode::NOT) {
+            excluded.push_back(buildExclusion(*child->children.front(), wordMap, bm25));
+        } else if (!child->isFilter()) {
+            included.push_back(buildScoredIterator(*child, wordMap, bm25));
+        }
+    }
+    std::optional<Roaring> files = groupFilter(node, wordMap); // Filters restrict the rest of the group
+    if (included.empty() && !files) { // Only exclusions
+        return std::make_unique<EmptyIterator>();
+    }
+
+    std::unique_ptr<DocIterator> result;
+    if (included.empty()) { // Only filters, every file passing them
+        result = std::make_unique<FileSetIterator>(std::move(*files), wordMap);
+    } else {
+        if (included.size() == 1) {
+            result = std::move(included.front());
+        } else if (node.type == QueryNode::AND) {
+            result = std::make_unique<AndIterator>(std::move(included));
+        } else {
+            result = std::make_unique<OrIterator>(std::move(included));
+        }
+        if (files) {
+            result = std::make_unique<FilteredIterator>(std::move(result), std::move(*files));
+        }
+    }
+
+    if (!excluded.empty()) {
+        std::unique_ptr<DocIterator> exclude = excluded.size() == 1 ? std::move(excluded.front()) : std::make_unique<OrIterator>(std::move(excluded));
+        result = std::make_unique<AndNotIterator>(std::move(result), std::move(exclude));
+    }
+    return result;
+}
+
+// Orders heap entries so that better matches come first: higher score, then lower id
+bool betterMatch(const std::pair<uint32_t, double>& a, const std::pair<uint32_t, double>& b) {
+    return a.second != b.second ? a.second > b.second : a.first < b.first;
+}
+
+// Bounded heap of the best matches seen so far, with the worst of them on top
+class TopHeap {
+public:
+    explicit TopHeap(size_t capacity) : capacity(capacity) {}
+
+    bool full() const { return matches.size() >= capacity; }
+    double threshold() const { return full() ? matches.front().second : -1.0; } // Score a new match must beat
+
+    void offer(uint32_t id, double score) { // Keep the match if it is among the best
+        std::pair<uint32_t, double> match(id, score);
+        if (!full()) {
+            matches.push_back(match);
+            std::push_heap(matches.begin(), matches.end(), betterMatch);
+        } else if (betterMatch(match, matches.front())) {
+            std::pop_heap(matches.begin(), matches.end(), betterMatch);
+            matches.back() = match;
+            std::push_heap(matches.begin(), matches.end(), betterMatch);
+        }
+    }
+
+    std::pmr::vector<std::pair<uint32_t, double>> sorted() { // Best first
+        std::sort_heap(matches.begin(), matches.end(), betterMatch);
+        return std::move(matches);
+    }
+
+private:
+    size_t capacity; // Number of matches to keep
+    std::pmr::vector<std::pair<uint32_t, double>> matches{QueryArena::current()}; // Heap of matches
+};
+
+// One word of a WAND query
+struct WandTerm {
+    PostingView::Cursor cursor; // Position in the word's postings
+    double weight; // Score of one unit of impact
+    double upperBound; // Largest score of any of its postings
+};
+
+// WAND over the words of an OR query; excluded and removed files are dropped before they are offered,
+// and files outside filter, when given, are skipped like files that cannot make the top matches
+void wand(std::pmr::vector<WandTerm>& terms, DocIterator* exclude, const Roaring* filter, const WordMap& wordMap, TopHeap& heap) {
+    std::pmr::vector<WandTerm*> order(QueryArena::current()); // Words that still have postings, sorted by current id
+    for (auto& term : terms) {
+        if (!term.cursor.atEnd()) {
+            order.push_back(&term);
+        }
+    }
+
+    DeadlineCheck deadline;
+    while (!order.empty() && !deadline.expired()) {
+        std::sort(order.begin(), order.end(), [](const WandTerm* a, const WandTerm* b) { // Ties keep query order so scores are summed the same way every time
+            return a->cursor.id() != b->cursor.id() ? a->cursor.id() < b->cursor.id() : a < b;
+        });
+
+        // The pivot is the first word whose bound, added to the bounds of the words before it, can beat the threshold
+        double threshold = heap.threshold();
+        double bound = 0;
+        size_t pivot = order.size();
+        for (size_t i = 0; i < order.size(); ++i) {
+            bound += order[i]->upperBound;
+            if (bound > threshold) {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot == order.size()) { // No remaining file can make the top matches
+            break;
+        }
+
+        uint32_t pivotId = order[pivot]->cursor.id();
+        if (filter && !filter->contains(pivotId)) { // Skip every word to the next file passing the filters
+            uint32_t target = filter->next(pivotId);
+            if (target == Roaring::END) {
+                break;
+            }
+            for (WandTerm* term : order) {
+                if (term->cursor.id() < target) {
+                    term->cursor.advance(target);
+                }
+            }
+        } else if (order.front()->cursor.id() == pivotId) { // Every word before the pivot is on the pivot file, score it
+            double score = 0;
+            for (WandTerm* term : order) {
+                if (term->cursor.id() != pivotId) {
+                    break;
+                }
+                score += term->weight * term->cursor.frequency();
+                term->cursor.next();
+            }
+            if (exclude) {
+                exclude->advance(pivotId);
+            }
+            if ((!exclude || exclude->atEnd() || exclude->id() != pivotId) && !wordMap.isRemoved(pivotId)) {
+                heap.offer(pivotId, score);
+            }
+        } else { // Files before the pivot cannot make the top matches, skip them
+            for (size_t i = 0; i < pivot; ++i) {
+                order[i]->cursor.advance(pivotId);
+            }
+        }
+
+        order.erase(std::remove_if(order.begin(), order.end(), [](const WandTerm* term) { return term->cursor.atEnd(); }), order.end());
+    }
+}
+
+// Counts of the attribute values of the matches of a query, by term id, site id or month yyyymm
+class FacetCounter {
+public:
+    explicit FacetCounter(const WordMap& wordMap) : wordMap(wordMap), counts{Counts(QueryArena::current()), Counts(QueryArena::current()), Counts(QueryArena::current()), Counts(QueryArena::current())} {}
+
+    void add(uint32_t id) { // Count the attributes of one match
+        ++matches;
+        for (Facets::Kind kind : {Facets::ORG, Facets::PERSON}) {
+            Attributes::Terms terms = wordMap.getEntities(kind == Facets::ORG ? indexfile::ORG : indexfile::NAME, id);
+            for (uint32_t i = 0; i < terms.count; ++i) {
+                ++counts[kind][terms.ids[i]];
+            }
+        }
+        uint32_t site = wordMap.getSite(id);
+        if (site != indexfile::NO_SITE) {
+            ++counts[Facets::SITE][site];
+        }
+        uint32_t date = wordMap.getDate(id);
+        if (date != Attributes::NO_DATE) {
+            ++counts[Facets::MONTH][date / 100];
+        }
+    }
+
+    void fill(Facets& facets) const { // Write the counts as filter clauses, keeping facets.limit of each kind
+        facets.matches = matches;
+        for (size_t kind = 0; kind < Facets::KIND_COUNT; ++kind) {
+            facets.values[kind].clear();
+            for (const auto& count : counts[kind]) {
+                facets.values[kind].emplace_back(clause(static_cast<Facets::Kind>(kind), count.first), count.second);
+            }
+        }
+        facets.trim();
+    }
+
+private:
+    using Counts = std::pmr::unordered_map<uint32_t, uint32_t>; // Matches with each value
+
+    std::string clause(Facets::Kind kind, uint32_t value) const { // Filter clause narrowing a query to a value
+        if (kind == Facets::MONTH) {
+            std::string text = "date:" + std::to_string(value / 100) + "-";
+            return text + (value % 100 < 10 ? "0" : "") + std::to_string(value % 100);
+        }
+        if (kind == Facets::SITE) {
+            return "site:" + std::string(wordMap.getSiteName(value));
+        }
+        return (kind == Facets::ORG ? "org=" : "person=") + std::string(wordMap.getTerm(value));
+    }
+
+    const WordMap& wordMap; // Source of the attributes
+    uint64_t matches = 0; // Number of matches counted
+    Counts counts[Facets::KIND_COUNT]; // Counts of each kind of value
+};
+
+}
+
+void CollectionStats::add(const CollectionStats& other) {
+    fileCount += other.fileCount;
+    for (const auto& pair : other.documentFrequencies) {
+        documentFrequencies[pair.first] += pair.second;
+    }
+}
+
+const char* const Facets::NAMES[Facets::KIND_COUNT] = {"org", "person", "site", "month"};
+
+void Facets::add(const Facets& other) {
+    matches += other.matches;
+    for (size_t kind = 0; kind < KIND_COUNT; ++kind) {
+        std::map<std::string, uint32_t> merged(values[kind].begin(), values[kind].end()); // Counts by clause
+        for (const auto& value : other.values[kind]) {
+            merged[value.first] += value.second;
+        }
+        values[kind].assign(merged.begin(), merged.end());
+    }
+}
+
+void Facets::trim() {
+    for (auto& kind : values) {
+        std::sort(kind.begin(), kind.end(), [](const auto& a, const auto& b) { return a.second != b.second ? a.second > b.second : a.first < b.first; });
+        if (kind.size() > limit) {
+            kind.resize(limit);
+        }
+    }
+}
+
+namespace {
+
+// Record the document frequency of every term below a node
+void collectTerms(const QueryNode& node, const WordMap& wordMap, CollectionStats& stats) {
+    if (node.type == QueryNode::TERM) {
+        std::pmr::string key(QueryArena::current()); // Boosts do not change the statistics
+        appendTermKey(key, node.field, node.term);
+        stats.documentFrequencies[std::string(key)] = wordMap.getPostings(node.field, node.term).count;
+        return;
+    }
+    if (node.type == QueryNode::WILDCARD || node.type == QueryNode::FUZZY) { // Every word it expands to here
+        std::pmr::string key(QueryArena::current());
+        for (const Expansion& expansion : expand(node, wordMap)) {
+            key.clear();
+            appendTermKey(key, node.field, wordMap.getTerm(expansion.term));
+            stats.documentFrequencies[std::string(key)] = expansion.postings.count;
+        }
+        return;
+    }
+    for (const auto& child : node.children) {
+        collectTerms(*child, wordMap, stats);
+    }
+}
+
+}
+
+CollectionStats collectStats(const QueryNode& node, const WordMap& wordMap) {
+    CollectionStats stats;
+    stats.fileCount = wordMap.fileCount();
+    collectTerms(node, wordMap, stats);
+    return stats;
+}
+
+Bm25::Bm25(const WordMap& wordMap) : wordMap(&wordMap), stats(nullptr), fileCount(wordMap.fileCount()) {}
+
+Bm25::Bm25(const WordMap& wordMap, const CollectionStats& stats) : wordMap(&wordMap), stats(&stats), fileCount(static_cast<double>(stats.fileCount)) {}
+
+double Bm25::idf(uint32_t documentFrequency) const {
+    return std::log(1.0 + (fileCount - documentFrequency + 0.5) / (documentFrequency + 0.5));
+}
+
+double Bm25::termIdf(const QueryNode& term, uint32_t localFrequency) const {
+    if (!stats) {
+        return idf(localFrequency);
+    }
+    std::pmr::string key(QueryArena::current());
+    appendTermKey(key, term.field, term.term);
+    return termIdf(std::string_view(key), localFrequency);
+}
+
+double Bm25::termIdf(std::string_view key, uint32_t localFrequency) const {
+    if (!stats) {
+        return idf(localFrequency);
+    }
+    auto it = stats->documentFrequencies.find(key);
+    return idf(it != stats->documentFrequencies.end() ? it->second : localFrequency); // A term the statistics miss only counts locally
+}
+
+double Bm25::weight(double idf, double boost) {
+    return idf * boost * (impact::K1 + 1) / impact::MAX; // An impact of MAX stands for a saturated frequency
+}
+
+std::unique_ptr<DocIterator> buildIterator(const QueryNode& node, const WordMap& wordMap) {
+    return buildScoredIterator(node, wordMap, Bm25(wordMap));
+}
+
+std::pmr::vector<std::pair<uint32_t, double>> topK(const QueryNode& node, const WordMap& wordMap, size_t count, const CollectionStats* stats, Facets* facets) {
+    if (count == 0 && !facets) {
+        return {};
+    }
+    metrics::Timer fetch(metrics::FETCH); // Posting lookups and iterator setup, until scoring starts
+    Bm25 bm25 = stats ? Bm25(wordMap, *stats) : Bm25(wordMap);
+    TopHeap heap(count);
+
+    // A single word, or an OR of words with optional exclusions, is scored with WAND
+    std::pmr::vector<const QueryNode*> words(QueryArena::current()); // Words of the query
+    std::pmr::vector<const QueryNode*> exclusions(QueryArena::current()); // Excluded nodes of the query
+    bool plain = node.type == QueryNode::TERM;
+    if (node.type == QueryNode::OR) {
+        plain = true;
+        for (const auto& child : node.children) {
+            if (child->type == QueryNode::TERM) {
+                words.push_back(child.get());
+            } else if (child->type == QueryNode::NOT) {
+                exclusions.push_back(child->children.front().get());
+            } else if (!child->isFilter()) { // Filters are applied to the words
+                plain = false;
+            }
+        }
+        plain = plain && !words.empty();
+    } else if (plain) {
+        words.push_back(&node);
+    }
+
+    if (!plain || facets) { // Any other query, or one whose matches are all counted, scores every match
+        std::unique_ptr<DocIterator> it = buildScoredIterator(node, wordMap, bm25);
+        fetch.stop();
+        {
+            metrics::Timer score(metrics::SCORE);
+            DeadlineCheck deadline;
+            if (!facets) {
+                for (; !it->atEnd() && !deadline.expired(); it->next()) {
+                    heap.offer(it->id(), it->score());
+                }
+            } else {
+                FacetCounter counter(wordMap);
+                for (; !it->atEnd() && !deadline.expired(); it->next()) {
+                    if (count > 0) {
+                        heap.offer(it->id(), it->score());
+                    }
+                    counter.add(it->id());
+                }
+                counter.fill(*facets);
+            }
+        }
+        metrics::Timer sort(metrics::SORT);
+        return heap.sorted();
+    }
+
+    std::pmr::vector<WandTerm> terms(QueryArena::current()); // Cursors over the words that are in the index
+    for (const QueryNode* word : words) {
+        PostingView postings = wordMap.getPostings(word->field, word->term);
+        if (postings.count > 0) {
+            double weight = Bm25::weight(bm25.termIdf(*word, postings.count), word->boost);
+            terms.push_back({postings.cursor(), weight, weight * postings.maxFrequency * (1 + 1e-9)}); // Pad for sums rounded in another order
+        }
+    }
+    std::unique_ptr<DocIterator> exclude; // Files to leave out
+    if (!exclusions.empty()) {
+        Operands excluded(QueryArena::current());
+        for (const QueryNode* exclusion : exclusions) {
+            excluded.push_back(buildExclusion(*exclusion, wordMap, bm25));
+        }
+        exclude = excluded.size() == 1 ? std::move(excluded.front()) : std::make_unique<OrIterator>(std::move(excluded));
+    }
+    std::optional<Roaring> filter = node.type == QueryNode::OR ? groupFilter(node, wordMap) : std::nullopt; // Files the words are restricted to
+    fetch.stop();
+    if (terms.empty()) { // Only exclusions, or no word in the index
+        return {};
+    }
+    {
+        metrics::Timer score(metrics::SCORE);
+        wand(terms, exclude.get(), filter ? &*filter : nullptr, wordMap, heap);
+    }
+    metrics::Timer sort(metrics::SORT);
+    return heap.sorted();
+}
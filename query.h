@@ -0,0 +1,132 @@
+#ifndef QUERY_H // Include guard to prevent multiple inclusions of this header file
+#define QUERY_H // Define the include guard
+
+#include "wordmap.h" // Include the WordMap header file
+#include "queryArena.h" // Include the per-thread scratch memory of a query
+#include <map> // Include the map library for document frequencies
+#include <memory> // Include the memory library
+#include <memory_resource> // Include the memory_resource library for arena-backed containers
+#include <string> // Include the string library
+#include <string_view> // Include the string_view library for canonical keys
+#include <utility> // Include the utility library for std::pair
+#include <vector> // Include the vector library
+
+// One node of a parsed query.
+//
+// Query syntax:
+//   word  org:word  person:word     terms, matched in the word, organization or person field
+//   "a b"  org:"a b"                phrase, files with the words next to each other in this order in the field
+//   a NEAR/3 b                      files with the words at most 3 positions apart in the field;
+//                                   operands that are not terms of one field are ANDed instead
+//   gold*  org:gold*man             words matching a pattern in which '*' stands for any run of characters
+//   word~1  word~2  word~           words at most 1 or 2 (the default) letters inserted, removed or changed away
+//   word^2  org:"a b"^0.5           boosted term, phrase or pattern: its score is multiplied by the number
+//   a b   a OR b                    files matching any of the terms
+//   a AND b                         files matching both terms
+//   -a   NOT a                      excludes files matching a from the rest of its group
+//   date:2018-01..2018-03           filters: keep only the files of the rest of their group published in a range of
+//   date:2018-05-02  date:2018..    days (inclusive, either end may be left open) or in one year, month or day,
+//   site:wsj.com                    from a site,
+//   org=goldman  person=yellen      or with a word in an organization or person name; org="a b" needs both words
+//   ( ... )                         grouping
+// Operators are upper case; terms are lowercased, and words in quotes lose their surrounding punctuation like indexed words.
+// Phrases and NEAR are scored like an AND of their words. Patterns and fuzzy words expand to at most
+// MAX_EXPANSIONS words of the field, the most common and, for fuzzy words, the closest first; a file scores
+// as its best matching word, fuzzy words weighted down by their distance. A group made only of exclusions matches nothing,
+// so evaluating a query never has to walk every file. Filters add nothing to the score; a group made only of filters
+// matches every file passing them, scored 0.
+//
+// Nodes, their words and their operand lists are allocated from QueryArena::current(), so a query parsed
+// inside a QueryArena::Scope must not outlive it.
+struct QueryNode : ArenaObject {
+    enum Type { TERM, AND, OR, NOT, PHRASE, NEAR, WILDCARD, FUZZY, DATE, SITE, ENTITY }; // Kinds of nodes; the last three are filters
+
+    Type type; // Kind of node
+    indexfile::Field field = indexfile::WORD; // Field of a TERM, ORG or NAME for an ENTITY
+    std::pmr::string term{QueryArena::current()}; // Lowercased word of a TERM, FUZZY or ENTITY, pattern of a WILDCARD, site of a SITE
+    uint32_t from = 0, to = 0; // Dates of a DATE as yyyymmdd, inclusive; a month or year runs from day 00 to day 99
+    uint32_t distance = 0; // Largest distance between the words of a NEAR, largest number of edits of a FUZZY
+    double boost = 1; // Factor of the score of a TERM, WILDCARD or FUZZY; the words of a boosted phrase each carry its boost
+    std::pmr::vector<std::unique_ptr<QueryNode>> children{QueryArena::current()}; // Operands of AND and OR, the excluded node of NOT, the TERMs of PHRASE and NEAR
+
+    std::string toString() const; // Canonical text of the node, equal for equivalent queries
+    void appendString(std::pmr::string& text) const; // Append toString() to text, allocating only from text's resource
+    std::string toQuery() const; // Query syntax that parses back to an equivalent node, for sending to shard servers
+    bool isFilter() const { return type == DATE || type == SITE || type == ENTITY; } // Whether the node only filters
+};
+
+const size_t MAX_EXPANSIONS = 64; // Words a WILDCARD or FUZZY node expands to at most
+const uint32_t MAX_EDITS = 2; // Largest distance of a FUZZY node
+
+// Parse a query, returns nullptr for an empty query
+std::unique_ptr<QueryNode> parseQuery(const std::string& query);
+
+// Collection statistics a query is scored with. Each shard of a corpus collects its own and the sums
+// are handed back to every shard, so scores from different shards can be compared.
+struct CollectionStats {
+    uint64_t fileCount = 0; // Number of file ids, removed ones included, as counted by idf
+    std::map<std::string, uint32_t, std::less<>> documentFrequencies; // Number of files containing each term of the query, keyed by QueryNode::toString() without its boost
+
+    void add(const CollectionStats& other); // Add the statistics of another shard
+};
+
+// Statistics of a WordMap for the terms of a query
+CollectionStats collectStats(const QueryNode& node, const WordMap& wordMap);
+
+// Attribute values of the files matching a query, counted by topK in the same pass that scores them.
+// Values are the clauses that narrow the query to them: "org=word", "person=word", "site:name" and
+// "date:YYYY-MM". Each shard counts its own files and the counts are added up.
+struct Facets {
+    enum Kind { ORG, PERSON, SITE, MONTH, KIND_COUNT }; // Attributes counted
+    static const char* const NAMES[KIND_COUNT]; // Name of each kind: "org", "person", "site" and "month"
+
+    size_t limit = 10; // Values wanted of each kind
+    uint64_t matches = 0; // Number of files matching the query
+    std::vector<std::pair<std::string, uint32_t>> values[KIND_COUNT]; // Each kind's filter clauses with their number of matching files, most first, then by clause
+
+    void add(const Facets& other); // Add the counts of another shard
+    void trim(); // Order each kind's values and keep the limit first
+};
+
+// BM25F scoring of the impacts stored in the posting lists (see impact.h). Everything that depends on
+// the file is in the impact, so a word's postings all score their impact times one weight, from the
+// word's idf over the collection and its boost.
+struct Bm25 {
+    explicit Bm25(const WordMap& wordMap); // Read the collection statistics
+    Bm25(const WordMap& wordMap, const CollectionStats& stats); // Score with the statistics of the whole corpus; wordMap still gives removed files
+
+    double idf(uint32_t documentFrequency) const; // Weight of a word found in documentFrequency files
+    double termIdf(const QueryNode& term, uint32_t localFrequency) const; // Weight of a TERM node found in localFrequency files of wordMap
+    double termIdf(std::string_view key, uint32_t localFrequency) const; // Weight of a term given by its statistics key
+    static double weight(double idf, double boost); // Score of one unit of impact of a word
+
+    const WordMap* wordMap; // Source of removed files
+    const CollectionStats* stats; // Corpus statistics, or nullptr to use wordMap alone
+    double fileCount; // Number of files
+};
+
+// Iterator over the ids of the files matching a query node, in increasing id order.
+// Iterators are allocated from QueryArena::current(), like query nodes.
+class DocIterator : public ArenaObject {
+public:
+    virtual ~DocIterator() = default; // Destructor
+
+    virtual bool atEnd() const = 0; // Whether every match has been read
+    virtual uint32_t id() const = 0; // Current file id
+    virtual void next() = 0; // Move to the next match
+    virtual void advance(uint32_t target) = 0; // Move to the first match with an id >= target
+    virtual double score() const = 0; // BM25 relevancy of the current match
+    virtual uint32_t cost() const = 0; // Upper bound on the number of matches, used to order intersections
+};
+
+// Build the iterator for a parsed query; never returns nullptr
+std::unique_ptr<DocIterator> buildIterator(const QueryNode& node, const WordMap& wordMap);
+
+// Best count matches of a parsed query as (file id, score), best first, ties broken by lower id, allocated from QueryArena::current().
+// Queries that are a plain list of words use WAND: each word's score upper bound lets postings
+// that cannot reach the current top count be skipped without being scored.
+// stats, when given, replaces the statistics of wordMap, for scoring one shard of a larger corpus.
+// facets, when given, gets the attributes of every match counted, and then no match can be skipped: such queries are not pruned with WAND.
+std::pmr::vector<std::pair<uint32_t, double>> topK(const QueryNode& node, const WordMap& wordMap, size_t count, const CollectionStats* stats = nullptr, Facets* facets = nullptr);
+
+#endif // QUERY_H // End of include guard
@@ -0,0 +1,88 @@
+#include "queryArena.h" // Include the query arena header
+
+#include <algorithm> // Include the algorithm library for std::max
+#include <cstdint> // Include the cstdint library for uintptr_t
+#include <new> // Include the new library for aligned operator new
+
+namespace {
+
+constexpr size_t HEADER = alignof(std::max_align_t); // Room in front of an ArenaObject for its resource, keeping the object aligned
+
+}
+
+QueryArena::QueryArena() : block(nullptr), size(0), used(0), overflowBytes(0), depth(0) {} // Constructor
+
+QueryArena::~QueryArena() {
+    reset();
+    ::operator delete(block);
+}
+
+std::pmr::memory_resource* QueryArena::current() {
+    QueryArena& arena = local();
+    return arena.depth > 0 ? static_cast<std::pmr::memory_resource*>(&arena) : std::pmr::new_delete_resource();
+}
+
+QueryArena::Scope::Scope() {
+    ++local().depth;
+}
+
+QueryArena::Scope::~Scope() {
+    QueryArena& arena = local();
+    if (--arena.depth == 0) { // Every query object of the thread is gone
+        arena.reset();
+    }
+}
+
+QueryArena& QueryArena::local() {
+    thread_local QueryArena arena;
+    return arena;
+}
+
+void* QueryArena::do_allocate(size_t bytes, size_t alignment) {
+    if (!block) { // First query of the thread
+        size = INITIAL_BLOCK;
+        block = static_cast<char*>(::operator new(size));
+    }
+    uintptr_t base = reinterpret_cast<uintptr_t>(block);
+    uintptr_t start = (base + used + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+    if (start + bytes <= base + size) {
+        used = start + bytes - base;
+        return reinterpret_cast<void*>(start);
+    }
+    void* memory = ::operator new(bytes, std::align_val_t(alignment)); // Block full, remember the allocation until reset
+    overflow.push_back({memory, alignment});
+    overflowBytes += bytes;
+    return memory;
+}
+
+void QueryArena::do_deallocate(void*, size_t, size_t) {}
+
+bool QueryArena::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+    return this == &other;
+}
+
+void QueryArena::reset() {
+    for (const auto& allocation : overflow) {
+        ::operator delete(allocation.first, std::align_val_t(allocation.second));
+    }
+    overflow.clear();
+    if (overflowBytes > 0 && size < MAX_BLOCK) { // Grow so a query like this one fits next time
+        size = std::min(MAX_BLOCK, std::max(size * 2, size + overflowBytes * 2));
+        ::operator delete(block);
+        block = static_cast<char*>(::operator new(size));
+    }
+    overflowBytes = 0;
+    used = 0;
+}
+
+void* ArenaObject::operator new(size_t size) {
+    std::pmr::memory_resource* resource = QueryArena::current();
+    char* memory = static_cast<char*>(resource->allocate(HEADER + size, alignof(std::max_align_t)));
+    *reinterpret_cast<std::pmr::memory_resource**>(memory) = resource;
+    return memory + HEADER;
+}
+
+void ArenaObject::operator delete(void* object, size_t size) {
+    char* memory = static_cast<char*>(object) - HEADER;
+    (*reinterpret_cast<std::pmr::memory_resource**>(memory))->deallocate(memory, HEADER + size, alignof(std::max_align_t));
+}
@@ -0,0 +1,63 @@
+#ifndef QUERYARENA_H // Include guard to prevent multiple inclusions of this header file
+#define QUERYARENA_H // Define the include guard
+
+#include <cstddef> // Include the cstddef library for size_t
+#include <memory_resource> // Include the memory_resource library for the polymorphic allocator interface
+#include <utility> // Include the utility library for std::pair
+#include <vector> // Include the vector library
+
+// Per-thread bump allocator for the scratch memory of a query.
+//
+// Parsing and evaluating a query builds many small objects that all die with it: tokens, query nodes,
+// iterators, cursors, heaps. While a QueryArena::Scope is open on a thread, the query code takes them
+// from that thread's arena by bumping a pointer, frees nothing, and the outermost scope releases them
+// all at once by resetting the arena. The arena keeps its block from one query to the next and grows
+// it to fit the largest query seen, up to MAX_BLOCK, so a warmed up thread serves queries without
+// calling malloc. Outside a scope, current() is the heap and the same code allocates normally.
+//
+// Anything allocated inside a scope must be destroyed before the scope closes.
+class QueryArena : public std::pmr::memory_resource {
+public:
+    static constexpr size_t INITIAL_BLOCK = 64 * 1024; // Block of a thread's first query
+    static constexpr size_t MAX_BLOCK = 16 * 1024 * 1024; // Largest block kept between queries; bigger queries also use the heap
+
+    static std::pmr::memory_resource* current(); // Arena of the calling thread inside a scope, otherwise the heap
+
+    // Marks the lifetime of one query's scratch memory on the calling thread; scopes nest
+    class Scope {
+    public:
+        Scope(); // Open a scope
+        ~Scope(); // Close it, resetting the arena when it is the outermost one
+        Scope(const Scope&) = delete; // Scopes are not copyable
+        Scope& operator=(const Scope&) = delete; // Scopes are not copyable
+    };
+
+    QueryArena(); // Constructor; the block is allocated on first use
+    ~QueryArena() override; // Destructor
+    QueryArena(const QueryArena&) = delete; // Arenas are not copyable
+    QueryArena& operator=(const QueryArena&) = delete; // Arenas are not copyable
+
+private:
+    void* do_allocate(size_t bytes, size_t alignment) override; // Bump allocate, or take from the heap when the block is full
+    void do_deallocate(void* memory, size_t bytes, size_t alignment) override; // Nothing; memory comes back on reset
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override; // Only equal to itself
+
+    static QueryArena& local(); // Arena of the calling thread
+    void reset(); // Forget every allocation, growing the block if the query did not fit in it
+
+    char* block; // Memory handed out by bumping
+    size_t size; // Size of block
+    size_t used; // Bytes of block handed out
+    std::vector<std::pair<void*, size_t>> overflow; // Heap allocations made when block was full, with their alignment
+    size_t overflowBytes; // Bytes allocated on the heap since the last reset
+    unsigned depth; // Number of open scopes
+};
+
+// Base of query objects that are allocated from QueryArena::current() when created with new.
+// Each allocation records its resource in front of the object, so it is deleted correctly on any thread.
+struct ArenaObject {
+    static void* operator new(size_t size); // Allocate from the current resource
+    static void operator delete(void* object, size_t size); // Return to the resource the object came from
+};
+
+#endif // QUERYARENA_H // End of include guard
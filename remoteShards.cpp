@@ -0,0 +1,174 @@
+#include "remoteShards.h" // Include the remote shards header
+#include "protocol.h" // Include the wire format
+#include "deadline.h" // Include the request deadline passed on to the servers
+
+#include <iostream> // Include the iostream library for error messages
+#include <unordered_map> // Include the unordered_map library for placing gathered documents
+#include <netdb.h> // Include getaddrinfo for server addresses
+#include <netinet/in.h> // Include internet address family
+#include <netinet/tcp.h> // Include TCP_NODELAY
+#include <sys/socket.h> // Include socket library
+#include <unistd.h> // Include POSIX operating system API
+
+RemoteShards::RemoteShards(const std::vector<std::string>& addresses) {
+    for (const auto& address : addresses) {
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos) { // Port missing, use the default one
+            servers.emplace_back(address, "12345");
+        } else {
+            servers.emplace_back(address.substr(0, colon), address.substr(colon + 1));
+        }
+    }
+    std::cout << "Searching " << servers.size() << " shard servers" << std::endl; // Print a message
+}
+
+RemoteShards::~RemoteShards() {
+    for (auto& links : pool) {
+        for (auto& link : links) {
+            closeLink(link);
+        }
+    }
+}
+
+CollectionStats RemoteShards::stats(const QueryNode& query) const {
+    CollectionStats total;
+    for (const auto& reply : exchange(std::string(1, protocol::STATS) + query.toQuery())) {
+        CollectionStats part;
+        size_t position = 0;
+        if (reply.first && protocol::decodeStats(reply.second, position, part)) {
+            total.add(part);
+        }
+    }
+    return total;
+}
+
+std::vector<ScoredFile> RemoteShards::top(const QueryNode& query, const CollectionStats& stats, size_t count, Facets* facets) const {
+    std::vector<std::vector<ScoredFile>> lists; // Best matches of each server
+    std::vector<Facets> parts; // Facets of each server
+    Deadline* deadline = Deadline::current();
+    size_t budget = deadline ? std::max<size_t>(1, static_cast<size_t>(deadline->remaining().count())) : 0; // The servers stop when this request would
+    for (const auto& reply : exchange(protocol::encodeTop(query.toQuery(), stats, count, facets ? facets->limit * FACET_OVERSAMPLING : 0, budget))) {
+        std::vector<ScoredFile> matches;
+        Facets part;
+        size_t position = 0; // Facets come first when asked for
+        if (reply.first && (!facets || protocol::decodeFacets(reply.second, position, part)) && protocol::decodeScored(reply.second, matches, position)) {
+            lists.push_back(std::move(matches));
+            parts.push_back(std::move(part));
+        }
+    }
+    if (facets) {
+        merge(parts, *facets);
+    }
+    return merge(lists, count);
+}
+
+void RemoteShards::documents(const std::vector<uint64_t>& ids, std::vector<Document>& out) const {
+    out.assign(ids.size(), Document());
+    if (ids.empty()) {
+        return;
+    }
+    std::unordered_map<uint64_t, size_t> places; // Position of each id in ids
+    for (size_t i = 0; i < ids.size(); ++i) {
+        places.emplace(ids[i], i);
+    }
+    for (const auto& reply : exchange(protocol::encodeDocumentRequest(ids))) { // Each server answers with the documents it holds
+        std::vector<Document> found;
+        if (!reply.first || !protocol::decodeDocuments(reply.second, found)) {
+            continue;
+        }
+        for (auto& document : found) {
+            auto place = places.find(document.id);
+            if (place != places.end()) {
+                out[place->second] = std::move(document);
+            }
+        }
+    }
+}
+
+std::vector<std::pair<bool, std::string>> RemoteShards::exchange(const std::string& request) const {
+    std::vector<Link> links; // One connection per server, taken from the pool while in use
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (!pool.empty()) {
+            links = std::move(pool.back());
+            pool.pop_back();
+        }
+    }
+    links.resize(servers.size());
+
+    std::vector<bool> sent(servers.size(), false); // Whether the request reached each server
+    for (size_t i = 0; i < servers.size(); ++i) { // Scatter before gathering so every server works at once
+        if (links[i].fd >= 0 && protocol::writeFrame(links[i].fd, request)) {
+            sent[i] = true;
+            continue;
+        }
+        closeLink(links[i]); // Pooled connection gone stale, try a new one
+        sent[i] = connectLink(i, links[i]) && protocol::writeFrame(links[i].fd, request);
+    }
+
+    std::vector<std::pair<bool, std::string>> replies(servers.size(), {false, std::string()});
+    for (size_t i = 0; i < servers.size(); ++i) {
+        std::string payload;
+        bool received = sent[i] && protocol::readFrame(links[i].fd, links[i].buffer, payload);
+        if (!received) { // The server may have closed an idle connection; retry once on a new one
+            closeLink(links[i]);
+            received = connectLink(i, links[i]) && protocol::writeFrame(links[i].fd, request) && protocol::readFrame(links[i].fd, links[i].buffer, payload);
+        }
+        if (!received) {
+            std::cerr << "Shard server " << servers[i].first << ":" << servers[i].second << " unavailable, searching without it" << std::endl; // Print error message
+            closeLink(links[i]);
+            continue;
+        }
+        if (!payload.empty() && (payload[0] == protocol::PARTIAL || payload[0] == protocol::OVERLOADED)) { // The server ran out of time, so this request has too
+            Deadline* deadline = Deadline::current();
+            if (deadline) {
+                deadline->cut();
+            }
+        }
+        if (payload.empty() || (payload[0] != protocol::OK && payload[0] != protocol::PARTIAL)) {
+            std::cerr << "Shard server " << servers[i].first << ":" << servers[i].second << " refused the request: " << (payload.empty() ? "" : payload.substr(1)) << std::endl; // Print error message
+            continue;
+        }
+        replies[i] = {true, payload.substr(1)};
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        pool.push_back(std::move(links));
+    }
+    return replies;
+}
+
+bool RemoteShards::connectLink(size_t server, Link& link) const {
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    if (getaddrinfo(servers[server].first.c_str(), servers[server].second.c_str(), &hints, &addresses) != 0) {
+        return false;
+    }
+    for (addrinfo* address = addresses; address; address = address->ai_next) { // First address that accepts
+        int fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (connect(fd, address->ai_addr, address->ai_addrlen) == 0) {
+            int noDelay = 1; // Requests are small and latency bound
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+            link.fd = fd;
+            link.buffer.clear();
+            break;
+        }
+        close(fd);
+    }
+    freeaddrinfo(addresses);
+    return link.fd >= 0;
+}
+
+void RemoteShards::closeLink(Link& link) {
+    if (link.fd >= 0) {
+        close(link.fd);
+    }
+    link.fd = -1;
+    link.buffer.clear();
+}
@@ -0,0 +1,38 @@
+#ifndef REMOTESHARDS_H // Include guard to prevent multiple inclusions of this header file
+#define REMOTESHARDS_H // Define the include guard
+
+#include "searcher.h" // Include the searcher interface
+#include <mutex> // Include the mutex library for the connection pool
+#include <string> // Include the string library
+#include <vector> // Include the vector library
+
+// A corpus served by socketSearch shard servers, each started with --shard I/N on its own part.
+// Every phase of a search is sent to all servers before any reply is read, so they work at the
+// same time. Connections are pooled and reused; a server that fails is reconnected once and
+// otherwise left out of that search, which then covers the remaining shards.
+class RemoteShards : public Searcher {
+public:
+    explicit RemoteShards(const std::vector<std::string>& addresses); // Constructor, takes one host:port per shard
+    ~RemoteShards(); // Destructor, closes pooled connections
+
+    CollectionStats stats(const QueryNode& query) const override; // Function to sum the statistics of every server
+    std::vector<ScoredFile> top(const QueryNode& query, const CollectionStats& stats, size_t count, Facets* facets = nullptr) const override; // Function to merge the best matches of every server
+    void documents(const std::vector<uint64_t>& ids, std::vector<Document>& out) const override; // Function to gather documents from the servers holding them
+
+private:
+    struct Link { // Connection to one server
+        int fd = -1; // Socket, or -1 when not connected
+        std::string buffer; // Bytes of later frames already received
+    };
+
+    // Send a request payload to every server and collect the bodies of OK responses; failed servers get no body
+    std::vector<std::pair<bool, std::string>> exchange(const std::string& request) const;
+    bool connectLink(size_t server, Link& link) const; // Open a connection to a server
+    static void closeLink(Link& link); // Close a connection
+
+    std::vector<std::pair<std::string, std::string>> servers; // Host and port of each shard server
+    mutable std::mutex poolMutex; // Guards pool
+    mutable std::vector<std::vector<Link>> pool; // Idle connection sets, one link per server
+};
+
+#endif // REMOTESHARDS_H // End of include guard
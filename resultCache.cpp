@@ -0,0 +1,186 @@
+#include "resultCache.h" // Include the result cache header
+#include "query.h" // Include the facet counts kept with results
+
+#include <algorithm> // Include the algorithm library for std::min
+#include <cstdlib> // Include the cstdlib library for std::getenv
+
+namespace {
+
+// Position of a key in one row of the frequency sketch
+size_t sketchIndex(uint64_t hash, size_t row, size_t width) {
+    uint64_t mixed = (hash + row) * 0x9E3779B97F4A7C15ULL; // Fibonacci hashing, with the high bits folded down
+    mixed ^= mixed >> 29; // so keys of one segment, which share their low bits, still spread over the row
+    return static_cast<size_t>(mixed % width);
+}
+
+// Approximate heap bytes of an entry, so long result lists count for more than short ones
+size_t entryCost(std::string_view key, const CachedResults& results) {
+    size_t cost = key.size() + sizeof(CachedResults) + 160 + results.ids.size() * sizeof(uint32_t); // Key in the list, node overheads and the ids
+    if (results.facets) {
+        cost += sizeof(Facets);
+        for (const auto& kind : results.facets->values) {
+            for (const auto& value : kind) {
+                cost += sizeof(value) + value.first.size();
+            }
+        }
+    }
+    return cost;
+}
+
+// Whether a holds at least as many matches as b
+bool deeper(const CachedResults& a, const CachedResults& b) {
+    return a.complete || (!b.complete && a.ids.size() >= b.ids.size());
+}
+
+// Whether a answers every page and facet request that b answers
+bool covers(const CachedResults& a, const CachedResults& b) {
+    return deeper(a, b) && (!b.facets || (a.facets && a.facets->limit >= b.facets->limit));
+}
+
+}
+
+ResultCache::ResultCache(size_t capacityBytes) : capacity(capacityBytes) {}
+
+std::shared_ptr<const CachedResults> ResultCache::find(std::string_view key, uint64_t generation, size_t count, const Facets* facets) {
+    if (!enabled()) {
+        return nullptr;
+    }
+    uint64_t hash = std::hash<std::string_view>()(key);
+    Segment& segment = segmentOf(hash);
+    std::lock_guard<std::mutex> lock(segment.mutex);
+    record(segment, hash); // Admission weighs every lookup, hit or miss
+
+    auto found = segment.entries.find(key);
+    if (found == segment.entries.end()) {
+        ++misses;
+        return nullptr;
+    }
+    auto node = found->second;
+    if (node->results->generation < generation) { // Computed before the last index update
+        erase(segment, node);
+        ++evictions;
+        ++misses;
+        return nullptr;
+    }
+    segment.order.splice(segment.order.begin(), segment.order, node); // Most recently used first
+    if (node->results->generation > generation || (!node->results->complete && node->results->ids.size() < count)) { // From a newer index than the caller's, or too short for the page
+        ++misses;
+        return nullptr;
+    }
+    if (facets && (!node->results->facets || node->results->facets->limit < facets->limit)) { // Facets not counted, or fewer values than wanted
+        ++misses;
+        return nullptr;
+    }
+    ++hits;
+    return node->results;
+}
+
+void ResultCache::insert(std::string_view key, std::shared_ptr<const CachedResults> results) {
+    if (!enabled()) {
+        return;
+    }
+    uint64_t hash = std::hash<std::string_view>()(key);
+    Segment& segment = segmentOf(hash);
+    std::lock_guard<std::mutex> lock(segment.mutex);
+
+    auto existing = segment.entries.find(key);
+    if (existing != segment.entries.end()) {
+        const CachedResults& old = *existing->second->results;
+        if (old.generation > results->generation) { // A newer index already answered
+            return;
+        }
+        if (old.generation == results->generation && !covers(*results, old)) { // Keep what the entry answers that the new results do not
+            if (covers(old, *results)) {
+                return;
+            }
+            bool newDeeper = deeper(*results, old); // One is deeper, the other has the facets
+            auto merged = std::make_shared<CachedResults>(newDeeper ? *results : old);
+            merged->facets = newDeeper ? old.facets : results->facets;
+            results = std::move(merged);
+        }
+    }
+
+    size_t cost = entryCost(key, *results);
+    size_t segmentCapacity = capacity / SEGMENTS; // Budget of each segment
+    if (cost > segmentCapacity) { // Could never fit
+        ++rejections;
+        return;
+    }
+    if (existing != segment.entries.end()) {
+        erase(segment, existing->second); // Replaced by a newer, deeper or merged list
+    }
+
+    // Pick the least recently used entries that must go to make room, refusing the new entry if any of them
+    // is still current and asked for at least as often
+    std::vector<std::list<Node>::iterator> victims;
+    uint8_t candidate = frequency(segment, hash);
+    size_t needed = segment.bytes + cost > segmentCapacity ? segment.bytes + cost - segmentCapacity : 0; // Bytes to free
+    size_t freed = 0;
+    for (auto node = segment.order.end(); freed < needed;) { // Ends before the front since cost fits the budget
+        --node;
+        if (node->results->generation >= results->generation && frequency(segment, node->hash) >= candidate) {
+            ++rejections;
+            return;
+        }
+        victims.push_back(node);
+        freed += node->cost;
+    }
+    for (auto victim : victims) {
+        erase(segment, victim);
+        ++evictions;
+    }
+
+    segment.order.push_front({std::string(key), hash, std::move(results), cost});
+    segment.entries[segment.order.front().key] = segment.order.begin();
+    segment.bytes += cost;
+    ++insertions;
+}
+
+ResultCache::Counters ResultCache::counters() const {
+    Counters result = {hits.load(), misses.load(), insertions.load(), evictions.load(), rejections.load(), 0, 0, capacity};
+    for (const auto& segment : segments) {
+        std::lock_guard<std::mutex> lock(segment.mutex);
+        result.entries += segment.entries.size();
+        result.bytes += segment.bytes;
+    }
+    return result;
+}
+
+size_t ResultCache::resolveCapacity() {
+    if (const char* env = std::getenv("SEARCH_CACHE_MB")) { // Budget from the environment, 0 disables the cache
+        long fromEnv = std::strtol(env, nullptr, 10);
+        if (fromEnv >= 0) {
+            return static_cast<size_t>(fromEnv) * 1024 * 1024;
+        }
+    }
+    return 64 * 1024 * 1024;
+}
+
+void ResultCache::record(Segment& segment, uint64_t hash) {
+    for (size_t row = 0; row < SKETCH_ROWS; ++row) {
+        uint8_t& counter = segment.sketch[row * SKETCH_WIDTH + sketchIndex(hash, row, SKETCH_WIDTH)];
+        if (counter < SKETCH_MAX) {
+            ++counter;
+        }
+    }
+    if (++segment.recorded >= 10 * SKETCH_WIDTH) { // Halve every counter so old popularity fades
+        for (auto& counter : segment.sketch) {
+            counter >>= 1;
+        }
+        segment.recorded /= 2;
+    }
+}
+
+uint8_t ResultCache::frequency(const Segment& segment, uint64_t hash) {
+    uint8_t estimate = SKETCH_MAX;
+    for (size_t row = 0; row < SKETCH_ROWS; ++row) { // Collisions only add, so the smallest counter is closest
+        estimate = std::min(estimate, segment.sketch[row * SKETCH_WIDTH + sketchIndex(hash, row, SKETCH_WIDTH)]);
+    }
+    return estimate;
+}
+
+void ResultCache::erase(Segment& segment, std::list<Node>::iterator node) {
+    segment.bytes -= node->cost;
+    segment.entries.erase(node->key);
+    segment.order.erase(node);
+}
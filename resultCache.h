@@ -0,0 +1,96 @@
+#ifndef RESULTCACHE_H // Include guard to prevent multiple inclusions of this header file
+#define RESULTCACHE_H // Define the include guard
+
+#include <atomic> // Include the atomic library for the counters
+#include <cstddef> // Include the cstddef library for size_t
+#include <cstdint> // Include the cstdint library for fixed width integers
+#include <list> // Include the list library for the recency order
+#include <memory> // Include the memory library
+#include <mutex> // Include the mutex library for the segments
+#include <string> // Include the string library
+#include <string_view> // Include the string_view library for lookups without a copy of the key
+#include <unordered_map> // Include the unordered_map library
+#include <vector> // Include the vector library
+
+class WordMap; // Index the cached file ids refer to
+struct Facets; // Facet counts kept with the results
+
+// Ranked results of one query as computed for one index generation
+struct CachedResults {
+    uint64_t generation = 0; // Index generation the results were computed on
+    bool complete = false; // Whether ids holds every match, not only the best ones
+    std::weak_ptr<const WordMap> index; // Snapshot the ids were found in; ids may be renumbered in the next one, and a cached entry does not keep it mapped
+    std::vector<uint32_t> ids; // File ids of the best matches, best first; paths are resolved only for the page returned
+    std::shared_ptr<const Facets> facets; // Facets of every match when the search counted them, or null
+};
+
+// Bounded cache of query results shared by every search thread.
+//
+// Entries are keyed by the canonical text of a parsed query, so equivalent queries share one entry,
+// and are stamped with the index generation they were computed on; a lookup with a newer generation
+// drops the entry, so an index update invalidates everything at once without walking the cache.
+//
+// The cache is split into segments by key hash, each with its own lock, recency list and byte budget.
+// Eviction is least recently used, weighed by the bytes an entry holds, with TinyLFU admission: every
+// lookup is counted in a small count-min sketch that is halved periodically, and a new entry only
+// displaces live entries that have been asked for less often, so one-off queries cannot flush the
+// hot ones.
+class ResultCache {
+public:
+    struct Counters { // Usage since the cache was created
+        uint64_t hits; // Lookups answered from the cache
+        uint64_t misses; // Lookups that had to search, stale entries included
+        uint64_t insertions; // Entries added
+        uint64_t evictions; // Entries dropped to make room or because they were stale
+        uint64_t rejections; // Entries refused by admission
+        size_t entries; // Entries held now
+        size_t bytes; // Approximate bytes held now
+        size_t capacity; // Byte budget
+    };
+
+    explicit ResultCache(size_t capacityBytes); // Constructor; a capacity of 0 disables the cache
+    ResultCache(const ResultCache&) = delete; // Caches are not copyable
+    ResultCache& operator=(const ResultCache&) = delete; // Caches are not copyable
+
+    // Results of a query for this generation holding at least count matches, and facets with at least
+    // facets->limit values of each kind when facets is given, or nullptr
+    std::shared_ptr<const CachedResults> find(std::string_view key, uint64_t generation, size_t count, const Facets* facets = nullptr);
+    void insert(std::string_view key, std::shared_ptr<const CachedResults> results); // Offer results to the cache; an entry of the same generation keeps the deeper list and the facets of either
+    Counters counters() const; // Current counters
+    bool enabled() const { return capacity > 0; } // Whether anything is ever cached
+
+    static size_t resolveCapacity(); // Byte budget from SEARCH_CACHE_MB, 64 MB by default
+
+private:
+    static constexpr size_t SEGMENTS = 16; // Independent parts of the cache
+    static constexpr size_t SKETCH_ROWS = 4; // Hash functions of the frequency sketch
+    static constexpr size_t SKETCH_WIDTH = 4096; // Counters per row and segment
+    static constexpr uint8_t SKETCH_MAX = 15; // Saturation of a frequency counter
+
+    struct Node { // One cached query
+        std::string key; // Canonical query text
+        uint64_t hash; // Hash of the key
+        std::shared_ptr<const CachedResults> results; // Cached results
+        size_t cost; // Approximate bytes held
+    };
+
+    struct Segment {
+        mutable std::mutex mutex; // Guards the rest of the segment
+        std::list<Node> order; // Entries, most recently used first
+        std::unordered_map<std::string_view, std::list<Node>::iterator> entries; // Entry of each key, viewing the key held by the entry
+        size_t bytes = 0; // Cost of every entry
+        std::vector<uint8_t> sketch = std::vector<uint8_t>(SKETCH_ROWS * SKETCH_WIDTH, 0); // Count-min frequency sketch
+        size_t recorded = 0; // Lookups counted since the sketch was last halved
+    };
+
+    Segment& segmentOf(uint64_t hash) { return segments[hash % SEGMENTS]; } // Segment holding a key
+    static void record(Segment& segment, uint64_t hash); // Count a lookup in the sketch
+    static uint8_t frequency(const Segment& segment, uint64_t hash); // Estimated lookups of a key
+    void erase(Segment& segment, std::list<Node>::iterator node); // Drop an entry
+
+    size_t capacity; // Byte budget of the whole cache
+    Segment segments[SEGMENTS]; // Parts of the cache
+    std::atomic<uint64_t> hits{0}, misses{0}, insertions{0}, evictions{0}, rejections{0}; // Counters
+};
+
+#endif // RESULTCACHE_H // End of include guard
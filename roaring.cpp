@@ -0,0 +1,685 @@
+#include "roaring.h" // Include the roaring set header
+
+#include <algorithm> // Include the algorithm library for searching and merging
+#include <cstdlib> // Include the cstdlib library for std::getenv
+#include <cstring> // Include the cstring library for copying saved containers
+#include <string_view> // Include the string_view library for the environment value
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // Include the AVX2 intrinsics, compiled per function with target attributes
+#define ROARING_X86 1 // Whether the vectorized bitmap kernels are built
+#endif
+
+namespace {
+
+constexpr uint32_t CHUNK = 65536; // Ids per container
+constexpr size_t BITMAP_BYTES = Roaring::BITMAP_WORDS * sizeof(uint64_t); // Size of a bitmap container
+
+enum Operation { AND, OR, ANDNOT }; // Ways bitmap words are combined
+
+template <Operation op>
+inline uint64_t combine(uint64_t a, uint64_t b) {
+    return op == AND ? a & b : op == OR ? a | b : a & ~b;
+}
+
+// Combine two bitmaps word by word into out, returns the number of bits set in out
+template <Operation op>
+uint32_t combineScalar(const uint64_t* a, const uint64_t* b, uint64_t* out) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < Roaring::BITMAP_WORDS; ++i) {
+        out[i] = combine<op>(a[i], b[i]);
+        count += static_cast<uint32_t>(__builtin_popcountll(out[i]));
+    }
+    return count;
+}
+
+#ifdef ROARING_X86
+
+template <Operation op>
+__attribute__((target("avx2,popcnt"))) uint32_t combineAvx2(const uint64_t* a, const uint64_t* b, uint64_t* out) {
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < Roaring::BITMAP_WORDS; i += 4) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i result = op == AND ? _mm256_and_si256(x, y) : op == OR ? _mm256_or_si256(x, y) : _mm256_andnot_si256(y, x); // andnot clears the bits of its first operand
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), result);
+        count += _mm_popcnt_u64(out[i]) + _mm_popcnt_u64(out[i + 1]) + _mm_popcnt_u64(out[i + 2]) + _mm_popcnt_u64(out[i + 3]);
+    }
+    return static_cast<uint32_t>(count);
+}
+
+#endif
+
+// Bitmap kernels picked for this process
+struct Kernels {
+    uint32_t (*intersect)(const uint64_t*, const uint64_t*, uint64_t*); // a & b
+    uint32_t (*unite)(const uint64_t*, const uint64_t*, uint64_t*); // a | b
+    uint32_t (*subtract)(const uint64_t*, const uint64_t*, uint64_t*); // a & ~b
+    const char* name; // Instruction set
+};
+
+Kernels choose() {
+    const char* cap = std::getenv("SEARCH_ROARING"); // Optional cap on the instruction set
+    std::string_view limit = cap ? cap : "";
+#ifdef ROARING_X86
+    __builtin_cpu_init();
+    if (limit != "scalar" && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+        return {combineAvx2<AND>, combineAvx2<OR>, combineAvx2<ANDNOT>, "avx2"};
+    }
+#endif
+    return {combineScalar<AND>, combineScalar<OR>, combineScalar<ANDNOT>, "scalar"};
+}
+
+const Kernels& chosen() {
+    static const Kernels instance = choose();
+    return instance;
+}
+
+inline bool testBit(const uint64_t* words, uint32_t bit) {
+    return (words[bit >> 6] >> (bit & 63)) & 1;
+}
+
+// First set bit >= from, or CHUNK
+uint32_t nextSetBit(const uint64_t* words, uint32_t from) {
+    if (from >= CHUNK) {
+        return CHUNK;
+    }
+    uint32_t word = from >> 6;
+    uint64_t bits = words[word] & (~uint64_t(0) << (from & 63));
+    while (bits == 0) {
+        if (++word == Roaring::BITMAP_WORDS) {
+            return CHUNK;
+        }
+        bits = words[word];
+    }
+    return word * 64 + static_cast<uint32_t>(__builtin_ctzll(bits));
+}
+
+// First clear bit >= from, or CHUNK
+uint32_t nextClearBit(const uint64_t* words, uint32_t from) {
+    if (from >= CHUNK) {
+        return CHUNK;
+    }
+    uint32_t word = from >> 6;
+    uint64_t bits = ~words[word] & (~uint64_t(0) << (from & 63));
+    while (bits == 0) {
+        if (++word == Roaring::BITMAP_WORDS) {
+            return CHUNK;
+        }
+        bits = ~words[word];
+    }
+    return word * 64 + static_cast<uint32_t>(__builtin_ctzll(bits));
+}
+
+// Set bits from to last, inclusive
+void setRange(uint64_t* words, uint32_t from, uint32_t last) {
+    uint32_t first = from >> 6, end = last >> 6;
+    uint64_t head = ~uint64_t(0) << (from & 63), tail = ~uint64_t(0) >> (63 - (last & 63));
+    if (first == end) {
+        words[first] |= head & tail;
+        return;
+    }
+    words[first] |= head;
+    for (uint32_t i = first + 1; i < end; ++i) {
+        words[i] = ~uint64_t(0);
+    }
+    words[end] |= tail;
+}
+
+void pad(std::ostream& out, size_t written) { // Pad a set of written bytes to an 8-byte boundary
+    static const char zeros[8] = {};
+    if (written % 8 != 0) {
+        out.write(zeros, static_cast<std::streamsize>(8 - written % 8));
+    }
+}
+
+size_t padded(size_t bytes) {
+    return (bytes + 7) / 8 * 8;
+}
+
+}
+
+Roaring::Roaring(std::pmr::memory_resource* resource) : resource(resource), containers(resource) {}
+
+void Roaring::add(uint32_t id) {
+    uint16_t key = static_cast<uint16_t>(id >> 16), low = static_cast<uint16_t>(id & 0xFFFF);
+    if (containers.empty() || containers.back().key != key) {
+        containers.emplace_back(key, ARRAY, resource);
+    }
+    Container& container = containers.back();
+    if (container.type == ARRAY) {
+        if (!container.values.empty() && container.values.back() == low) { // Already added
+            return;
+        }
+        if (container.cardinality < ARRAY_MAX) {
+            container.values.push_back(low);
+            ++container.cardinality;
+            return;
+        }
+        container.words.assign(BITMAP_WORDS, 0); // Full, a bitmap is smaller from here on
+        toBitmap(container, container.words.data());
+        container.values.clear();
+        container.values.shrink_to_fit();
+        container.type = BITMAP;
+    } else if (container.type == RUN) { // Only optimize() makes runs; extend them as a bitmap
+        container.words.assign(BITMAP_WORDS, 0);
+        toBitmap(container, container.words.data());
+        container.values.clear();
+        container.type = BITMAP;
+    }
+    if (!testBit(container.words.data(), low)) {
+        container.words[low >> 6] |= uint64_t(1) << (low & 63);
+        ++container.cardinality;
+    }
+}
+
+void Roaring::addBitmap(uint16_t key, const uint64_t* words) {
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < BITMAP_WORDS; ++i) {
+        count += static_cast<uint32_t>(__builtin_popcountll(words[i]));
+    }
+    if (count == 0) {
+        return;
+    }
+    containers.emplace_back(key, BITMAP, resource);
+    fromBitmap(containers.back(), words, count);
+}
+
+void Roaring::optimize() {
+    for (Container& container : containers) {
+        pick(container);
+    }
+}
+
+uint64_t Roaring::cardinality() const {
+    uint64_t total = 0;
+    for (const Container& container : containers) {
+        total += container.cardinality;
+    }
+    return total;
+}
+
+size_t Roaring::find(uint16_t key) const {
+    return static_cast<size_t>(std::lower_bound(containers.begin(), containers.end(), key, [](const Container& container, uint16_t value) {
+        return container.key < value;
+    }) - containers.begin());
+}
+
+bool Roaring::contains(uint32_t id) const {
+    size_t i = find(static_cast<uint16_t>(id >> 16));
+    return i < containers.size() && containers[i].key == (id >> 16) && containerContains(containers[i], static_cast<uint16_t>(id & 0xFFFF));
+}
+
+uint32_t Roaring::next(uint32_t id) const {
+    uint32_t key = id >> 16;
+    for (size_t i = find(static_cast<uint16_t>(key)); i < containers.size(); ++i) {
+        const Container& container = containers[i];
+        uint32_t low = container.key == key ? (id & 0xFFFF) : 0; // Later containers are searched from their start
+        uint32_t found = containerNext(container, low);
+        if (found < CHUNK) {
+            return (static_cast<uint32_t>(container.key) << 16) | found;
+        }
+    }
+    return END;
+}
+
+uint32_t Roaring::nextAbsent(uint32_t id) const {
+    while (true) {
+        uint32_t key = id >> 16;
+        size_t i = find(static_cast<uint16_t>(key));
+        if (i == containers.size() || containers[i].key != key) { // No container, nothing of the chunk is in the set
+            return id;
+        }
+        uint32_t found = containerNextAbsent(containers[i], id & 0xFFFF);
+        if (found < CHUNK) {
+            return (key << 16) | found;
+        }
+        if (key == 0xFFFF) { // Every id from here is in the set
+            return END;
+        }
+        id = (key + 1) << 16;
+    }
+}
+
+void Roaring::toBitmap(const Container& container, uint64_t* words) {
+    if (container.type == BITMAP) {
+        std::copy(container.words.begin(), container.words.end(), words);
+    } else if (container.type == ARRAY) {
+        for (uint16_t low : container.values) {
+            words[low >> 6] |= uint64_t(1) << (low & 63);
+        }
+    } else {
+        for (size_t i = 0; i < container.values.size(); i += 2) {
+            setRange(words, container.values[i], container.values[i] + container.values[i + 1]);
+        }
+    }
+}
+
+uint32_t Roaring::runCount(const Container& container) {
+    if (container.type == RUN) {
+        return static_cast<uint32_t>(container.values.size() / 2);
+    }
+    uint32_t runs = 0;
+    if (container.type == ARRAY) {
+        for (size_t i = 0; i < container.values.size(); ++i) {
+            runs += i == 0 || container.values[i] != container.values[i - 1] + 1;
+        }
+        return runs;
+    }
+    uint64_t carry = 0; // Last bit of the previous word
+    for (uint64_t word : container.words) {
+        runs += static_cast<uint32_t>(__builtin_popcountll(word & ~((word << 1) | carry))); // Bits set whose previous bit is clear start runs
+        carry = word >> 63;
+    }
+    return runs;
+}
+
+void Roaring::fromBitmap(Container& container, const uint64_t* words, uint32_t cardinality) {
+    uint32_t runs = 0;
+    uint64_t carry = 0;
+    for (uint32_t i = 0; i < BITMAP_WORDS; ++i) {
+        runs += static_cast<uint32_t>(__builtin_popcountll(words[i] & ~((words[i] << 1) | carry)));
+        carry = words[i] >> 63;
+    }
+    size_t arrayBytes = cardinality * sizeof(uint16_t), runBytes = runs * 2 * sizeof(uint16_t);
+    container.cardinality = cardinality;
+    container.values.clear();
+    container.words.clear();
+    if (runBytes < std::min(arrayBytes, BITMAP_BYTES)) {
+        container.type = RUN;
+        container.values.reserve(runs * 2);
+        for (uint32_t start = nextSetBit(words, 0); start < CHUNK;) {
+            uint32_t end = nextClearBit(words, start);
+            container.values.push_back(static_cast<uint16_t>(start));
+            container.values.push_back(static_cast<uint16_t>(end - 1 - start));
+            start = nextSetBit(words, end);
+        }
+    } else if (cardinality <= ARRAY_MAX) {
+        container.type = ARRAY;
+        container.values.reserve(cardinality);
+        for (uint32_t i = 0; i < BITMAP_WORDS; ++i) {
+            for (uint64_t bits = words[i]; bits != 0; bits &= bits - 1) {
+                container.values.push_back(static_cast<uint16_t>(i * 64 + __builtin_ctzll(bits)));
+            }
+        }
+    } else {
+        container.type = BITMAP;
+        container.words.assign(words, words + BITMAP_WORDS);
+    }
+    container.values.shrink_to_fit();
+}
+
+void Roaring::pick(Container& container) {
+    size_t bytes = container.type == BITMAP ? BITMAP_BYTES : container.values.size() * sizeof(uint16_t);
+    size_t smallest = std::min({static_cast<size_t>(container.cardinality) * sizeof(uint16_t), BITMAP_BYTES, static_cast<size_t>(runCount(container)) * 2 * sizeof(uint16_t)});
+    if (bytes <= smallest) { // Already in its smallest form
+        return;
+    }
+    uint64_t words[BITMAP_WORDS] = {};
+    toBitmap(container, words);
+    fromBitmap(container, words, container.cardinality);
+}
+
+bool Roaring::containerContains(const Container& container, uint16_t low) {
+    if (container.type == BITMAP) {
+        return testBit(container.words.data(), low);
+    }
+    if (container.type == ARRAY) {
+        return std::binary_search(container.values.begin(), container.values.end(), low);
+    }
+    size_t runs = container.values.size() / 2, lo = 0, hi = runs; // Find the last run starting at or before low
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (container.values[mid * 2] <= low) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo > 0 && low <= container.values[(lo - 1) * 2] + container.values[(lo - 1) * 2 + 1];
+}
+
+uint32_t Roaring::containerNext(const Container& container, uint32_t low) {
+    if (low >= CHUNK) {
+        return CHUNK;
+    }
+    if (container.type == BITMAP) {
+        return nextSetBit(container.words.data(), low);
+    }
+    if (container.type == ARRAY) {
+        auto found = std::lower_bound(container.values.begin(), container.values.end(), low);
+        return found == container.values.end() ? CHUNK : *found;
+    }
+    size_t runs = container.values.size() / 2, lo = 0, hi = runs; // Find the first run ending at or after low
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (static_cast<uint32_t>(container.values[mid * 2]) + container.values[mid * 2 + 1] < low) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo == runs ? CHUNK : std::max<uint32_t>(low, container.values[lo * 2]);
+}
+
+uint32_t Roaring::containerNextAbsent(const Container& container, uint32_t low) {
+    if (container.type == BITMAP) {
+        return nextClearBit(container.words.data(), low);
+    }
+    if (container.type == ARRAY) {
+        for (auto it = std::lower_bound(container.values.begin(), container.values.end(), low); it != container.values.end() && *it == low; ++it) {
+            ++low;
+        }
+        return low;
+    }
+    uint32_t start = containerNext(container, low); // Start of the run holding low, if any
+    if (start != low) {
+        return low;
+    }
+    size_t runs = container.values.size() / 2, lo = 0, hi = runs;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (static_cast<uint32_t>(container.values[mid * 2]) + container.values[mid * 2 + 1] < low) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return static_cast<uint32_t>(container.values[lo * 2]) + container.values[lo * 2 + 1] + 1; // Runs never touch, so the id after a run is absent
+}
+
+Roaring::Container Roaring::intersectContainers(const Container& a, const Container& b, std::pmr::memory_resource* resource) {
+    Container result(a.key, ARRAY, resource);
+    if (a.type == BITMAP && b.type == BITMAP) {
+        uint64_t words[BITMAP_WORDS];
+        uint32_t count = chosen().intersect(a.words.data(), b.words.data(), words);
+        if (count > 0) {
+            fromBitmap(result, words, count);
+        }
+        return result;
+    }
+    if (a.type == ARRAY || b.type == ARRAY) { // The result is no larger than the array, probe the other container with it
+        const Container& array = a.type == ARRAY ? a : b;
+        const Container& other = a.type == ARRAY ? b : a;
+        if (other.type == ARRAY) { // Merge, or look the smaller array up in the larger one when their sizes are far apart
+            const Container& small = array.values.size() <= other.values.size() ? array : other;
+            const Container& large = array.values.size() <= other.values.size() ? other : array;
+            if (small.values.size() * 32 < large.values.size()) {
+                auto from = large.values.begin();
+                for (uint16_t low : small.values) {
+                    from = std::lower_bound(from, large.values.end(), low);
+                    if (from == large.values.end()) {
+                        break;
+                    }
+                    if (*from == low) {
+                        result.values.push_back(low);
+                    }
+                }
+            } else {
+                std::set_intersection(small.values.begin(), small.values.end(), large.values.begin(), large.values.end(), std::back_inserter(result.values));
+            }
+        } else if (other.type == BITMAP) {
+            for (uint16_t low : array.values) {
+                if (testBit(other.words.data(), low)) {
+                    result.values.push_back(low);
+                }
+            }
+        } else { // Walk the array and the runs together
+            size_t run = 0;
+            for (uint16_t low : array.values) {
+                while (run < other.values.size() && static_cast<uint32_t>(other.values[run]) + other.values[run + 1] < low) {
+                    run += 2;
+                }
+                if (run == other.values.size()) {
+                    break;
+                }
+                if (low >= other.values[run]) {
+                    result.values.push_back(low);
+                }
+            }
+        }
+        result.cardinality = static_cast<uint32_t>(result.values.size());
+        return result;
+    }
+    if (a.type == RUN && b.type == RUN) { // Overlaps of the two lists of runs
+        result.type = RUN;
+        for (size_t i = 0, j = 0; i < a.values.size() && j < b.values.size();) {
+            uint32_t aEnd = static_cast<uint32_t>(a.values[i]) + a.values[i + 1], bEnd = static_cast<uint32_t>(b.values[j]) + b.values[j + 1];
+            uint32_t start = std::max(a.values[i], b.values[j]), end = std::min(aEnd, bEnd);
+            if (start <= end) {
+                result.values.push_back(static_cast<uint16_t>(start));
+                result.values.push_back(static_cast<uint16_t>(end - start));
+                result.cardinality += end - start + 1;
+            }
+            if (aEnd < bEnd) {
+                i += 2;
+            } else {
+                j += 2;
+            }
+        }
+        pick(result);
+        return result;
+    }
+    uint64_t runs[BITMAP_WORDS] = {}, words[BITMAP_WORDS]; // A bitmap and runs: mask the bitmap with the runs
+    toBitmap(a.type == RUN ? a : b, runs);
+    uint32_t count = chosen().intersect(a.type == BITMAP ? a.words.data() : b.words.data(), runs, words);
+    if (count > 0) {
+        fromBitmap(result, words, count);
+    }
+    return result;
+}
+
+Roaring::Container Roaring::uniteContainers(const Container& a, const Container& b, std::pmr::memory_resource* resource) {
+    Container result(a.key, ARRAY, resource);
+    if (a.type == ARRAY && b.type == ARRAY && a.values.size() + b.values.size() <= ARRAY_MAX) { // Fits in an array
+        std::set_union(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), std::back_inserter(result.values));
+        result.cardinality = static_cast<uint32_t>(result.values.size());
+        pick(result);
+        return result;
+    }
+    if (a.type == RUN && b.type == RUN) { // Merge the runs by start
+        result.type = RUN;
+        size_t i = 0, j = 0;
+        while (i < a.values.size() || j < b.values.size()) {
+            bool fromA = j == b.values.size() || (i < a.values.size() && a.values[i] <= b.values[j]);
+            const Container& source = fromA ? a : b;
+            size_t& at = fromA ? i : j;
+            uint32_t start = source.values[at], end = start + source.values[at + 1];
+            at += 2;
+            if (!result.values.empty()) {
+                size_t last = result.values.size() - 2;
+                uint32_t lastEnd = static_cast<uint32_t>(result.values[last]) + result.values[last + 1];
+                if (start <= lastEnd + 1) { // Touches or overlaps the last run, extend it
+                    if (end > lastEnd) {
+                        result.values[last + 1] = static_cast<uint16_t>(end - result.values[last]);
+                    }
+                    continue;
+                }
+            }
+            result.values.push_back(static_cast<uint16_t>(start));
+            result.values.push_back(static_cast<uint16_t>(end - start));
+        }
+        for (size_t k = 0; k < result.values.size(); k += 2) {
+            result.cardinality += result.values[k + 1] + 1u;
+        }
+        pick(result);
+        return result;
+    }
+    uint64_t words[BITMAP_WORDS] = {}; // Any other pair: set the bits of both, or OR two bitmaps
+    uint32_t count;
+    if (a.type == BITMAP && b.type == BITMAP) {
+        count = chosen().unite(a.words.data(), b.words.data(), words);
+    } else {
+        uint64_t other[BITMAP_WORDS] = {};
+        toBitmap(a, words);
+        toBitmap(b, other);
+        count = chosen().unite(words, other, words);
+    }
+    fromBitmap(result, words, count);
+    return result;
+}
+
+Roaring::Container Roaring::subtractContainers(const Container& a, const Container& b, std::pmr::memory_resource* resource) {
+    Container result(a.key, ARRAY, resource);
+    if (a.type == ARRAY) { // The result is no larger than a, keep the ids b lacks
+        if (b.type == ARRAY) {
+            std::set_difference(a.values.begin(), a.values.end(), b.values.begin(), b.values.end(), std::back_inserter(result.values));
+        } else {
+            for (uint16_t low : a.values) {
+                if (!containerContains(b, low)) {
+                    result.values.push_back(low);
+                }
+            }
+        }
+        result.cardinality = static_cast<uint32_t>(result.values.size());
+        return result;
+    }
+    uint64_t words[BITMAP_WORDS]; // Clear the bits of b from a bitmap of a
+    uint32_t count;
+    if (a.type == BITMAP && b.type == BITMAP) {
+        count = chosen().subtract(a.words.data(), b.words.data(), words);
+    } else if (a.type == BITMAP && b.type == ARRAY) {
+        std::copy(a.words.begin(), a.words.end(), words);
+        count = a.cardinality;
+        for (uint16_t low : b.values) {
+            count -= static_cast<uint32_t>(testBit(words, low));
+            words[low >> 6] &= ~(uint64_t(1) << (low & 63));
+        }
+    } else {
+        uint64_t first[BITMAP_WORDS] = {}, second[BITMAP_WORDS] = {};
+        toBitmap(a, first);
+        toBitmap(b, second);
+        count = chosen().subtract(first, second, words);
+    }
+    if (count > 0) {
+        fromBitmap(result, words, count);
+    }
+    return result;
+}
+
+Roaring Roaring::intersect(const Roaring& a, const Roaring& b, std::pmr::memory_resource* resource) {
+    Roaring result(resource);
+    for (size_t i = 0, j = 0; i < a.containers.size() && j < b.containers.size();) {
+        if (a.containers[i].key < b.containers[j].key) {
+            ++i;
+        } else if (a.containers[i].key > b.containers[j].key) {
+            ++j;
+        } else {
+            Container both = intersectContainers(a.containers[i++], b.containers[j++], resource);
+            if (both.cardinality > 0) {
+                result.containers.push_back(std::move(both));
+            }
+        }
+    }
+    return result;
+}
+
+Roaring Roaring::unite(const Roaring& a, const Roaring& b, std::pmr::memory_resource* resource) {
+    Roaring result(resource);
+    for (size_t i = 0, j = 0; i < a.containers.size() || j < b.containers.size();) {
+        if (j == b.containers.size() || (i < a.containers.size() && a.containers[i].key < b.containers[j].key)) {
+            result.containers.emplace_back(a.containers[i++], resource);
+        } else if (i == a.containers.size() || a.containers[i].key > b.containers[j].key) {
+            result.containers.emplace_back(b.containers[j++], resource);
+        } else {
+            result.containers.push_back(uniteContainers(a.containers[i++], b.containers[j++], resource));
+        }
+    }
+    return result;
+}
+
+Roaring Roaring::subtract(const Roaring& a, const Roaring& b, std::pmr::memory_resource* resource) {
+    Roaring result(resource);
+    size_t j = 0;
+    for (const Container& container : a.containers) {
+        while (j < b.containers.size() && b.containers[j].key < container.key) {
+            ++j;
+        }
+        if (j == b.containers.size() || b.containers[j].key != container.key) {
+            result.containers.emplace_back(container, resource);
+            continue;
+        }
+        Container rest = subtractContainers(container, b.containers[j], resource);
+        if (rest.cardinality > 0) {
+            result.containers.push_back(std::move(rest));
+        }
+    }
+    return result;
+}
+
+size_t Roaring::memoryUsage() const {
+    size_t bytes = containers.capacity() * sizeof(Container);
+    for (const Container& container : containers) {
+        bytes += container.values.capacity() * sizeof(uint16_t) + container.words.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+size_t Roaring::serializedSize() const {
+    size_t bytes = 2 * sizeof(uint32_t) + containers.size() * sizeof(SavedContainer);
+    for (const Container& container : containers) {
+        bytes += container.type == BITMAP ? BITMAP_BYTES : padded(container.values.size() * sizeof(uint16_t));
+    }
+    return bytes;
+}
+
+const char* Roaring::implementation() {
+    return chosen().name;
+}
+
+bool Roaring::write(std::ostream& out) const {
+    uint32_t counts[2] = {static_cast<uint32_t>(containers.size()), 0};
+    out.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+    for (const Container& container : containers) {
+        SavedContainer saved = {container.key, container.type, 0, container.cardinality, container.type == BITMAP ? 0 : static_cast<uint32_t>(container.values.size()), 0};
+        out.write(reinterpret_cast<const char*>(&saved), sizeof(saved));
+    }
+    for (const Container& container : containers) {
+        if (container.type == BITMAP) {
+            out.write(reinterpret_cast<const char*>(container.words.data()), static_cast<std::streamsize>(BITMAP_BYTES));
+        } else {
+            size_t bytes = container.values.size() * sizeof(uint16_t);
+            out.write(reinterpret_cast<const char*>(container.values.data()), static_cast<std::streamsize>(bytes));
+            pad(out, bytes);
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+bool Roaring::read(const char* data, size_t size, Roaring& out) {
+    out.containers.clear();
+    uint32_t count;
+    if (size < 2 * sizeof(uint32_t)) {
+        return false;
+    }
+    std::memcpy(&count, data, sizeof(count));
+    size_t offset = 2 * sizeof(uint32_t) + static_cast<size_t>(count) * sizeof(SavedContainer); // Start of the contents
+    if (offset > size) {
+        return false;
+    }
+    out.containers.reserve(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        SavedContainer saved;
+        std::memcpy(&saved, data + 2 * sizeof(uint32_t) + i * sizeof(SavedContainer), sizeof(saved));
+        size_t bytes = saved.type == BITMAP ? BITMAP_BYTES : padded(saved.valueCount * sizeof(uint16_t));
+        bool valid = saved.type <= RUN && saved.cardinality > 0 && saved.cardinality <= CHUNK && offset + bytes <= size
+                     && (out.containers.empty() || out.containers.back().key < saved.key)
+                     && (saved.type != ARRAY || (saved.valueCount == saved.cardinality && saved.cardinality <= ARRAY_MAX))
+                     && (saved.type != RUN || (saved.valueCount > 0 && saved.valueCount % 2 == 0));
+        if (!valid) {
+            out.containers.clear();
+            return false;
+        }
+        Container& container = out.containers.emplace_back(saved.key, static_cast<Type>(saved.type), out.resource);
+        container.cardinality = saved.cardinality;
+        if (saved.type == BITMAP) {
+            container.words.resize(BITMAP_WORDS);
+            std::memcpy(container.words.data(), data + offset, BITMAP_BYTES);
+        } else {
+            container.values.resize(saved.valueCount);
+            std::memcpy(container.values.data(), data + offset, saved.valueCount * sizeof(uint16_t));
+        }
+        offset += bytes;
+    }
+    return true;
+}
@@ -0,0 +1,92 @@
+#ifndef ROARING_H // Include guard to prevent multiple inclusions of this header file
+#define ROARING_H // Define the include guard
+
+#include <cstddef> // Include cstddef library for size_t
+#include <cstdint> // Include cstdint library for fixed width integers
+#include <memory_resource> // Include memory_resource library for sets in query scratch memory
+#include <ostream> // Include ostream library for saving
+#include <vector> // Include vector library
+
+// Set of file ids in the style of roaring bitmaps.
+//
+// Ids are split by their high 16 bits into chunks of 65536, and each chunk that has ids is one container,
+// whichever of three is smallest: an array of the sorted low 16 bits when it holds at most ARRAY_MAX ids,
+// a bitmap of 65536 bits when it holds more, or a list of runs of consecutive ids when the ids bunch up.
+// Intersection, union and difference pick a kernel for each pair of container types, and bitmap pairs are
+// combined 256 bits at a time with AVX2 where the processor has it. Each container knows its number of ids,
+// so counting a set is a sum over its containers.
+//
+// Containers are allocated from the memory resource given at construction, QueryArena::current() for the
+// sets a query builds. A set is written to the index as a table of container headers and their contents,
+// and read back with one copy per container.
+class Roaring {
+public:
+    static constexpr uint32_t END = UINT32_MAX; // Returned by next() past the last id
+    static constexpr uint32_t ARRAY_MAX = 4096; // Most ids an array container holds; past it a bitmap is smaller
+    static constexpr uint32_t BITMAP_WORDS = 65536 / 64; // Words of a bitmap container
+
+    explicit Roaring(std::pmr::memory_resource* resource = std::pmr::get_default_resource()); // Empty set
+
+    void add(uint32_t id); // Add an id larger than every id in the set; call optimize() once done
+    void addBitmap(uint16_t key, const uint64_t* words); // Add the ids of chunk key, after every chunk in the set, from a bitmap of BITMAP_WORDS words
+    void optimize(); // Store every container in its smallest form
+
+    bool empty() const { return containers.empty(); } // Whether the set has no ids
+    uint64_t cardinality() const; // Number of ids in the set
+    bool contains(uint32_t id) const; // Whether an id is in the set
+    uint32_t next(uint32_t id) const; // First id >= id in the set, or END
+    uint32_t nextAbsent(uint32_t id) const; // First id >= id not in the set, or END
+
+    static Roaring intersect(const Roaring& a, const Roaring& b, std::pmr::memory_resource* resource); // Ids in both sets
+    static Roaring unite(const Roaring& a, const Roaring& b, std::pmr::memory_resource* resource); // Ids in either set
+    static Roaring subtract(const Roaring& a, const Roaring& b, std::pmr::memory_resource* resource); // Ids of a not in b
+
+    static const char* implementation(); // Instruction set of the bitmap kernels: "avx2" or "scalar", capped by SEARCH_ROARING=scalar
+
+    size_t memoryUsage() const; // Heap bytes held by the containers
+    size_t serializedSize() const; // Bytes written by write()
+    bool write(std::ostream& out) const; // Save the set; the stream must be at an 8-byte boundary
+    static bool read(const char* data, size_t size, Roaring& out); // Load a set saved by write(), returns false if the bytes are not one
+
+private:
+    enum Type : uint8_t { ARRAY = 0, BITMAP = 1, RUN = 2 }; // Kinds of containers
+
+    struct Container { // Ids of one chunk of 65536
+        Container(uint16_t key, Type type, std::pmr::memory_resource* resource) : key(key), type(type), cardinality(0), values(resource), words(resource) {}
+        Container(const Container& other, std::pmr::memory_resource* resource) : key(other.key), type(other.type), cardinality(other.cardinality), values(other.values, resource), words(other.words, resource) {}
+
+        uint16_t key; // High 16 bits of every id in it
+        Type type; // Form of its ids
+        uint32_t cardinality; // Number of ids
+        std::pmr::vector<uint16_t> values; // Sorted low bits of an ARRAY, or (start, length - 1) pairs of a RUN
+        std::pmr::vector<uint64_t> words; // BITMAP_WORDS bits of a BITMAP
+    };
+
+    struct SavedContainer { // Header of one container in a saved set, followed by the contents of every container in order
+        uint16_t key; // High 16 bits of its ids
+        uint8_t type; // Type
+        uint8_t reserved; // Padding
+        uint32_t cardinality; // Number of ids
+        uint32_t valueCount; // Number of uint16_t values of an ARRAY or RUN, 0 for a BITMAP
+        uint32_t reserved2; // Padding
+    };
+
+    static void toBitmap(const Container& container, uint64_t* words); // Set the bits of a container's ids in zeroed words
+    static uint32_t runCount(const Container& container); // Number of runs of consecutive ids
+    static void fromBitmap(Container& container, const uint64_t* words, uint32_t cardinality); // Store a container's ids from a bitmap in their smallest form
+    static void pick(Container& container); // Store a container in its smallest form
+    static bool containerContains(const Container& container, uint16_t low); // Whether a container has a low half
+    static uint32_t containerNext(const Container& container, uint32_t low); // First low half >= low in a container, or 65536
+    static uint32_t containerNextAbsent(const Container& container, uint32_t low); // First low half >= low not in a container, up to 65536
+
+    static Container intersectContainers(const Container& a, const Container& b, std::pmr::memory_resource* resource); // Kernel for each pair of types
+    static Container uniteContainers(const Container& a, const Container& b, std::pmr::memory_resource* resource);
+    static Container subtractContainers(const Container& a, const Container& b, std::pmr::memory_resource* resource);
+
+    size_t find(uint16_t key) const; // Index of the first container with a key >= key
+
+    std::pmr::memory_resource* resource; // Source of the containers' memory
+    std::pmr::vector<Container> containers; // Containers by increasing key
+};
+
+#endif // ROARING_H // End of include guard
@@ -1,155 +1,926 @@
 #include "searchEngine.h" // Include the header file for the SearchEngine class
-#include "rapidjson/document.h" // Include the RapidJSON document header
-#include "rapidjson/istreamwrapper.h" // Include the RapidJSON input stream wrapper header
+#include "shardSet.h" // Include the in-process shards
+#include "remoteShards.h" // Include the shard server client
+#include "deadline.h" // Include the request deadline that may cut a search short
+#include "logger.h" // Include the optional search log
+#include "metrics.h" // Include the search counters and timers
+#include "tokenizer.h" // Include the word splitter shared with the query parser
+#include "rapidjson/reader.h" // Include the RapidJSON SAX reader header
+
+#include <atomic> // Include the atomic library for the shared work queue index
+#include <cerrno> // Include the cerrno library for EINTR
+#include <cstdio> // Include the cstdio library for removing stale logs
+#include <cstdlib> // Include the cstdlib library for std::getenv
+#include <deque> // Include the deque library for strings copied out of the parser
+#include <fcntl.h> // Include open
+#include <memory_resource> // Include the memory_resource library for the build workers' pools
+#include <string_view> // Include the string_view library for words inside the parse buffer
+#include <sys/stat.h> // Include stat and fstat for file sizes and a missing index
+#include <thread> // Include the thread library for the build workers
+#include <unistd.h> // Include read and close
+#include <unordered_set> // Include the unordered_set library for files seen on disk
 
 namespace fs = std::filesystem; // Create an alias for the std::filesystem namespace
 
-SearchEngine::SearchEngine(const std::string& folderPath, const std::string &filenamepath, const std::string& osavePath, const std::string& nsavePath, const std::string& wsavePath, const std::string& fsavePath) {
-    if (!wordMap.load(filenamepath, osavePath, nsavePath, wsavePath, fsavePath)) { // Load the word map, if it fails, build from scratch
-        buildFromScratch(folderPath); // Build the word map from scratch
-        wordMap.save(filenamepath, osavePath, nsavePath, wsavePath, fsavePath); // Save the word map to the specified paths
+namespace {
+
+// Words of one field found by one build worker, in a pool of their own. Words, their nodes and their lists
+// are many small allocations that the pool carves out of large chunks, and dropping the map once it is
+// merged hands the chunks back all at once.
+template <typename List>
+struct PooledWords {
+    std::pmr::unsynchronized_pool_resource pool; // Memory of the map, used by one thread at a time
+    std::pmr::unordered_map<std::pmr::string, List> lists{&pool}; // List of each word
+};
+
+// Words found by one build worker, per field, keyed by word
+struct PartialIndex {
+    std::unique_ptr<PooledWords<std::pmr::vector<std::pair<int, impact::Counts>>>> ids[indexfile::FIELD_COUNT]; // Ids of the files each word appears in, with its occurrences in each zone
+    std::unique_ptr<PooledWords<std::pmr::vector<uint32_t>>> positions[indexfile::FIELD_COUNT]; // (id, count, positions...) runs of each word, one per file
+
+    PartialIndex() {
+        for (uint32_t field = 0; field < indexfile::FIELD_COUNT; ++field) {
+            ids[field] = std::make_unique<PooledWords<std::pmr::vector<std::pair<int, impact::Counts>>>>();
+            positions[field] = std::make_unique<PooledWords<std::pmr::vector<uint32_t>>>();
+        }
     }
+};
+
+// One word of a file where it occurs
+struct Occurrence {
+    std::string_view text; // Lowercased word, inside the file's buffer
+    uint32_t position; // Position in its field
+    indexfile::Zone zone; // Part of the file it is in
+};
+
+const uint32_t COMPACT_RATIO = 4; // Compact after an update once tombstones or in-memory posting lists reach a quarter of the index
+const size_t MAX_LOG_BYTES = 64 * 1024 * 1024; // Checkpoint once the write-ahead log grows past this
+const size_t CACHE_DEPTH = 100; // Fewest matches computed for a cached query
+const size_t CACHE_PAGES = 5; // Pages of the requested size computed beyond the requested one, so flipping through them hits the cache
+const size_t CACHE_MAX_DEPTH = 1000; // Most matches computed for a cached query, unless the requested page itself goes deeper
+
+// Matches computed for a cached query: whole pages of k beyond the one requested, so page sizes that do not
+// divide the offsets, like the GUI's extra result for a next page, still find the next pages in the entry
+size_t cacheDepth(size_t count, size_t k, size_t offset) {
+    if (k == 0) { // Only facets were asked for
+        return std::max(count, CACHE_DEPTH);
+    }
+    size_t pages = offset / k + 1 + CACHE_PAGES;
+    size_t depth = k > CACHE_MAX_DEPTH / pages ? CACHE_MAX_DEPTH : pages * k;
+    return std::max({count, CACHE_DEPTH, depth});
 }
 
-SearchEngine::~SearchEngine() {} // Destructor for the SearchEngine class
+// Resolve the number of build threads: explicit value, then SEARCH_THREADS, then the number of cores
+unsigned resolveThreadCount(unsigned requested) {
+    if (requested > 0) { // An explicit count from the constructor wins
+        return requested;
+    }
+    if (const char* env = std::getenv("SEARCH_THREADS")) { // Fall back to the environment
+        int fromEnv = std::atoi(env); // Parse the environment value
+        if (fromEnv > 0) {
+            return static_cast<unsigned>(fromEnv);
+        }
+    }
+    unsigned cores = std::thread::hardware_concurrency(); // Finally use the number of cores
+    return cores > 0 ? cores : 1;
+}
 
-std::vector<std::string> SearchEngine::search(const std::string& searchTerms) const {
-    auto start = std::chrono::high_resolution_clock::now();
+// Merge the same field of every partial index, adding ids in ascending order so the result does not depend on the thread count.
+// The associations are also recorded in batch, when given, with ids counted from firstId.
+void mergeField(std::vector<PartialIndex>& partials, indexfile::Field field, WordMap& target, WriteAheadLog::Batch* batch, int firstId) {
+    std::pmr::unsynchronized_pool_resource pool; // Memory of the merged lists, released when the field is done
+    std::pmr::unordered_map<std::pmr::string, std::pmr::vector<std::pair<int, impact::Counts>>> merged(&pool); // Ids of every file per word across all workers
+    for (auto& partial : partials) { // Gather each worker's ids
+        for (auto& pair : partial.ids[field]->lists) {
+            auto& ids = merged[pair.first];
+            ids.insert(ids.end(), pair.second.begin(), pair.second.end());
+        }
+        partial.ids[field].reset(); // Release the worker's copy as soon as it is merged
+    }
+    for (auto& pair : merged) { // Add the ids to the word map in a fixed order
+        std::sort(pair.second.begin(), pair.second.end(), [](const auto& a, const auto& b) { return a.first < b.first; }); // Each file once per word
+        uint32_t term = target.addTerm(pair.first); // Look the word up once for all of its files
+        for (const auto& posting : pair.second) {
+            target.associate(field, term, posting.first, posting.second);
+        }
+        if (batch) {
+            batch->associate(field, pair.first, pair.second, firstId);
+        }
+    }
+}
 
-    std::unordered_map<std::string, int> result; // Map to store file paths and their relevancy scores
-    std::unordered_set<std::string> terms = parse(searchTerms); // Parse the search terms
+// Merge the positions of every partial index, adding files in ascending id order like mergeField
+void mergePositions(std::vector<PartialIndex>& partials, WordMap& target, WriteAheadLog::Batch* batch, int firstId) {
+    for (uint32_t field = 0; field < indexfile::FIELD_COUNT; ++field) { // For each field
+        std::pmr::unsynchronized_pool_resource pool; // Memory of the merged lists, released when the field is done
+        std::pmr::unordered_map<std::string_view, std::pmr::vector<const uint32_t*>> merged(&pool); // Runs of every file per word across all workers
+        for (auto& partial : partials) {
+            for (const auto& pair : partial.positions[field]->lists) {
+                auto& runs = merged[pair.first];
+                for (size_t i = 0; i + 1 < pair.second.size(); i += 2 + pair.second[i + 1]) {
+                    runs.push_back(pair.second.data() + i);
+                }
+            }
+        }
+        for (auto& pair : merged) { // Add the runs to the word map in a fixed order
+            std::sort(pair.second.begin(), pair.second.end(), [](const uint32_t* a, const uint32_t* b) { return a[0] < b[0]; });
+            uint32_t term = target.addTerm(pair.first);
+            for (const uint32_t* run : pair.second) {
+                target.associatePositions(static_cast<indexfile::Field>(field), term, static_cast<int>(run[0]), run + 2, run[1]);
+            }
+            if (batch) {
+                batch->associatePositions(static_cast<indexfile::Field>(field), pair.first, pair.second, firstId);
+            }
+        }
+        merged.clear(); // Drop the views before the runs they point into
+        for (auto& partial : partials) { // Release the workers' copies
+            partial.positions[field].reset();
+        }
+    }
+}
+
+}
+
+struct SearchEngine::RelevantWords {
+    std::vector<Occurrence> tokens[3]; // Every non-empty organization, person and other word, lowercased, with its position in the field
+    std::deque<std::string> copies; // Strings the parser could not leave in the buffer, owning the views that point into them
+    std::pmr::vector<tokenizer::Word> split; // Words of the string being read, reused for every string
+    Document document; // Title, date, URL and text as written in the file, for the document store
+    std::string site; // Value of "thread.site" as written, for filtering and facets
+};
 
-    if (terms.empty()) {
-        return {};
+bool Shard::owns(const std::string& filePath) const {
+    return count <= 1 || Manifest::hash(filePath.data(), filePath.size()) % count == index; // The path hash is stable across runs and machines
+}
+
+std::string Shard::indexPath(const std::string& basePath) const {
+    if (count <= 1) {
+        return basePath;
+    }
+    size_t slash = basePath.find_last_of('/');
+    size_t dot = basePath.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) { // No extension
+        return basePath + "." + std::to_string(index);
     }
+    return basePath.substr(0, dot) + "." + std::to_string(index) + basePath.substr(dot);
+}
 
-    for (const auto& term : terms) {
-        std::unordered_map<std::string, int> files;
-        if (term.rfind("org:", 0) == 0) {
-            files = wordMap.getFilesByOrg(term.substr(4));
-        } else if (term.rfind("person:", 0) == 0) {
-            files = wordMap.getFilesByName(term.substr(7));
-        } else {
-            files = wordMap.getFilesByWord(term);
+SearchEngine::SearchEngine(const std::string& folderPath, const std::string& indexPath, unsigned threadCount, Shard shard) : threadCount(resolveThreadCount(threadCount)), folderPath(folderPath), indexPath(indexPath), shard(shard), cache(ResultCache::resolveCapacity()) {
+    auto loaded = std::make_shared<WordMap>(); // Mapped index
+    struct stat status;
+    if (stat(indexPath.c_str(), &status) == 0 && loaded->loadBinary(indexPath)) { // Map the binary index; a missing one is built without an error
+        uint64_t indexSequence = loaded->mappedSequence(); // Last logged update the index holds
+        uint64_t manifestSequence = 0; // Last logged update the manifest holds
+        if (!manifest.load(indexPath + ".manifest", &manifestSequence) || manifestSequence > indexSequence) { // An index saved without a manifest is taken to match the files as they are now
+            manifest.clear();
+            for (uint32_t id = 0; id < loaded->fileCount(); ++id) {
+                FileState state; // Files that are gone keep an empty state and are removed by the refresh below
+                Manifest::stat(loaded->getFile(id), state);
+                manifest.set(loaded->getFile(id), state);
+            }
+            manifestSequence = indexSequence;
+        }
+        wal.open(indexPath + ".wal", indexSequence);
+        size_t replayed = wal.replay(indexSequence, loaded.get(), manifestSequence, &manifest); // Updates made after the last checkpoint
+        if (replayed > 0) {
+            std::cout << replayed << " updates replayed from the write-ahead log.\n"; // Print the number of updates recovered
         }
+        wordMap = loaded;
+        refresh(); // Catch up with changes made while the index was not in use
+        return;
+    }
+    wal.open(indexPath + ".wal"); // Any records in it belong to the index being replaced
+    buildFromScratch(folderPath); // Build the word map from scratch
+    saveIndex(indexPath); // Save the word map to the index file, emptying the log
+    if (loaded->loadBinary(indexPath)) { // Serve from the saved file, like a restart would
+        wordMap = loaded;
+    }
+}
+
+SearchEngine::SearchEngine(const std::string& folderPath, const std::string &filenamepath, const std::string& osavePath, const std::string& nsavePath, const std::string& wsavePath, const std::string& fsavePath, unsigned threadCount) : threadCount(resolveThreadCount(threadCount)), folderPath(folderPath), cache(ResultCache::resolveCapacity()) {
+    auto loaded = std::make_shared<WordMap>(); // Word map read from the save files
+    if (!loaded->load(filenamepath, osavePath, nsavePath, wsavePath, fsavePath)) { // Load the word map, if it fails, build from scratch
+        buildFromScratch(folderPath); // Build the word map from scratch
+        wordMap->save(filenamepath, osavePath, nsavePath, wsavePath, fsavePath); // Save the word map to the specified paths
+        return;
+    }
+    wordMap = loaded;
+}
+
+SearchEngine::~SearchEngine() {
+    watcher.stop(); // No update may run while the engine is destroyed
+    waitForCheckpoint();
+    if (checkpointThread.joinable()) {
+        checkpointThread.join();
+    }
+} // Destructor for the SearchEngine class
 
-        for (const auto& file : files) {
-            result[file.first] += file.second; // Aggregate relevancy scores
+std::unique_ptr<Searcher> openSearchEngine(int argc, char* argv[]) {
+    bool useCsv = false; // Whether to use the legacy CSV save files
+    bool migrate = false; // Whether to convert the CSV save files to the binary index
+    uint32_t shardCount = 1; // Number of engines searched in parallel in this process
+    Shard shard; // Part of the corpus served alone
+    std::vector<std::string> remotes; // Shard servers to search instead of a local index
+    for (int i = 1; i < argc; ++i) { // Read command line flags
+        std::string arg = argv[i];
+        if (arg == "--csv") {
+            useCsv = true;
+        } else if (arg == "--migrate") {
+            useCsv = migrate = true;
+        } else if (arg == "--shards" && i + 1 < argc) {
+            shardCount = static_cast<uint32_t>(std::max(1, std::atoi(argv[++i])));
+        } else if (arg == "--shard" && i + 1 < argc) {
+            std::string value = argv[++i]; // I/N
+            size_t slash = value.find('/');
+            shard.index = static_cast<uint32_t>(std::atoi(value.substr(0, slash).c_str()));
+            shard.count = slash == std::string::npos ? 1 : static_cast<uint32_t>(std::max(1, std::atoi(value.substr(slash + 1).c_str())));
+            if (shard.index >= shard.count) {
+                std::cerr << "Invalid shard " << value << ", serving the whole corpus" << std::endl; // Print error message
+                shard = Shard();
+            }
+        } else if (arg == "--remote" && i + 1 < argc) {
+            std::istringstream list(argv[++i]); // Comma-separated host:port list
+            std::string address;
+            while (std::getline(list, address, ',')) {
+                if (!address.empty()) {
+                    remotes.push_back(address);
+                }
+            }
         }
     }
 
-    // Convert the result map to a vector and sort by relevancy score
-    std::vector<std::pair<std::string, int>> sortedResults(result.begin(), result.end());
-    std::sort(sortedResults.begin(), sortedResults.end(), [](const auto& a, const auto& b) {
-        return b.second < a.second; // Sort in descending order of relevancy score
-    });
+    if (!remotes.empty()) {
+        return std::make_unique<RemoteShards>(remotes); // Aggregate shard servers
+    }
+    if (shardCount > 1) {
+        return std::make_unique<ShardSet>("docs", "index.bin", shardCount); // Map or build one binary index per shard
+    }
+    if (!useCsv) {
+        return std::make_unique<SearchEngine>("docs", shard.indexPath("index.bin"), 0, shard); // Map or build the binary index
+    }
+    auto engine = std::make_unique<SearchEngine>("docs", "fnsavefile.csv", "osavefile.csv", "nsavefile.csv", "wsavefile.csv", "fsavefile.csv"); // Load or build the CSV save files
+    if (migrate) {
+        engine->saveIndex("index.bin"); // Write the binary index for the next start
+    }
+    return engine;
+}
 
-    std::vector<std::string> finalResults;
-    for (const auto& file : sortedResults) {
-        finalResults.push_back(file.first);
+bool SearchEngine::saveIndex(const std::string& indexPath) {
+    waitForCheckpoint(); // A checkpoint writes the same files
+    std::lock_guard<std::mutex> lock(updateMutex); // The manifest must describe the saved snapshot
+    uint64_t sequence = wal.lastSequence(); // The saved index holds every logged update
+    if (!snapshot()->saveBinary(indexPath, sequence) || !manifest.save(indexPath + ".manifest", sequence)) { // Write the word map as a binary index, then its manifest
+        return false;
+    }
+    if (indexPath == this->indexPath) {
+        return wal.truncate(sequence);
     }
+    std::remove((indexPath + ".wal").c_str()); // A log left from an older index there would be replayed onto this one
+    return true;
+}
 
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> duration = end - start;
-    std::cout << finalResults.size() << " results for " << searchTerms << " in " << duration.count() << " seconds.\n";
+std::shared_ptr<const WordMap> SearchEngine::snapshot() const {
+    return std::atomic_load(&wordMap);
+}
 
-    return finalResults;
+void SearchEngine::publish(std::shared_ptr<const WordMap> next) {
+    std::atomic_store(&wordMap, std::move(next));
+    ++generation; // After the store: a search reads the generation before the snapshot, so results stamped with it are never older than it
 }
 
-void SearchEngine::buildFromScratch(const std::string& folderPath) {
-    std::cout << "Reading JSONs..." << std::endl; // Print a message indicating the start of JSON reading
-    auto start = std::chrono::high_resolution_clock::now(); // Start the timer
+bool SearchEngine::refresh() {
+    return update({folderPath}); // Check every file in the folder
+}
 
-    for (const auto& entry : fs::recursive_directory_iterator(folderPath)) { // Iterate over each file in the folder
-        if (entry.is_regular_file()) { // Check if the entry is a regular file
-            std::string filePath = entry.path().string(); // Get the file path as a string
+bool SearchEngine::update(const std::vector<std::string>& paths) {
+    if (indexPath.empty()) {
+        std::cerr << "Incremental updates need the binary index" << std::endl; // Print error message
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(updateMutex); // One update at a time
+    auto start = std::chrono::high_resolution_clock::now(); // Start the timer
 
-            std::vector<std::unordered_set<std::string>> words = getRelevantData(filePath); // Get the relevant data from the file
-            for (const auto& word : words[0]) { // Iterate over the organization words
-                std::string lowerWord = word; // Copy the word to a new string
-                std::transform(lowerWord.begin(), lowerWord.end(), lowerWord.begin(), ::tolower); // Convert the word to lowercase
-                wordMap.associateOrg(lowerWord, filePath); // Associate the word with the file path in the word map
+    std::vector<std::string> changed; // Files to index again
+    std::vector<std::string> removed; // Files to drop
+    WriteAheadLog::Batch batch; // Changes to log
+    std::unordered_set<std::string> seen; // Files found on disk
+    auto check = [&](const std::string& filePath) { // Compare a file on disk with the manifest
+        if (!shard.owns(filePath) || !seen.insert(filePath).second) { // Files of other shards are left to them
+            return;
+        }
+        const FileState* indexed = manifest.find(filePath);
+        FileState state;
+        if (!Manifest::stat(filePath, state)) { // Gone since it was listed
+            seen.erase(filePath);
+            return;
+        }
+        if (indexed && indexed->size == state.size && indexed->mtime == state.mtime) { // Unchanged
+            return;
+        }
+        if (indexed && indexed->hash != 0 && indexed->size == state.size && Manifest::hash(filePath) == indexed->hash) { // Touched but the same contents
+            state.hash = indexed->hash;
+            manifest.set(filePath, state);
+            batch.setState(filePath, state);
+            return;
+        }
+        changed.push_back(filePath);
+    };
+    auto forgetMissing = [&](const std::string& path) { // Drop indexed files at or below a path that are no longer on disk
+        std::string prefix = path;
+        while (prefix.size() > 1 && prefix.back() == '/') {
+            prefix.pop_back();
+        }
+        prefix += "/";
+        for (const auto& pair : manifest.files()) {
+            bool below = pair.first == path || pair.first.compare(0, prefix.size(), prefix) == 0;
+            if (below && !seen.count(pair.first)) {
+                removed.push_back(pair.first);
             }
+        }
+    };
 
-            for (const auto& word : words[1]) { // Iterate over the person words
-                std::string lowerWord = word; // Copy the word to a new string
-                std::transform(lowerWord.begin(), lowerWord.end(), lowerWord.begin(), ::tolower); // Convert the word to lowercase
-                wordMap.associateName(lowerWord, filePath); // Associate the word with the file path in the word map
+    for (const auto& path : paths) { // Find what changed at each path
+        std::error_code error; // Files may disappear while they are checked
+        if (fs::is_regular_file(path, error)) {
+            check(path);
+        } else if (fs::is_directory(path, error)) { // Check every file below a folder, and drop indexed files no longer in it
+            for (fs::recursive_directory_iterator it(path, error), end; !error && it != end; it.increment(error)) {
+                if (it->is_regular_file(error)) {
+                    check(it->path().string());
+                }
             }
+            forgetMissing(path);
+        } else if (manifest.find(path)) { // A deleted file
+            removed.push_back(path);
+        } else { // Possibly a deleted folder
+            forgetMissing(path);
+        }
+    }
+    std::sort(changed.begin(), changed.end()); // New files get ids in path order, like a full build
+    std::sort(removed.begin(), removed.end());
+    removed.erase(std::unique(removed.begin(), removed.end()), removed.end());
+    if (changed.empty() && removed.empty()) {
+        return batch.empty() || wal.append(batch); // Only states changed; a lost record just costs hashing the files again
+    }
+
+    auto next = std::make_shared<WordMap>(*snapshot()); // Searches keep using the current snapshot meanwhile
+    for (const auto& filePath : removed) {
+        next->removeFile(filePath);
+        manifest.erase(filePath);
+        batch.removeFile(filePath);
+    }
+    for (const auto& filePath : changed) { // A changed file gets a new id; its old one becomes a tombstone
+        next->removeFile(filePath);
+        batch.removeFile(filePath);
+    }
+    indexFiles(*next, changed, &batch);
+    if (!wal.append(batch)) { // Still served, and saved by the next checkpoint; a crash before it loses the update until the files are refreshed
+        ++unloggedUpdates;
+    }
+    publish(next); // Publish the new snapshot
+
+    auto end = std::chrono::high_resolution_clock::now(); // End the timer
+    std::chrono::duration<double> duration = end - start; // Calculate the duration
+    std::cout << changed.size() << " files indexed and " << removed.size() << " removed in " << duration.count() << " seconds.\n"; // Print the duration
+
+    // Compact once tombstones or posting lists copied out of the mapped file take a large share of the index, or the log grows long
+    if (next->removedCount() * COMPACT_RATIO > next->fileCount() || (next->mappedBytes() > 0 && next->memoryUsage() * COMPACT_RATIO > next->mappedBytes()) || wal.size() > MAX_LOG_BYTES || unloggedUpdates > 0) {
+        startCheckpoint();
+    }
+    return true;
+}
+
+bool SearchEngine::checkpoint() {
+    if (indexPath.empty()) {
+        std::cerr << "Checkpoints need the binary index" << std::endl; // Print error message
+        return false;
+    }
+    waitForCheckpoint(); // One already running may have missed the latest updates
+    {
+        std::lock_guard<std::mutex> lock(updateMutex);
+        startCheckpoint();
+    }
+    waitForCheckpoint();
+    std::lock_guard<std::mutex> lock(checkpointMutex);
+    return checkpointSaved;
+}
+
+void SearchEngine::startCheckpoint() {
+    std::lock_guard<std::mutex> lock(checkpointMutex);
+    if (checkpointRunning) { // The next update tries again
+        return;
+    }
+    if (checkpointThread.joinable()) { // Finished, only returning
+        checkpointThread.join();
+    }
+    checkpointRunning = true;
+    checkpointThread = std::thread(&SearchEngine::runCheckpoint, this, snapshot(), manifest, wal.lastSequence(), unloggedUpdates); // The snapshot never changes, the manifest is copied
+}
+
+void SearchEngine::runCheckpoint(std::shared_ptr<const WordMap> saved, Manifest files, uint64_t sequence, uint64_t unlogged) {
+    bool ok = saved->saveBinary(indexPath, sequence) && files.save(indexPath + ".manifest", sequence); // Write the compacted index, then its manifest; neither needs the lock
+    auto mapped = std::make_shared<WordMap>();
+    ok = ok && mapped->loadBinary(indexPath);
+    saved.reset();
+    if (ok) {
+        std::lock_guard<std::mutex> lock(updateMutex); // Briefly: only the updates logged since the snapshot are applied again
+        if (unloggedUpdates == unlogged) { // Every update since the snapshot can be replayed onto the saved index
+            size_t replayed = wal.replay(sequence, mapped.get(), UINT64_MAX, nullptr);
+            publish(mapped); // Searches still running keep the old mapping alive; file ids may have been renumbered
+            wal.truncate(sequence);
+            unloggedUpdates = 0;
+            std::cout << "Checkpoint saved with " << replayed << " updates made while saving.\n"; // Print a message
+        }
+    }
+    std::lock_guard<std::mutex> lock(checkpointMutex);
+    checkpointRunning = false;
+    checkpointSaved = ok;
+    checkpointDone.notify_all();
+}
+
+void SearchEngine::waitForCheckpoint() {
+    std::unique_lock<std::mutex> lock(checkpointMutex);
+    checkpointDone.wait(lock, [this] { return !checkpointRunning; });
+}
+
+bool SearchEngine::cacheCounters(ResultCache::Counters& counters) const {
+    counters = cache.counters();
+    return true;
+}
 
-            for (const auto& word : words[2]) { // Iterate over the other words
-                std::string lowerWord = word; // Copy the word to a new string
-                std::transform(lowerWord.begin(), lowerWord.end(), lowerWord.begin(), ::tolower); // Convert the word to lowercase
-                wordMap.associateWord(lowerWord, filePath); // Associate the word with the file path in the word map
+bool SearchEngine::watch() {
+    if (indexPath.empty()) {
+        std::cerr << "Watching the folder needs the binary index" << std::endl; // Print error message
+        return false;
+    }
+    return watcher.start(folderPath, [this](const std::vector<std::string>& paths) { update(paths); });
+}
+
+void SearchEngine::gauges(const std::string& labels, std::vector<metrics::Gauge>& out) const {
+    static const char* const FIELD_NAMES[indexfile::FIELD_COUNT] = {"org", "name", "word"};
+    std::shared_ptr<const WordMap> current = snapshot();
+    std::string prefix = labels.empty() ? "" : labels + ","; // Caller's labels come first
+    out.push_back({"search_index_files", "Files in the index, removed ones excluded", labels, static_cast<double>(current->fileCount() - current->removedCount())});
+    out.push_back({"search_index_removed_files", "Removed files still taking ids until the next checkpoint", labels, static_cast<double>(current->removedCount())});
+    out.push_back({"search_index_generation", "Snapshots published since the engine started", labels, static_cast<double>(generation.load())});
+    out.push_back({"search_index_mapped_bytes", "Size of the mapped index file", labels, static_cast<double>(current->mappedBytes())});
+    out.push_back({"search_index_memory_bytes", "Approximate heap bytes of the index held in memory", labels, static_cast<double>(current->memoryUsage())});
+    for (uint32_t field = 0; field < indexfile::FIELD_COUNT; ++field) {
+        WordMap::FieldSize size = current->fieldSize(static_cast<indexfile::Field>(field));
+        std::string mapped = prefix + "field=\"" + FIELD_NAMES[field] + "\",storage=\"mapped\"";
+        std::string memory = prefix + "field=\"" + FIELD_NAMES[field] + "\",storage=\"memory\"";
+        out.push_back({"search_index_posting_lists", "Posting lists per field, in the mapped file and in memory", mapped, static_cast<double>(size.mappedLists)});
+        out.push_back({"search_index_posting_lists", "Posting lists per field, in the mapped file and in memory", memory, static_cast<double>(size.memoryLists)});
+        out.push_back({"search_index_posting_bytes", "Bytes of postings and positions per field, in the mapped file and in memory", mapped, static_cast<double>(size.mappedBytes)});
+        out.push_back({"search_index_posting_bytes", "Bytes of postings and positions per field, in the mapped file and in memory", memory, static_cast<double>(size.memoryBytes)});
+    }
+    ResultCache::Counters counters = cache.counters();
+    out.push_back({"search_cache_entries", "Entries held by the result cache", labels, static_cast<double>(counters.entries)});
+    out.push_back({"search_cache_bytes", "Approximate bytes held by the result cache", labels, static_cast<double>(counters.bytes)});
+}
+
+void SearchEngine::search(const std::string& searchTerms, std::vector<std::string>& results, size_t k, size_t offset, Facets* facets) const {
+    auto start = std::chrono::steady_clock::now();
+    metrics::trace() = {}; // Stages of this search only
+    QueryArena::Scope scratch; // Query nodes, iterators and matches live in this thread's arena until the search returns
+
+    std::unique_ptr<QueryNode> query = parse(searchTerms); // Parse the search terms
+    if (facets) { // Nothing counted yet
+        facets->matches = 0;
+        for (auto& values : facets->values) {
+            values.clear();
+        }
+    }
+
+    if (!query || (k == 0 && !facets)) {
+        results.clear();
+        return;
+    }
+
+    size_t count = k > SIZE_MAX - offset ? SIZE_MAX : offset + k; // Number of best matches needed to fill the page
+    std::pmr::string key(QueryArena::current()); // Equivalent queries share a cache entry
+    query->appendString(key);
+    uint64_t stamp = generation.load(); // Read before the snapshot, see publish
+    std::shared_ptr<const CachedResults> cachedResults = cache.find(key, stamp, count, facets);
+    std::shared_ptr<const WordMap> cachedIndex = cachedResults ? cachedResults->index.lock() : nullptr; // Null once that snapshot was replaced and released, and the query is searched again
+    bool cached = cachedIndex != nullptr;
+    size_t found = 0; // Paths written to results
+    if (cached) {
+        for (size_t i = offset; i < cachedResults->ids.size() && i - offset < k; ++i) { // Paths of the page from the snapshot the ids belong to
+            setResult(results, found++, cachedIndex->filePath(cachedResults->ids[i]));
+        }
+        if (facets) { // Counted with at least as many values of each kind as wanted
+            size_t limit = facets->limit;
+            *facets = *cachedResults->facets;
+            facets->limit = limit;
+            facets->trim();
+        }
+    } else {
+        std::shared_ptr<const WordMap> current = snapshot(); // Updates published during the search do not affect it
+        size_t depth = cache.enabled() ? cacheDepth(count, k, offset) : count; // Fill a few pages at once for the cache
+        std::pmr::vector<std::pair<uint32_t, double>> matches = topK(*query, *current, depth, nullptr, facets); // Best matches, best first; counting facets scores every match
+
+        for (size_t i = offset; i < matches.size() && i - offset < k; ++i) { // Resolve paths only for the requested page
+            setResult(results, found++, current->filePath(matches[i].first));
+        }
+        Deadline* deadline = Deadline::current();
+        if (cache.enabled() && !(deadline && deadline->wasCut())) { // Matches of a search cut short are not kept
+            auto computed = std::make_shared<CachedResults>();
+            computed->generation = stamp;
+            computed->complete = matches.size() < depth;
+            computed->index = current;
+            computed->ids.reserve(matches.size());
+            for (const auto& match : matches) {
+                computed->ids.push_back(match.first);
+            }
+            if (facets) { // Later pages of the query, with or without facets, are answered from the entry
+                computed->facets = std::make_shared<Facets>(*facets);
             }
+            cache.insert(key, std::move(computed));
+        }
+    }
+    results.resize(found);
+
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    metrics::record(metrics::SEARCH, static_cast<uint64_t>(duration.count() * 1e9));
+    metrics::add(metrics::QUERIES);
+    metrics::add(metrics::RESULTS, found);
+    if (logger::enabled()) { // Formatting the line is skipped unless someone reads it
+        logger::write(std::to_string(found) + " results for " + searchTerms + " in " + std::to_string(duration.count()) + " seconds" + (cached ? " from the cache" : "") + " (" + metrics::describe(metrics::trace()) + ").");
+    }
+}
+
+CollectionStats SearchEngine::stats(const QueryNode& query) const {
+    QueryArena::Scope scratch; // Expansions of patterns and fuzzy words
+    return collectStats(query, *snapshot());
+}
+
+std::vector<ScoredFile> SearchEngine::top(const QueryNode& query, const CollectionStats& stats, size_t count, Facets* facets) const {
+    QueryArena::Scope scratch; // Iterators and matches, on the thread running this shard
+    std::shared_ptr<const WordMap> current = snapshot(); // An update since stats were collected only shifts scores slightly
+    std::vector<ScoredFile> results;
+    for (const auto& match : topK(query, *current, count, &stats, facets)) { // Best matches, best first
+        results.push_back({match.second, current->getFile(match.first)});
+    }
+    return results;
+}
+
+void SearchEngine::documents(const std::vector<uint64_t>& ids, std::vector<Document>& out) const {
+    std::shared_ptr<const WordMap> current = snapshot();
+    out.assign(ids.size(), Document());
+    std::string buffer; // Contents of a file without a stored document
+    RelevantWords words; // Its fields
+    for (size_t i = 0; i < ids.size(); ++i) {
+        uint32_t file = current->findDocument(ids[i]);
+        if (file == UINT32_MAX || current->getDocument(file, out[i])) { // Not indexed here, or stored
+            continue;
+        }
+        uint64_t hash; // Unused
+        if (getRelevantData(current->getFile(file), buffer, words, hash)) { // Indexed from save files, which keep no documents
+            out[i] = std::move(words.document);
+            out[i].id = ids[i];
+            out[i].path = current->getFile(file);
+        }
+    }
+}
+
+void SearchEngine::buildFromScratch(const std::string& folderPath) {
+    std::cout << "Reading JSONs with " << threadCount << " threads..." << std::endl; // Print a message indicating the start of JSON reading
+    auto start = std::chrono::high_resolution_clock::now(); // Start the timer
+
+    std::vector<std::string> filePaths; // Work queue of every file to index
+    for (const auto& entry : fs::recursive_directory_iterator(folderPath)) { // Iterate over each file in the folder
+        if (entry.is_regular_file() && shard.owns(entry.path().string())) { // Check if the entry is a regular file of this shard
+            filePaths.push_back(entry.path().string()); // Queue the file path
         }
     }
+    std::sort(filePaths.begin(), filePaths.end()); // Sort the paths so file ids are stable across runs and thread counts
+
+    auto built = std::make_shared<WordMap>(); // Word map being built
+    manifest.clear();
+    indexFiles(*built, filePaths);
+    publish(built);
 
     auto end = std::chrono::high_resolution_clock::now(); // End the timer
     std::chrono::duration<double> duration = end - start; // Calculate the duration
-    std::cout << "JSONs read in " << duration.count() << " seconds.\n"; // Print the duration
+    std::cout << filePaths.size() << " JSONs read in " << duration.count() << " seconds.\n"; // Print the duration
 }
 
-std::unordered_set<std::string> SearchEngine::parse(const std::string& searchTerms) const {
-    std::unordered_set<std::string> terms; // Initialize the set of terms
-    std::istringstream iss(searchTerms); // Create an input string stream from the search terms
-    std::string term; // Initialize a string to hold each term
-    while (iss >> term) { // Iterate over each term in the input stream
-        std::transform(term.begin(), term.end(), term.begin(), ::tolower); // Convert the term to lowercase
-        terms.insert(term); // Insert the term into the set
+void SearchEngine::indexFiles(WordMap& target, const std::vector<std::string>& filePaths, WriteAheadLog::Batch* batch) {
+    std::vector<int> ids; // Id of each file, in queue order
+    ids.reserve(filePaths.size());
+    for (const auto& filePath : filePaths) { // Assign every file its id up front
+        ids.push_back(target.addFile(filePath));
+    }
+    std::vector<FileState> states(filePaths.size()); // Manifest entry of each file
+    std::vector<impact::Lengths> lengths(filePaths.size()); // Number of words in each zone of each file
+    std::vector<std::shared_ptr<const std::string>> records(filePaths.size()); // Stored document of each file, packed by DocStore::pack
+    std::vector<uint32_t> dates(filePaths.size(), Attributes::NO_DATE); // Publish date of each file as yyyymmdd
+    std::vector<std::string> sites(filePaths.size()); // Lowercased site of each file
+
+    unsigned workers = std::max(1u, std::min<unsigned>(threadCount, static_cast<unsigned>(filePaths.size()))); // Never start more workers than files
+    std::vector<PartialIndex> partials(workers); // One partial index per worker
+    std::atomic<size_t> next(0); // Index of the next file to hand out
+
+    auto work = [&](PartialIndex& partial) { // Body of each worker thread
+        std::string buffer; // Contents of the current file, reused so reading does not allocate per file
+        RelevantWords words; // Words of the current file, pointing into buffer
+        std::pmr::string lowerWord; // Word copied out of the buffer, reused for every word
+        for (size_t i = next++; i < filePaths.size(); i = next++) { // Take the next file from the queue
+            int id = ids[i]; // Id assigned above
+            Manifest::stat(filePaths[i], states[i]); // Record the file as it is before reading it, so a later write is seen as a change
+            if (getRelevantData(filePaths[i], buffer, words, states[i].hash)) { // Get the relevant data from the file
+                records[i] = DocStore::pack(words.document); // Compressed here, in parallel
+                dates[i] = Attributes::parseDate(words.document.date);
+                sites[i] = std::move(words.site);
+                tokenizer::fold(&sites[i][0], sites[i].size()); // Matched against lowercased query terms
+            }
+            for (int field = 0; field < 3; ++field) { // Iterate over the organization, person and other words
+                auto& tokens = words.tokens[field]; // Group the occurrences of each word, already lowercased, in position order
+                std::sort(tokens.begin(), tokens.end(), [](const Occurrence& a, const Occurrence& b) {
+                    return a.text < b.text || (a.text == b.text && a.position < b.position);
+                });
+                for (size_t start = 0, end; start < tokens.size(); start = end) {
+                    impact::Counts counts = {}; // Occurrences of the word in each zone
+                    for (end = start; end < tokens.size() && tokens[start].text == tokens[end].text; ++end) {
+                        impact::add(counts, tokens[end].zone);
+                    }
+                    lowerWord.assign(tokens[start].text.data(), tokens[start].text.size()); // Copy the word out of the buffer
+                    partial.ids[field]->lists[lowerWord].push_back({id, counts}); // Record the word for this file
+                    std::pmr::vector<uint32_t>& runs = partial.positions[field]->lists[lowerWord];
+                    runs.push_back(static_cast<uint32_t>(id)); // One run per file: id, count, positions
+                    runs.push_back(static_cast<uint32_t>(end - start));
+                    for (size_t k = start; k < end; ++k) {
+                        runs.push_back(tokens[k].position);
+                    }
+                }
+            }
+            for (const Occurrence& token : words.tokens[indexfile::WORD]) { // Every word is in the word field, so it gives the length of each zone
+                ++lengths[i][token.zone];
+            }
+        }
+    };
+
+    std::vector<std::thread> threads; // Worker threads
+    for (unsigned t = 1; t < workers; ++t) { // Start the extra workers
+        threads.emplace_back(work, std::ref(partials[t]));
+    }
+    work(partials[0]); // The calling thread works too
+    for (auto& thread : threads) { // Wait for every worker to finish
+        thread.join();
+    }
+
+    int firstId = ids.empty() ? 0 : ids[0]; // Files are new or were removed first, so their ids follow on from it
+    for (size_t i = 0; i < filePaths.size(); ++i) { // Every length is known before any impact is computed
+        target.setLengths(ids[i], lengths[i]);
+        target.setDocument(ids[i], records[i]);
+        target.setAttributes(ids[i], dates[i], sites[i]);
+    }
+    if (batch) { // Log the files before their words, in the order they were added
+        for (size_t i = 0; i < filePaths.size(); ++i) {
+            batch->addFile(filePaths[i], states[i], lengths[i], dates[i], sites[i], records[i] ? std::string_view(*records[i]) : std::string_view());
+        }
+    }
+    mergeField(partials, indexfile::ORG, target, batch, firstId); // Merge organizations
+    mergeField(partials, indexfile::NAME, target, batch, firstId); // Merge persons
+    mergeField(partials, indexfile::WORD, target, batch, firstId); // Merge other words
+    mergePositions(partials, target, batch, firstId); // Merge where the words occur
+    target.finalize(); // Compress the merged ids into posting lists
+
+    for (size_t i = 0; i < filePaths.size(); ++i) { // Record the indexed files
+        manifest.set(filePaths[i], states[i]);
     }
-    return terms; // Return the set of terms
 }
 
-void extractWords(const rapidjson::Value& value, std::vector<std::unordered_set<std::string>>& words, const std::string& currentPath = "") {
-    if (value.IsString()) { // Check if the value is a string
-        std::istringstream iss(value.GetString()); // Create an input string stream from the value
-        std::string word; // Initialize a string to hold each word
-        while (iss >> word) { // Iterate over each word in the input stream
-            // Remove punctuation from the beginning and end of the word
-            word.erase(word.begin(), std::find_if(word.begin(), word.end(), [](unsigned char ch) {
-                return !std::ispunct(ch);
-            }));
-            word.erase(std::find_if(word.rbegin(), word.rend(), [](unsigned char ch) {
-                return !std::ispunct(ch);
-            }).base(), word.end());
+std::unique_ptr<QueryNode> SearchEngine::parse(const std::string& searchTerms) const {
+    return parseQuery(searchTerms); // Parse terms, operators and parentheses into a query tree
+}
+
+namespace {
+
+// SAX handler collecting the words of a JSON document by field.
+// Instead of building a path string for every value, it keeps a stack with one set of flags per open
+// object or array: a string under entities.organizations[...] or entities.persons[...] whose path also
+// contains a "name" key is an organization or person word; every string is also split into other words.
+// Words are numbered in each field as they are read, leaving a gap after each string so phrases do not
+// run from one value into the next. Each word also records its zone for ranking: entity names, then
+// anything under a "title" key, then anything under a "text" key, then the rest.
+// The top-level "title", "url" and "text" strings are also kept as written for the document store, with
+// "thread.published" as the date, or the top-level "published" when there is none, and "thread.site" as the site.
+class WordHandler {
+public:
+    WordHandler(std::vector<Occurrence> (&tokens)[3], std::deque<std::string>& copies, std::pmr::vector<tokenizer::Word>& split, Document& document, std::string& site) : tokens(tokens), copies(copies), split(split), document(document), site(site) {}
+
+    bool Null() { return true; }
+    bool Bool(bool) { return true; }
+    bool Int(int) { return true; }
+    bool Uint(unsigned) { return true; }
+    bool Int64(int64_t) { return true; }
+    bool Uint64(uint64_t) { return true; }
+    bool Double(double) { return true; }
+    bool RawNumber(const char*, rapidjson::SizeType, bool) { return true; }
+
+    bool String(const char* str, rapidjson::SizeType length, bool copy) {
+        char* text = const_cast<char*>(str); // In-situ strings lie in the buffer, which is ours to lowercase
+        if (copy) { // The parser reuses its storage for this string, keep a copy for the views
+            copies.emplace_back(str, length);
+            text = &copies.back()[0];
+        }
+        if (stored && (replace || stored->empty())) { // Before the words are lowercased in place
+            stored->assign(text, length);
+        }
+        stored = nullptr;
+        addWords(text, length, valueFlags());
+        return true;
+    }
 
-            if (currentPath.find("entities.organizations") != std::string::npos && currentPath.find("name") != std::string::npos) { // Check if the current path indicates an organization name
-                words[0].insert(word); // Insert the word into the organization set
-            } else if (currentPath.find("entities.persons") != std::string::npos && currentPath.find("name") != std::string::npos) { // Check if the current path indicates a person name
-                words[1].insert(word); // Insert the word into the person set
+    bool StartObject() { return open(true); }
+    bool Key(const char* str, rapidjson::SizeType length, bool) {
+        std::string_view key(str, length);
+        uint8_t parent = stack.back().flags; // Flags of the enclosing object
+        keyFlags = parent & (ORGANIZATION | PERSON | NAME | TITLE | TEXT); // Sections, names and zones hold for everything below them
+        stored = nullptr;
+        replace = true;
+        if (stack.size() == 1) { // Keys of the document itself
+            if (key == "title") {
+                stored = &document.title;
+            } else if (key == "url") {
+                stored = &document.url;
+            } else if (key == "text") {
+                stored = &document.text;
+            } else if (key == "published") {
+                stored = &document.date;
+                replace = false; // thread.published comes first
+            } else if (key == "thread") {
+                keyFlags |= THREAD;
             }
-            words[2].insert(word); // Insert the word into the other words set
+        } else if ((parent & THREAD) && key == "published") {
+            stored = &document.date;
+        } else if ((parent & THREAD) && key == "site") {
+            stored = &site;
         }
-    } else if (value.IsObject()) { // Check if the value is an object
-        for (auto it = value.MemberBegin(); it != value.MemberEnd(); ++it) { // Iterate over each member of the object
-            extractWords(it->value, words, currentPath.empty() ? it->name.GetString() : currentPath + "." + it->name.GetString()); // Recursively extract words from the member
+        if (key == "entities") {
+            keyFlags |= ENTITIES;
+        } else if ((parent & ENTITIES) && key == "organizations") {
+            keyFlags |= ORGANIZATION;
+        } else if ((parent & ENTITIES) && key == "persons") {
+            keyFlags |= PERSON;
         }
-    } else if (value.IsArray()) { // Check if the value is an array
-        for (rapidjson::SizeType i = 0; i < value.Size(); ++i) { // Iterate over each element of the array
-            extractWords(value[i], words, currentPath + "[" + std::to_string(i) + "]"); // Recursively extract words from the element
+        if (key == "name") {
+            keyFlags |= NAME;
+        } else if (key == "title") {
+            keyFlags |= TITLE;
+        } else if (key == "text") {
+            keyFlags |= TEXT;
         }
+        return true;
     }
-}
+    bool EndObject(rapidjson::SizeType) { return close(); }
+    bool StartArray() { return open(false); }
+    bool EndArray(rapidjson::SizeType) { return close(); }
 
-std::vector<std::unordered_set<std::string>> SearchEngine::getRelevantData(const std::string& filePath) const {
-    std::vector<std::unordered_set<std::string>> words(3); // Initialize a vector of sets to hold the words
-    std::ifstream file(filePath); // Open the file
-    if (!file.is_open()) { // Check if the file failed to open
-        std::cerr << "Failed to open file: " << filePath << std::endl; // Print an error message
-        return words; // Return the empty vector of sets
+private:
+    enum Flag : uint8_t {
+        ENTITIES = 1, // Value of an "entities" key
+        ORGANIZATION = 2, // Inside entities.organizations
+        PERSON = 4, // Inside entities.persons
+        NAME = 8, // Inside a "name" key
+        TITLE = 16, // Inside a "title" key
+        TEXT = 32, // Inside a "text" key
+        THREAD = 64, // Value of the top-level "thread" key
+    };
+
+    struct Frame {
+        uint8_t flags; // Flags of the object or array itself
+        bool object; // Whether it is an object, whose values take the flags of their key
+    };
+
+    std::vector<Occurrence> (&tokens)[3]; // Output words with their positions and zones
+    uint32_t positions[3] = {0, 0, 0}; // Position of the next word in each field
+    std::deque<std::string>& copies; // Output storage for copied strings
+    std::pmr::vector<tokenizer::Word>& split; // Words of the current string
+    Document& document; // Output fields kept as written
+    std::string& site; // Output site kept as written
+    std::string* stored = nullptr; // Field of document the next value is stored in, if it is a string
+    bool replace = true; // Whether the next string replaces a value stored already
+    std::vector<Frame> stack; // Open objects and arrays
+    uint8_t keyFlags = 0; // Flags of the value following the last key
+
+    // Flags of the value about to be read
+    uint8_t valueFlags() const {
+        if (stack.empty()) { // The document itself
+            return 0;
+        }
+        const Frame& top = stack.back();
+        return top.object ? keyFlags : top.flags & ~ENTITIES; // Array elements are no longer directly under "entities"
     }
 
-    rapidjson::IStreamWrapper isw(file); // Create a RapidJSON input stream wrapper from the file
-    rapidjson::Document document; // Initialize a RapidJSON document
-    document.ParseStream(isw); // Parse the JSON from the input stream
+    bool open(bool object) {
+        stored = nullptr; // Only plain strings are stored
+        stack.push_back({valueFlags(), object});
+        return true;
+    }
 
-    if (document.HasParseError()) { // Check if there was a parse error
-        std::cerr << "Failed to parse JSON file: " << filePath << std::endl; // Print an error message
-        return words; // Return the empty vector of sets
+    bool close() {
+        stack.pop_back();
+        return true;
+    }
+
+    // Split text into lowercased words and list each in its fields
+    void addWords(char* text, size_t length, uint8_t flags) {
+        uint32_t starts[3] = {positions[0], positions[1], positions[2]}; // To tell which fields got words
+        indexfile::Zone zone = indexfile::OTHER;
+        if ((flags & (ORGANIZATION | PERSON)) && (flags & NAME)) {
+            zone = indexfile::ENTITIES;
+        } else if (flags & TITLE) {
+            zone = indexfile::TITLE;
+        } else if (flags & TEXT) {
+            zone = indexfile::TEXT;
+        }
+        split.clear();
+        tokenizer::split(text, length, split);
+        for (const tokenizer::Word& word : split) {
+            if ((flags & ORGANIZATION) && (flags & NAME)) { // Organization name
+                add(0, word, zone);
+            } else if ((flags & PERSON) && (flags & NAME)) { // Person name
+                add(1, word, zone);
+            }
+            add(2, word, zone); // Every word
+        }
+        for (int field = 0; field < 3; ++field) { // Keep the next string's words from following on from these
+            if (positions[field] != starts[field]) {
+                ++positions[field];
+            }
+        }
+    }
+
+    // List a word in a field with the next position, skipping words that were all punctuation
+    void add(int field, const tokenizer::Word& word, indexfile::Zone zone) {
+        if (!word.text.empty()) {
+            tokens[field].push_back({word.text, positions[field]++, zone});
+        }
+    }
+};
+
+// Read a whole file into buffer, keeping a terminating null for in-situ parsing
+bool readFile(const std::string& filePath, std::string& buffer) {
+    int fd = ::open(filePath.c_str(), O_RDONLY | O_CLOEXEC); // Open the file read-only
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st; // File size, used as a first guess
+    size_t size = 0; // Bytes read so far
+    buffer.resize(fstat(fd, &st) == 0 && st.st_size > 0 ? static_cast<size_t>(st.st_size) + 1 : 4096);
+    for (;;) {
+        if (size + 1 >= buffer.size()) { // The file grew since fstat, make room
+            buffer.resize(buffer.size() * 2);
+        }
+        ssize_t n = ::read(fd, &buffer[size], buffer.size() - size - 1);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            ::close(fd);
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        size += static_cast<size_t>(n);
     }
+    ::close(fd);
+    buffer.resize(size + 1); // Keeps the allocation, only the length changes
+    buffer[size] = '\0';
+    return true;
+}
 
-    extractWords(document, words); // Extract words from the document
+}
+
+bool SearchEngine::getRelevantData(const std::string& filePath, std::string& buffer, RelevantWords& words, uint64_t& hash) const {
+    for (int field = 0; field < 3; ++field) { // Forget the previous file, keeping the capacity
+        words.tokens[field].clear();
+    }
+    words.copies.clear();
+    words.document = Document();
+    words.site.clear();
+    if (!readFile(filePath, buffer)) { // Check if the file failed to open
+        std::cerr << "Failed to open file: " << filePath << std::endl; // Print an error message
+        hash = 0;
+        return false;
+    }
+    hash = Manifest::hash(buffer.data(), buffer.size() - 1); // Hash before parsing rewrites the buffer
 
-    return words; // Return the vector of sets
-}
\ No newline at end of file
+    WordHandler handler(words.tokens, words.copies, words.split, words.document, words.site); // Collect the words and stored fields while parsing
+    rapidjson::Reader reader; // SAX parser, no document tree is built
+    rapidjson::InsituStringStream stream(&buffer[0]); // Strings are decoded in place and handed over as pointers into the buffer
+    if (reader.Parse<rapidjson::kParseInsituFlag>(stream, handler).IsError()) { // Check if there was a parse error
+        std::cerr << "Failed to parse JSON file: " << filePath << std::endl; // Print an error message
+        for (int field = 0; field < 3; ++field) { // Index nothing from an invalid file
+            words.tokens[field].clear();
+        }
+        words.document = Document();
+        words.site.clear();
+        return false;
+    }
+    return true;
+}
@@ -2,32 +2,108 @@
 #define SEARCHENGINE_H // Define the include guard
 
 #include "wordmap.h" // Include the WordMap header file
+#include "query.h" // Include the query parser and iterators
+#include "searcher.h" // Include the searcher interface
+#include "manifest.h" // Include the manifest of indexed files
+#include "folderWatcher.h" // Include the inotify folder watcher
+#include "writeAheadLog.h" // Include the log of updates since the last checkpoint
 #include <vector> // Include the vector library
 #include <filesystem> // Include the filesystem library
 #include <algorithm> // Include the algorithm library
+#include <memory> // Include the memory library
+#include <mutex> // Include the mutex library for serializing updates
+#include <condition_variable> // Include the condition_variable library for waiting on checkpoints
+#include <thread> // Include the thread library for background checkpoints
+#include <atomic> // Include the atomic library for the index generation
+#include <cstdint> // Include the cstdint library for SIZE_MAX
 
-class SearchEngine { // Define the SearchEngine class
+// Part of a corpus held by one engine: the files whose path hashes to index modulo count
+struct Shard {
+    uint32_t index = 0; // Position of this part
+    uint32_t count = 1; // Number of parts, 1 for the whole corpus
+
+    bool owns(const std::string& filePath) const; // Whether a file belongs to this part
+    std::string indexPath(const std::string& basePath) const; // Index file of this part: index.bin becomes index.2.bin, the whole corpus keeps basePath
+};
+
+class SearchEngine : public Searcher { // Define the SearchEngine class
 public: // Public access specifier
-    // Constructor
-    SearchEngine(const std::string& folderPath, const std::string &filenamepath, const std::string& osavePath, const std::string& nsavePath, const std::string& wsavePath, const std::string& fsavePath);
+    // Constructor; maps the binary index at indexPath, building it from folderPath if it is missing or invalid,
+    // then applies any change made to folderPath since the index was saved. Only files owned by shard are indexed.
+    // threadCount of 0 reads SEARCH_THREADS from the environment, falling back to the number of cores
+    SearchEngine(const std::string& folderPath, const std::string& indexPath, unsigned threadCount = 0, Shard shard = Shard());
+
+    // Legacy constructor using the five CSV save files, kept for migrating old indexes
+    SearchEngine(const std::string& folderPath, const std::string &filenamepath, const std::string& osavePath, const std::string& nsavePath, const std::string& wsavePath, const std::string& fsavePath, unsigned threadCount = 0);
 
     // Destructor
     ~SearchEngine(); // Destructor declaration
 
-    // Function to search for a word
-    std::vector<std::string> search(const std::string& searchTerms) const; // Function to search for a word
+    // Function to search for a word; returns the file paths of matches offset to offset + k - 1 in BM25 order
+    using Searcher::search; // Keep the overload returning a new vector
+    void search(const std::string& searchTerms, std::vector<std::string>& results, size_t k = SIZE_MAX, size_t offset = 0, Facets* facets = nullptr) const override; // Function to search for a word, counting facets when given
+
+    // Shard phases of a search over several engines; see Searcher
+    CollectionStats stats(const QueryNode& query) const override; // Function to collect the statistics of this engine's files
+    std::vector<ScoredFile> top(const QueryNode& query, const CollectionStats& stats, size_t count, Facets* facets = nullptr) const override; // Function to find the best matches scored with corpus statistics
+    void documents(const std::vector<uint64_t>& ids, std::vector<Document>& out) const override; // Function to read stored documents, or the files of an index without them
+
+    // Function to write the current index to a binary index file, with its manifest next to it
+    bool saveIndex(const std::string& indexPath); // Function to save the binary index
+
+    // Incremental updates, available with the binary index. Changes are applied to a copy of the index
+    // that replaces the current one once complete, so searches always see a consistent snapshot.
+    // Each update is appended to the write-ahead log next to the index before it is published, and replayed
+    // from it after a restart. Once enough has changed, a checkpoint saves the index in the background
+    // and empties the log, while searches and further updates go on.
+    bool refresh(); // Function to apply every file added, changed or removed in the folder
+    bool update(const std::vector<std::string>& paths); // Function to apply changes to the given files and folders
+    bool checkpoint(); // Function to save and remap the index, dropping removed files; waits for it to finish
+    bool watch() override; // Function to apply changes to the folder as they happen, until the engine is destroyed
+    bool cacheCounters(ResultCache::Counters& counters) const override; // Function to read the hit, miss and size counters of the result cache
+    void gauges(const std::string& labels, std::vector<metrics::Gauge>& out) const override; // Function to append the sizes of the current snapshot and the result cache
 
 private: // Private access specifier
-    WordMap wordMap; // Instance of WordMap
+    std::shared_ptr<const WordMap> wordMap; // Current snapshot of the index; read and replaced with std::atomic_load and std::atomic_store
+    unsigned threadCount; // Number of worker threads used to build the index
+    std::string folderPath; // Folder of indexed files
+    std::string indexPath; // Binary index file, empty when using the CSV save files
+    Shard shard; // Files of the folder this engine indexes
+    Manifest manifest; // State of every file in the current snapshot
+    mutable std::mutex updateMutex; // Serializes updates, and the start and end of checkpoints
+    WriteAheadLog wal; // Updates since the last checkpoint, used with the binary index
+    uint64_t unloggedUpdates = 0; // Updates published without reaching the log, which a checkpoint must not drop
+    std::mutex checkpointMutex; // Guards the checkpoint thread and its state
+    std::condition_variable checkpointDone; // Signalled when a checkpoint finishes
+    std::thread checkpointThread; // Background checkpoint, joined before the next one starts
+    bool checkpointRunning = false; // Whether checkpointThread is still working
+    bool checkpointSaved = true; // Whether the last checkpoint succeeded
+    FolderWatcher watcher; // Reports folder changes when watching
+    std::atomic<uint64_t> generation{0}; // Incremented after each new snapshot is published, stamps cached results
+    mutable ResultCache cache; // Recent search results, sized by SEARCH_CACHE_MB
+
+    std::shared_ptr<const WordMap> snapshot() const; // Current snapshot of the index
+    void publish(std::shared_ptr<const WordMap> next); // Replace the snapshot and invalidate cached results
 
     // Helper function to process data
     void buildFromScratch(const std::string& folderPath); // Function to build data from scratch
+    void indexFiles(WordMap& target, const std::vector<std::string>& filePaths, WriteAheadLog::Batch* batch = nullptr); // Function to parse files in parallel into a word map and record them in the manifest, and in batch when given
+    void startCheckpoint(); // Function to start saving the current snapshot in the background unless a checkpoint is running, called with updateMutex held
+    void runCheckpoint(std::shared_ptr<const WordMap> saved, Manifest files, uint64_t sequence, uint64_t unlogged); // Body of the checkpoint thread
+    void waitForCheckpoint(); // Function to wait until no checkpoint is running
 
     // Helper function to process search terms
-    std::unordered_set<std::string> parse(const std::string& searchTerms) const; // Function to parse search terms
+    std::unique_ptr<QueryNode> parse(const std::string& searchTerms) const; // Function to parse search terms into a query tree
 
     // Helper function to process JSON data
-    std::vector<std::unordered_set<std::string>> getRelevantData(const std::string& filePath) const; // Function to get relevant data from a file
+    struct RelevantWords; // Words of one file by field, pointing into the buffer they were parsed from
+    bool getRelevantData(const std::string& filePath, std::string& buffer, RelevantWords& words, uint64_t& hash) const; // Function to read a file into buffer, hash it and parse its words in place
 };
 
+// Create the search engine for a command line program: the binary index by default,
+// the legacy CSV save files with --csv, or the CSV save files converted to the binary index with --migrate.
+// --shards N splits the corpus between N engines searched in parallel, --shard I/N serves part I of N alone,
+// and --remote host:port,... searches shard servers started with --shard.
+std::unique_ptr<Searcher> openSearchEngine(int argc, char* argv[]);
+
 #endif // SEARCHENGINE_H // End of include guard
\ No newline at end of file
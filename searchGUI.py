@@ -1,33 +1,102 @@
 import sys  # Importing the sys module
-from PyQt5.QtWidgets import QApplication, QWidget, QVBoxLayout, QLineEdit, QPushButton, QTextEdit, QListView, QMessageBox, QHBoxLayout, QLabel  # Importing necessary PyQt5 widgets
+from PyQt5.QtWidgets import QApplication, QWidget, QVBoxLayout, QLineEdit, QPushButton, QTextEdit, QListView, QListWidget, QListWidgetItem, QMessageBox, QHBoxLayout, QLabel  # Importing necessary PyQt5 widgets
 from PyQt5.QtCore import QThread, pyqtSignal, QAbstractListModel, Qt  # Importing necessary PyQt5 core components
 import socket  # Importing the socket module
-import os  # Importing the os module
-import json  # Importing the json module
+import html  # Importing the html module for escaping document fields
+import struct  # Importing the struct module for frame lengths
+import threading  # Importing the threading module
+
+HIGHLIGHT_START = '\x02'  # Byte before a highlighted word of a snippet, see snippet.h
+HIGHLIGHT_END = '\x03'  # Byte after a highlighted word of a snippet
+
+def parseFields(line):  # Splitting a result or document line into its fields, undoing the server's escapes
+    fields = ['']  # Fields read so far
+    i = 0
+    while i < len(line):
+        c = line[i]
+        if c == '\t':  # Separator
+            fields.append('')
+        elif c == '\\' and i + 1 < len(line):  # Escaped backslash, tab or newline
+            i += 1
+            fields[-1] += {'t': '\t', 'n': '\n'}.get(line[i], line[i])
+        else:
+            fields[-1] += c
+        i += 1
+    return fields
+
+class SearchConnection:  # Persistent connection to socketSearch using length-prefixed frames
+    def __init__(self, host='localhost', port=12345):  # Initializing the SearchConnection class
+        self.address = (host, port)  # Storing the server address
+        self.sock = None  # Connected socket, opened on first use
+        self.lock = threading.Lock()  # Keeping requests from overlapping search threads apart
+
+    def results(self, query, offset, k, facets=0):  # Sending a query for one page of results with snippets, and facets values of each kind, and returning (ok, body)
+        header = f"{offset} {k} {facets}\n" if facets else f"{offset} {k}\n"  # Facets are only counted when asked for
+        request = b'R' + header.encode() + query.encode()  # Building the results request payload
+        with self.lock:
+            return self.send(request)
+
+    def documents(self, ids):  # Fetching stored documents by id and returning (ok, body)
+        request = b'D' + ' '.join(ids).encode()  # Building the documents request payload
+        with self.lock:
+            return self.send(request)
+
+    def send(self, request):  # Sending a request payload and reading its response
+        for attempt in range(2):  # Reconnecting once if the server closed the connection
+            try:
+                if self.sock is None:  # Connecting if needed
+                    self.sock = socket.create_connection(self.address)
+                self.sock.sendall(struct.pack('>I', len(request)) + request)  # Sending the framed request
+                length = struct.unpack('>I', self.recvExact(4))[0]  # Reading the response length
+                response = self.recvExact(length)  # Reading the response payload
+                return response[:1] in (b'\x00', b'\x02'), response[1:].decode()  # Splitting the status byte from the body; partial results are shown like complete ones
+            except OSError:
+                self.close()  # Dropping the broken connection
+                if attempt == 1:
+                    raise
+
+    def recvExact(self, count):  # Receiving exactly count bytes
+        data = b""  # Initializing an empty byte string
+        while len(data) < count:  # Receiving data in a loop
+            part = self.sock.recv(count - len(data))  # Receiving a part of the data
+            if not part:  # The server closed the connection
+                raise ConnectionError('connection closed')
+            data += part  # Adding the part to the data
+        return data
+
+    def close(self):  # Closing the connection
+        if self.sock is not None:
+            self.sock.close()
+            self.sock = None
 
 class SearchThread(QThread):  # Defining the SearchThread class inheriting from QThread
-    results_ready = pyqtSignal(str)  # Defining a custom signal
+    results_ready = pyqtSignal(str, int, list, bool, int, list)  # Query, page, results, whether a next page exists, number of matches and facets
+    search_failed = pyqtSignal(str)  # Error message
 
-    def __init__(self, query):  # Initializing the SearchThread class
+    def __init__(self, connection, query, page, results_per_page, facets_per_kind):  # Initializing the SearchThread class
         super().__init__()  # Calling the superclass constructor
+        self.connection = connection  # Storing the shared connection
         self.query = query  # Storing the query
+        self.page = page  # Storing the requested page
+        self.results_per_page = results_per_page  # Storing the page size
+        self.facets_per_kind = facets_per_kind  # Storing the facet values wanted of each kind
 
     def run(self):  # Defining the run method
-        results = self.sendQueryToBackend(self.query)  # Sending the query to the backend and getting results
-        self.results_ready.emit(results)  # Emitting the results_ready signal with the results
-
-    def sendQueryToBackend(self, query):  # Defining the sendQueryToBackend method
-        BUFFER_SIZE = 8192  # Increased buffer size  # Setting the buffer size
-        data = b""  # Initializing an empty byte string
-        with socket.socket(socket.AF_INET, socket.SOCK_STREAM) as s:  # Creating a socket
-            s.connect(('localhost', 12345))  # Connecting to the backend server
-            s.sendall(query.encode())  # Sending the query
-            while True:  # Receiving data in a loop
-                part = s.recv(BUFFER_SIZE)  # Receiving a part of the data
-                data += part  # Adding the part to the data
-                if len(part) < BUFFER_SIZE:  # Breaking the loop if the part is smaller than the buffer size
-                    break
-        return data.decode()  # Decoding and returning the data
+        try:
+            # One extra result tells whether a next page exists without counting every match
+            ok, body = self.connection.results(self.query, self.page * self.results_per_page, self.results_per_page + 1, self.facets_per_kind)
+        except OSError as error:
+            self.search_failed.emit(str(error))  # Reporting connection errors
+            return
+        if not ok:
+            self.search_failed.emit(body)  # Reporting errors from the server
+            return
+        lines = [line for line in body.split('\n') if line]  # Splitting the body by newline
+        matches, count = (int(number) for number in lines[0].split()) if lines else (0, 0)  # Facet header: matching files and facet values
+        facets = [parseFields(line) for line in lines[1:count + 1]]  # Kind, count and clause of each facet value
+        keys = ('id', 'path', 'title', 'date', 'url', 'snippet')  # Fields of each result line
+        results = [dict(zip(keys, parseFields(line))) for line in lines[count + 1:]]  # The results follow the facets
+        self.results_ready.emit(self.query, self.page, results[:self.results_per_page], len(results) > self.results_per_page, matches, facets)  # Emitting the results_ready signal with the page
 
 class ResultsModel(QAbstractListModel):  # Defining the ResultsModel class inheriting from QAbstractListModel
     def __init__(self, results=None, parent=None):  # Initializing the ResultsModel class
@@ -39,14 +108,21 @@ class ResultsModel(QAbstractListModel):  # Defining the ResultsModel class inher
 
     def data(self, index, role):  # Defining the data method
         if role == Qt.DisplayRole:  # Checking if the role is DisplayRole
-            return self.results[index.row()]  # Returning the result at the given index
+            result = self.results[index.row()]  # Result at the given index
+            snippet = result.get('snippet', '').replace(HIGHLIGHT_START, '«').replace(HIGHLIGHT_END, '»')  # Marking the query's words
+            return f"{result.get('title') or result.get('path')}\n{snippet}"  # Returning the title and snippet of the result
 
 class SearchGUI(QWidget):  # Defining the SearchGUI class inheriting from QWidget
     def __init__(self):  # Initializing the SearchGUI class
         super().__init__()  # Calling the superclass constructor
         self.results = []  # Initializing an empty list for results
+        self.query = ''  # Query of the results shown
         self.current_page = 0  # Initializing the current page to 0
+        self.has_next = False  # Whether the current query has a next page
+        self.connection = SearchConnection()  # Connection reused by every search
         self.results_per_page = 100  # Adjust this number as needed  # Setting the number of results per page
+        self.facets_per_kind = 5  # Organizations, people, sites and months offered to narrow the query
+        self.matches = 0  # Number of files matching the query
         self.initUI()  # Initializing the UI
 
     def initUI(self):  # Defining the initUI method
@@ -72,11 +148,20 @@ class SearchGUI(QWidget):  # Defining the SearchGUI class inheriting from QWidge
         layout.addWidget(results_label)  # Adding the label to the layout
 
         self.resultsList = QListView(self)  # Creating a list view for the search results
-        self.resultsList.setToolTip('Double-click to view file content')  # Setting the tooltip
+        self.resultsList.setToolTip('Double-click to view the document')  # Setting the tooltip
         self.resultsList.setModel(ResultsModel(self.results))  # Setting the model for the list view
         self.resultsList.doubleClicked.connect(self.viewFile)  # Connecting the double-click signal to the viewFile method
         layout.addWidget(self.resultsList)  # Adding the list view to the layout
 
+        facets_label = QLabel('Refine:', self)  # Creating a label for the facets
+        layout.addWidget(facets_label)  # Adding the label to the layout
+
+        self.facetsList = QListWidget(self)  # Creating a list of the facet values of the matches
+        self.facetsList.setToolTip('Click to keep only the results with this value')  # Setting the tooltip
+        self.facetsList.setMaximumHeight(100)  # Keeping the results the larger list
+        self.facetsList.itemClicked.connect(self.refine)  # Connecting the click signal to the refine method
+        layout.addWidget(self.facetsList)  # Adding the facets list to the layout
+
         file_content_label = QLabel('File Content:', self)  # Creating a label for the file content
         layout.addWidget(file_content_label)  # Adding the label to the layout
 
@@ -105,73 +190,73 @@ class SearchGUI(QWidget):  # Defining the SearchGUI class inheriting from QWidge
     def performSearch(self):  # Defining the performSearch method
         query = self.queryInput.text()  # Getting the query from the input
         if query:  # Checking if the query is not empty
-            self.searchThread = SearchThread(query)  # Creating a SearchThread with the query
-            self.searchThread.results_ready.connect(self.handleResults)  # Connecting the results_ready signal to the handleResults method
-            self.searchThread.start()  # Starting the search thread
+            self.requestPage(query, 0)  # Requesting the first page
         else:  # If the query is empty
             QMessageBox.warning(self, 'Input Error', 'Please enter a search query.')  # Showing a warning message
 
-    def handleResults(self, results):  # Defining the handleResults method
-        self.results = results.split('\n')  # Splitting the results by newline
-        self.current_page = 0  # Resetting the current page to 0
+    def requestPage(self, query, page):  # Requesting one page of results from the backend
+        self.searchThread = SearchThread(self.connection, query, page, self.results_per_page, self.facets_per_kind)  # Creating a SearchThread for the page
+        self.searchThread.results_ready.connect(self.handleResults)  # Connecting the results_ready signal to the handleResults method
+        self.searchThread.search_failed.connect(self.handleError)  # Connecting the search_failed signal to the handleError method
+        self.searchThread.start()  # Starting the search thread
+
+    def handleResults(self, query, page, results, has_next, matches, facets):  # Defining the handleResults method
+        self.query = query  # Storing the query of the page
+        self.current_page = page  # Storing the page number
+        self.results = results  # Storing the page of results
+        self.has_next = has_next  # Storing whether a next page exists
+        self.matches = matches  # Storing the number of matches
         self.updateResultsList()  # Updating the results list
+        self.facetsList.clear()  # Replacing the facets of the previous query
+        for kind, count, clause in (facet for facet in facets if len(facet) == 3):
+            item = QListWidgetItem(f"{kind}: {clause.split(':', 1)[-1].split('=', 1)[-1]} ({count})", self.facetsList)  # Showing the value without its prefix
+            item.setData(Qt.UserRole, clause)  # Keeping the clause that narrows the query to it
+
+    def refine(self, item):  # Narrowing the query to a facet value
+        query = f"({self.query}) {item.data(Qt.UserRole)}"  # Filters apply to the rest of their group
+        self.queryInput.setText(query)  # Showing the narrowed query
+        self.requestPage(query, 0)  # Requesting its first page
+
+    def handleError(self, message):  # Defining the handleError method
+        QMessageBox.warning(self, 'Search Error', message)  # Showing a warning message
 
     def updateResultsList(self):  # Defining the updateResultsList method
-        start_index = self.current_page * self.results_per_page  # Calculating the start index
-        end_index = start_index + self.results_per_page  # Calculating the end index
-        self.resultsList.model().results = self.results[start_index:end_index]  # Updating the results in the model
+        self.resultsList.model().results = self.results  # Updating the results in the model
         self.resultsList.model().layoutChanged.emit()  # Emitting the layoutChanged signal
         self.prevButton.setEnabled(self.current_page > 0)  # Enabling/disabling the previous button
-        self.nextButton.setEnabled(end_index < len(self.results))  # Enabling/disabling the next button
-        total_pages = (len(self.results) + self.results_per_page - 1) // self.results_per_page  # Calculating the total number of pages
-        self.pageInfoLabel.setText(f"Page {self.current_page + 1} of {total_pages}; {self.results_per_page} results per page")  # Updating the page information label
+        self.nextButton.setEnabled(self.has_next)  # Enabling/disabling the next button
+        self.pageInfoLabel.setText(f"Page {self.current_page + 1} of {self.matches} matches; {self.results_per_page} results per page")  # Updating the page information label
 
     def prevPage(self):  # Defining the prevPage method
         if self.current_page > 0:  # Checking if the current page is greater than 0
-            self.current_page -= 1  # Decrementing the current page
-            self.updateResultsList()  # Updating the results list
+            self.requestPage(self.query, self.current_page - 1)  # Requesting the previous page
 
     def nextPage(self):  # Defining the nextPage method
-        if (self.current_page + 1) * self.results_per_page < len(self.results):  # Checking if there are more results
-            self.current_page += 1  # Incrementing the current page
-            self.updateResultsList()  # Updating the results list
+        if self.has_next:  # Checking if there are more results
+            self.requestPage(self.query, self.current_page + 1)  # Requesting the next page
 
     def viewFile(self, index):  # Defining the viewFile method
-        file_path = self.resultsList.model().data(index, Qt.DisplayRole)  # Getting the file path from the model
-        if os.path.exists(file_path):  # Checking if the file exists
-            with open(file_path, 'r') as file:  # Opening the file
-                content = file.read()  # Reading the file content
-                try:  # Trying to parse the content as JSON
-                    json_content = json.loads(content)  # Parsing the content as JSON
-                    formatted_content = self.json_to_html(json_content)  # Formatting the JSON content as HTML
-                except json.JSONDecodeError:  # If the content is not valid JSON
-                    formatted_content = content  # Using the raw content
-                self.fileContent.setHtml(formatted_content)  # Setting the formatted content in the text edit
-        else:  # If the file does not exist
-            QMessageBox.warning(self, 'File Error', f'File not found: {file_path}')  # Showing a warning message
-
-    def json_to_html(self, json_content):  # Defining the json_to_html method
+        result = self.resultsList.model().results[index.row()]  # Getting the result from the model
+        try:
+            ok, body = self.connection.documents([result['id']])  # Fetching the stored document from the server
+        except OSError as error:
+            QMessageBox.warning(self, 'Document Error', str(error))  # Reporting connection errors
+            return
+        lines = [line for line in body.split('\n') if line] if ok else []  # One line per document found
+        if not lines:  # Removed since the search, or not stored
+            QMessageBox.warning(self, 'Document Error', body if not ok else f"Document not found: {result['path']}")  # Showing a warning message
+            return
+        keys = ('id', 'path', 'title', 'date', 'url', 'text')  # Fields of a document line
+        self.fileContent.setHtml(self.document_to_html(dict(zip(keys, parseFields(lines[0])))))  # Setting the formatted document in the text edit
+
+    def document_to_html(self, document):  # Defining the document_to_html method
+        escaped = {key: html.escape(value) for key, value in document.items()}  # Escaping every field
         html_content = "<html><body>"  # Initializing the HTML content
-        html_content += f"<h1>{json_content.get('title', 'No Title')}</h1>"  # Adding the title
-        html_content += f"<p><strong>Author:</strong> {json_content.get('author', 'Unknown')}</p>"  # Adding the author
-        html_content += f"<p><strong>Published:</strong> {json_content['thread'].get('published', 'Unknown')}</p>"  # Adding the published date
-        html_content += f"<p><strong>URL:</strong> <a href='{json_content.get('url', '#')}'>{json_content.get('url', 'No URL')}</a></p>"  # Adding the URL
-        html_content += f"<p><strong>Text:</strong> {json_content.get('text', 'No Text')}</p>"  # Adding the text
-        html_content += "<h2>Entities</h2>"  # Adding the entities header
-        html_content += "<ul>"  # Starting the entities list
-        for person in json_content['entities'].get('persons', []):  # Iterating over the persons
-            html_content += f"<li>{person.get('name', 'Unknown')}</li>"  # Adding each person to the list
-        html_content += "</ul>"  # Ending the entities list
-        html_content += "<h2>Locations</h2>"  # Adding the locations header
-        html_content += "<ul>"  # Starting the locations list
-        for location in json_content['entities'].get('locations', []):  # Iterating over the locations
-            html_content += f"<li>{location.get('name', 'Unknown')}</li>"  # Adding each location to the list
-        html_content += "</ul>"  # Ending the locations list
-        html_content += "<h2>Organizations</h2>"  # Adding the organizations header
-        html_content += "<ul>"  # Starting the organizations list
-        for organization in json_content['entities'].get('organizations', []):  # Iterating over the organizations
-            html_content += f"<li>{organization.get('name', 'Unknown')}</li>"  # Adding each organization to the list
-        html_content += "</ul>"  # Ending the organizations list
+        html_content += f"<h1>{escaped.get('title') or 'No Title'}</h1>"  # Adding the title
+        html_content += f"<p><strong>Published:</strong> {escaped.get('date') or 'Unknown'}</p>"  # Adding the published date
+        html_content += f"<p><strong>URL:</strong> <a href='{escaped.get('url') or '#'}'>{escaped.get('url') or 'No URL'}</a></p>"  # Adding the URL
+        html_content += f"<p><strong>File:</strong> {escaped.get('path', '')}</p>"  # Adding the file it was indexed from
+        html_content += f"<p><strong>Text:</strong> {escaped.get('text') or 'No Text'}</p>"  # Adding the text
         html_content += "</body></html>"  # Ending the HTML content
         return html_content  # Returning the HTML content
 
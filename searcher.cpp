@@ -0,0 +1,117 @@
+#include "searcher.h" // Include the searcher header
+
+#include "logger.h" // Include the optional search log
+#include "metrics.h" // Include the search counters and timers
+#include "snippet.h" // Include the snippets of stored text
+
+#include <chrono> // Include the chrono library for timing searches
+
+std::vector<std::string> Searcher::search(const std::string& searchTerms, size_t k, size_t offset) const {
+    std::vector<std::string> results;
+    search(searchTerms, results, k, offset);
+    return results;
+}
+
+void Searcher::search(const std::string& searchTerms, std::vector<std::string>& results, size_t k, size_t offset, Facets* facets) const {
+    find(searchTerms, results, k, offset, facets);
+}
+
+void Searcher::find(const std::string& searchTerms, std::vector<std::string>& results, size_t k, size_t offset, Facets* facets) const {
+    auto start = std::chrono::steady_clock::now();
+    metrics::trace() = {}; // Stages of this search only
+    QueryArena::Scope scratch; // The parsed query lives in this thread's arena
+
+    std::unique_ptr<QueryNode> query = parseQuery(searchTerms); // Parse the search terms
+    if (facets) { // Nothing counted yet
+        facets->matches = 0;
+        for (auto& values : facets->values) {
+            values.clear();
+        }
+    }
+    if (!query || (k == 0 && !facets)) {
+        results.clear();
+        return;
+    }
+
+    size_t count = k > SIZE_MAX - offset ? SIZE_MAX : offset + k; // Number of best matches needed to fill the page
+    std::vector<ScoredFile> matches = top(*query, stats(*query), count, facets); // Best matches, best first
+
+    size_t found = 0;
+    for (size_t i = offset; i < matches.size(); ++i) { // Keep only the requested page
+        setResult(results, found++, matches[i].path);
+    }
+    results.resize(found);
+
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    metrics::record(metrics::SEARCH, static_cast<uint64_t>(duration.count() * 1e9));
+    metrics::add(metrics::QUERIES);
+    metrics::add(metrics::RESULTS, found);
+    if (logger::enabled()) { // Formatting the line is skipped unless someone reads it
+        logger::write(std::to_string(found) + " results for " + searchTerms + " in " + std::to_string(duration.count()) + " seconds (" + metrics::describe(metrics::trace()) + ").");
+    }
+}
+
+void Searcher::results(const std::string& searchTerms, std::vector<SearchResult>& out, size_t k, size_t offset, Facets* facets) const {
+    std::vector<std::string> paths; // Matches of the page, from the result cache when there is one and it has them
+    search(searchTerms, paths, k, offset, facets);
+    std::vector<uint64_t> ids; // Document id of each match
+    for (const auto& path : paths) {
+        ids.push_back(DocStore::documentId(path));
+    }
+    metrics::Timer timer(metrics::DOCUMENTS);
+    std::vector<Document> documents;
+    this->documents(ids, documents);
+
+    QueryArena::Scope scratch; // The query parsed again for its words
+    std::unique_ptr<QueryNode> query = parseQuery(searchTerms);
+    out.resize(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        SearchResult& result = out[i];
+        if (i < documents.size() && !documents[i].path.empty()) {
+            result.document = std::move(documents[i]);
+        } else { // Removed since it was found, or its shard is unavailable
+            result.document = Document();
+            result.document.id = ids[i];
+            result.document.path = paths[i];
+        }
+        result.snippet = query ? snippet::make(*query, result.document.text) : std::string();
+        result.document.text.clear(); // Fetched whole with documents
+    }
+}
+
+void Searcher::merge(const std::vector<Facets>& parts, Facets& out) {
+    Facets total;
+    total.limit = out.limit;
+    for (const Facets& part : parts) {
+        total.add(part);
+    }
+    total.trim();
+    out = std::move(total);
+}
+
+void Searcher::setResult(std::vector<std::string>& results, size_t index, std::string_view path) {
+    if (index < results.size()) {
+        results[index].assign(path);
+    } else {
+        results.emplace_back(path);
+    }
+}
+
+std::vector<ScoredFile> Searcher::merge(std::vector<std::vector<ScoredFile>>& lists, size_t count) {
+    metrics::Timer sort(metrics::SORT);
+    std::vector<ScoredFile> merged;
+    std::vector<size_t> positions(lists.size(), 0); // Next match of each list
+    while (merged.size() < count) {
+        size_t best = lists.size(); // List holding the best remaining match
+        for (size_t i = 0; i < lists.size(); ++i) {
+            if (positions[i] < lists[i].size() && (best == lists.size() || lists[i][positions[i]].score > lists[best][positions[best]].score)) {
+                best = i;
+            }
+        }
+        if (best == lists.size()) { // Every list is used up
+            break;
+        }
+        merged.push_back(std::move(lists[best][positions[best]++]));
+    }
+    return merged;
+}
@@ -0,0 +1,72 @@
+#ifndef SEARCHER_H // Include guard to prevent multiple inclusions of this header file
+#define SEARCHER_H // Define the include guard
+
+#include "query.h" // Include the query tree and collection statistics
+#include "resultCache.h" // Include the result cache counters
+#include "metrics.h" // Include the gauges reported for monitoring
+#include <cstdint> // Include the cstdint library for SIZE_MAX
+#include <string> // Include the string library
+#include <string_view> // Include the string_view library
+#include <vector> // Include the vector library
+
+// One match of a query with its BM25 score
+struct ScoredFile {
+    double score; // Relevancy, comparable across shards scored with the same statistics
+    std::string path; // File path
+};
+
+// One result of a query with what a client shows of it
+struct SearchResult {
+    Document document; // Stored fields of the file, without its text
+    std::string snippet; // Part of the text around the query's words, see snippet.h
+};
+
+// Anything that answers queries over a corpus: one SearchEngine, a ShardSet splitting the corpus
+// between several engines in this process, or RemoteShards forwarding to shard servers.
+//
+// A search runs in two phases so every shard scores with the statistics of the whole corpus:
+// stats gathers file counts and term document frequencies, then top returns the best
+// matches scored with their sum, counting facets of the matches in the same pass when asked. Results are then shown from the stored documents, fetched by document id
+// from whichever shard holds them, so clients never read the indexed files.
+class Searcher {
+public:
+    virtual ~Searcher() = default; // Destructor
+
+    // Function to search for a word; returns the file paths of matches offset to offset + k - 1 in BM25 order
+    std::vector<std::string> search(const std::string& searchTerms, size_t k = SIZE_MAX, size_t offset = 0) const;
+    // Same, into results, reusing its strings so a caller that keeps results between searches does not reallocate them.
+    // facets, when given, also gets facets->limit values of each kind counted over every match
+    virtual void search(const std::string& searchTerms, std::vector<std::string>& results, size_t k = SIZE_MAX, size_t offset = 0, Facets* facets = nullptr) const;
+
+    // Function to search for a word; returns matches offset to offset + k - 1 in BM25 order with their stored fields and a snippet.
+    // facets, when given, also gets the attributes of every match counted
+    void results(const std::string& searchTerms, std::vector<SearchResult>& out, size_t k = SIZE_MAX, size_t offset = 0, Facets* facets = nullptr) const;
+
+    virtual CollectionStats stats(const QueryNode& query) const = 0; // Statistics of this corpus for the terms of a query
+    // Best count matches scored with stats, best first; facets, when given, gets facets->limit values of each kind counted over every match
+    virtual std::vector<ScoredFile> top(const QueryNode& query, const CollectionStats& stats, size_t count, Facets* facets = nullptr) const = 0;
+    virtual void documents(const std::vector<uint64_t>& ids, std::vector<Document>& out) const = 0; // Stored documents of document ids, in the same order; missing ones are left with an empty path
+    virtual bool watch() { return false; } // Function to apply changes to the folder as they happen, when supported
+    virtual bool cacheCounters(ResultCache::Counters& counters) const { (void)counters; return false; } // Function to read the result cache counters, when there is a cache
+    virtual void gauges(const std::string& labels, std::vector<metrics::Gauge>& out) const { (void)labels; (void)out; } // Function to append index and cache sizes, each labelled with labels and its own
+
+    // Merge lists sorted best first into the best count matches; ties keep list order, then position
+    static std::vector<ScoredFile> merge(std::vector<std::vector<ScoredFile>>& lists, size_t count);
+
+    // Add up the facets of every shard into out, keeping out.limit values of each kind
+    static void merge(const std::vector<Facets>& parts, Facets& out);
+
+protected:
+    // Each shard counts this many times the values wanted, so a value just outside one shard's list still
+    // adds to the sum; counts of the values merged are exact only for the values every shard listed
+    static constexpr size_t FACET_OVERSAMPLING = 4;
+
+    // Store path as the index-th result, reusing the string already there
+    static void setResult(std::vector<std::string>& results, size_t index, std::string_view path);
+
+private:
+    // Search with both phases, counting facets when given
+    void find(const std::string& searchTerms, std::vector<std::string>& results, size_t k, size_t offset, Facets* facets) const;
+};
+
+#endif // SEARCHER_H // End of include guard
@@ -0,0 +1,74 @@
+#include "shardSet.h" // Include the shard set header
+#include "taskPool.h" // Include the pool running the shards
+
+ShardSet::ShardSet(const std::string& folderPath, const std::string& indexPath, uint32_t shardCount, unsigned threadCount) : folderPath(folderPath) {
+    shardCount = std::max(1u, shardCount);
+    for (uint32_t index = 0; index < shardCount; ++index) { // Each shard builds with every build thread, one after the other
+        Shard shard{index, shardCount};
+        std::cout << "Opening shard " << index + 1 << " of " << shardCount << "..." << std::endl; // Print a message for each shard
+        shards.push_back(std::make_unique<SearchEngine>(folderPath, shard.indexPath(indexPath), threadCount, shard));
+    }
+}
+
+ShardSet::~ShardSet() {
+    watcher.stop(); // No update may run while the shards are destroyed
+}
+
+CollectionStats ShardSet::stats(const QueryNode& query) const {
+    std::vector<CollectionStats> parts(shards.size()); // Statistics of each shard
+    forEachShard([&](size_t i) { parts[i] = shards[i]->stats(query); });
+    CollectionStats total;
+    for (const auto& part : parts) {
+        total.add(part);
+    }
+    return total;
+}
+
+std::vector<ScoredFile> ShardSet::top(const QueryNode& query, const CollectionStats& stats, size_t count, Facets* facets) const {
+    std::vector<std::vector<ScoredFile>> lists(shards.size()); // Best matches of each shard
+    std::vector<Facets> parts(facets ? shards.size() : 0); // Facets of each shard
+    for (Facets& part : parts) {
+        part.limit = facets->limit * FACET_OVERSAMPLING;
+    }
+    forEachShard([&](size_t i) { lists[i] = shards[i]->top(query, stats, count, facets ? &parts[i] : nullptr); });
+    if (facets) {
+        merge(parts, *facets);
+    }
+    return merge(lists, count);
+}
+
+void ShardSet::documents(const std::vector<uint64_t>& ids, std::vector<Document>& out) const {
+    out.assign(ids.size(), Document());
+    std::vector<std::vector<uint64_t>> parts(shards.size()); // Ids held by each shard, see Shard::owns
+    std::vector<std::vector<size_t>> places(shards.size()); // Position of each of them in ids
+    for (size_t i = 0; i < ids.size(); ++i) {
+        parts[ids[i] % shards.size()].push_back(ids[i]);
+        places[ids[i] % shards.size()].push_back(i);
+    }
+    forEachShard([&](size_t shard) {
+        if (parts[shard].empty()) {
+            return;
+        }
+        std::vector<Document> found;
+        shards[shard]->documents(parts[shard], found);
+        for (size_t j = 0; j < found.size(); ++j) { // Each shard writes its own positions
+            out[places[shard][j]] = std::move(found[j]);
+        }
+    });
+}
+
+bool ShardSet::watch() {
+    return watcher.start(folderPath, [this](const std::vector<std::string>& paths) {
+        forEachShard([&](size_t i) { shards[i]->update(paths); }); // Each shard picks out its own files
+    });
+}
+
+void ShardSet::gauges(const std::string& labels, std::vector<metrics::Gauge>& out) const {
+    for (size_t i = 0; i < shards.size(); ++i) {
+        shards[i]->gauges(labels + (labels.empty() ? "" : ",") + "shard=\"" + std::to_string(i) + "\"", out);
+    }
+}
+
+void ShardSet::forEachShard(const std::function<void(size_t)>& work) const {
+    TaskPool::shared().forEach(shards.size(), work); // The calling thread claims shards too, so concurrent searches cannot starve each other
+}
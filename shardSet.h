@@ -0,0 +1,33 @@
+#ifndef SHARDSET_H // Include guard to prevent multiple inclusions of this header file
+#define SHARDSET_H // Define the include guard
+
+#include "searchEngine.h" // Include the search engine of each shard
+#include "folderWatcher.h" // Include the inotify folder watcher
+#include <functional> // Include the functional library for the work of each shard
+#include <memory> // Include the memory library
+#include <vector> // Include the vector library
+
+// A corpus split by file between several SearchEngines in one process, each with its own index file.
+// Both phases of a search run on every shard at once on the process's TaskPool, the calling thread taking
+// part, so a query's latency follows the largest shard rather than the corpus.
+class ShardSet : public Searcher {
+public:
+    // Constructor; opens or builds shard I of shardCount at Shard::indexPath(indexPath) for every I
+    ShardSet(const std::string& folderPath, const std::string& indexPath, uint32_t shardCount, unsigned threadCount = 0);
+    ~ShardSet(); // Destructor, stops watching
+
+    CollectionStats stats(const QueryNode& query) const override; // Function to sum the statistics of every shard
+    std::vector<ScoredFile> top(const QueryNode& query, const CollectionStats& stats, size_t count, Facets* facets = nullptr) const override; // Function to merge the best matches of every shard
+    void documents(const std::vector<uint64_t>& ids, std::vector<Document>& out) const override; // Function to read each document from the shard its id hashes to
+    bool watch() override; // Function to pass folder changes to every shard, each keeping its own files
+    void gauges(const std::string& labels, std::vector<metrics::Gauge>& out) const override; // Function to append the sizes of every shard, labelled with its number
+
+private:
+    void forEachShard(const std::function<void(size_t)>& work) const; // Run work for every shard in parallel and wait for all of them
+
+    std::string folderPath; // Folder of indexed files
+    std::vector<std::unique_ptr<SearchEngine>> shards; // One engine per shard
+    FolderWatcher watcher; // Reports folder changes when watching
+};
+
+#endif // SHARDSET_H // End of include guard
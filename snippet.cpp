@@ -0,0 +1,184 @@
+#include "snippet.h" // Include the snippet header
+#include "termDictionary.h" // Include the pattern matcher of wildcard terms
+#include "tokenizer.h" // Include the word splitter shared with indexing
+
+#include <algorithm> // Include the algorithm library for std::min
+
+namespace snippet {
+
+namespace {
+
+// Words a query looks for, each source of hits numbered in this order: words, patterns, fuzzy words
+struct Sources {
+    std::vector<std::string> words; // Words of terms, phrases and NEAR groups
+    std::vector<std::string> patterns; // Patterns of wildcard terms
+    std::vector<std::pair<std::string, uint32_t>> fuzzy; // Fuzzy words with their largest number of edits
+};
+
+// Gather the words of every node that is not excluded
+void collect(const QueryNode& node, Sources& sources) {
+    switch (node.type) {
+    case QueryNode::NOT:
+        return;
+    case QueryNode::TERM:
+        sources.words.emplace_back(node.term);
+        return;
+    case QueryNode::WILDCARD:
+        sources.patterns.emplace_back(node.term);
+        return;
+    case QueryNode::FUZZY:
+        sources.fuzzy.emplace_back(std::string(node.term), node.distance);
+        return;
+    default:
+        for (const auto& child : node.children) {
+            collect(*child, sources);
+        }
+    }
+}
+
+// Whether two words are at most maxEdits insertions, deletions or substitutions apart
+bool withinEdits(std::string_view a, std::string_view b, uint32_t maxEdits) {
+    if ((a.size() > b.size() ? a.size() - b.size() : b.size() - a.size()) > maxEdits) {
+        return false;
+    }
+    std::vector<uint32_t> row(b.size() + 1); // Distances from a prefix of a to every prefix of b
+    for (size_t j = 0; j <= b.size(); ++j) {
+        row[j] = static_cast<uint32_t>(j);
+    }
+    for (size_t i = 1; i <= a.size(); ++i) {
+        uint32_t diagonal = row[0]; // Distance of the previous prefixes of both
+        row[0] = static_cast<uint32_t>(i);
+        uint32_t smallest = row[0];
+        for (size_t j = 1; j <= b.size(); ++j) {
+            uint32_t above = row[j];
+            row[j] = std::min({above + 1, row[j - 1] + 1, diagonal + (a[i - 1] == b[j - 1] ? 0 : 1)});
+            diagonal = above;
+            smallest = std::min(smallest, row[j]);
+        }
+        if (smallest > maxEdits) { // Longer prefixes only grow further apart
+            return false;
+        }
+    }
+    return row[b.size()] <= maxEdits;
+}
+
+// Source of the hits a word is, or -1 when the query does not look for it
+int sourceOf(std::string_view word, const Sources& sources) {
+    int source = 0;
+    for (const std::string& candidate : sources.words) {
+        if (candidate == word) {
+            return source;
+        }
+        ++source;
+    }
+    for (const std::string& pattern : sources.patterns) {
+        if (globMatch(pattern, word)) {
+            return source;
+        }
+        ++source;
+    }
+    for (const auto& fuzzy : sources.fuzzy) {
+        if (withinEdits(fuzzy.first, word, fuzzy.second)) {
+            return source;
+        }
+        ++source;
+    }
+    return -1;
+}
+
+bool isSpace(char c) { // Whitespace of the C locale, and the highlight bytes
+    return c == ' ' || (c >= '\t' && c <= '\r') || c == HIGHLIGHT_START || c == HIGHLIGHT_END;
+}
+
+// Append text with each run of whitespace made one space
+void appendCollapsed(std::string& out, std::string_view text) {
+    for (char c : text) {
+        if (!isSpace(c)) {
+            out += c;
+        } else if (out.empty() || out.back() != ' ') {
+            out += ' ';
+        }
+    }
+}
+
+// One word of the text
+struct Token {
+    size_t begin; // Offset of its first byte in the text
+    size_t end; // Offset past its last byte
+    int source; // Source of the hit it is, or -1
+};
+
+}
+
+std::string make(const QueryNode& query, std::string_view text, size_t words) {
+    Sources sources;
+    collect(query, sources);
+    size_t sourceCount = sources.words.size() + sources.patterns.size() + sources.fuzzy.size();
+
+    std::string lowered(text); // Folding keeps the length, so offsets into it are offsets into text
+    std::pmr::vector<tokenizer::Word> split;
+    tokenizer::split(&lowered[0], lowered.size(), split);
+    std::vector<Token> tokens;
+    for (const tokenizer::Word& word : split) {
+        if (!word.text.empty()) { // Words that were all punctuation
+            size_t begin = static_cast<size_t>(word.text.data() - lowered.data());
+            tokens.push_back({begin, begin + word.text.size(), sourceCount > 0 ? sourceOf(word.text, sources) : -1});
+        }
+    }
+    if (tokens.empty() || words == 0) {
+        return std::string();
+    }
+
+    size_t width = std::min(words, tokens.size()); // Words in the window
+    std::vector<uint32_t> counts(sourceCount, 0); // Hits of each source in the window
+    size_t distinct = 0, hits = 0; // Sources with a hit and hits in the window
+    auto enter = [&](const Token& token) {
+        if (token.source >= 0) {
+            distinct += counts[token.source]++ == 0;
+            ++hits;
+        }
+    };
+    auto leave = [&](const Token& token) {
+        if (token.source >= 0) {
+            distinct -= --counts[token.source] == 0;
+            --hits;
+        }
+    };
+    for (size_t i = 0; i < width; ++i) {
+        enter(tokens[i]);
+    }
+    size_t best = 0, bestDistinct = distinct, bestHits = hits; // Earliest of the windows with the most distinct hits, then the most hits
+    for (size_t start = 1; start + width <= tokens.size(); ++start) {
+        leave(tokens[start - 1]);
+        enter(tokens[start + width - 1]);
+        if (distinct > bestDistinct || (distinct == bestDistinct && hits > bestHits)) {
+            best = start;
+            bestDistinct = distinct;
+            bestHits = hits;
+        }
+    }
+
+    std::string out;
+    if (best > 0) {
+        out += "\xE2\x80\xA6 "; // Ellipsis
+    }
+    for (size_t i = best; i < best + width; ++i) {
+        const Token& token = tokens[i];
+        if (i > best) { // Spaces and punctuation between words
+            appendCollapsed(out, text.substr(tokens[i - 1].end, token.begin - tokens[i - 1].end));
+        }
+        if (token.source >= 0) {
+            out += HIGHLIGHT_START;
+        }
+        appendCollapsed(out, text.substr(token.begin, token.end - token.begin));
+        if (token.source >= 0) {
+            out += HIGHLIGHT_END;
+        }
+    }
+    if (best + width < tokens.size()) {
+        out += " \xE2\x80\xA6";
+    }
+    return out;
+}
+
+}
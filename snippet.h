@@ -0,0 +1,27 @@
+#ifndef SNIPPET_H // Include guard to prevent multiple inclusions of this header file
+#define SNIPPET_H // Define the include guard
+
+#include "query.h" // Include the query tree whose words are highlighted
+#include <cstddef> // Include cstddef library for size_t
+#include <string> // Include string library
+#include <string_view> // Include string_view library
+
+// Snippets of stored text for result lists.
+//
+// The text is split and folded like indexed words, and every word the query looks for is a hit: the
+// words of its terms, phrases and NEAR groups in any field, since names are also words of the text,
+// words matching its patterns, and words within the edits of its fuzzy words. Excluded words are not.
+// The snippet is the window of words holding the most distinct hits, then the most hits, earliest
+// first, cut from the original text with each hit between HIGHLIGHT_START and HIGHLIGHT_END, runs
+// of whitespace made single spaces, and an ellipsis where text was left out.
+namespace snippet {
+
+constexpr char HIGHLIGHT_START = '\x02'; // Byte before a highlighted word, made a space where the text itself has one
+constexpr char HIGHLIGHT_END = '\x03'; // Byte after a highlighted word
+constexpr size_t DEFAULT_WORDS = 30; // Words of a snippet
+
+std::string make(const QueryNode& query, std::string_view text, size_t words = DEFAULT_WORDS); // Snippet of text for a parsed query
+
+}
+
+#endif // SNIPPET_H // End of include guard
@@ -1,69 +1,625 @@
 #include "searchEngine.h" // Include the search engine header
+#include "protocol.h" // Include the wire format
+#include "deadline.h" // Include the per-request deadlines
+#include "taskPool.h" // Include the pool running the requests
+#include "logger.h" // Include the optional search log
+#include "metrics.h" // Include the counters, timers and Prometheus text
 
 #include <iostream> // Include input-output stream
 #include <string> // Include string library
 #include <cstring> // Include C string library
+#include <cerrno> // Include errno for socket errors
+#include <csignal> // Include signal numbers
+#include <condition_variable> // Include condition variables for draining requests on shutdown
+#include <map> // Include map for responses waiting on earlier ones
+#include <memory> // Include shared_ptr for deadlines shared with the running requests
+#include <mutex> // Include mutexes for the completion queue
+#include <thread> // Include threads for the core count
+#include <unordered_map> // Include unordered_map for the connection table
+#include <fcntl.h> // Include file control for non-blocking sockets
 #include <sys/types.h> // Include socket types
 #include <sys/socket.h> // Include socket library
+#include <sys/epoll.h> // Include epoll for readiness notification
+#include <sys/eventfd.h> // Include eventfd for waking the event loop
+#include <sys/signalfd.h> // Include signalfd for handling SIGTERM in the event loop
 #include <netinet/in.h> // Include internet address family
+#include <arpa/inet.h> // Include inet_addr for the loopback metrics address
 #include <unistd.h> // Include POSIX operating system API
 
 #define PORT 12345 // Define the port number
-#define BUFFER_SIZE 1024 // Define the buffer size
+#define BUFFER_SIZE 65536 // Define the read buffer size
+#define MAX_EVENTS 256 // Define the number of events handled per epoll_wait
+#define MAX_HTTP_REQUEST 8192 // Define the largest HTTP request accepted on the metrics port
+#define DEFAULT_DEADLINE_MS 2000 // Define the time a request may take from its arrival, when not set with --deadline-ms
+#define QUEUE_PER_WORKER 16 // Define the requests that may wait per worker, when not set with --max-queue
 
-int main() {
-    SearchEngine searchEngine("docs", "fnsavefile.csv", "osavefile.csv", "nsavefile.csv", "wsavefile.csv", "fsavefile.csv"); // Initialize the search engine
+namespace {
 
-    int server_fd, new_socket; // Declare server and new socket file descriptors
-    struct sockaddr_in address; // Declare address structure
-    int addrlen = sizeof(address); // Get the size of the address structure
-    char buffer[BUFFER_SIZE] = {0}; // Initialize buffer with zeros
+// Event loop keys for the non-connection file descriptors; connections use ids from FIRST_CONNECTION
+enum : uint64_t { LISTENER = 0, SIGNALS = 1, WAKEUP = 2, METRICS_LISTENER = 3, FIRST_CONNECTION = 4 };
 
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) { // Create a socket
-        std::cerr << "Socket failed" << std::endl; // Print error message if socket creation fails
-        return -1; // Return error code
+// One request handed to the worker pool
+struct Task {
+    uint64_t connection; // Connection the request came from
+    uint64_t sequence; // Position of the request on its connection
+    std::string request; // Request payload
+    std::shared_ptr<Deadline> deadline; // Started on arrival, cancelled if the connection closes first
+};
+
+// One response handed back to the event loop
+struct Completion {
+    uint64_t connection; // Connection to answer
+    uint64_t sequence; // Position of the request on its connection
+    std::string response; // Response payload
+};
+
+// A client connection
+struct Connection {
+    int fd; // Socket
+    std::string input; // Bytes received but not yet parsed into frames
+    std::string output; // Framed responses not yet sent
+    uint64_t nextSequence = 0; // Sequence number of the next request
+    uint64_t nextToSend = 0; // Sequence number of the next response to send
+    std::map<uint64_t, std::string> finished; // Responses waiting on earlier ones
+    std::map<uint64_t, std::shared_ptr<Deadline>> running; // Deadlines of the requests not answered yet, by sequence
+    bool writing = false; // Whether the socket is registered for EPOLLOUT
+    bool http = false; // Whether the connection came to the metrics port and speaks HTTP instead of frames
+    bool closeAfterFlush = false; // Whether to close once the output is sent, after an HTTP response
+};
+
+// Everything a metrics request reports, in the Prometheus text format
+std::string metricsText(const Searcher& searchEngine) {
+    std::vector<metrics::Gauge> gauges; // Sizes sampled now
+    searchEngine.gauges("", gauges);
+    std::vector<metrics::Gauge> counters; // Result cache counters, kept by the cache itself
+    ResultCache::Counters cache;
+    if (searchEngine.cacheCounters(cache)) {
+        counters.push_back({"search_cache_hits_total", "Searches answered from the result cache", "", static_cast<double>(cache.hits)});
+        counters.push_back({"search_cache_misses_total", "Searches that missed the result cache", "", static_cast<double>(cache.misses)});
+        counters.push_back({"search_cache_evictions_total", "Result cache entries dropped", "", static_cast<double>(cache.evictions)});
+        counters.push_back({"search_cache_rejections_total", "Result cache entries refused by admission", "", static_cast<double>(cache.rejections)});
     }
+    return metrics::prometheus(metrics::collect(), gauges, counters);
+}
+
+// Wrap a body in an HTTP/1.0 response; the connection closes after it
+std::string httpResponse(const char* status, const std::string& body) {
+    return std::string("HTTP/1.0 ") + status + "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+}
 
-    address.sin_family = AF_INET; // Set address family to Internet
-    address.sin_addr.s_addr = INADDR_ANY; // Set IP address to any available interface
-    address.sin_port = htons(PORT); // Set port number
+// Signals that stop the server, read from a descriptor by the event loop
+sigset_t shutdownSignals() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    return mask;
+}
 
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) { // Bind the socket to the address
-        std::cerr << "Bind failed" << std::endl; // Print error message if bind fails
-        close(server_fd); // Close the socket
-        return -1; // Return error code
+// Whether a request is for monitoring, which is answered even when the server is overloaded
+bool monitoring(const std::string& request) {
+    return !request.empty() && request[0] == protocol::METRICS;
+}
+
+// Shorten the current request's deadline to the budget its client gave, if any
+void applyBudget(size_t budget) {
+    Deadline* deadline = Deadline::current();
+    if (deadline && budget > 0) {
+        deadline->limit(std::chrono::milliseconds(budget));
     }
+}
 
-    if (listen(server_fd, 3) < 0) { // Listen for incoming connections
-        std::cerr << "Listen failed" << std::endl; // Print error message if listen fails
-        close(server_fd); // Close the socket
-        return -1; // Return error code
+// Answer one request payload, under the request's Deadline
+std::string handleRequest(const Searcher& searchEngine, const std::string& request) {
+    if (request.empty()) {
+        return std::string(1, protocol::BAD_REQUEST) + "empty request";
     }
+    if (request[0] == protocol::QUERY) {
+        std::string query; // Query text
+        size_t offset = 0, k = 0, budget = 0; // Requested page and time budget
+        if (!protocol::decodeQuery(request.substr(1), query, offset, k, nullptr, &budget)) {
+            return std::string(1, protocol::BAD_REQUEST) + "malformed query request";
+        }
+        applyBudget(budget);
+        thread_local std::vector<std::string> results; // Paths of the page, reused by every search of this worker
+        searchEngine.search(query, results, k, offset); // Perform search with the query
 
-    while (true) { // Infinite loop to handle incoming connections
-        std::cout << "Waiting for connections..." << std::endl; // Print waiting message
-        if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t*)&addrlen)) < 0) { // Accept a new connection
-            std::cerr << "Accept failed" << std::endl; // Print error message if accept fails
-            close(server_fd); // Close the socket
+        std::string response(1, protocol::OK); // Initialize response string
+        for (const auto& result : results) { // Iterate through search results
+            response += result; // Append each result to the response string
+            response += '\n';
+        }
+        return response;
+    }
+    if (request[0] == protocol::RESULTS) { // A page of results with their stored fields and snippets
+        std::string query; // Query text
+        size_t offset = 0, k = 0, facetCount = 0, budget = 0; // Requested page, facet values of each kind and time budget
+        if (!protocol::decodeQuery(request.substr(1), query, offset, k, &facetCount, &budget)) {
+            return std::string(1, protocol::BAD_REQUEST) + "malformed results request";
+        }
+        applyBudget(budget);
+        thread_local std::vector<SearchResult> results; // Results of the page, reused by every search of this worker
+        if (facetCount == 0) {
+            searchEngine.results(query, results, k, offset);
+            return std::string(1, protocol::OK) + protocol::encodeResults(results);
+        }
+        Facets facets;
+        facets.limit = facetCount;
+        searchEngine.results(query, results, k, offset, &facets);
+        return std::string(1, protocol::OK) + protocol::encodeFacets(facets) + protocol::encodeResults(results);
+    }
+    if (request[0] == protocol::DOCUMENTS) { // Whole documents, by id
+        std::vector<uint64_t> ids; // Requested document ids
+        if (!protocol::decodeDocumentRequest(request.substr(1), ids)) {
+            return std::string(1, protocol::BAD_REQUEST) + "malformed documents request";
+        }
+        std::vector<Document> documents;
+        searchEngine.documents(ids, documents);
+        return std::string(1, protocol::OK) + protocol::encodeDocuments(documents);
+    }
+    if (request[0] == protocol::STATS) { // First phase of a search spread over shard servers
+        std::unique_ptr<QueryNode> query = parseQuery(request.substr(1));
+        if (!query) {
+            return std::string(1, protocol::BAD_REQUEST) + "empty query";
+        }
+        return std::string(1, protocol::OK) + protocol::encodeStats(searchEngine.stats(*query));
+    }
+    if (request[0] == protocol::TOP) { // Second phase, scored with the statistics of every shard
+        std::string text; // Query text
+        CollectionStats stats; // Statistics of the whole corpus
+        size_t count = 0, facetCount = 0, budget = 0; // Number of matches and of facet values of each kind wanted, and time budget
+        if (!protocol::decodeTop(request.substr(1), text, stats, count, &facetCount, &budget)) {
+            return std::string(1, protocol::BAD_REQUEST) + "malformed top request";
+        }
+        applyBudget(budget);
+        std::unique_ptr<QueryNode> query = parseQuery(text);
+        if (!query) {
+            return std::string(1, protocol::BAD_REQUEST) + "empty query";
+        }
+        if (facetCount == 0) {
+            return std::string(1, protocol::OK) + protocol::encodeScored(searchEngine.top(*query, stats, count));
+        }
+        Facets facets;
+        facets.limit = facetCount;
+        std::vector<ScoredFile> matches = searchEngine.top(*query, stats, count, &facets);
+        return std::string(1, protocol::OK) + protocol::encodeFacets(facets) + protocol::encodeScored(matches);
+    }
+    if (request[0] == protocol::METRICS) { // Monitoring
+        return std::string(1, protocol::OK) + metricsText(searchEngine);
+    }
+    return std::string(1, protocol::BAD_REQUEST) + "unknown request type";
+}
+
+// Epoll server: one thread owns every socket, the process's TaskPool runs the searches.
+// Every request gets a Deadline when it arrives, covering its wait in the queue as well as its search;
+// one still queued when it passes is answered OVERLOADED without running, one running is cut short and
+// answered PARTIAL. A request arriving while maxQueue requests wait is refused OVERLOADED at once, so
+// overload shows up as quick refusals rather than as every client's latency growing.
+class SearchServer {
+public:
+    SearchServer(const Searcher& searchEngine, TaskPool& pool, std::chrono::milliseconds deadline, size_t maxQueue) : searchEngine(searchEngine), pool(pool), deadline(deadline), maxQueue(maxQueue) {}
+
+    int run(int port, int metricsPort) { // Serve until SIGTERM or SIGINT, returns the exit code; metricsPort 0 disables the HTTP metrics endpoint
+        if (!setup(port) || (metricsPort > 0 && !listenForMetrics(metricsPort))) {
             return -1; // Return error code
         }
+        std::cout << "Listening on port " << port << " with " << pool.size() << " workers" << std::endl; // Print waiting message
+
+        epoll_event events[MAX_EVENTS];
+        while (running) { // Event loop
+            int count = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                std::cerr << "epoll_wait failed: " << std::strerror(errno) << std::endl; // Print error message
+                break;
+            }
+            for (int i = 0; i < count; ++i) {
+                uint64_t key = events[i].data.u64;
+                if (key == LISTENER || key == METRICS_LISTENER) {
+                    acceptConnections(key == METRICS_LISTENER ? metricsFd : serverFd, key == METRICS_LISTENER);
+                } else if (key == SIGNALS) {
+                    signalfd_siginfo info;
+                    if (read(signalFd, &info, sizeof(info)) > 0) {
+                        std::cout << "Shutting down" << std::endl; // Print shutdown message
+                    }
+                    running = false;
+                } else if (key == WAKEUP) {
+                    deliverCompletions();
+                } else {
+                    handleConnection(key, events[i].events);
+                }
+            }
+        }
+
+        shutdown();
+        return 0; // Return success code
+    }
+
+private:
+    bool setup(int port) { // Create the listening socket, signal and wakeup descriptors
+        if ((serverFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) { // Create a socket
+            std::cerr << "Socket failed" << std::endl; // Print error message if socket creation fails
+            return false;
+        }
+        int reuse = 1;
+        setsockopt(serverFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)); // Allow restarting while old connections linger
+
+        struct sockaddr_in address = {}; // Declare address structure
+        address.sin_family = AF_INET; // Set address family to Internet
+        address.sin_addr.s_addr = INADDR_ANY; // Set IP address to any available interface
+        address.sin_port = htons(port); // Set port number
+
+        if (bind(serverFd, (struct sockaddr *)&address, sizeof(address)) < 0) { // Bind the socket to the address
+            std::cerr << "Bind failed" << std::endl; // Print error message if bind fails
+            return false;
+        }
+        if (listen(serverFd, SOMAXCONN) < 0) { // Listen for incoming connections
+            std::cerr << "Listen failed" << std::endl; // Print error message if listen fails
+            return false;
+        }
+
+        sigset_t mask = shutdownSignals(); // Blocked by main before any thread started, so they wait for the descriptor
+        signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (signalFd < 0 || wakeupFd < 0 || epollFd < 0) {
+            std::cerr << "Event setup failed: " << std::strerror(errno) << std::endl; // Print error message
+            return false;
+        }
+        signal(SIGPIPE, SIG_IGN); // Closed clients are handled through send errors
 
-        int valread = read(new_socket, buffer, BUFFER_SIZE); // Read data from the socket
-        if (valread > 0) { // Check if data was read
-            std::string query(buffer, valread); // Convert buffer to string
-            auto results = searchEngine.search(query); // Perform search with the query
+        return watch(serverFd, LISTENER, EPOLLIN) && watch(signalFd, SIGNALS, EPOLLIN) && watch(wakeupFd, WAKEUP, EPOLLIN);
+    }
 
-            std::string response; // Initialize response string
-            for (const auto& result : results) { // Iterate through search results
-                response += result + "\n"; // Append each result to the response string
+    bool listenForMetrics(int port) { // Open the HTTP metrics endpoint, reachable from this host only
+        if ((metricsFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0)) < 0) {
+            std::cerr << "Metrics socket failed" << std::endl; // Print error message
+            return false;
+        }
+        int reuse = 1;
+        setsockopt(metricsFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        struct sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = inet_addr("127.0.0.1"); // Loopback only: the endpoint has no authentication
+        address.sin_port = htons(port);
+
+        if (bind(metricsFd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(metricsFd, SOMAXCONN) < 0) {
+            std::cerr << "Metrics bind failed" << std::endl; // Print error message
+            return false;
+        }
+        std::cout << "Serving metrics on http://127.0.0.1:" << port << "/metrics" << std::endl; // Print the endpoint
+        return watch(metricsFd, METRICS_LISTENER, EPOLLIN);
+    }
+
+    bool watch(int fd, uint64_t key, uint32_t events) { // Register a descriptor with the event loop
+        epoll_event event = {};
+        event.events = events;
+        event.data.u64 = key;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+            std::cerr << "epoll_ctl failed: " << std::strerror(errno) << std::endl; // Print error message
+            return false;
+        }
+        return true;
+    }
+
+    void acceptConnections(int listenFd, bool http) { // Accept every pending connection
+        while (true) {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC); // Accept a new connection
+            if (fd < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) { // Errors affect only this connection
+                    std::cerr << "Accept failed: " << std::strerror(errno) << std::endl; // Print error message if accept fails
+                }
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                return;
             }
+            uint64_t key = nextConnection++;
+            if (!watch(fd, key, EPOLLIN | EPOLLRDHUP)) {
+                close(fd);
+                continue;
+            }
+            connections[key].fd = fd;
+            connections[key].http = http;
+            metrics::add(metrics::CONNECTIONS);
+        }
+    }
+
+    void handleConnection(uint64_t key, uint32_t events) { // Read requests from or write responses to a connection
+        auto it = connections.find(key);
+        if (it == connections.end()) {
+            return;
+        }
+        Connection& connection = it->second;
 
-            send(new_socket, response.c_str(), response.size(), 0); // Send the response back to the client
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            closeConnection(key);
+            return;
         }
+        if (events & EPOLLIN) {
+            char buffer[BUFFER_SIZE]; // Read buffer
+            while (true) {
+                ssize_t valread = read(connection.fd, buffer, BUFFER_SIZE); // Read data from the socket
+                if (valread > 0) {
+                    connection.input.append(buffer, static_cast<size_t>(valread));
+                    continue;
+                }
+                if (valread < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (valread < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    break;
+                }
+                closeConnection(key); // Closed by the client or failed
+                return;
+            }
+
+            if (connection.http) {
+                readHttpRequest(key);
+                return;
+            }
 
-        close(new_socket); // Close the new socket
+            std::string request;
+            bool tooLarge = false;
+            while (protocol::extractFrame(connection.input, request, tooLarge)) { // Queue every complete request
+                uint64_t sequence = connection.nextSequence++;
+                if (maxQueue > 0 && pool.pending() >= maxQueue && !monitoring(request)) {
+                    metrics::add(metrics::REQUESTS);
+                    metrics::add(metrics::REJECTED);
+                    deliver({key, sequence, std::string(1, protocol::OVERLOADED) + "too many requests waiting"});
+                    if (connections.find(key) == connections.end()) { // Sending the refusal failed and closed the connection
+                        return;
+                    }
+                    continue;
+                }
+                submit({key, sequence, std::move(request), nullptr});
+            }
+            if (tooLarge) {
+                std::cerr << "Closing connection with oversized frame" << std::endl; // Print error message
+                closeConnection(key);
+                return;
+            }
+        }
+        if (events & EPOLLOUT) {
+            flush(key);
+        }
     }
 
-    close(server_fd); // Close the server socket
-    return 0; // Return success code
-}
\ No newline at end of file
+    void readHttpRequest(uint64_t key) { // Answer a metrics request once its headers are complete
+        Connection& connection = connections.at(key);
+        if (connection.closeAfterFlush || connection.nextSequence > 0) { // Already answered or being answered; ignore anything more
+            connection.input.clear();
+            return;
+        }
+        if (connection.input.find("\r\n\r\n") == std::string::npos) {
+            if (connection.input.size() > MAX_HTTP_REQUEST) {
+                closeConnection(key);
+            }
+            return;
+        }
+        bool found = connection.input.compare(0, 13, "GET /metrics ") == 0 || connection.input.compare(0, 6, "GET / ") == 0;
+        connection.input.clear();
+        if (!found) {
+            connection.output = httpResponse("404 Not Found", "Not found, try /metrics\n");
+            connection.closeAfterFlush = true;
+            flush(key);
+            return;
+        }
+        submit({key, connection.nextSequence++, std::string(1, protocol::METRICS), nullptr}); // Rendered by a worker, like any request
+    }
+
+    void flush(uint64_t key) { // Send as much pending output as the socket takes
+        Connection& connection = connections.at(key);
+        metrics::Timer timer(metrics::SEND);
+        while (!connection.output.empty()) {
+            ssize_t sent = send(connection.fd, connection.output.data(), connection.output.size(), MSG_NOSIGNAL);
+            if (sent > 0) {
+                connection.output.erase(0, static_cast<size_t>(sent));
+                metrics::add(metrics::BYTES_SENT, static_cast<uint64_t>(sent));
+            } else if (sent < 0 && errno == EINTR) {
+                continue;
+            } else if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            } else {
+                closeConnection(key);
+                return;
+            }
+        }
+        if (connection.output.empty() && connection.closeAfterFlush) { // HTTP response complete
+            closeConnection(key);
+            return;
+        }
+        bool wantWrite = !connection.output.empty(); // Wait for EPOLLOUT only while output is pending
+        if (wantWrite != connection.writing) {
+            epoll_event event = {};
+            event.events = EPOLLIN | EPOLLRDHUP | (wantWrite ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+            event.data.u64 = key;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+            connection.writing = wantWrite;
+        }
+    }
+
+    void closeConnection(uint64_t key) { // Close a connection; its requests are cancelled and late responses dropped
+        auto it = connections.find(key);
+        if (it != connections.end()) {
+            for (auto& pair : it->second.running) { // Searches stop at their next deadline check
+                pair.second->cancel();
+            }
+            close(it->second.fd); // Closing also removes it from epoll
+            connections.erase(it);
+        }
+    }
+
+    void submit(Task task) { // Start the request's deadline and hand it to the worker pool
+        task.deadline = std::make_shared<Deadline>(deadline);
+        connections.at(task.connection).running[task.sequence] = task.deadline;
+        {
+            std::lock_guard<std::mutex> lock(completionsMutex);
+            ++outstanding;
+        }
+        pool.submit([this, task = std::move(task)] { work(task); });
+    }
+
+    void work(const Task& task) { // Run one request on a pool worker
+        std::string response;
+        if (task.deadline->expired() && !monitoring(task.request)) { // Waited too long, or its client went away
+            response = std::string(1, protocol::OVERLOADED) + "deadline passed before the request started";
+            metrics::add(metrics::REJECTED);
+        } else {
+            Deadline::Scope scope(task.deadline.get());
+            response = handleRequest(searchEngine, task.request);
+            if (!response.empty() && response[0] == protocol::OK && task.deadline->wasCut()) {
+                response[0] = protocol::PARTIAL;
+                metrics::add(metrics::PARTIAL);
+            }
+        }
+        metrics::add(metrics::REQUESTS);
+        if (!response.empty() && response[0] == protocol::BAD_REQUEST) {
+            metrics::add(metrics::BAD_REQUESTS);
+        }
+        std::lock_guard<std::mutex> lock(completionsMutex); // Held until the wakeup is written, so shutdown cannot close the eventfd first
+        completions.push_back({task.connection, task.sequence, std::move(response)});
+        uint64_t one = 1;
+        if (write(wakeupFd, &one, sizeof(one)) < 0) { // Wake the event loop
+            std::cerr << "Failed to wake event loop" << std::endl; // Print error message
+        }
+        if (--outstanding == 0) {
+            drained.notify_all();
+        }
+    }
+
+    void deliverCompletions() { // Move finished responses to their connections in request order
+        uint64_t counter;
+        if (read(wakeupFd, &counter, sizeof(counter)) < 0 && errno != EAGAIN) {
+            std::cerr << "Failed to read wakeup counter" << std::endl; // Print error message
+        }
+        std::vector<Completion> done;
+        {
+            std::lock_guard<std::mutex> lock(completionsMutex);
+            done.swap(completions);
+        }
+        for (auto& completion : done) {
+            deliver(std::move(completion));
+        }
+    }
+
+    void deliver(Completion completion) { // Queue one response on its connection, sending what is in order
+        auto it = connections.find(completion.connection);
+        if (it == connections.end()) { // The client went away
+            return;
+        }
+        Connection& connection = it->second;
+        connection.running.erase(completion.sequence);
+        if (connection.http) { // The only request of a metrics connection
+            connection.output = httpResponse("200 OK", completion.response.substr(1));
+            connection.closeAfterFlush = true;
+            flush(completion.connection);
+            return;
+        }
+        connection.finished[completion.sequence] = std::move(completion.response);
+        while (!connection.finished.empty() && connection.finished.begin()->first == connection.nextToSend) { // Send responses in order
+            connection.output += protocol::frame(connection.finished.begin()->second);
+            connection.finished.erase(connection.finished.begin());
+            ++connection.nextToSend;
+        }
+        flush(completion.connection);
+    }
+
+    void shutdown() { // Cancel the requests in flight, wait for them and close every descriptor
+        while (!connections.empty()) { // Close the client sockets, cancelling their requests
+            closeConnection(connections.begin()->first);
+        }
+        {
+            std::unique_lock<std::mutex> lock(completionsMutex);
+            drained.wait(lock, [this] { return outstanding == 0; }); // Queued requests see their deadline cancelled and return at once
+        }
+        for (int fd : {serverFd, metricsFd, signalFd, wakeupFd, epollFd}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+
+    const Searcher& searchEngine; // Shared by all workers; search is const
+    TaskPool& pool; // Runs the requests
+    std::chrono::milliseconds deadline; // Time each request may take from its arrival
+    size_t maxQueue; // Requests that may wait for a worker before new ones are refused, 0 for no limit
+
+    int serverFd = -1; // Listening socket
+    int metricsFd = -1; // Listening socket of the HTTP metrics endpoint
+    int signalFd = -1; // SIGTERM and SIGINT
+    int wakeupFd = -1; // Signalled by workers when responses are ready
+    int epollFd = -1; // Event loop
+    bool running = true; // Cleared on shutdown signals
+
+    uint64_t nextConnection = FIRST_CONNECTION; // Key of the next connection
+    std::unordered_map<uint64_t, Connection> connections; // Open connections, owned by the event loop thread
+
+    std::mutex completionsMutex; // Guards completions and outstanding
+    std::vector<Completion> completions; // Responses waiting for the event loop
+    size_t outstanding = 0; // Requests submitted to the pool and not finished
+    std::condition_variable drained; // Signalled when outstanding drops to 0
+};
+
+}
+
+int main(int argc, char* argv[]) {
+    sigset_t mask = shutdownSignals(); // Blocked before the first thread starts, so every thread inherits the mask and only the event loop's descriptor takes them
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    std::unique_ptr<Searcher> engine = openSearchEngine(argc, argv); // Map, migrate or build the index chosen on the command line, or reach its shard servers
+    const Searcher& searchEngine = *engine; // Search engine used below
+
+    int port = PORT; // Port to listen on
+    unsigned workers = std::thread::hardware_concurrency(); // One worker per core by default
+    long deadlineMs = DEFAULT_DEADLINE_MS; // Time a request may take from its arrival, 0 for no limit
+    long maxQueue = -1; // Requests that may wait for a worker, 0 for no limit, -1 for QUEUE_PER_WORKER per worker
+    bool watch = true; // Whether to apply changes to the docs folder live
+    int metricsPort = 0; // Port of the HTTP metrics endpoint, 0 for none
+    for (int i = 1; i < argc; ++i) { // Read server flags
+        std::string arg = argv[i];
+        if (arg == "--port" && i + 1 < argc) {
+            port = std::atoi(argv[++i]);
+        } else if (arg == "--workers" && i + 1 < argc) {
+            workers = static_cast<unsigned>(std::atoi(argv[++i]));
+        } else if (arg == "--deadline-ms" && i + 1 < argc) {
+            deadlineMs = std::atol(argv[++i]);
+        } else if (arg == "--max-queue" && i + 1 < argc) {
+            maxQueue = std::atol(argv[++i]);
+        } else if (arg == "--no-watch") {
+            watch = false;
+        } else if (arg == "--metrics-port" && i + 1 < argc) {
+            metricsPort = std::atoi(argv[++i]);
+        } else if (arg == "--log") {
+            logger::start(); // Log every search, written by a background thread
+        }
+    }
+    TaskPool& pool = TaskPool::shared(workers > 0 ? workers : 1); // Created before anything else can use it, with the requested workers
+    if (watch) {
+        engine->watch(); // Searches keep running against the current snapshot while changes are applied
+    }
+
+    std::chrono::milliseconds deadline = deadlineMs > 0 ? std::chrono::milliseconds(deadlineMs) : std::chrono::hours(24 * 365); // No limit is a year
+    SearchServer server(searchEngine, pool, deadline, maxQueue >= 0 ? static_cast<size_t>(maxQueue) : static_cast<size_t>(pool.size()) * QUEUE_PER_WORKER);
+    int status = server.run(port, metricsPort);
+    logger::stop();
+
+    metrics::Snapshot totals = metrics::collect(); // Reported on shutdown; scrape the metrics request for more
+    std::cout << totals.counters[metrics::QUERIES] << " queries, " << totals.counters[metrics::REQUESTS] << " requests, " << totals.counters[metrics::BAD_REQUESTS] << " bad requests, "
+              << totals.counters[metrics::REJECTED] << " rejected, " << totals.counters[metrics::PARTIAL] << " partial" << std::endl;
+    for (int stage = 0; stage < metrics::STAGE_COUNT; ++stage) {
+        const metrics::Distribution& d = totals.stages[stage];
+        if (d.count > 0) {
+            std::cout << "  " << metrics::stageName(static_cast<metrics::Stage>(stage)) << ": p50 " << d.quantile(0.5) * 1e6 << " us, p99 " << d.quantile(0.99) * 1e6 << " us, max " << d.quantile(1.0) * 1e6 << " us over " << d.count << std::endl;
+        }
+    }
+
+    ResultCache::Counters cache; // Reported on shutdown to help size SEARCH_CACHE_MB
+    if (searchEngine.cacheCounters(cache)) {
+        std::cout << "Result cache: " << cache.hits << " hits, " << cache.misses << " misses, " << cache.evictions << " evictions, " << cache.rejections << " rejections, "
+                  << cache.entries << " entries in " << cache.bytes << " of " << cache.capacity << " bytes" << std::endl;
+    }
+    return status;
+}
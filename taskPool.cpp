@@ -0,0 +1,142 @@
+#include "taskPool.h" // Include the task pool header
+#include "deadline.h" // Include the deadline carried to the parts of forEach
+
+#include <algorithm> // Include the algorithm library for std::max
+
+namespace {
+
+thread_local const TaskPool* owner = nullptr; // Pool the calling thread works for, if any
+thread_local size_t ownIndex = 0; // Its index among the pool's workers
+
+// State of one forEach call, kept alive by the tasks that may still run after it returns
+struct Batch {
+    const std::function<void(size_t)>* work; // Work of each index; only used while an index is left
+    size_t count; // Number of indexes
+    Deadline* deadline; // Deadline of the caller
+    std::atomic<size_t> next{0}; // Next index to claim
+    std::atomic<size_t> done{0}; // Indexes finished
+    std::mutex mutex; // Orders the last finish against the caller's wait
+    std::condition_variable finished; // Signalled when every index is done
+};
+
+// Run indexes of a batch until none is left to claim
+void claim(Batch& batch) {
+    Deadline::Scope scope(batch.deadline);
+    for (size_t index = batch.next.fetch_add(1); index < batch.count; index = batch.next.fetch_add(1)) {
+        (*batch.work)(index);
+        if (batch.done.fetch_add(1) + 1 == batch.count) {
+            std::lock_guard<std::mutex> lock(batch.mutex);
+            batch.finished.notify_all();
+        }
+    }
+}
+
+}
+
+TaskPool& TaskPool::shared(unsigned threads) {
+    static TaskPool pool(threads);
+    return pool;
+}
+
+TaskPool::TaskPool(unsigned threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        local.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(&TaskPool::run, this, i);
+    }
+}
+
+TaskPool::~TaskPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void TaskPool::submit(Task task) {
+    bool fromWorker = owner == this;
+    Queue& queue = fromWorker ? *local[ownIndex] : outside;
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back(std::move(task));
+        queued.fetch_add(1); // Counted with the queue locked, so a worker taking it cannot count it first
+        if (!fromWorker) {
+            waiting.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    { // A worker about to sleep either sees the task or is already waiting for the signal
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wake.notify_one();
+}
+
+void TaskPool::forEach(size_t count, const std::function<void(size_t)>& work) {
+    if (count == 0) {
+        return;
+    }
+    auto batch = std::make_shared<Batch>();
+    batch->work = &work;
+    batch->count = count;
+    batch->deadline = Deadline::current();
+    for (size_t i = 1; i < count; ++i) { // Helpers for every index but one; each claims whichever index is left
+        submit([batch] { claim(*batch); });
+    }
+    claim(*batch); // The caller claims indexes too, so the batch finishes even when every worker is busy
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->finished.wait(lock, [&batch] { return batch->done.load() == batch->count; }); // Indexes claimed by workers are still running
+}
+
+bool TaskPool::take(size_t self, Task& task) {
+    auto pop = [&](Queue& queue, bool newest) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.tasks.empty()) {
+            return false;
+        }
+        if (newest) {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        } else {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        queued.fetch_sub(1);
+        if (&queue == &outside) {
+            waiting.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return true;
+    };
+    if (pop(*local[self], true) || pop(outside, false)) {
+        return true;
+    }
+    for (size_t i = 1; i < local.size(); ++i) { // Steal, starting from the next worker so thieves spread out
+        if (pop(*local[(self + i) % local.size()], false)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TaskPool::run(size_t self) {
+    owner = this;
+    ownIndex = self;
+    for (;;) {
+        Task task;
+        if (take(self, task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+        if (stopping && queued.load() == 0) { // Stopping with nothing left to do
+            return;
+        }
+    }
+}
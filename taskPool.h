@@ -0,0 +1,62 @@
+#ifndef TASKPOOL_H // Include guard to prevent multiple inclusions of this header file
+#define TASKPOOL_H // Define the include guard
+
+#include <atomic> // Include the atomic library for the queue counters
+#include <condition_variable> // Include the condition_variable library for idle workers
+#include <cstddef> // Include the cstddef library for size_t
+#include <deque> // Include the deque library for the task queues
+#include <functional> // Include the functional library for tasks
+#include <memory> // Include the memory library
+#include <mutex> // Include the mutex library for the task queues
+#include <thread> // Include the thread library for the workers
+#include <vector> // Include the vector library
+
+// Work-stealing pool of threads shared by everything a process runs in parallel: the server's requests
+// and the shards of each search.
+//
+// Tasks submitted from outside the pool, like the requests of the server's event loop, wait in one
+// queue in arrival order. Each worker also owns a deque: tasks it submits itself, like the shards of
+// the search it is running, go to the back of it and it takes its next task from there, newest first,
+// so a search's shards run while its data is still in cache. A worker with nothing of its own takes the
+// oldest request, and failing that steals the oldest task from another worker's deque.
+//
+// pending() is the number of requests that have not started, which the server compares with its queue
+// limit to turn new requests away before they wait.
+class TaskPool {
+public:
+    using Task = std::function<void()>; // Unit of work
+
+    static TaskPool& shared(unsigned threads = 0); // Pool of the process, created by the first call with threads workers, or one per core for 0
+
+    explicit TaskPool(unsigned threads); // Start the workers, one per core for 0
+    ~TaskPool(); // Run every queued task, then join the workers
+    TaskPool(const TaskPool&) = delete; // Pools are not copyable
+    TaskPool& operator=(const TaskPool&) = delete; // Pools are not copyable
+
+    void submit(Task task); // Queue a task; from a worker it goes to the worker's own deque
+    // Run work(0) to work(count - 1) in parallel, the calling thread taking part, and return once all of them are done.
+    // Each runs under the caller's Deadline, so its checks stop every part of the work.
+    void forEach(size_t count, const std::function<void(size_t)>& work);
+    size_t pending() const { return waiting.load(std::memory_order_relaxed); } // Tasks submitted from outside the pool that have not started
+    unsigned size() const { return static_cast<unsigned>(workers.size()); } // Number of workers
+
+private:
+    struct Queue { // Tasks of one worker, or of the outside
+        std::mutex mutex; // Guards tasks
+        std::deque<Task> tasks; // Queued tasks
+    };
+
+    bool take(size_t self, Task& task); // Next task for worker self: its own newest, the oldest from outside, or one stolen from another worker
+    void run(size_t self); // Body of worker self
+
+    std::vector<std::unique_ptr<Queue>> local; // Deque of each worker
+    Queue outside; // Tasks submitted from other threads
+    std::atomic<size_t> queued{0}; // Tasks in every queue
+    std::atomic<size_t> waiting{0}; // Tasks in outside
+    std::mutex sleepMutex; // Guards stopping, and orders sleeping against new tasks
+    std::condition_variable wake; // Signalled when a task is queued or the pool stops
+    bool stopping = false; // Whether the workers should exit once the queues are empty
+    std::vector<std::thread> workers; // Worker threads
+};
+
+#endif // TASKPOOL_H // End of include guard
@@ -0,0 +1,281 @@
+#include "termDictionary.h" // Include the term dictionary header
+#include "deadline.h" // Include the request deadline checked while walking the vocabulary
+
+#include <algorithm> // Include algorithm library for sorting and merging the added terms
+
+namespace {
+
+// Find a term in a hash table, returns its id or NO_TERM
+template <typename TermAt>
+uint32_t probe(const indexfile::TermSlot* slots, uint64_t slotCount, std::string_view term, uint64_t hash, TermAt termAt) {
+    if (slotCount == 0) { // Empty dictionary
+        return indexfile::NO_TERM;
+    }
+    uint32_t tag = static_cast<uint32_t>(hash >> 32);
+    for (uint64_t i = hash & (slotCount - 1); ; i = (i + 1) & (slotCount - 1)) { // Tables are never full, so an empty slot ends the search
+        const indexfile::TermSlot& slot = slots[i];
+        if (slot.term == indexfile::NO_TERM) {
+            return indexfile::NO_TERM;
+        }
+        if (slot.tag == tag && termAt(slot.term) == term) {
+            return slot.term;
+        }
+    }
+}
+
+// Place a term id in the first free slot of its probe sequence
+void place(std::vector<indexfile::TermSlot>& slots, uint32_t id, uint64_t hash) {
+    uint64_t mask = slots.size() - 1;
+    uint64_t i = hash & mask;
+    while (slots[i].term != indexfile::NO_TERM) {
+        i = (i + 1) & mask;
+    }
+    slots[i] = {id, static_cast<uint32_t>(hash >> 32)};
+}
+
+// Smallest power of two holding count terms at most half full
+uint64_t slotCountFor(size_t count) {
+    uint64_t slotCount = 16;
+    while (slotCount < count * 2) {
+        slotCount *= 2;
+    }
+    return slotCount;
+}
+
+// First index in [first, last) whose term fails pred, for a pred that holds on a leading run of a sorted range
+template <typename TermAtIndex, typename Pred>
+size_t firstFailing(size_t first, size_t last, TermAtIndex termAt, Pred pred) {
+    while (first < last) {
+        size_t middle = first + (last - first) / 2;
+        if (pred(termAt(middle))) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    return first;
+}
+
+
+// Terms of one sorted run matching a wildcard pattern: only the terms starting with its literal prefix are tested
+template <typename TermAtIndex, typename IdAtIndex>
+void wildcardRun(size_t count, TermAtIndex termAt, IdAtIndex idAt, std::string_view pattern, std::pmr::vector<uint32_t>& out) {
+    std::string_view prefix = pattern.substr(0, pattern.find('*'));
+    size_t first = firstFailing(0, count, termAt, [prefix](std::string_view term) { return term < prefix; });
+    DeadlineCheck deadline; // A short prefix can leave most of the vocabulary to test
+    for (size_t i = first; i < count && !deadline.expired(); ++i) {
+        std::string_view term = termAt(i);
+        if (term.compare(0, prefix.size(), prefix) != 0) { // Past the terms with the prefix
+            break;
+        }
+        if (globMatch(pattern, term)) {
+            out.push_back(idAt(i));
+        }
+    }
+}
+
+// Terms of one sorted run within maxEdits of word. Consecutive terms share the dynamic programming
+// rows of their common prefix, as if walking a trie, and once every entry of a row exceeds maxEdits no
+// term with that prefix can match, so the run skips past all of them.
+template <typename TermAtIndex, typename IdAtIndex>
+void fuzzyRun(size_t count, TermAtIndex termAt, IdAtIndex idAt, std::string_view word, uint32_t maxEdits, std::pmr::vector<std::pair<uint32_t, uint32_t>>& out) {
+    size_t width = word.size() + 1;
+    std::pmr::vector<uint32_t> rows(width, out.get_allocator()); // Row d holds the distances from the first d characters of the current term to every prefix of word
+    for (size_t j = 0; j < width; ++j) {
+        rows[j] = static_cast<uint32_t>(j);
+    }
+    std::string_view previous; // Term the rows were computed for
+    size_t depth = 0; // Number of valid rows after the first
+    DeadlineCheck deadline; // A large distance prunes little of the vocabulary
+    for (size_t i = 0; i < count && !deadline.expired();) {
+        std::string_view term = termAt(i);
+        size_t common = 0;
+        while (common < depth && common < term.size() && term[common] == previous[common]) {
+            ++common;
+        }
+        depth = common;
+        previous = term;
+        bool pruned = false;
+        for (; depth < term.size(); ++depth) { // Extend the rows with the rest of the term
+            rows.resize((depth + 2) * width);
+            const uint32_t* above = &rows[depth * width];
+            uint32_t* row = &rows[(depth + 1) * width];
+            row[0] = static_cast<uint32_t>(depth + 1);
+            uint32_t smallest = row[0];
+            for (size_t j = 1; j < width; ++j) {
+                uint32_t substitute = above[j - 1] + (word[j - 1] == term[depth] ? 0 : 1);
+                row[j] = std::min({above[j] + 1, row[j - 1] + 1, substitute});
+                smallest = std::min(smallest, row[j]);
+            }
+            if (smallest > maxEdits) { // No term with this prefix can match
+                std::string_view prefix = term.substr(0, depth + 1);
+                i = firstFailing(i + 1, count, termAt, [prefix](std::string_view other) { return other.compare(0, prefix.size(), prefix) == 0; });
+                ++depth;
+                pruned = true;
+                break;
+            }
+        }
+        if (pruned) {
+            continue;
+        }
+        uint32_t distance = rows[depth * width + word.size()];
+        if (distance <= maxEdits) {
+            out.push_back({idAt(i), distance});
+        }
+        ++i;
+    }
+}
+
+}
+
+bool globMatch(std::string_view pattern, std::string_view text) {
+    size_t p = 0, t = 0;
+    size_t star = std::string_view::npos, resume = 0; // Last '*' seen and where its run would end next
+    while (t < text.size()) {
+        if (p < pattern.size() && pattern[p] == '*') { // Let the run start empty
+            star = p++;
+            resume = t;
+        } else if (p < pattern.size() && pattern[p] == text[t]) {
+            ++p;
+            ++t;
+        } else if (star != std::string_view::npos) { // Grow the last run by one character and retry
+            p = star + 1;
+            t = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') {
+        ++p;
+    }
+    return p == pattern.size();
+}
+
+TermDictionary::TermDictionary() : mappedTerms(nullptr), mappedStrings(nullptr), mappedSlots(nullptr), mappedSlotCount(0), mapped(0) {} // Constructor
+
+void TermDictionary::attach(const char* base, const indexfile::Header& header) {
+    clear();
+    mappedTerms = reinterpret_cast<const indexfile::TermEntry*>(base + header.termTableOffset);
+    mappedStrings = base + header.termStringsOffset;
+    mappedSlots = reinterpret_cast<const indexfile::TermSlot*>(base + header.slotTableOffset);
+    mappedSlotCount = header.slotCount;
+    mapped = header.termCount;
+}
+
+void TermDictionary::clear() {
+    mappedTerms = nullptr;
+    mappedStrings = nullptr;
+    mappedSlots = nullptr;
+    mappedSlotCount = 0;
+    mapped = 0;
+    pool.clear();
+    starts.clear();
+    slots.clear();
+    sorted.clear();
+}
+
+uint32_t TermDictionary::find(std::string_view term) const {
+    uint64_t h = hash(term);
+    auto termAt = [this](uint32_t id) { return this->term(id); };
+    uint32_t id = probe(mappedSlots, mappedSlotCount, term, h, termAt); // Mapped terms first
+    if (id == indexfile::NO_TERM) {
+        id = probe(slots.data(), slots.size(), term, h, termAt); // Then terms added since mapping
+    }
+    return id;
+}
+
+uint32_t TermDictionary::intern(std::string_view term) {
+    uint32_t id = find(term);
+    if (id != indexfile::NO_TERM) { // Already known
+        return id;
+    }
+    if (starts.empty()) { // First added term
+        starts.push_back(0);
+    }
+    if ((starts.size() - 1) * 2 >= slots.size()) { // Keep the table at most half full
+        grow();
+    }
+    id = size();
+    pool.append(term.data(), term.size());
+    starts.push_back(pool.size());
+    place(slots, id, hash(term));
+    return id;
+}
+
+std::string_view TermDictionary::term(uint32_t id) const {
+    if (id < mapped) { // Term of the mapped index
+        const indexfile::TermEntry& entry = mappedTerms[id];
+        return std::string_view(mappedStrings + entry.stringOffset, entry.stringLength);
+    }
+    size_t index = id - mapped;
+    return std::string_view(pool.data() + starts[index], starts[index + 1] - starts[index]);
+}
+
+uint32_t TermDictionary::size() const {
+    return mapped + static_cast<uint32_t>(starts.empty() ? 0 : starts.size() - 1);
+}
+
+size_t TermDictionary::memoryUsage() const {
+    return pool.capacity() + starts.capacity() * sizeof(size_t) + slots.capacity() * sizeof(indexfile::TermSlot) + sorted.capacity() * sizeof(uint32_t);
+}
+
+void TermDictionary::sortAdded() {
+    uint32_t added = size() - mapped;
+    if (sorted.size() == added) { // Nothing new
+        return;
+    }
+    size_t middle = sorted.size();
+    for (uint32_t index = static_cast<uint32_t>(middle); index < added; ++index) {
+        sorted.push_back(mapped + index);
+    }
+    auto less = [this](uint32_t a, uint32_t b) { return term(a) < term(b); };
+    std::sort(sorted.begin() + middle, sorted.end(), less); // Sort the new terms, then merge them with the sorted ones
+    std::inplace_merge(sorted.begin(), sorted.begin() + middle, sorted.end(), less);
+}
+
+void TermDictionary::matchWildcard(std::string_view pattern, std::pmr::vector<uint32_t>& out) const {
+    auto mappedTerm = [this](size_t index) { return term(static_cast<uint32_t>(index)); };
+    auto mappedId = [](size_t index) { return static_cast<uint32_t>(index); };
+    wildcardRun(mapped, mappedTerm, mappedId, pattern, out); // Mapped ids are in term order
+    auto addedTerm = [this](size_t index) { return term(sorted[index]); };
+    auto addedId = [this](size_t index) { return sorted[index]; };
+    wildcardRun(sorted.size(), addedTerm, addedId, pattern, out);
+}
+
+void TermDictionary::matchFuzzy(std::string_view word, uint32_t maxEdits, std::pmr::vector<std::pair<uint32_t, uint32_t>>& out) const {
+    auto mappedTerm = [this](size_t index) { return term(static_cast<uint32_t>(index)); };
+    auto mappedId = [](size_t index) { return static_cast<uint32_t>(index); };
+    fuzzyRun(mapped, mappedTerm, mappedId, word, maxEdits, out);
+    auto addedTerm = [this](size_t index) { return term(sorted[index]); };
+    auto addedId = [this](size_t index) { return sorted[index]; };
+    fuzzyRun(sorted.size(), addedTerm, addedId, word, maxEdits, out);
+}
+
+uint64_t TermDictionary::hash(std::string_view term) {
+    uint64_t h = 14695981039346656037ULL; // FNV-1a offset basis
+    for (char c : term) {
+        h = (h ^ static_cast<unsigned char>(c)) * 1099511628211ULL; // FNV-1a prime
+    }
+    h ^= h >> 33; // Mix the high bits into the low bits used for the slot index
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+std::vector<indexfile::TermSlot> TermDictionary::buildSlots(const std::vector<std::string_view>& terms) {
+    std::vector<indexfile::TermSlot> table(slotCountFor(terms.size()), {indexfile::NO_TERM, 0});
+    for (size_t id = 0; id < terms.size(); ++id) {
+        place(table, static_cast<uint32_t>(id), hash(terms[id]));
+    }
+    return table;
+}
+
+void TermDictionary::grow() {
+    size_t count = starts.empty() ? 0 : starts.size() - 1; // Added terms
+    std::vector<indexfile::TermSlot> larger(slotCountFor(count + 1), {indexfile::NO_TERM, 0});
+    for (size_t index = 0; index < count; ++index) { // Rehash every added term
+        uint32_t id = mapped + static_cast<uint32_t>(index);
+        place(larger, id, hash(term(id)));
+    }
+    slots.swap(larger);
+}
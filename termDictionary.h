@@ -0,0 +1,63 @@
+#ifndef TERMDICTIONARY_H // Include guard to prevent multiple inclusions of this header file
+#define TERMDICTIONARY_H // Define the include guard
+
+#include <cstddef> // Include cstddef library for size_t
+#include <cstdint> // Include cstdint library for fixed width integers
+#include <memory_resource> // Include memory_resource library for match results in query scratch memory
+#include <string> // Include string library
+#include <string_view> // Include string_view library
+#include <utility> // Include utility library for std::pair
+#include <vector> // Include vector library
+#include "indexFile.h" // Include the TermEntry and TermSlot layout
+
+// Dense uint32_t ids for every term of an index, shared by the organization, person and word fields.
+//
+// Terms live back to back in one string pool and are found through an open-addressing hash table
+// with linear probing, kept at most half full. Each slot holds a term id and the high half of the
+// term's hash, so a lookup usually compares a single string. The same table is written into the
+// binary index; a dictionary attached to a mapped index looks terms up in the file first, and terms
+// added afterwards get ids following the mapped ones.
+//
+// Mapped terms are numbered in sorted order and added terms are kept in a sorted list of their ids,
+// so the two sorted runs serve as the vocabulary for expanding wildcard and fuzzy terms: a run is
+// walked as an implicit trie, where terms sharing a prefix are adjacent and a whole prefix can be
+// skipped with one binary search.
+class TermDictionary {
+public:
+    TermDictionary(); // Constructor
+
+    void attach(const char* base, const indexfile::Header& header); // Serve the dictionary of a mapped index, forgetting every term
+    void clear(); // Forget every term and any mapped dictionary
+
+    uint32_t find(std::string_view term) const; // Id of a term, or indexfile::NO_TERM
+    uint32_t intern(std::string_view term); // Id of a term, adding it if it is new
+    std::string_view term(uint32_t id) const; // Text of a term id
+    uint32_t size() const; // Number of term ids
+    uint32_t mappedCount() const { return mapped; } // Number of terms in the mapped dictionary
+    size_t memoryUsage() const; // Heap bytes held by added terms
+
+    void sortAdded(); // Bring the sorted list of added terms up to date; expansions only see terms added before the last call
+    void matchWildcard(std::string_view pattern, std::pmr::vector<uint32_t>& out) const; // Append the ids of terms matching a pattern in which '*' stands for any run of characters
+    void matchFuzzy(std::string_view word, uint32_t maxEdits, std::pmr::vector<std::pair<uint32_t, uint32_t>>& out) const; // Append (id, distance) for every term at most maxEdits insertions, deletions or substitutions from word
+
+    static uint64_t hash(std::string_view term); // Hash used by the tables, in memory and on disk
+    static std::vector<indexfile::TermSlot> buildSlots(const std::vector<std::string_view>& terms); // Hash table of terms whose ids are their positions
+
+private:
+    void grow(); // Double the in-memory hash table
+
+    const indexfile::TermEntry* mappedTerms; // Term table of the mapped index
+    const char* mappedStrings; // Term strings of the mapped index
+    const indexfile::TermSlot* mappedSlots; // Hash table of the mapped index
+    uint64_t mappedSlotCount; // Number of mapped hash slots
+    uint32_t mapped; // Number of mapped terms
+
+    std::string pool; // Text of every added term, back to back
+    std::vector<size_t> starts; // Start of each added term in the pool, followed by the end of the last one
+    std::vector<indexfile::TermSlot> slots; // Hash table of added terms, holding their ids
+    std::vector<uint32_t> sorted; // Ids of added terms in term order
+};
+
+bool globMatch(std::string_view pattern, std::string_view text); // Whether text matches a pattern in which '*' stands for any run of characters
+
+#endif // TERMDICTIONARY_H // End of include guard
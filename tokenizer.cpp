@@ -0,0 +1,284 @@
+#include "tokenizer.h" // Include the tokenizer header
+
+#include <cstdlib> // Include the cstdlib library for std::getenv
+#include <cstring> // Include the cstring library for padding the last block
+#include <string_view> // Include the string_view library for the environment values
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h> // Include the SSE4.2 and AVX2 intrinsics, compiled per function with target attributes
+#define TOKENIZER_X86 1 // Whether the vectorized classifiers are built
+#endif
+
+namespace tokenizer {
+
+namespace {
+
+constexpr size_t BLOCK = 64; // Bytes classified at once, one bit each in a uint64_t
+
+// Classes of the bytes of one block, bit i for byte i
+struct Masks {
+    uint64_t space; // Whitespace
+    uint64_t punct; // Punctuation
+    uint64_t upper; // Bytes that were folded to lower case
+    uint64_t high; // Bytes of multi-byte UTF-8 characters
+};
+
+enum : uint8_t { SPACE = 1, PUNCT = 2, UPPER = 4 }; // Byte classes of the scalar table
+
+// Class of every byte in the C locale
+struct ClassTable {
+    uint8_t classes[256]; // Class of each byte value
+
+    constexpr ClassTable() : classes() {
+        for (int c = 0; c < 256; ++c) {
+            if ((c >= 0x09 && c <= 0x0D) || c == ' ') {
+                classes[c] = SPACE;
+            } else if ((c >= '!' && c <= '/') || (c >= ':' && c <= '@') || (c >= '[' && c <= '`') || (c >= '{' && c <= '~')) {
+                classes[c] = PUNCT;
+            } else if (c >= 'A' && c <= 'Z') {
+                classes[c] = UPPER;
+            }
+        }
+    }
+};
+
+constexpr ClassTable TABLE; // Classes used by the scalar classifier
+
+// Classify 64 bytes and lowercase them in place, one byte at a time
+Masks classifyScalar(char* block) {
+    Masks masks = {0, 0, 0, 0};
+    for (size_t i = 0; i < BLOCK; ++i) {
+        unsigned char byte = static_cast<unsigned char>(block[i]);
+        uint8_t type = TABLE.classes[byte];
+        masks.space |= static_cast<uint64_t>(type == SPACE) << i;
+        masks.punct |= static_cast<uint64_t>(type == PUNCT) << i;
+        masks.upper |= static_cast<uint64_t>(type == UPPER) << i;
+        masks.high |= static_cast<uint64_t>(byte >> 7) << i;
+        if (type == UPPER) {
+            block[i] = static_cast<char>(byte + ('a' - 'A'));
+        }
+    }
+    return masks;
+}
+
+#ifdef TOKENIZER_X86
+
+// Bytes between lo and hi inclusive, as 0xFF lanes
+__attribute__((target("avx2"))) inline __m256i inRange(__m256i bytes, uint8_t lo, uint8_t hi) {
+    __m256i shifted = _mm256_sub_epi8(bytes, _mm256_set1_epi8(static_cast<char>(lo))); // Bytes below lo wrap around above hi - lo
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(static_cast<char>(hi - lo))), shifted);
+}
+
+// Classify 64 bytes and lowercase them in place, 32 at a time
+__attribute__((target("avx2"))) Masks classifyAvx2(char* block) {
+    Masks masks = {0, 0, 0, 0};
+    for (size_t half = 0; half < 2; ++half) {
+        __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 32 * half));
+        __m256i space = _mm256_or_si256(inRange(bytes, 0x09, 0x0D), _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')));
+        __m256i upper = inRange(bytes, 'A', 'Z');
+        __m256i letter = inRange(_mm256_or_si256(bytes, _mm256_set1_epi8(0x20)), 'a', 'z'); // Either case
+        __m256i alphanumeric = _mm256_or_si256(letter, inRange(bytes, '0', '9'));
+        __m256i punct = _mm256_andnot_si256(alphanumeric, inRange(bytes, '!', '~')); // Printable, not a letter or digit
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(block + 32 * half), _mm256_add_epi8(bytes, _mm256_and_si256(upper, _mm256_set1_epi8(0x20))));
+        unsigned shift = static_cast<unsigned>(32 * half);
+        masks.space |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(space))) << shift;
+        masks.punct |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(punct))) << shift;
+        masks.upper |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(upper))) << shift;
+        masks.high |= static_cast<uint64_t>(static_cast<uint32_t>(_mm256_movemask_epi8(bytes))) << shift;
+    }
+    return masks;
+}
+
+// Classify 64 bytes and lowercase them in place, 16 at a time; the string compare instruction tests every range of a class at once
+__attribute__((target("sse4.2"))) Masks classifySse42(char* block) {
+    const __m128i spaceRanges = _mm_setr_epi8(0x09, 0x0D, ' ', ' ', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i punctRanges = _mm_setr_epi8('!', '/', ':', '@', '[', '`', '{', '~', 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i upperRange = _mm_setr_epi8('A', 'Z', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    constexpr int RANGES = _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES; // Match bytes falling in any (lo, hi) pair
+    Masks masks = {0, 0, 0, 0};
+    for (size_t quarter = 0; quarter < 4; ++quarter) {
+        __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * quarter));
+        uint64_t space = static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_cmpestrm(spaceRanges, 4, bytes, 16, RANGES | _SIDD_BIT_MASK)));
+        uint64_t punct = static_cast<uint16_t>(_mm_cvtsi128_si32(_mm_cmpestrm(punctRanges, 8, bytes, 16, RANGES | _SIDD_BIT_MASK)));
+        __m128i upper = _mm_cmpestrm(upperRange, 2, bytes, 16, RANGES | _SIDD_UNIT_MASK); // 0xFF lanes, to fold with
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(block + 16 * quarter), _mm_add_epi8(bytes, _mm_and_si128(upper, _mm_set1_epi8(0x20))));
+        unsigned shift = static_cast<unsigned>(16 * quarter);
+        masks.space |= space << shift;
+        masks.punct |= punct << shift;
+        masks.upper |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(upper))) << shift;
+        masks.high |= static_cast<uint64_t>(static_cast<uint16_t>(_mm_movemask_epi8(bytes))) << shift;
+    }
+    return masks;
+}
+
+#endif
+
+// Classifier picked for this process
+struct Implementation {
+    Masks (*classify)(char* block); // Classify and lowercase 64 bytes
+    const char* name; // Instruction set
+};
+
+Implementation choose() {
+    const char* cap = std::getenv("SEARCH_TOKENIZER"); // Optional cap on the instruction set
+    std::string_view limit = cap ? cap : "";
+#ifdef TOKENIZER_X86
+    __builtin_cpu_init();
+    if (limit != "scalar" && limit != "sse4.2" && __builtin_cpu_supports("avx2")) {
+        return {classifyAvx2, "avx2"};
+    }
+    if (limit != "scalar" && __builtin_cpu_supports("sse4.2")) {
+        return {classifySse42, "sse4.2"};
+    }
+#endif
+    return {classifyScalar, "scalar"};
+}
+
+const Implementation& chosen() {
+    static const Implementation instance = choose();
+    return instance;
+}
+
+// Lower case of a code point, for the capitals that keep their UTF-8 length
+uint32_t lowerCodePoint(uint32_t point) {
+    if ((point >= 0xC0 && point <= 0xDE && point != 0xD7) || (point >= 0x391 && point <= 0x3AB && point != 0x3A2) || (point >= 0x410 && point <= 0x42F)) { // Latin-1, Greek and Russian capitals
+        return point + 0x20;
+    }
+    if (point >= 0x400 && point <= 0x40F) { // Other Cyrillic capitals
+        return point + 0x50;
+    }
+    if (point == 0x178) { // Y with diaeresis
+        return 0xFF;
+    }
+    bool evenCapital = (point >= 0x100 && point <= 0x12F) || (point >= 0x132 && point <= 0x137) || (point >= 0x14A && point <= 0x177); // Latin Extended-A pairs
+    bool oddCapital = (point >= 0x139 && point <= 0x148) || (point >= 0x179 && point <= 0x17E);
+    if ((evenCapital && point % 2 == 0) || (oddCapital && point % 2 == 1)) {
+        return point + 1;
+    }
+    return point;
+}
+
+// Fold the two-byte UTF-8 capitals starting in the block at base, marking their lead bytes in upper
+void foldUtf8(char* text, size_t size, size_t base, uint64_t high, uint64_t& upper) {
+    for (; high != 0; high &= high - 1) {
+        size_t i = base + static_cast<size_t>(__builtin_ctzll(high));
+        unsigned char lead = static_cast<unsigned char>(text[i]);
+        if ((lead & 0xE0) != 0xC0 || i + 1 >= size) { // Continuation bytes, longer characters and cut off ones stay
+            continue;
+        }
+        unsigned char next = static_cast<unsigned char>(text[i + 1]);
+        if ((next & 0xC0) != 0x80) {
+            continue;
+        }
+        uint32_t point = (static_cast<uint32_t>(lead & 0x1F) << 6) | (next & 0x3F);
+        uint32_t lower = lowerCodePoint(point);
+        if (lower != point) {
+            text[i] = static_cast<char>(0xC0 | (lower >> 6));
+            text[i + 1] = static_cast<char>(0x80 | (lower & 0x3F));
+            upper |= uint64_t(1) << (i - base);
+        }
+    }
+}
+
+// Classify and fold the block of text starting at base; bytes past the end count as whitespace
+Masks classifyBlock(char* text, size_t size, size_t base, Folding mode) {
+    Masks masks;
+    if (size - base >= BLOCK) {
+        masks = chosen().classify(text + base);
+    } else { // Last, partial block: pad with spaces so the classifier can read a whole block
+        char padded[BLOCK];
+        std::memset(padded, ' ', BLOCK);
+        std::memcpy(padded, text + base, size - base);
+        masks = chosen().classify(padded);
+        std::memcpy(text + base, padded, size - base);
+    }
+    if (mode == UTF8 && masks.high != 0) {
+        foldUtf8(text, size, base, masks.high, masks.upper);
+    }
+    return masks;
+}
+
+uint64_t rotateLeft(uint64_t bits, size_t count) {
+    count %= 64;
+    return count == 0 ? bits : (bits << count) | (bits >> (64 - count));
+}
+
+}
+
+Folding configuredFolding() {
+    static const Folding folding = [] {
+        const char* env = std::getenv("SEARCH_FOLDING");
+        return env && std::string_view(env) == "utf8" ? UTF8 : ASCII;
+    }();
+    return folding;
+}
+
+const char* implementation() {
+    return chosen().name;
+}
+
+void split(char* text, size_t size, std::pmr::vector<Word>& out, Folding mode) {
+    bool inRun = false; // Whether a run of non-whitespace is open
+    size_t runStart = 0; // First byte of the open run
+    bool hasCore = false; // Whether the run has a byte that is not punctuation
+    size_t first = 0, last = 0; // First and last such bytes
+    uint64_t runCase = 0; // Folded bytes of the run, bit i for byte runStart + i
+    auto finish = [&]() { // Hand over the open run trimmed of its punctuation
+        if (hasCore) {
+            out.push_back({std::string_view(text + first, last + 1 - first), rotateLeft(runCase, 64 - (first - runStart) % 64)});
+        } else {
+            out.push_back({std::string_view(text + runStart, 0), 0});
+        }
+        inRun = false;
+    };
+
+    for (size_t base = 0; base < size; base += BLOCK) {
+        Masks masks = classifyBlock(text, size, base, mode);
+        uint64_t valid = size - base >= BLOCK ? ~uint64_t(0) : (uint64_t(1) << (size - base)) - 1;
+        uint64_t space = masks.space | ~valid; // The padding ends the last run
+        size_t position = 0; // Next byte of the block to look at
+        while (position < BLOCK) {
+            uint64_t from = ~uint64_t(0) << position; // Bytes from position on
+            if (!inRun) { // Skip whitespace to the next run
+                uint64_t starts = ~space & from;
+                if (starts == 0) {
+                    break;
+                }
+                position = static_cast<size_t>(__builtin_ctzll(starts));
+                from = ~uint64_t(0) << position;
+                inRun = true;
+                runStart = base + position;
+                hasCore = false;
+                runCase = 0;
+            }
+            uint64_t stops = space & from;
+            size_t end = stops != 0 ? static_cast<size_t>(__builtin_ctzll(stops)) : BLOCK; // End of the run within the block
+            uint64_t span = end == BLOCK ? from : from & ((uint64_t(1) << end) - 1); // Bytes of the run in this block
+            uint64_t core = span & ~masks.punct;
+            if (core != 0) {
+                if (!hasCore) {
+                    first = base + static_cast<size_t>(__builtin_ctzll(core));
+                    hasCore = true;
+                }
+                last = base + 63 - static_cast<size_t>(__builtin_clzll(core));
+            }
+            runCase ^= rotateLeft((masks.upper & span) >> position, base + position - runStart);
+            if (stops == 0) { // The run goes on in the next block
+                break;
+            }
+            finish();
+            position = end;
+        }
+    }
+    if (inRun) { // Text ending on a full block inside a run
+        finish();
+    }
+}
+
+void fold(char* text, size_t size, Folding mode) {
+    for (size_t base = 0; base < size; base += BLOCK) {
+        classifyBlock(text, size, base, mode);
+    }
+}
+
+}
@@ -0,0 +1,46 @@
+#ifndef TOKENIZER_H // Include guard to prevent multiple inclusions of this header file
+#define TOKENIZER_H // Define the include guard
+
+#include <cstddef> // Include cstddef library for size_t
+#include <cstdint> // Include cstdint library for fixed width integers
+#include <memory_resource> // Include memory_resource library so queries can split into their scratch memory
+#include <string_view> // Include string_view library
+#include <vector> // Include vector library
+
+// Splits text into the words the index is made of and folds them to lower case.
+//
+// A word is a run of non-whitespace with the punctuation at both of its ends trimmed off; punctuation
+// inside a word stays ("u.s", "o'neil"), and a run made only of punctuation gives an empty word.
+// Whitespace and punctuation are the ASCII classes of the C locale, so the bytes of multi-byte UTF-8
+// characters are always part of words. Words are lowercased in place and handed back as views into the
+// text. Ingestion and the query parser both split and fold through here, so an indexed word and a query
+// term are normalized identically.
+//
+// Text is classified and lowercased 64 bytes at a time with AVX2 or SSE4.2 when the CPU has them,
+// chosen once per process, and byte by byte otherwise; every implementation gives the same words.
+// SEARCH_TOKENIZER=scalar or sse4.2 caps the choice, for comparing them.
+namespace tokenizer {
+
+enum Folding {
+    ASCII, // A to Z only
+    UTF8, // Also the capitals of Latin-1, Latin Extended-A, Greek and Cyrillic, which keep their length in UTF-8
+};
+
+// One word of a split text
+struct Word {
+    std::string_view text; // Lowercased word, inside the text that was split
+    uint64_t caseBits; // Bit i set when byte i of the word was folded, wrapping every 64 bytes; with text, tells spellings apart
+};
+
+// Folding of this process: UTF8 when SEARCH_FOLDING is "utf8", otherwise ASCII.
+// An index must be searched with the folding it was built with.
+Folding configuredFolding();
+
+const char* implementation(); // Instruction set in use: "avx2", "sse4.2" or "scalar"
+
+void split(char* text, size_t size, std::pmr::vector<Word>& out, Folding mode = configuredFolding()); // Append the words of text to out, lowercasing them in place
+void fold(char* text, size_t size, Folding mode = configuredFolding()); // Lowercase text in place without splitting it
+
+}
+
+#endif // TOKENIZER_H // End of include guard
@@ -1,119 +1,621 @@
 #include "wordmap.h"
+#include "durableFile.h" // Include the crash-safe save helpers
 
-WordMap::WordMap() {} // Constructor
+#include <algorithm> // Include algorithm library for sorting and binary search
+#include <cstdlib> // Include cstdlib library for strtol
+#include <cstring> // Include cstring library for memcmp
+#include <deque> // Include deque library for re-encoded posting lists
+#include <string_view> // Include string_view library for comparing mapped terms
+#include <vector> // Include vector library
+
+WordMap::WordMap() : zoneTotals{}, weights(impact::configuredWeights()), removedFiles(0), header(nullptr), detached(false) {} // Constructor
 
 WordMap::~WordMap() {} // Destructor
 
-void WordMap::associateOrg(const std::string &org, const std::string &filepath) {
-    auto it = toid.find(filepath);
-    if(it == toid.end()) {
-        size_t id = toid.size();
-        it = toid.emplace(filepath, id).first;
-        tofile[id] = filepath;
+int WordMap::addFile(const std::string &filepath) {
+    detach(); // Every path must be known to find existing files
+    auto it = toid.find(filepath); // Look up the file path
+    if(it == toid.end()) { // If the file path has not been seen yet
+        int id = static_cast<int>(fileCount()); // Next id follows every existing one, removed or not
+        it = toid.emplace(filepath, id).first; // Insert file path and id into toid map
+        tofile[id] = filepath; // Insert id and file path into tofile map
+        documents.addFile(static_cast<uint32_t>(id), filepath); // Found by the hash of its path
     }
+    return it->second; // Return the id of the file path
+}
 
-    orgmap[org].emplace(it->second);
-    wordFrequency[org][it->second]++;
+namespace {
+
+// Counts of a word found once in a zone
+impact::Counts once(indexfile::Zone zone) {
+    impact::Counts counts = {};
+    counts[zone] = 1;
+    return counts;
 }
 
-void WordMap::associateName(const std::string &name, const std::string &filepath) {
-    auto it = toid.find(filepath);
-    if(it == toid.end()) {
-        size_t id = toid.size();
-        it = toid.emplace(filepath, id).first;
-        tofile[id] = filepath;
+}
+
+void WordMap::associateOrg(const std::string &org, int id) {
+    associate(indexfile::ORG, terms.intern(org), id, once(indexfile::ENTITIES));
+}
+
+void WordMap::associateName(const std::string &name, int id) {
+    associate(indexfile::NAME, terms.intern(name), id, once(indexfile::ENTITIES));
+}
+
+void WordMap::associateWord(const std::string &word, int id) {
+    associate(indexfile::WORD, terms.intern(word), id, once(indexfile::TEXT));
+}
+
+uint32_t WordMap::addTerm(std::string_view word) {
+    return terms.intern(word);
+}
+
+void WordMap::setLengths(int id, const impact::Lengths &lengths) {
+    detach(); // Totals of a mapped index are about to change
+    if (norms.size() <= static_cast<size_t>(id)) {
+        norms.resize(std::max<size_t>(fileCount(), static_cast<size_t>(id) + 1));
+    }
+    impact::Norms &file = norms[id];
+    for (uint32_t zone = 0; zone < indexfile::ZONE_COUNT; ++zone) { // Totals add up decoded lengths, so they match a saved and reloaded index exactly
+        if (!isRemoved(static_cast<uint32_t>(id))) {
+            zoneTotals[zone] -= impact::decodeLength(file[zone]);
+        }
+        file[zone] = impact::encodeLength(lengths[zone]);
+        if (!isRemoved(static_cast<uint32_t>(id))) {
+            zoneTotals[zone] += impact::decodeLength(file[zone]);
+        }
     }
+}
+
+void WordMap::associate(indexfile::Field field, uint32_t term, int id, const impact::Counts &counts) {
+    pending[field][term].push_back({static_cast<uint32_t>(id), counts});
+    attributes.addEntity(field, static_cast<uint32_t>(id), term); // Organizations and persons are also columns
+}
+
+void WordMap::associateImpact(indexfile::Field field, uint32_t term, int id, uint32_t impact) {
+    pendingImpacts[field][term].push_back({static_cast<uint32_t>(id), impact});
+    attributes.addEntity(field, static_cast<uint32_t>(id), term);
+}
 
-    namemap[name].emplace(it->second);
-    wordFrequency[name][it->second]++;
+void WordMap::associatePositions(indexfile::Field field, uint32_t term, int id, const uint32_t *positions, uint32_t count) {
+    std::vector<uint32_t> &runs = pendingPositions[field][term];
+    runs.push_back(static_cast<uint32_t>(id));
+    runs.push_back(count);
+    runs.insert(runs.end(), positions, positions + count);
+}
+
+void WordMap::associateOrg(const std::string &org, const std::string &filepath) {
+    associateOrg(org, addFile(filepath));
+}
+
+void WordMap::associateName(const std::string &name, const std::string &filepath) {
+    associateName(name, addFile(filepath));
 }
 
 void WordMap::associateWord(const std::string &word, const std::string &filepath) {
-    auto it = toid.find(filepath);
-    if(it == toid.end()) {
-        size_t id = toid.size();
-        it = toid.emplace(filepath, id).first;
-        tofile[id] = filepath;
+    associateWord(word, addFile(filepath));
+}
+
+void WordMap::finalize() {
+    terms.sortAdded(); // Words added since the last call become visible to wildcard and fuzzy expansion
+    attributes.finalize(); // Entities of the added files become columns
+    bool any = false; // Whether there is anything to add
+    for (uint32_t field = 0; field < indexfile::FIELD_COUNT; ++field) {
+        any = any || !pending[field].empty() || !pendingImpacts[field].empty() || !pendingPositions[field].empty();
+    }
+    if (!any) {
+        return;
+    }
+    detach(); // Posting lists of a mapped index are about to change
+
+    std::array<double, indexfile::ZONE_COUNT> averages; // Average zone lengths, including the files being added
+    for (uint32_t zone = 0; zone < indexfile::ZONE_COUNT; ++zone) {
+        averages[zone] = averageLength(static_cast<indexfile::Zone>(zone));
+    }
+    for (uint32_t field = 0; field < indexfile::FIELD_COUNT; ++field) { // Turn zone counts into impacts
+        for (auto &pair : pending[field]) {
+            auto &entries = pair.second;
+            std::sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+            auto &impacts = pendingImpacts[field][pair.first];
+            for (size_t i = 0; i < entries.size(); ) {
+                uint32_t id = entries[i].first;
+                impact::Counts counts = {}; // Counts of every association of the word with the file
+                for (; i < entries.size() && entries[i].first == id; ++i) {
+                    for (uint32_t zone = 0; zone < indexfile::ZONE_COUNT; ++zone) {
+                        counts[zone] = static_cast<uint8_t>(std::min<uint32_t>(UINT8_MAX, counts[zone] + entries[i].second[zone]));
+                    }
+                }
+                impacts.push_back({id, impact::compute(counts, getNorms(id), averages, weights)});
+            }
+        }
+    }
+
+    for (uint32_t field = 0; field < indexfile::FIELD_COUNT; ++field) { // For each field
+        for (auto &pair : pendingImpacts[field]) { // For each word with pending ids
+            std::vector<std::pair<uint32_t, uint32_t>> &postings = pair.second;
+            std::sort(postings.begin(), postings.end()); // By id, then impact
+            for (size_t i = 1; i < postings.size(); ++i) { // An id associated twice keeps its larger impact, last after sorting
+                if (postings[i].first == postings[i - 1].first) {
+                    postings[i - 1].first = UINT32_MAX;
+                }
+            }
+            postings.erase(std::remove_if(postings.begin(), postings.end(), [](const auto &posting) { return posting.first == UINT32_MAX; }), postings.end());
+            PostingList &list = editableList(static_cast<indexfile::Field>(field), pair.first);
+            list.merge(postings); // Append to or merge into the word's list
+            list.shrink();
+        }
+    }
+
+    for (uint32_t field = 0; field < indexfile::FIELD_COUNT; ++field) { // For each field
+        for (auto &pair : pendingPositions[field]) { // For each word with pending positions
+            const std::vector<uint32_t> &runs = pair.second;
+            std::vector<std::pair<uint32_t, size_t>> entries; // File id and offset of each run
+            for (size_t i = 0; i + 1 < runs.size(); i += 2 + runs[i + 1]) {
+                entries.push_back({runs[i], i});
+            }
+            std::stable_sort(entries.begin(), entries.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+            PositionList &list = editablePositions(static_cast<indexfile::Field>(field), pair.first);
+            for (const auto &entry : entries) {
+                const uint32_t *run = runs.data() + entry.second;
+                if (list.empty() || run[0] > list.lastId()) { // New files append, as when indexing
+                    list.add(run[0], run + 2, run[1]);
+                } else { // Files indexed again are merged in
+                    list.merge(run[0], run + 2, run[1]);
+                }
+            }
+            list.shrink();
+        }
+    }
+
+    for (uint32_t field = 0; field < indexfile::FIELD_COUNT; ++field) { // Release the pending associations
+        std::unordered_map<uint32_t, std::vector<std::pair<uint32_t, impact::Counts>>>().swap(pending[field]);
+        std::unordered_map<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>>().swap(pendingImpacts[field]);
+        std::unordered_map<uint32_t, std::vector<uint32_t>>().swap(pendingPositions[field]);
     }
+    if (norms.size() < fileCount()) { // Files indexed without lengths have empty zones
+        norms.resize(fileCount());
+    }
+}
+
+bool WordMap::removeFile(const std::string &filepath) {
+    detach(); // Every path must be known to find the file
+    auto it = toid.find(filepath); // Find the id of the file path
+    if (it == toid.end()) { // Unknown or already removed
+        return false;
+    }
+    uint32_t id = static_cast<uint32_t>(it->second);
+    toid.erase(it); // Adding the path again gives it a new id
+    removed.resize(fileCount());
+    removed[id] = true; // Searches skip the id until saving drops its postings
+    ++removedFiles;
+    if (id < norms.size()) { // Averages only count the files still searched
+        for (uint32_t zone = 0; zone < indexfile::ZONE_COUNT; ++zone) {
+            zoneTotals[zone] -= impact::decodeLength(norms[id][zone]);
+        }
+        norms[id] = impact::Norms();
+    }
+    return true;
+}
+
+void WordMap::setDocument(int id, std::shared_ptr<const std::string> packed) {
+    documents.setRecord(static_cast<uint32_t>(id), std::move(packed));
+}
+
+bool WordMap::getDocument(uint32_t id, Document &document) const {
+    if (id >= fileCount() || !documents.get(id, document)) {
+        return false;
+    }
+    document.id = DocStore::documentId(filePath(id));
+    document.path = std::string(filePath(id));
+    return true;
+}
+
+uint32_t WordMap::findDocument(uint64_t documentId) const {
+    std::vector<uint32_t> ids; // Every id the path has had, as it gets a new one when indexed again
+    documents.find(documentId, ids);
+    for (auto it = ids.rbegin(); it != ids.rend(); ++it) { // Newest first
+        if (!isRemoved(*it)) {
+            return *it;
+        }
+    }
+    return UINT32_MAX;
+}
+
+void WordMap::setAttributes(int id, uint32_t date, std::string_view site) {
+    attributes.setFile(static_cast<uint32_t>(id), date, site);
+}
+
+uint32_t WordMap::getDate(uint32_t id) const {
+    return attributes.date(id);
+}
+
+uint32_t WordMap::getSite(uint32_t id) const {
+    return attributes.site(id);
+}
+
+std::string_view WordMap::getSiteName(uint32_t site) const {
+    return attributes.siteName(site);
+}
+
+Attributes::Terms WordMap::getEntities(indexfile::Field field, uint32_t id) const {
+    return attributes.entities(field, id);
+}
 
-    wordmap[word].emplace(it->second);
-    wordFrequency[word][it->second]++;
+void WordMap::matchDates(uint32_t from, uint32_t to, Roaring &files) const {
+    attributes.matchDates(from, to, files);
+}
+
+void WordMap::matchSite(std::string_view site, Roaring &files) const {
+    attributes.matchSite(attributes.findSite(site), files);
+}
+
+bool WordMap::isRemoved(uint32_t id) const {
+    return id < removed.size() && removed[id];
+}
+
+uint32_t WordMap::removedCount() const {
+    return removedFiles;
+}
+
+void WordMap::detach() {
+    if (!header || detached) { // Nothing mapped, or already in memory
+        return;
+    }
+    const indexfile::FileEntry *files = reinterpret_cast<const indexfile::FileEntry *>(mapped->data() + header->fileTableOffset);
+    norms.resize(fileCount());
+    toid.reserve(fileCount());
+    for (uint32_t id = 0; id < header->fileCount; ++id) { // Copy the file table; paths stay mapped for getFile
+        std::copy(files[id].norms, files[id].norms + indexfile::ZONE_COUNT, norms[id].begin());
+        toid.emplace(mappedPath(id), static_cast<int>(id));
+    }
+    std::copy(header->zoneLengths, header->zoneLengths + indexfile::ZONE_COUNT, zoneTotals);
+    detached = true;
+}
+
+PostingList &WordMap::editableList(indexfile::Field field, uint32_t term) {
+    auto &map = fieldMap(field);
+    auto it = map.find(term);
+    if (it != map.end()) { // Already in memory
+        return it->second;
+    }
+    PostingList &list = map[term];
+    if (header) { // Start from the mapped postings; the in-memory list replaces them from now on
+        for (PostingView::Cursor cursor = mappedPostings(field, term).cursor(); !cursor.atEnd(); cursor.next()) {
+            list.add(cursor.id(), cursor.frequency());
+        }
+    }
+    return list;
+}
+
+PositionList &WordMap::editablePositions(indexfile::Field field, uint32_t term) {
+    auto &map = positionMaps[field];
+    auto it = map.find(term);
+    if (it != map.end()) { // Already in memory
+        return it->second;
+    }
+    PositionList &list = map[term];
+    if (header) { // Start from the mapped positions; the in-memory list replaces them from now on
+        std::vector<uint32_t> positions;
+        for (PositionView::Cursor cursor = mappedPositions(field, term).cursor(); !cursor.atEnd(); cursor.next()) {
+            cursor.positions(positions);
+            list.add(cursor.id(), positions.data(), static_cast<uint32_t>(positions.size()));
+        }
+    }
+    return list;
 }
 
 void WordMap::disassociate(const std::string &word, const std::string &filepath) {
-    if (orgmap.find(word) != orgmap.end()) { // If word is found in orgmap
-        orgmap[word].erase(toid[filepath]); // Remove id associated with filepath
-        if (orgmap[word].empty()) { // If no more ids are associated with word
-            orgmap.erase(word); // Remove word from orgmap
+    detach(); // Every path must be known to find the file
+    auto file = toid.find(filepath); // Find the id of the file path
+    uint32_t term = terms.find(word); // Find the id of the word
+    if (file == toid.end() || term == indexfile::NO_TERM) { // Unknown files and words have no associations
+        return;
+    }
+    finalize(); // Make sure every association is in a posting list
+    for (uint32_t field = 0; field < indexfile::FIELD_COUNT; ++field) { // For each field
+        auto &map = fieldMap(static_cast<indexfile::Field>(field));
+        if (getPostings(static_cast<indexfile::Field>(field), term).count == 0) { // If word is not in the field
+            continue;
+        }
+        PostingList &list = editableList(static_cast<indexfile::Field>(field), term);
+        list.remove(static_cast<uint32_t>(file->second)); // Remove id associated with filepath; zone lengths count occurrences, not words, so they stay
+        if (list.empty() && !header) { // If no more ids are associated with word; an empty list still hides a mapped one
+            map.erase(term); // Remove word from the field
         }
     }
-    if (namemap.find(word) != namemap.end()) { // If word is found in namemap
-        namemap[word].erase(toid[filepath]); // Remove id associated with filepath
-        if (namemap[word].empty()) { // If no more ids are associated with word
-            namemap.erase(word); // Remove word from namemap
+}
+
+std::unordered_map<uint32_t, PostingList> &WordMap::fieldMap(indexfile::Field field) {
+    return field == indexfile::ORG ? orgmap : field == indexfile::NAME ? namemap : wordmap;
+}
+
+const std::unordered_map<uint32_t, PostingList> &WordMap::fieldMap(indexfile::Field field) const {
+    return field == indexfile::ORG ? orgmap : field == indexfile::NAME ? namemap : wordmap;
+}
+
+uint32_t WordMap::findTerm(std::string_view word) const {
+    return terms.find(word);
+}
+
+std::string_view WordMap::getTerm(uint32_t term) const {
+    return terms.term(term);
+}
+
+void WordMap::matchWildcard(std::string_view pattern, std::pmr::vector<uint32_t> &out) const {
+    terms.matchWildcard(pattern, out);
+}
+
+void WordMap::matchFuzzy(std::string_view word, uint32_t maxEdits, std::pmr::vector<std::pair<uint32_t, uint32_t>> &out) const {
+    terms.matchFuzzy(word, maxEdits, out);
+}
+
+PostingView WordMap::getPostings(indexfile::Field field, uint32_t term) const {
+    if (term == indexfile::NO_TERM) { // Unknown word
+        return PostingView();
+    }
+    const auto &map = fieldMap(field);
+    if (!map.empty()) { // In-memory lists replace mapped ones
+        auto it = map.find(term);
+        if (it != map.end()) {
+            return it->second.view();
         }
     }
-    if (wordmap.find(word) != wordmap.end()) { // If word is found in wordmap
-        wordmap[word].erase(toid[filepath]); // Remove id associated with filepath
-        if (wordmap[word].empty()) { // If no more ids are associated with word
-            wordmap.erase(word); // Remove word from wordmap
+    return header ? mappedPostings(field, term) : PostingView();
+}
+
+PostingView WordMap::getPostings(indexfile::Field field, std::string_view word) const {
+    return getPostings(field, terms.find(word));
+}
+
+PostingView WordMap::mappedPostings(indexfile::Field field, uint32_t term) const {
+    PostingView view;
+    if (term >= terms.mappedCount()) { // Added after the index was mapped
+        return view;
+    }
+    uint32_t index = reinterpret_cast<const indexfile::TermEntry *>(mapped->data() + header->termTableOffset)[term].postings[field];
+    if (index != indexfile::NO_TERM) { // Point the view at the mapped pages
+        const indexfile::FieldSection &section = header->fields[field];
+        const indexfile::PostingEntry &entry = reinterpret_cast<const indexfile::PostingEntry *>(mapped->data() + section.postingTableOffset)[index];
+        view.data = reinterpret_cast<const uint8_t *>(mapped->data() + section.postingsOffset + entry.postingOffset);
+        view.skips = reinterpret_cast<const PostingSkip *>(mapped->data() + section.skipsOffset) + entry.skipOffset;
+        view.count = entry.postingCount;
+        view.skipCount = (entry.postingCount + PostingList::BLOCK_SIZE - 1) / PostingList::BLOCK_SIZE;
+        view.maxFrequency = entry.maxFrequency;
+    }
+    return view;
+}
+
+bool WordMap::getPresence(indexfile::Field field, uint32_t term, Roaring &files) const {
+    if (term == indexfile::NO_TERM || !header || term >= terms.mappedCount()) { // Unknown word, or added after the index was mapped
+        return false;
+    }
+    const auto &map = fieldMap(field);
+    if (!map.empty() && map.count(term) > 0) { // The postings changed since the set was saved
+        return false;
+    }
+    uint32_t index = reinterpret_cast<const indexfile::TermEntry *>(mapped->data() + header->termTableOffset)[term].postings[field];
+    const indexfile::FieldSection &section = header->fields[field];
+    const indexfile::PresenceEntry *table = reinterpret_cast<const indexfile::PresenceEntry *>(mapped->data() + section.presenceTableOffset);
+    const indexfile::PresenceEntry *end = table + section.presenceCount;
+    const indexfile::PresenceEntry *found = std::lower_bound(table, end, index, [](const indexfile::PresenceEntry &entry, uint32_t value) { return entry.postingIndex < value; });
+    if (index == indexfile::NO_TERM || found == end || found->postingIndex != index || found->offset + found->size > mapped->size()) { // Rare in the field
+        return false;
+    }
+    return Roaring::read(mapped->data() + found->offset, found->size, files);
+}
+
+PositionView WordMap::getPositions(indexfile::Field field, uint32_t term) const {
+    if (term == indexfile::NO_TERM) { // Unknown word
+        return PositionView();
+    }
+    const auto &map = positionMaps[field];
+    if (!map.empty()) { // In-memory lists replace mapped ones
+        auto it = map.find(term);
+        if (it != map.end()) {
+            return it->second.view();
         }
     }
+    return header ? mappedPositions(field, term) : PositionView();
 }
 
-std::unordered_map<std::string, int> WordMap::getFilesByOrg(const std::string &word) const {
-    std::unordered_map<std::string, int> files;
-    if (orgmap.find(word) != orgmap.end()) {
-        for (const auto &id : orgmap.at(word)) {
-            files[tofile.at(id)] = wordFrequency.at(word).at(id);
+PositionView WordMap::mappedPositions(indexfile::Field field, uint32_t term) const {
+    PositionView view;
+    if (term >= terms.mappedCount()) { // Added after the index was mapped
+        return view;
+    }
+    uint32_t index = reinterpret_cast<const indexfile::TermEntry *>(mapped->data() + header->termTableOffset)[term].postings[field];
+    if (index != indexfile::NO_TERM) { // Point the view at the mapped pages
+        const indexfile::FieldSection &section = header->fields[field];
+        const indexfile::PostingEntry &entry = reinterpret_cast<const indexfile::PostingEntry *>(mapped->data() + section.postingTableOffset)[index];
+        view.data = reinterpret_cast<const uint8_t *>(mapped->data() + section.positionsOffset + entry.positionOffset);
+        view.skips = reinterpret_cast<const PostingSkip *>(mapped->data() + section.positionSkipsOffset) + entry.positionSkipOffset;
+        view.count = entry.positionCount;
+        view.skipCount = (entry.positionCount + PositionList::BLOCK_SIZE - 1) / PositionList::BLOCK_SIZE;
+    }
+    return view;
+}
+
+std::string WordMap::getFile(uint32_t id) const {
+    return std::string(filePath(id));
+}
+
+std::string_view WordMap::filePath(uint32_t id) const {
+    return header && id < header->fileCount ? mappedPath(id) : std::string_view(tofile.at(static_cast<int>(id)));
+}
+
+uint32_t WordMap::fileCount() const {
+    return (header ? header->fileCount : 0) + static_cast<uint32_t>(tofile.size()); // A mapped index keeps only files added later in tofile
+}
+
+impact::Norms WordMap::getNorms(uint32_t id) const {
+    impact::Norms file = {};
+    if (header && !detached && id < header->fileCount) { // Lengths are stored in the mapped file table
+        const uint8_t *stored = reinterpret_cast<const indexfile::FileEntry *>(mapped->data() + header->fileTableOffset)[id].norms;
+        std::copy(stored, stored + indexfile::ZONE_COUNT, file.begin());
+    } else if (id < norms.size()) {
+        file = norms[id];
+    }
+    return file;
+}
+
+double WordMap::averageLength(indexfile::Zone zone) const {
+    uint32_t files = fileCount() - removedFiles;
+    uint64_t total = header && !detached ? header->zoneLengths[zone] : zoneTotals[zone];
+    return files == 0 ? 0.0 : static_cast<double>(total) / files;
+}
+
+const impact::Weights &WordMap::zoneWeights() const {
+    return weights;
+}
+
+size_t WordMap::memoryUsage() const {
+    size_t bytes = 0;
+    for (const auto *map : {&orgmap, &namemap, &wordmap}) { // Posting lists and their hash nodes
+        for (const auto &pair : *map) {
+            bytes += pair.second.memoryUsage() + sizeof(pair) + sizeof(void *) * 2;
         }
     }
-    return files;
+    for (const auto &map : positionMaps) { // Position lists and their hash nodes
+        for (const auto &pair : map) {
+            bytes += pair.second.memoryUsage() + sizeof(pair) + sizeof(void *) * 2;
+        }
+    }
+    bytes += terms.memoryUsage(); // Added terms and their hash table
+    bytes += documents.memoryUsage(); // Documents of added files
+    bytes += attributes.memoryUsage(); // Attribute columns of added files
+    for (const auto &pair : toid) { // File paths and their hash nodes
+        bytes += pair.first.capacity() + sizeof(pair) + sizeof(void *) * 2;
+    }
+    for (const auto &pair : tofile) {
+        bytes += pair.second.capacity() + sizeof(pair) + sizeof(void *) * 2;
+    }
+    bytes += norms.capacity() * sizeof(impact::Norms) + removed.capacity() / 8;
+    return bytes;
 }
 
-std::unordered_map<std::string, int> WordMap::getFilesByName(const std::string &name) const {
+size_t WordMap::mappedBytes() const {
+    return header ? mapped->size() : 0;
+}
+
+uint64_t WordMap::mappedSequence() const {
+    return header ? header->sequence : 0;
+}
+
+WordMap::FieldSize WordMap::fieldSize(indexfile::Field field) const {
+    FieldSize size = {0, 0, 0, 0};
+    if (header) {
+        const indexfile::FieldSection &section = header->fields[field];
+        size.mappedLists = section.postingCount;
+        size.mappedBytes = section.postingBytes + section.positionBytes;
+    }
+    for (const auto &pair : fieldMap(field)) {
+        size.memoryBytes += pair.second.memoryUsage();
+    }
+    for (const auto &pair : positionMaps[field]) {
+        size.memoryBytes += pair.second.memoryUsage();
+    }
+    size.memoryLists = fieldMap(field).size();
+    return size;
+}
+
+std::unordered_map<std::string, int> WordMap::getFiles(indexfile::Field field, const std::string &word) const {
     std::unordered_map<std::string, int> files;
-    if (namemap.find(name) != namemap.end()) {
-        for (const auto &id : namemap.at(name)) {
-            files[tofile.at(id)] = wordFrequency.at(name).at(id);
+    PostingView postings = getPostings(field, word);
+    files.reserve(postings.count);
+    for (PostingView::Cursor cursor = postings.cursor(); !cursor.atEnd(); cursor.next()) { // Decode postings on the fly
+        if (isRemoved(cursor.id())) { // Removed files are not results
+            continue;
         }
+        files[getFile(cursor.id())] = static_cast<int>(cursor.frequency());
     }
     return files;
 }
 
+std::unordered_map<std::string, int> WordMap::getFilesByOrg(const std::string &word) const {
+    return getFiles(indexfile::ORG, word);
+}
+
+std::unordered_map<std::string, int> WordMap::getFilesByName(const std::string &name) const {
+    return getFiles(indexfile::NAME, name);
+}
+
 std::unordered_map<std::string, int> WordMap::getOtherFilesByWord(const std::string &word) const {
     std::unordered_map<std::string, int> files; // Map to store filepaths and their weights
-    std::unordered_set<int> excluded_ids; // Set to store excluded ids
-    
-    if (wordmap.find(word) != wordmap.end()) { // If word is found in wordmap
-        excluded_ids = wordmap.at(word); // Get ids associated with word
-    }
-    
-    for (const auto &pair : tofile) { // For each id-filepath pair
-        if (excluded_ids.find(pair.first) == excluded_ids.end()) { // If id is not in excluded_ids
-            files[pair.second] = wordFrequency.at(word).at(pair.first); // Insert filepath and its weight
+    PostingView::Cursor excluded = getPostings(indexfile::WORD, word).cursor(); // Ids associated with word, sorted
+    for (uint32_t id = 0; id < fileCount(); ++id) { // For each file
+        excluded.advance(id); // Skip excluded ids below the current id
+        if (!isRemoved(id) && (excluded.atEnd() || excluded.id() != id)) { // If id is not removed or excluded
+            files[getFile(id)] = 0; // Insert filepath; it does not contain the word so it has no weight
         }
     }
-    
     return files; // Return map of filepaths and their weights
 }
 
 std::unordered_map<std::string, int> WordMap::getFilesByWord(const std::string &word) const {
-    std::unordered_map<std::string, int> files;
-    if (wordmap.find(word) != wordmap.end()) {
-        for (const auto &id : wordmap.at(word)) {
-            files[tofile.at(id)] = wordFrequency.at(word).at(id);
+    return getFiles(indexfile::WORD, word);
+}
+
+namespace {
+
+// Append the seal of a save file: an "#end stamp checksum" line, checksum covering the lines before it
+bool sealSaveFile(const std::string &path, uint64_t stamp) {
+    MappedFile contents; // Lines as written
+    uint64_t checksum = contents.open(path) ? durable::checksum(contents.data(), contents.size()) : durable::checksum(nullptr, 0); // An empty file cannot be mapped
+    contents.close();
+    std::ofstream ofs(path, std::ios::app);
+    ofs << "#end " << stamp << " " << checksum << "\n";
+    ofs.close();
+    return static_cast<bool>(ofs);
+}
+
+// Queue the associations of a save file line, saved as "id:impact"; ids saved by earlier versions have no impact and count as one word in zone
+void associateSaved(WordMap &wordMap, indexfile::Field field, uint32_t term, std::istringstream &iss, indexfile::Zone zone) {
+    std::string token; // Association being read
+    while (iss >> token) {
+        char *end = nullptr;
+        long id = std::strtol(token.c_str(), &end, 10);
+        if (end == token.c_str()) { // Not an id
+            break;
+        }
+        if (*end == ':') {
+            wordMap.associateImpact(field, term, static_cast<int>(id), static_cast<uint32_t>(std::strtoul(end + 1, nullptr, 10)));
+        } else {
+            wordMap.associate(field, term, static_cast<int>(id), once(zone));
         }
     }
-    return files;
+}
+
+// Check the seal of a save file and read its stamp; a file without a seal was saved by an earlier version and gets stamp 0
+bool checkSaveFile(const std::string &path, uint64_t &stamp) {
+    MappedFile contents; // Whole file
+    stamp = 0;
+    if (!contents.open(path)) { // Empty, or missing and reported by the caller
+        return true;
+    }
+    std::string_view text(contents.data(), contents.size());
+    size_t seal = text.size() >= 2 ? text.rfind('\n', text.size() - 2) + 1 : 0; // Start of the last line; npos + 1 is 0
+    if (text.compare(seal, 5, "#end ") != 0) {
+        return true;
+    }
+    std::istringstream iss(std::string(text.substr(seal + 5)));
+    uint64_t checksum;
+    return (iss >> stamp >> checksum) && checksum == durable::checksum(text.data(), seal) && stamp != 0;
+}
+
 }
 
 void WordMap::save(const std::string &filenamepath, const std::string &ofilepath, const std::string &nfilepath, const std::string &wfilepath, const std::string &ffilepath) const {
-    std::ofstream fnofs(filenamepath); // Open file for saving filemap
-    std::ofstream oofs(ofilepath); // Open file for saving orgmap
-    std::ofstream nofs(nfilepath); // Open file for saving namemap
-    std::ofstream wofs(wfilepath); // Open file for saving wordmap
-    std::ofstream fofs(ffilepath); // Open file for saving wordFrequency
+    if (header) { // A mapped index has no in-memory maps to save
+        std::cerr << "Index is mapped from a binary file, not saving to: " << filenamepath << std::endl; // Print error message
+        return; // Return from function
+    }
+    const std::string *paths[] = {&filenamepath, &ofilepath, &nfilepath, &wfilepath, &ffilepath}; // Save files, each written to a temporary file first
+    std::ofstream fnofs(filenamepath + ".tmp"); // Open file for saving filemap
+    std::ofstream oofs(ofilepath + ".tmp"); // Open file for saving orgmap
+    std::ofstream nofs(nfilepath + ".tmp"); // Open file for saving namemap
+    std::ofstream wofs(wfilepath + ".tmp"); // Open file for saving wordmap
+    std::ofstream fofs(ffilepath + ".tmp"); // Open file for saving wordFrequency
     if (!fnofs.is_open() || !oofs.is_open() || !nofs.is_open() || !wofs.is_open() || !fofs.is_open()) { // If any file fails to open
         std::cerr << "Failed to open file for saving: " << filenamepath << ", " << ofilepath << ", " << nfilepath << ", " << wfilepath << ", and/or " << ffilepath << std::endl; // Print error message
         return; // Return from function
@@ -123,13 +625,18 @@ void WordMap::save(const std::string &filenamepath, const std::string &ofilepath
     auto start = std::chrono::high_resolution_clock::now(); // Get start time
 
     for (const auto &pair : tofile) { // For each id-filepath pair
-        fnofs << pair.first << " " << pair.second << "\n"; // Save id and filepath
+        fnofs << pair.first << " " << pair.second; // Save id and filepath
+        for (uint8_t norm : getNorms(static_cast<uint32_t>(pair.first))) { // Save the zone lengths, which earlier versions do not read
+            fnofs << " " << impact::decodeLength(norm);
+        }
+        fnofs << "\n"; // New line
     }
+    fnofs.close(); // Close filemap file
     
-    for (const auto &pair : orgmap) { // For each org-id set pair
-        oofs << pair.first; // Save org
-        for (const auto &file : pair.second) { // For each id in set
-            oofs << " " << file; // Save id
+    for (const auto &pair : orgmap) { // For each org-posting list pair
+        oofs << terms.term(pair.first); // Save org
+        for (PostingView::Cursor file = pair.second.view().cursor(); !file.atEnd(); file.next()) { // For each id in the posting list
+            oofs << " " << file.id() << ":" << file.frequency(); // Save id and impact
         }
         oofs << "\n"; // New line
     }
@@ -137,10 +644,10 @@ void WordMap::save(const std::string &filenamepath, const std::string &ofilepath
 
     std::cout << "Orgmap saved!" << std::endl; // Print message
 
-    for (const auto &pair : namemap) { // For each name-id set pair
-        nofs << pair.first; // Save name
-        for (const auto &file : pair.second) { // For each id in set
-            nofs << " " << file; // Save id
+    for (const auto &pair : namemap) { // For each name-posting list pair
+        nofs << terms.term(pair.first); // Save name
+        for (PostingView::Cursor file = pair.second.view().cursor(); !file.atEnd(); file.next()) { // For each id in the posting list
+            nofs << " " << file.id() << ":" << file.frequency(); // Save id and impact
         }
         nofs << "\n"; // New line
     }
@@ -148,10 +655,10 @@ void WordMap::save(const std::string &filenamepath, const std::string &ofilepath
 
     std::cout << "Namemap saved!" << std::endl; // Print message
 
-    for (const auto &pair : wordmap) { // For each word-id set pair
-        wofs << pair.first; // Save word
-        for (const auto &file : pair.second) { // For each id in set
-            wofs << " " << file; // Save id
+    for (const auto &pair : wordmap) { // For each word-posting list pair
+        wofs << terms.term(pair.first); // Save word
+        for (PostingView::Cursor file = pair.second.view().cursor(); !file.atEnd(); file.next()) { // For each id in the posting list
+            wofs << " " << file.id() << ":" << file.frequency(); // Save id and impact
         }
         wofs << "\n"; // New line
     }
@@ -159,17 +666,35 @@ void WordMap::save(const std::string &filenamepath, const std::string &ofilepath
 
     std::cout << "Wordmap saved!" << std::endl; // Print message
 
-    for (const auto &pair : wordFrequency) { // For each word-frequency map pair
-        fofs << pair.first; // Save word
-        for (const auto &freq : pair.second) { // For each file id-frequency pair
-            fofs << " " << freq.first << ":" << freq.second; // Save file id and frequency
+    for (const auto *map : {&wordmap, &orgmap, &namemap}) { // Impacts of each word once, preferring the word field, for earlier versions; loading reads the impacts of each field
+        for (const auto &pair : *map) { // For each word-posting list pair
+            if (map != &wordmap && wordmap.count(pair.first)) { // Already saved with the words
+                continue;
+            }
+            fofs << terms.term(pair.first); // Save word
+            for (PostingView::Cursor freq = pair.second.view().cursor(); !freq.atEnd(); freq.next()) { // For each file id-impact pair
+                fofs << " " << freq.id() << ":" << freq.frequency(); // Save file id and impact
+            }
+            fofs << "\n"; // New line
         }
-        fofs << "\n"; // New line
     }
     fofs.close(); // Close wordFrequency file
 
     std::cout << "WordFrequency saved!" << std::endl; // Print message
 
+    uint64_t stamp = static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count()); // Marks the five files as one save
+    bool written = fnofs && oofs && nofs && wofs && fofs; // Whether every write succeeded
+    for (const std::string *path : paths) { // Seal each file, then move them all into place
+        written = written && sealSaveFile(*path + ".tmp", stamp);
+    }
+    for (const std::string *path : paths) {
+        written = written && durable::replaceFile(*path + ".tmp", *path);
+    }
+    if (!written) {
+        std::cerr << "Failed to write save files: " << filenamepath << ", " << ofilepath << ", " << nfilepath << ", " << wfilepath << ", and/or " << ffilepath << std::endl; // Print error message
+        return; // Return from function
+    }
+
     auto end = std::chrono::high_resolution_clock::now(); // Get end time
     std::chrono::duration<double> duration = end - start; // Calculate duration
     std::cout << "Files saved in " << duration.count() << " seconds.\n"; // Print duration
@@ -186,85 +711,443 @@ bool WordMap::load(const std::string &filenamepath, const std::string &ofilepath
         return false; // Return false
     }
 
+    uint64_t stamps[5]; // Save each file belongs to, 0 for files saved by earlier versions
+    const std::string *paths[] = {&filenamepath, &ofilepath, &nfilepath, &wfilepath, &ffilepath};
+    for (int i = 0; i < 5; ++i) {
+        if (!checkSaveFile(*paths[i], stamps[i])) { // Torn or damaged
+            std::cerr << "Save file failed its checksum: " << *paths[i] << std::endl; // Print error message
+            return false; // Return false
+        }
+    }
+    if (std::count(stamps, stamps + 5, stamps[0]) != 5) { // A crash while the files were being replaced
+        std::cerr << "Save files are from different saves: " << filenamepath << ", " << ofilepath << ", " << nfilepath << ", " << wfilepath << ", and/or " << ffilepath << std::endl; // Print error message
+        return false; // Return false
+    }
+    if (stamps[0] == 0) {
+        std::cerr << "Save files have no checksums, loading them unchecked" << std::endl; // Print warning
+    }
+
     std::cout << "Reading save file..." << std::endl; // Print message
     auto start = std::chrono::high_resolution_clock::now(); // Get start time
 
+    mapped.reset(); // Drop any mapped index
+    header = nullptr;
+    detached = false;
+    removed.clear(); // Saved files have no removed ids
+    removedFiles = 0;
+    norms.clear(); // Zone lengths are read with the file paths
+    std::fill(zoneTotals, zoneTotals + indexfile::ZONE_COUNT, 0);
+    weights = impact::configuredWeights();
     toid.clear(); // Clear toid map
     tofile.clear(); // Clear tofile map
+    documents.clear(); // Save files have no documents, only their ids
+    attributes.clear(); // Nor dates or sites; entities are read with the postings
+    terms.clear(); // Words are numbered again as they are read
+    for (auto &map : positionMaps) { // Save files have no positions, so phrases need a binary index
+        map.clear();
+    }
     std::string line; // String to store line
-    while (std::getline(fnifs, line)) { // Read each line
+    while (std::getline(fnifs, line) && line.compare(0, 5, "#end ") != 0) { // Read each line up to the seal
         std::istringstream iss(line); // Create string stream
         std::string id, file; // Strings to store id and file
         iss >> id >> file; // Read id and file
         toid[file] = std::stoi(id); // Insert file and id into toid map
         tofile[std::stoi(id)] = file; // Insert id and file into tofile map
+        documents.addFile(static_cast<uint32_t>(std::stoi(id)), file); // Found by id, though its document is not saved
+        impact::Lengths lengths = {}; // Zone lengths, missing from files saved by earlier versions
+        for (uint32_t &length : lengths) {
+            iss >> length;
+        }
+        if (iss) {
+            setLengths(std::stoi(id), lengths);
+        }
     }
     fnifs.close(); // Close filemap file
 
     std::cout << "Filemap loaded!" << std::endl; // Print message
 
     orgmap.clear(); // Clear orgmap
-    while (std::getline(oifs, line)) { // Read each line
+    while (std::getline(oifs, line) && line.compare(0, 5, "#end ") != 0) { // Read each line up to the seal
         std::istringstream iss(line); // Create string stream
         std::string word; // String to store word
-        int id; // Integer to store id
         iss >> word; // Read word
-        while (iss >> id) { // Read each id
-            orgmap[word].insert(id); // Insert id into orgmap
-        }
+        uint32_t term = addTerm(word); // Number the word once for all of its ids
+        associateSaved(*this, indexfile::ORG, term, iss, indexfile::ENTITIES); // Queue the ids for orgmap
     }
     oifs.close(); // Close orgmap file
 
     std::cout << "Orgmap loaded!" << std::endl; // Print message
 
     namemap.clear(); // Clear namemap
-    while (std::getline(nifs, line)) { // Read each line
+    while (std::getline(nifs, line) && line.compare(0, 5, "#end ") != 0) { // Read each line up to the seal
         std::istringstream iss(line); // Create string stream
         std::string word; // String to store word
-        int id; // Integer to store id
         iss >> word; // Read word
-        while (iss >> id) { // Read each id
-            namemap[word].insert(id); // Insert id into namemap
-        }
+        uint32_t term = addTerm(word); // Number the word once for all of its ids
+        associateSaved(*this, indexfile::NAME, term, iss, indexfile::ENTITIES); // Queue the ids for namemap
     }
     nifs.close(); // Close namemap file
 
     std::cout << "Namemap loaded!" << std::endl; // Print message
 
     wordmap.clear(); // Clear wordmap
-    while (std::getline(wifs, line)) { // Read each line
+    while (std::getline(wifs, line) && line.compare(0, 5, "#end ") != 0) { // Read each line up to the seal
         std::istringstream iss(line); // Create string stream
         std::string word; // String to store word
-        int id; // Integer to store id
         iss >> word; // Read word
-        while (iss >> id) { // Read each id
-            wordmap[word].insert(id); // Insert id into wordmap
-        }
+        uint32_t term = addTerm(word); // Number the word once for all of its ids
+        associateSaved(*this, indexfile::WORD, term, iss, indexfile::TEXT); // Queue the ids for wordmap
     }
     wifs.close(); // Close wordmap file
 
     std::cout << "Wordmap loaded!" << std::endl; // Print message
 
-    wordFrequency.clear(); // Clear wordFrequency
-    while (std::getline(fifs, line)) { // Read each line
-        std::istringstream iss(line); // Create string stream
-        std::string word; // String to store word
-        iss >> word; // Read word
-        std::string freqPair; // String to store file id and frequency pair
-        while (iss >> freqPair) { // Read each file id and frequency pair
-            size_t pos = freqPair.find(':'); // Find position of colon
-            int id = std::stoi(freqPair.substr(0, pos)); // Extract file id
-            int freq = std::stoi(freqPair.substr(pos + 1)); // Extract frequency
-            wordFrequency[word][id] = freq; // Insert file id and frequency into wordFrequency
+    fifs.close(); // Impacts were read with each field
+    finalize(); // Build the posting lists
+
+    std::cout << "Posting lists built!" << std::endl; // Print message
+
+    auto end = std::chrono::high_resolution_clock::now(); // Get end time
+    std::chrono::duration<double> duration = end - start; // Calculate duration
+    std::cout << "Save file read in " << duration.count() << " seconds.\n"; // Print duration
+
+    return true; // Return true
+}
+
+namespace {
+
+// Append zero bytes until the stream position is a multiple of 8
+void pad(std::ofstream &ofs) {
+    static const char zeros[8] = {0};
+    std::streamoff remainder = ofs.tellp() % 8;
+    if (remainder != 0) {
+        ofs.write(zeros, 8 - remainder);
+    }
+}
+
+// Lists of one term in one field, as saved
+struct KeptTerm {
+    uint32_t term; // Term id
+    const PostingList *postings; // Posting list, never empty
+    const PositionList *positions; // Position list, empty when the files were indexed without positions
+};
+
+// Write a plain struct or array of structs
+template <typename T>
+void writeRaw(std::ofstream &ofs, const T *data, size_t count) {
+    ofs.write(reinterpret_cast<const char *>(data), static_cast<std::streamsize>(sizeof(T) * count));
+}
+
+}
+
+bool WordMap::saveBinary(const std::string &indexpath, uint64_t sequence) const {
+    std::string temppath = indexpath + ".tmp"; // Write to a temporary file and rename it into place
+    std::ofstream ofs(temppath, std::ios::binary); // Open file for saving the index
+    if (!ofs.is_open()) { // If the file fails to open
+        std::cerr << "Failed to open file for saving: " << temppath << std::endl; // Print error message
+        return false; // Return false
+    }
+
+    std::cout << "Making index file..." << std::endl; // Print message
+    auto start = std::chrono::high_resolution_clock::now(); // Get start time
+
+    std::vector<uint32_t> newIds(fileCount(), UINT32_MAX); // Saved id of every kept file; removed files are dropped and the rest renumbered in order
+    indexfile::Header hdr = {}; // Header, filled in as sections are written
+    std::memcpy(hdr.magic, indexfile::MAGIC, sizeof(hdr.magic));
+    hdr.version = indexfile::VERSION;
+    hdr.sequence = sequence;
+    std::copy(weights.begin(), weights.end(), hdr.zoneWeights);
+    for (uint32_t id = 0; id < fileCount(); ++id) { // Number the kept files and total their zone lengths
+        if (isRemoved(id)) {
+            continue;
+        }
+        newIds[id] = hdr.fileCount++;
+        impact::Norms file = getNorms(id);
+        for (uint32_t zone = 0; zone < indexfile::ZONE_COUNT; ++zone) {
+            hdr.zoneLengths[zone] += impact::decodeLength(file[zone]);
         }
     }
-    fifs.close(); // Close wordFrequency file
+    writeRaw(ofs, &hdr, 1); // Reserve space for the header
 
-    std::cout << "WordFrequency loaded!" << std::endl; // Print message
+    std::vector<indexfile::FileEntry> fileTable; // File table indexed by saved id
+    std::string paths; // Path blob
+    std::vector<uint32_t> keptIds; // Old id of each saved id
+    std::vector<uint64_t> documentIds; // Document id of each saved id
+    for (uint32_t id = 0; id < fileCount(); ++id) { // For each kept id in order
+        if (newIds[id] == UINT32_MAX) {
+            continue;
+        }
+        std::string path = getFile(id);
+        keptIds.push_back(id);
+        documentIds.push_back(DocStore::documentId(path));
+        indexfile::FileEntry entry = {paths.size(), static_cast<uint32_t>(path.size()), {}};
+        impact::Norms file = getNorms(id);
+        std::copy(file.begin(), file.end(), entry.norms);
+        fileTable.push_back(entry);
+        paths += path;
+    }
+    hdr.fileTableOffset = static_cast<uint64_t>(ofs.tellp());
+    writeRaw(ofs, fileTable.data(), fileTable.size()); // Save file table
+    hdr.pathsOffset = static_cast<uint64_t>(ofs.tellp());
+    ofs.write(paths.data(), static_cast<std::streamsize>(paths.size())); // Save paths
+    pad(ofs);
+
+    std::deque<PostingList> rebuilt; // Lists re-encoded to drop removed files or copy mapped postings
+    std::deque<PositionList> rebuiltPositions; // Position lists re-encoded the same way
+    std::vector<KeptTerm> kept[indexfile::FIELD_COUNT]; // Non-empty list of each term per field
+    std::vector<uint32_t> used; // Terms with postings in any field
+    for (uint32_t field = 0; field < indexfile::FIELD_COUNT; ++field) { // For each field
+        const auto &map = fieldMap(static_cast<indexfile::Field>(field));
+        std::vector<uint32_t> candidates; // Terms of the field, in memory or mapped
+        for (const auto &pair : map) {
+            candidates.push_back(pair.first);
+        }
+        for (uint32_t term = 0; term < terms.mappedCount(); ++term) { // Terms only in the mapped index
+            if (map.find(term) == map.end() && mappedPostings(static_cast<indexfile::Field>(field), term).count > 0) {
+                candidates.push_back(term);
+            }
+        }
+        for (uint32_t term : candidates) {
+            auto it = map.find(term);
+            const PostingList *list;
+            if (it != map.end() && removedFiles == 0) { // In-memory lists can be saved as they are
+                list = &it->second;
+            } else { // Re-encode with the saved ids
+                rebuilt.emplace_back();
+                PostingView postings = it != map.end() ? it->second.view() : mappedPostings(static_cast<indexfile::Field>(field), term);
+                for (PostingView::Cursor cursor = postings.cursor(); !cursor.atEnd(); cursor.next()) {
+                    if (newIds[cursor.id()] != UINT32_MAX) {
+                        rebuilt.back().add(newIds[cursor.id()], cursor.frequency());
+                    }
+                }
+                list = &rebuilt.back();
+            }
+            if (list->empty()) { // Every file with the term was removed
+                continue;
+            }
+            const auto &positionMap = positionMaps[field];
+            auto inMemory = positionMap.find(term);
+            const PositionList *positions;
+            if (inMemory != positionMap.end() && removedFiles == 0) { // In-memory lists can be saved as they are
+                positions = &inMemory->second;
+            } else { // Re-encode with the saved ids
+                rebuiltPositions.emplace_back();
+                std::vector<uint32_t> offsets;
+                for (PositionView::Cursor cursor = getPositions(static_cast<indexfile::Field>(field), term).cursor(); !cursor.atEnd(); cursor.next()) {
+                    if (newIds[cursor.id()] != UINT32_MAX) {
+                        cursor.positions(offsets);
+                        rebuiltPositions.back().add(newIds[cursor.id()], offsets.data(), static_cast<uint32_t>(offsets.size()));
+                    }
+                }
+                positions = &rebuiltPositions.back();
+            }
+            kept[field].push_back({term, list, positions});
+            used.push_back(term);
+        }
+    }
+
+    std::sort(used.begin(), used.end(), [this](uint32_t a, uint32_t b) { return terms.term(a) < terms.term(b); }); // Saved ids follow term order
+    used.erase(std::unique(used.begin(), used.end()), used.end());
+    std::vector<uint32_t> newTerms(terms.size(), indexfile::NO_TERM); // Saved id of every kept term
+    std::vector<indexfile::TermEntry> termTable; // Dictionary indexed by saved term id
+    std::vector<std::string_view> words; // Text of each saved term id
+    std::string strings; // Term blob
+    for (uint32_t term : used) {
+        newTerms[term] = static_cast<uint32_t>(termTable.size());
+        std::string_view word = terms.term(term);
+        termTable.push_back({strings.size(), static_cast<uint32_t>(word.size()), {indexfile::NO_TERM, indexfile::NO_TERM, indexfile::NO_TERM}});
+        strings += word;
+        words.push_back(word);
+    }
+    std::vector<indexfile::TermSlot> slots = TermDictionary::buildSlots(words); // Hash table from term to saved id
+    for (uint32_t field = 0; field < indexfile::FIELD_COUNT; ++field) { // Posting entries follow saved term ids
+        std::sort(kept[field].begin(), kept[field].end(), [&newTerms](const KeptTerm &a, const KeptTerm &b) { return newTerms[a.term] < newTerms[b.term]; });
+        for (uint32_t index = 0; index < kept[field].size(); ++index) {
+            termTable[newTerms[kept[field][index].term]].postings[field] = index;
+        }
+    }
+
+    hdr.termCount = static_cast<uint32_t>(termTable.size());
+    hdr.slotCount = slots.size();
+    hdr.termTableOffset = static_cast<uint64_t>(ofs.tellp());
+    writeRaw(ofs, termTable.data(), termTable.size()); // Save dictionary
+    hdr.termStringsOffset = static_cast<uint64_t>(ofs.tellp());
+    ofs.write(strings.data(), static_cast<std::streamsize>(strings.size())); // Save terms
+    pad(ofs);
+    hdr.slotTableOffset = static_cast<uint64_t>(ofs.tellp());
+    writeRaw(ofs, slots.data(), slots.size()); // Save hash table
+
+    for (uint32_t field = 0; field < indexfile::FIELD_COUNT; ++field) { // For each field
+        std::vector<indexfile::PostingEntry> entries; // Postings of each term in the field
+        std::vector<PostingSkip> skips; // Skip tables of the field
+        std::vector<PostingSkip> positionSkips; // Skip tables of the field's position lists
+        uint64_t postingBytes = 0; // Size of the encoded postings of the field
+        uint64_t positionBytes = 0; // Size of the encoded positions of the field
+        for (const KeptTerm &keptTerm : kept[field]) { // For each term in saved id order
+            const PostingList *list = keptTerm.postings;
+            const PositionList *positions = keptTerm.positions;
+            entries.push_back({postingBytes, skips.size(), list->size(), list->maxFrequency(), positionBytes, positionSkips.size(), positions->size(), 0});
+            skips.insert(skips.end(), list->skipTable().begin(), list->skipTable().end());
+            postingBytes += list->encoded().size();
+            positionSkips.insert(positionSkips.end(), positions->skipTable().begin(), positions->skipTable().end());
+            positionBytes += positions->encoded().size();
+        }
+
+        indexfile::FieldSection &section = hdr.fields[field];
+        section.postingCount = static_cast<uint32_t>(entries.size());
+        section.skipCount = skips.size();
+        section.postingBytes = postingBytes;
+        section.postingTableOffset = static_cast<uint64_t>(ofs.tellp());
+        writeRaw(ofs, entries.data(), entries.size()); // Save posting entries
+        section.skipsOffset = static_cast<uint64_t>(ofs.tellp());
+        writeRaw(ofs, skips.data(), skips.size()); // Save skip tables
+        section.postingsOffset = static_cast<uint64_t>(ofs.tellp());
+        for (const KeptTerm &keptTerm : kept[field]) { // Save encoded postings in the same order
+            const std::vector<uint8_t> &bytes = keptTerm.postings->encoded();
+            ofs.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        }
+        pad(ofs);
+
+        section.positionSkipCount = positionSkips.size();
+        section.positionBytes = positionBytes;
+        section.positionSkipsOffset = static_cast<uint64_t>(ofs.tellp());
+        writeRaw(ofs, positionSkips.data(), positionSkips.size()); // Save position skip tables
+        section.positionsOffset = static_cast<uint64_t>(ofs.tellp());
+        for (const KeptTerm &keptTerm : kept[field]) { // Save encoded positions in the same order
+            const std::vector<uint8_t> &bytes = keptTerm.positions->encoded();
+            ofs.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        }
+        pad(ofs);
+
+        std::vector<indexfile::PresenceEntry> presence; // Sets of the terms found in many files
+        for (uint32_t index = 0; index < kept[field].size(); ++index) {
+            const PostingList *list = kept[field][index].postings;
+            if (static_cast<uint64_t>(list->size()) * indexfile::PRESENCE_DENSITY < keptIds.size()) { // Rare terms are only read as postings
+                continue;
+            }
+            Roaring files;
+            for (PostingView::Cursor cursor = list->view().cursor(); !cursor.atEnd(); cursor.next()) {
+                files.add(cursor.id());
+            }
+            files.optimize();
+            presence.push_back({index, 0, static_cast<uint64_t>(ofs.tellp()), files.serializedSize()});
+            files.write(ofs); // Save the set; its size is a multiple of 8
+        }
+        section.presenceCount = static_cast<uint32_t>(presence.size());
+        section.presenceTableOffset = static_cast<uint64_t>(ofs.tellp());
+        writeRaw(ofs, presence.data(), presence.size()); // Save presence entries
+    }
+
+    attributes.write(ofs, keptIds, newTerms, hdr); // Attribute columns, with entity terms renumbered like the dictionary
+    documents.write(ofs, keptIds, documentIds, hdr); // Stored documents, last so the checksum can stop before them
+
+    hdr.fileSize = static_cast<uint64_t>(ofs.tellp());
+    ofs.flush(); // Make the sections readable through a mapping
+    MappedFile written; // Sections as written, to checksum them
+    if (!ofs || !written.open(temppath) || written.size() != hdr.fileSize) {
+        std::cerr << "Failed to write index file: " << temppath << std::endl; // Print error message
+        return false; // Return false
+    }
+    hdr.checksum = durable::checksum(written.data() + sizeof(hdr), hdr.docBlocksOffset - sizeof(hdr)); // Blocks have their own checksums
+    written.close();
+    ofs.seekp(0);
+    writeRaw(ofs, &hdr, 1); // Save the completed header
+    ofs.close(); // Close index file
+    if (!ofs) { // If any write failed
+        std::cerr << "Failed to write index file: " << temppath << std::endl; // Print error message
+        return false; // Return false
+    }
+    if (!durable::replaceFile(temppath, indexpath)) { // Move the finished file into place; a mapping of the old file stays valid
+        return false; // Return false
+    }
 
     auto end = std::chrono::high_resolution_clock::now(); // Get end time
     std::chrono::duration<double> duration = end - start; // Calculate duration
-    std::cout << "Save file read in " << duration.count() << " seconds.\n"; // Print duration
+    std::cout << "Index file saved in " << duration.count() << " seconds.\n"; // Print duration
+    return true; // Return true
+}
+
+bool WordMap::loadBinary(const std::string &indexpath) {
+    auto file = std::make_shared<MappedFile>(); // Kept apart until validated, so a failed load leaves the word map as it was
+    if (!file->open(indexpath)) { // Map the index file
+        std::cerr << "Failed to open file for loading: " << indexpath << std::endl; // Print error message
+        return false; // Return false
+    }
+
+    auto start = std::chrono::high_resolution_clock::now(); // Get start time
 
+    const MappedFile &mapped = *file; // File being validated
+    const indexfile::Header *hdr = reinterpret_cast<const indexfile::Header *>(mapped.data()); // Header at the start of the file
+    bool valid = mapped.size() >= sizeof(indexfile::Header)
+        && std::memcmp(hdr->magic, indexfile::MAGIC, sizeof(hdr->magic)) == 0
+        && hdr->version == indexfile::VERSION
+        && hdr->fileSize == mapped.size()
+        && hdr->fileTableOffset + sizeof(indexfile::FileEntry) * hdr->fileCount <= mapped.size()
+        && hdr->pathsOffset <= mapped.size()
+        && hdr->termTableOffset + sizeof(indexfile::TermEntry) * hdr->termCount <= mapped.size()
+        && hdr->termStringsOffset <= mapped.size()
+        && hdr->slotCount > hdr->termCount && (hdr->slotCount & (hdr->slotCount - 1)) == 0 // Lookups need a power of two with free slots
+        && hdr->slotTableOffset + sizeof(indexfile::TermSlot) * hdr->slotCount <= mapped.size(); // Check the header before trusting any offsets
+    for (uint32_t field = 0; valid && field < indexfile::FIELD_COUNT; ++field) { // Check every section fits in the file
+        const indexfile::FieldSection &section = hdr->fields[field];
+        valid = section.postingTableOffset + sizeof(indexfile::PostingEntry) * section.postingCount <= mapped.size()
+            && section.skipsOffset + sizeof(PostingSkip) * section.skipCount <= mapped.size()
+            && section.postingsOffset + section.postingBytes <= mapped.size()
+            && section.positionSkipsOffset + sizeof(PostingSkip) * section.positionSkipCount <= mapped.size()
+            && section.positionsOffset + section.positionBytes <= mapped.size()
+            && section.presenceTableOffset + sizeof(indexfile::PresenceEntry) * section.presenceCount <= mapped.size();
+    }
+    valid = valid && hdr->datesOffset + sizeof(uint32_t) * hdr->fileCount <= mapped.size()
+        && hdr->sitesOffset + sizeof(uint32_t) * hdr->fileCount <= mapped.size()
+        && hdr->siteTableOffset + sizeof(indexfile::SiteEntry) * hdr->siteCount <= mapped.size()
+        && hdr->siteNamesOffset <= mapped.size();
+    for (uint32_t field = 0; valid && field < indexfile::ENTITY_FIELDS; ++field) {
+        const indexfile::EntityColumn &column = hdr->entities[field];
+        valid = column.offsetsOffset + sizeof(uint32_t) * (static_cast<uint64_t>(hdr->fileCount) + 1) <= mapped.size()
+            && column.termsOffset + sizeof(uint32_t) * column.termCount <= mapped.size();
+    }
+    valid = valid && hdr->docTableOffset + sizeof(indexfile::DocEntry) * hdr->fileCount <= mapped.size()
+        && hdr->docKeysOffset + sizeof(indexfile::DocKey) * hdr->fileCount <= mapped.size()
+        && hdr->docBlocksOffset >= sizeof(indexfile::Header) && hdr->docBlocksOffset + hdr->docBytes == mapped.size(); // Blocks end the file
+    if (!valid) { // If the file is not a usable index
+        std::cerr << "Invalid or outdated index file: " << indexpath << std::endl; // Print error message
+        return false; // Return false
+    }
+    if (durable::checksum(mapped.data() + sizeof(*hdr), hdr->docBlocksOffset - sizeof(*hdr)) != hdr->checksum) { // Reads every page but the documents' once, so the first searches also start warm
+        std::cerr << "Index file failed its checksum: " << indexpath << std::endl; // Print error message
+        return false; // Return false
+    }
+
+    toid.clear(); // The mapped index replaces any in-memory data
+    tofile.clear();
+    orgmap.clear();
+    namemap.clear();
+    wordmap.clear();
+    for (uint32_t field = 0; field < indexfile::FIELD_COUNT; ++field) {
+        pending[field].clear();
+        positionMaps[field].clear();
+        pendingImpacts[field].clear();
+        pendingPositions[field].clear();
+    }
+    norms.clear();
+    std::fill(zoneTotals, zoneTotals + indexfile::ZONE_COUNT, 0);
+    std::copy(hdr->zoneWeights, hdr->zoneWeights + indexfile::ZONE_COUNT, weights.begin()); // Impacts added later match the mapped ones
+    removed.clear();
+    removedFiles = 0;
+    this->mapped = file;
+    header = hdr;
+    detached = false;
+    terms.attach(file->data(), *hdr); // Term ids are the mapped dictionary's
+    documents.attach(file->data(), *hdr); // Documents are read from the mapped blocks when fetched
+    attributes.attach(file->data(), *hdr); // Columns are read in place
+
+    auto end = std::chrono::high_resolution_clock::now(); // Get end time
+    std::chrono::duration<double> duration = end - start; // Calculate duration
+    std::cout << "Index file with " << header->fileCount << " files mapped in " << duration.count() << " seconds.\n"; // Print duration
     return true; // Return true
-}
\ No newline at end of file
+}
+
+std::string_view WordMap::mappedPath(uint32_t id) const {
+    const indexfile::FileEntry &entry = reinterpret_cast<const indexfile::FileEntry *>(mapped->data() + header->fileTableOffset)[id];
+    return std::string_view(mapped->data() + header->pathsOffset + entry.pathOffset, entry.pathLength);
+}
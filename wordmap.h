@@ -4,34 +4,131 @@
 #include <string> // Include string library
 #include <unordered_map> // Include unordered_map library
 #include <unordered_set> // Include unordered_set library
+#include <vector> // Include vector library
 #include <fstream> // Include fstream library for file operations
 #include <sstream> // Include sstream library for string stream operations
 #include <iostream> // Include iostream library for input/output operations
 #include <chrono> // Include chrono library for time operations
+#include <memory> // Include memory library for the shared mapping
+#include <string_view> // Include string_view library for term lookups
+#include "indexFile.h" // Include the binary index layout and MappedFile
+#include "impact.h" // Include the zone counts, lengths and weights of the impacts
+#include "postingList.h" // Include the compressed posting lists
+#include "positionList.h" // Include the compressed position lists
+#include "termDictionary.h" // Include the term ids
+#include "docStore.h" // Include the stored documents
+#include "attributes.h" // Include the columns filtered and counted by queries
+#include "roaring.h" // Include the file id sets of common terms
 
 class WordMap { // Define WordMap class
 private: // Private members
     std::unordered_map<std::string, int> toid; // Map from string to int
     std::unordered_map<int, std::string> tofile; // Map from int to string
 
-    std::unordered_map<std::string, std::unordered_set<int>> orgmap; // Map from string to set of ints for organizations
-    std::unordered_map<std::string, std::unordered_set<int>> namemap; // Map from string to set of ints for names
-    std::unordered_map<std::string, std::unordered_set<int>> wordmap; // Map from string to set of ints for words
+    TermDictionary terms; // Id of every word, shared by the three fields; the maps below are keyed by it
 
-    std::unordered_map<std::string, std::unordered_map<int, int>> wordFrequency; // Map from word to map of file id to frequency
+    // Posting lists hold each file id once with the word's impact in that file, computed from its counts
+    // in the file's zones when the association is finalized, see impact.h
+    std::unordered_map<uint32_t, PostingList> orgmap; // Map from term id to posting list for organizations
+    std::unordered_map<uint32_t, PostingList> namemap; // Map from term id to posting list for names
+    std::unordered_map<uint32_t, PostingList> wordmap; // Map from term id to posting list for words
+
+    std::unordered_map<uint32_t, std::vector<std::pair<uint32_t, impact::Counts>>> pending[indexfile::FIELD_COUNT]; // Associations not yet added to the posting lists, with their zone counts, per field
+    std::unordered_map<uint32_t, std::vector<std::pair<uint32_t, uint32_t>>> pendingImpacts[indexfile::FIELD_COUNT]; // Associations whose impact is already known, per field
+
+    // Positions of each term's occurrences per field, alongside the posting lists: in-memory lists replace mapped ones
+    std::unordered_map<uint32_t, PositionList> positionMaps[indexfile::FIELD_COUNT]; // Map from term id to position list, per field
+    std::unordered_map<uint32_t, std::vector<uint32_t>> pendingPositions[indexfile::FIELD_COUNT]; // Positions not yet added, as (id, count, positions...) runs per term
+
+    std::vector<impact::Norms> norms; // Zone lengths of each file, indexed by id
+    uint64_t zoneTotals[indexfile::ZONE_COUNT]; // Sum of the decoded zone lengths of the files that have not been removed
+    impact::Weights weights; // Zone weights of new impacts: the configured ones, or those of the mapped index
+
+    DocStore documents; // Stored title, date, URL and text of each file, by id
+    Attributes attributes; // Date, site and entity terms of each file, by id
+
+    std::vector<bool> removed; // Tombstones of removed files, indexed by id; ids are never reused
+    uint32_t removedFiles; // Number of tombstones
+
+    // Binary index file, when loaded with loadBinary; shared so copies of the word map can serve from the same pages.
+    // A mapped index can still be changed: the maps above then hold the posting lists that differ from the mapped ones,
+    // files added after it was mapped, and (once detached) every path, length and length statistic.
+    std::shared_ptr<MappedFile> mapped;
+    const indexfile::Header* header; // Header of the mapped index, or nullptr when serving from the maps above
+    bool detached; // Whether the file paths, zone lengths and their totals of a mapped index have been copied into memory
+    void detach(); // Copy the file table of a mapped index into memory before changing it
+
+    PostingList &editableList(indexfile::Field field, uint32_t term); // Posting list of a term that can be changed, copied from the mapped index if needed
+    PostingView mappedPostings(indexfile::Field field, uint32_t term) const; // Posting list of a term in the mapped index
+    PositionList &editablePositions(indexfile::Field field, uint32_t term); // Position list of a term that can be changed, copied from the mapped index if needed
+    PositionView mappedPositions(indexfile::Field field, uint32_t term) const; // Position list of a term in the mapped index
+
+    std::unordered_map<uint32_t, PostingList> &fieldMap(indexfile::Field field); // Posting lists of a field
+    const std::unordered_map<uint32_t, PostingList> &fieldMap(indexfile::Field field) const; // Posting lists of a field
+    std::string_view mappedPath(uint32_t id) const; // File path of an id in the mapped index
+    std::unordered_map<std::string, int> getFiles(indexfile::Field field, const std::string &word) const; // Get files and frequencies of a word in a field
 public: // Public members
     WordMap(); // Constructor
     ~WordMap(); // Destructor
+    int addFile(const std::string &filepath); // Get the id of a file path, assigning the next id if it is new
+    void associateOrg(const std::string &org, int id); // Associate organization with file id
+    void associateName(const std::string &name, int id); // Associate name with file id
+    void associateWord(const std::string &word, int id); // Associate word with file id
     void associateOrg(const std::string &org, const std::string &filepath); // Associate organization with file path
     void associateName(const std::string &name, const std::string &filepath); // Associate name with file path
     void associateWord(const std::string &word, const std::string &filepath); // Associate word with file path
+    uint32_t addTerm(std::string_view word); // Get the id of a word, assigning the next id if it is new
+    void setLengths(int id, const impact::Lengths &lengths); // Record the number of words in each zone of a file, before finalizing its associations
+    void associate(indexfile::Field field, uint32_t term, int id, const impact::Counts &counts); // Associate a term id with file id in a field, with its occurrences in each zone
+    void associateImpact(indexfile::Field field, uint32_t term, int id, uint32_t impact); // Associate a term id with file id in a field with a known impact
+    void associatePositions(indexfile::Field field, uint32_t term, int id, const uint32_t *positions, uint32_t count); // Record where a term occurs in a file's field; positions sorted
+    void finalize(); // Compute the impacts of pending associations and add them to the posting lists; call before searching or saving
+    void setDocument(int id, std::shared_ptr<const std::string> packed); // Store the document of a file added since the index was mapped, packed by DocStore::pack
+    bool getDocument(uint32_t id, Document &document) const; // Get the stored document of a file id, returns false if it has none
+    uint32_t findDocument(uint64_t documentId) const; // Get the file id of a document id, the newest one that is not removed, or UINT32_MAX
+    void setAttributes(int id, uint32_t date, std::string_view site); // Record the publish date (yyyymmdd) and site of a file added since the index was mapped
+    uint32_t getDate(uint32_t id) const; // Get the publish date of a file as yyyymmdd, or Attributes::NO_DATE
+    uint32_t getSite(uint32_t id) const; // Get the site id of a file, or indexfile::NO_SITE
+    std::string_view getSiteName(uint32_t site) const; // Get the name of a site id
+    Attributes::Terms getEntities(indexfile::Field field, uint32_t id) const; // Get the distinct organization or person term ids of a file
+    void matchDates(uint32_t from, uint32_t to, Roaring &files) const; // Add every file dated from to to (yyyymmdd, inclusive) to an empty set
+    void matchSite(std::string_view site, Roaring &files) const; // Add every file of a site to an empty set
+    bool removeFile(const std::string &filepath); // Tombstone a file so searches skip it, returns false if it is not indexed
+    bool isRemoved(uint32_t id) const; // Whether a file id has been removed
+    uint32_t removedCount() const; // Number of removed file ids, dropped from the index when it is saved
     void disassociate(const std::string &word, const std::string &filepath); // Disassociate word from file path
+    uint32_t findTerm(std::string_view word) const; // Get the id of a word, or indexfile::NO_TERM if no file has it
+    std::string_view getTerm(uint32_t term) const; // Get the word of a term id
+    void matchWildcard(std::string_view pattern, std::pmr::vector<uint32_t> &out) const; // Get the ids of words matching a pattern in which '*' stands for any run of characters
+    void matchFuzzy(std::string_view word, uint32_t maxEdits, std::pmr::vector<std::pair<uint32_t, uint32_t>> &out) const; // Get the ids of words at most maxEdits edits from word, with their distances
+    PostingView getPostings(indexfile::Field field, uint32_t term) const; // Get the posting list of a term id in a field
+    PostingView getPostings(indexfile::Field field, std::string_view word) const; // Get the posting list of a word in a field
+    bool getPresence(indexfile::Field field, uint32_t term, Roaring &files) const; // Get the files of a term id in a field as a set, returns false unless the mapped index saved one and it is still current
+    PositionView getPositions(indexfile::Field field, uint32_t term) const; // Get the positions of a term id in a field, empty for files indexed without positions
+    std::string getFile(uint32_t id) const; // Get the file path of an id
+    std::string_view filePath(uint32_t id) const; // Same without copying it, valid until the WordMap changes
+    uint32_t fileCount() const; // Get the number of file ids, including removed ones
+    impact::Norms getNorms(uint32_t id) const; // Get the encoded zone lengths of a file
+    double averageLength(indexfile::Zone zone) const; // Get the average number of words in a zone of the files that have not been removed
+    const impact::Weights &zoneWeights() const; // Get the zone weights impacts are computed with
+    size_t memoryUsage() const; // Approximate heap bytes held by the posting lists and file maps
+    size_t mappedBytes() const; // Size of the mapped index file, 0 when not mapped
+    uint64_t mappedSequence() const; // Last write-ahead log record included in the mapped index file, 0 when not mapped
+    struct FieldSize { // Size of one field of the index
+        uint64_t mappedLists; // Posting lists in the mapped index
+        uint64_t mappedBytes; // Encoded postings and positions in the mapped index
+        uint64_t memoryLists; // Posting lists held in memory, replacing or adding to mapped ones
+        uint64_t memoryBytes; // Heap bytes of the posting and position lists held in memory
+    };
+    FieldSize fieldSize(indexfile::Field field) const; // Get the size of a field, for monitoring
     std::unordered_map<std::string, int> getFilesByOrg(const std::string &word) const; // Get files by organization
     std::unordered_map<std::string, int> getFilesByName(const std::string &word) const; // Get files by name
     std::unordered_map<std::string, int> getOtherFilesByWord(const std::string &word) const; // Get other files by word
     std::unordered_map<std::string, int> getFilesByWord(const std::string &word) const; // Get files by word
     void save(const std::string &filenamepath, const std::string &ofilepath, const std::string &nfilepath, const std::string &wfilepath, const std::string &ffilepath) const; // Save data to files
     bool load(const std::string &filenamepath, const std::string &ofilepath, const std::string &nfilepath, const std::string &wfilepath, const std::string &ffilepath);
+    bool saveBinary(const std::string &indexpath, uint64_t sequence = 0) const; // Save data to a single binary index file crash-safely, dropping removed files and renumbering the rest; sequence is the last log record it includes
+    bool loadBinary(const std::string &indexpath); // Map a binary index file and serve lookups from it
 };
 
-#endif // _WORDMAP_H_ // End of include guard
\ No newline at end of file
+#endif // _WORDMAP_H_ // End of include guard
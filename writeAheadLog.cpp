@@ -0,0 +1,394 @@
+#include "writeAheadLog.h" // Include the write-ahead log header
+#include "durableFile.h" // Include the checksum and crash-safe replacement
+#include "wordmap.h" // Include the index records are replayed into
+
+#include <algorithm> // Include the algorithm library for std::max
+#include <cerrno> // Include the cerrno library for EINTR
+#include <cstring> // Include the cstring library for memcpy
+#include <fcntl.h> // Include open
+#include <iostream> // Include the iostream library for error messages
+#include <sys/stat.h> // Include fstat for the log size
+#include <unistd.h> // Include read, write, ftruncate and close
+
+namespace {
+
+constexpr char MAGIC[8] = {'S', 'E', 'W', 'A', 'L', '0', '0', '4'}; // Identifies a log file
+constexpr size_t RECORD_HEADER = sizeof(uint32_t) + sizeof(uint64_t); // Payload size and checksum
+
+enum Tag : uint8_t { STATE = 1, REMOVE = 2, ADD = 3, IDS = 4, POSITIONS = 5 }; // Kinds of entries
+
+// Append a plain value to an encoded record
+template <typename T>
+void put(std::string& bytes, T value) {
+    bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void putString(std::string& bytes, std::string_view text) {
+    put(bytes, static_cast<uint32_t>(text.size()));
+    bytes.append(text.data(), text.size());
+}
+
+void putState(std::string& bytes, const FileState& state) {
+    put(bytes, state.size);
+    put(bytes, state.mtime);
+    put(bytes, state.hash);
+}
+
+// Write all of data to a file, retrying short writes
+bool writeFully(int fd, const std::string& data) {
+    for (size_t written = 0; written < data.size();) {
+        ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Reads the entries of a record, failing once anything would run past its end
+struct Decoder {
+    const char* data; // Next byte
+    const char* end; // End of the payload
+    bool ok = true; // Whether every read so far fit
+
+    template <typename T>
+    T get() {
+        T value{};
+        if (static_cast<size_t>(end - data) < sizeof(value)) {
+            ok = false;
+            return value;
+        }
+        std::memcpy(&value, data, sizeof(value));
+        data += sizeof(value);
+        return value;
+    }
+
+    std::string_view getString() {
+        uint32_t size = get<uint32_t>();
+        if (!ok || static_cast<size_t>(end - data) < size) {
+            ok = false;
+            return {};
+        }
+        std::string_view text(data, size);
+        data += size;
+        return text;
+    }
+
+    FileState getState() {
+        FileState state;
+        state.size = get<uint64_t>();
+        state.mtime = get<int64_t>();
+        state.hash = get<uint64_t>();
+        return state;
+    }
+};
+
+}
+
+void WriteAheadLog::Batch::setState(const std::string& filePath, const FileState& state) {
+    put(bytes, STATE);
+    putString(bytes, filePath);
+    putState(bytes, state);
+}
+
+void WriteAheadLog::Batch::removeFile(const std::string& filePath) {
+    put(bytes, REMOVE);
+    putString(bytes, filePath);
+}
+
+void WriteAheadLog::Batch::addFile(const std::string& filePath, const FileState& state, const impact::Lengths& lengths, uint32_t date, std::string_view site, std::string_view document) {
+    put(bytes, ADD);
+    putString(bytes, filePath);
+    putState(bytes, state);
+    for (uint32_t length : lengths) {
+        put(bytes, length);
+    }
+    put(bytes, date);
+    putString(bytes, site);
+    putString(bytes, document);
+}
+
+void WriteAheadLog::Batch::associate(indexfile::Field field, std::string_view word, const std::pmr::vector<std::pair<int, impact::Counts>>& postings, int firstId) {
+    put(bytes, IDS);
+    put(bytes, static_cast<uint8_t>(field));
+    putString(bytes, word);
+    put(bytes, static_cast<uint32_t>(postings.size()));
+    for (const auto& posting : postings) {
+        put(bytes, static_cast<uint32_t>(posting.first - firstId));
+        bytes.append(reinterpret_cast<const char*>(posting.second.data()), posting.second.size());
+    }
+}
+
+void WriteAheadLog::Batch::associatePositions(indexfile::Field field, std::string_view word, const std::pmr::vector<const uint32_t*>& runs, int firstId) {
+    put(bytes, POSITIONS);
+    put(bytes, static_cast<uint8_t>(field));
+    putString(bytes, word);
+    put(bytes, static_cast<uint32_t>(runs.size()));
+    for (const uint32_t* run : runs) {
+        put(bytes, static_cast<uint32_t>(static_cast<int>(run[0]) - firstId));
+        put(bytes, run[1]);
+        bytes.append(reinterpret_cast<const char*>(run + 2), sizeof(uint32_t) * run[1]);
+    }
+}
+
+WriteAheadLog::WriteAheadLog() : fd(-1), sequence(0), bytes(0) {} // Constructor
+
+WriteAheadLog::~WriteAheadLog() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+bool WriteAheadLog::open(const std::string& logPath, uint64_t floor) {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    path = logPath;
+    sequence = floor;
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to open write-ahead log: " << path << std::endl; // Print error message
+        return false;
+    }
+
+    std::vector<Record> records; // Intact records
+    size_t validBytes = 0; // Size of the log up to the end of the last intact record
+    if (!read(records, validBytes)) { // Not a log, or written by another version: start over
+        std::cerr << "Invalid write-ahead log, starting a new one: " << path << std::endl; // Print error message
+        validBytes = 0;
+    }
+    struct stat st; // Size on disk, to see whether anything follows the intact records
+    if (fstat(fd, &st) != 0) {
+        return false;
+    }
+    if (validBytes < static_cast<size_t>(st.st_size)) { // A record torn by a crash, or a damaged one, and everything after it
+        if (validBytes > 0) {
+            std::cerr << "Dropping " << (static_cast<size_t>(st.st_size) - validBytes) << " bytes of torn records from write-ahead log: " << path << std::endl; // Print warning
+        }
+        if (::ftruncate(fd, static_cast<off_t>(validBytes)) != 0 || !durable::syncFile(fd)) {
+            std::cerr << "Failed to repair write-ahead log: " << path << std::endl; // Print error message
+            return false;
+        }
+    }
+    bytes = validBytes;
+    if (bytes == 0) { // New log
+        if (!writeFully(fd, std::string(MAGIC, sizeof(MAGIC))) || !durable::syncFile(fd)) {
+            std::cerr << "Failed to write write-ahead log: " << path << std::endl; // Print error message
+            return false;
+        }
+        bytes = sizeof(MAGIC);
+    }
+    for (const Record& record : records) {
+        sequence = std::max(sequence, record.sequence);
+    }
+    return true;
+}
+
+bool WriteAheadLog::append(const Batch& batch) {
+    if (fd < 0) {
+        return false;
+    }
+    std::string record(RECORD_HEADER, '\0'); // Header filled in below, then the payload
+    put(record, sequence + 1);
+    record += batch.bytes;
+    uint32_t size = static_cast<uint32_t>(record.size() - RECORD_HEADER);
+    uint64_t checksum = durable::checksum(record.data() + RECORD_HEADER, size);
+    std::memcpy(&record[0], &size, sizeof(size));
+    std::memcpy(&record[sizeof(size)], &checksum, sizeof(checksum));
+    size_t before = bytes;
+    if (!writeFully(fd, record) || !durable::syncFile(fd)) { // Cut off what was written, so later records do not follow a torn one
+        std::cerr << "Failed to append to write-ahead log: " << path << std::endl; // Print error message
+        if (::ftruncate(fd, static_cast<off_t>(before)) == 0) {
+            bytes = before;
+        }
+        return false;
+    }
+    bytes += record.size();
+    ++sequence;
+    return true;
+}
+
+size_t WriteAheadLog::replay(uint64_t indexSequence, WordMap* target, uint64_t manifestSequence, Manifest* manifest) const {
+    std::vector<Record> records;
+    size_t validBytes = 0;
+    read(records, validBytes);
+    size_t applied = 0; // Records applied to the index
+    std::vector<int> added; // Ids given to the added files of the current record
+    std::vector<uint32_t> positions; // Positions of one run, copied out of the record to align them
+    for (const Record& record : records) {
+        bool toIndex = target && record.sequence > indexSequence;
+        bool toManifest = manifest && record.sequence > manifestSequence;
+        if (!toIndex && !toManifest) { // Already in both
+            continue;
+        }
+        added.clear();
+        Decoder decoder{record.payload.data(), record.payload.data() + record.payload.size()};
+        while (decoder.ok && decoder.data < decoder.end) {
+            uint8_t tag = decoder.get<uint8_t>();
+            if (tag == STATE || tag == REMOVE || tag == ADD) {
+                std::string filePath(decoder.getString());
+                FileState state = tag == REMOVE ? FileState() : decoder.getState();
+                impact::Lengths lengths = {};
+                uint32_t date = 0; // Publish date as yyyymmdd
+                std::string_view site; // Site, empty when the file has none
+                std::string_view document; // Packed stored document, empty when the file has none
+                if (tag == ADD) {
+                    for (uint32_t& length : lengths) {
+                        length = decoder.get<uint32_t>();
+                    }
+                    date = decoder.get<uint32_t>();
+                    site = decoder.getString();
+                    document = decoder.getString();
+                }
+                if (!decoder.ok) {
+                    break;
+                }
+                if (tag == REMOVE) {
+                    if (toIndex) {
+                        target->removeFile(filePath);
+                    }
+                    if (toManifest) {
+                        manifest->erase(filePath);
+                    }
+                    continue;
+                }
+                if (tag == ADD && toIndex) {
+                    added.push_back(target->addFile(filePath));
+                    target->setLengths(added.back(), lengths);
+                    target->setAttributes(added.back(), date, site);
+                    if (!document.empty()) {
+                        target->setDocument(added.back(), std::make_shared<const std::string>(document));
+                    }
+                }
+                if (toManifest) {
+                    manifest->set(filePath, state);
+                }
+            } else if (tag == IDS || tag == POSITIONS) {
+                indexfile::Field field = static_cast<indexfile::Field>(decoder.get<uint8_t>());
+                std::string_view word = decoder.getString();
+                uint32_t count = decoder.get<uint32_t>();
+                uint32_t term = toIndex && decoder.ok ? target->addTerm(word) : 0;
+                for (uint32_t i = 0; decoder.ok && i < count; ++i) {
+                    uint32_t file = decoder.get<uint32_t>();
+                    impact::Counts counts = {};
+                    if (tag == IDS) {
+                        for (uint8_t& zoneCount : counts) {
+                            zoneCount = decoder.get<uint8_t>();
+                        }
+                    }
+                    uint32_t length = tag == POSITIONS ? decoder.get<uint32_t>() : 0;
+                    positions.resize(length);
+                    for (uint32_t& position : positions) {
+                        position = decoder.get<uint32_t>();
+                    }
+                    if (!decoder.ok || !toIndex) { // Words only matter when replaying into the index
+                        continue;
+                    }
+                    if (file >= added.size() || field >= indexfile::FIELD_COUNT) {
+                        decoder.ok = false;
+                        continue;
+                    }
+                    if (tag == IDS) {
+                        target->associate(field, term, added[file], counts);
+                    } else {
+                        target->associatePositions(field, term, added[file], positions.data(), length);
+                    }
+                }
+            } else {
+                decoder.ok = false;
+            }
+        }
+        if (!decoder.ok) {
+            std::cerr << "Invalid record " << record.sequence << " in write-ahead log: " << path << std::endl; // Print error message
+        }
+        if (toIndex) {
+            target->finalize(); // Each update was finalized before the next one, which may remove its files
+            ++applied;
+        }
+    }
+    return applied;
+}
+
+bool WriteAheadLog::truncate(uint64_t through) {
+    std::vector<Record> records;
+    size_t validBytes = 0;
+    if (fd < 0 || !read(records, validBytes)) {
+        return false;
+    }
+    std::string kept(MAGIC, sizeof(MAGIC)); // Log holding only the records after through
+    for (const Record& record : records) {
+        if (record.sequence <= through) {
+            continue;
+        }
+        std::string payload;
+        put(payload, record.sequence);
+        payload += record.payload;
+        put(kept, static_cast<uint32_t>(payload.size()));
+        put(kept, durable::checksum(payload.data(), payload.size()));
+        kept += payload;
+    }
+    std::string temppath = path + ".tmp"; // Written aside and moved into place, so a crash keeps one whole log
+    int out = ::open(temppath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (out < 0) {
+        std::cerr << "Failed to open file for saving: " << temppath << std::endl; // Print error message
+        return false;
+    }
+    bool written = writeFully(out, kept);
+    ::close(out);
+    if (!written || !durable::replaceFile(temppath, path)) {
+        std::cerr << "Failed to truncate write-ahead log: " << path << std::endl; // Print error message
+        return false;
+    }
+    ::close(fd);
+    fd = ::open(path.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+    bytes = kept.size();
+    return fd >= 0;
+}
+
+bool WriteAheadLog::read(std::vector<Record>& records, size_t& validBytes) const {
+    records.clear();
+    validBytes = 0;
+    std::string contents; // Whole log
+    char buffer[65536];
+    for (off_t offset = 0;;) {
+        ssize_t n = ::pread(fd, buffer, sizeof(buffer), offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        contents.append(buffer, static_cast<size_t>(n));
+        offset += n;
+    }
+    if (contents.empty()) {
+        return true;
+    }
+    if (contents.size() < sizeof(MAGIC) || std::memcmp(contents.data(), MAGIC, sizeof(MAGIC)) != 0) {
+        return false;
+    }
+    size_t offset = sizeof(MAGIC);
+    validBytes = offset;
+    while (contents.size() - offset >= RECORD_HEADER) {
+        uint32_t size;
+        uint64_t checksum;
+        std::memcpy(&size, contents.data() + offset, sizeof(size));
+        std::memcpy(&checksum, contents.data() + offset + sizeof(size), sizeof(checksum));
+        const char* payload = contents.data() + offset + RECORD_HEADER;
+        if (size < sizeof(uint64_t) || contents.size() - offset - RECORD_HEADER < size || durable::checksum(payload, size) != checksum) { // Torn or damaged
+            break;
+        }
+        Record record;
+        std::memcpy(&record.sequence, payload, sizeof(record.sequence));
+        record.payload.assign(payload + sizeof(record.sequence), size - sizeof(record.sequence));
+        records.push_back(std::move(record));
+        offset += RECORD_HEADER + size;
+        validBytes = offset;
+    }
+    return true;
+}
+
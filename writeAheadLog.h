@@ -0,0 +1,71 @@
+#ifndef WRITEAHEADLOG_H // Include guard to prevent multiple inclusions of this header file
+#define WRITEAHEADLOG_H // Define the include guard
+
+#include "impact.h" // Include the zone lengths and counts of added files
+#include "indexFile.h" // Include the field numbers
+#include "manifest.h" // Include the manifest the log keeps up to date
+#include <cstdint> // Include the cstdint library for fixed width integers
+#include <memory_resource> // Include the memory_resource library for the build workers' lists
+#include <string> // Include the string library
+#include <string_view> // Include the string_view library
+#include <vector> // Include the vector library
+
+class WordMap; // Index the log is replayed into
+
+// Write-ahead log of the changes made to a binary index since it was last saved.
+//
+// Each incremental update is appended as one record, flushed to disk before the update is published:
+// the files it removed, the files it added with their manifest state, zone lengths, date, site and stored document, and the words of
+// the added files with their occurrences in each zone and their positions. Impacts are not logged: they
+// are computed again from the counts and the lengths, which give the same averages as the original update. A checkpoint saves the index and the manifest with the sequence number of the
+// last record they include; recovery maps the index and replays the newer records on top of it, so a
+// crash loses no published update and never needs the changed files again. The index and the manifest
+// are each replaced atomically but not together, so records newer than the manifest and not newer
+// than the index are still applied to the manifest.
+//
+// File format: the "SEWAL004" magic, then records of a uint32 payload size, a uint64 durable::checksum
+// of the payload and the payload: a uint64 sequence number followed by tagged entries. A record that is
+// cut short or fails its checksum ends the log; it is cut off when the log is opened.
+class WriteAheadLog {
+public:
+    // Changes of one update, in the order they were made to the index
+    class Batch {
+    public:
+        void setState(const std::string& filePath, const FileState& state); // A file whose state changed but not its contents
+        void removeFile(const std::string& filePath); // A file dropped from the index
+        void addFile(const std::string& filePath, const FileState& state, const impact::Lengths& lengths, uint32_t date, std::string_view site, std::string_view document); // A file given the next id, with its attributes and its stored document packed by DocStore::pack or empty; later entries refer to added files by their order in the batch
+        void associate(indexfile::Field field, std::string_view word, const std::pmr::vector<std::pair<int, impact::Counts>>& postings, int firstId); // Added files (first one firstId) a word is in, with its occurrences in each zone
+        void associatePositions(indexfile::Field field, std::string_view word, const std::pmr::vector<const uint32_t*>& runs, int firstId); // (id, count, positions...) runs of a word in added files
+        bool empty() const { return bytes.empty(); } // Whether nothing was recorded
+
+    private:
+        friend class WriteAheadLog;
+        std::string bytes; // Encoded entries
+    };
+
+    WriteAheadLog(); // Constructor
+    ~WriteAheadLog(); // Destructor, closes the log
+    WriteAheadLog(const WriteAheadLog&) = delete; // Logs are not copyable
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete; // Logs are not copyable
+
+    bool open(const std::string& path, uint64_t floor = 0); // Open or create the log, cutting off a torn last record; numbering continues after floor or the last record
+    uint64_t lastSequence() const { return sequence; } // Sequence number of the last record appended
+    size_t size() const { return bytes; } // Size of the log file
+    bool append(const Batch& batch); // Append a record and flush it to disk, returns false if it could not be made durable
+    size_t replay(uint64_t indexSequence, WordMap* target, uint64_t manifestSequence, Manifest* manifest) const; // Apply the records newer than each sequence to the index and the manifest, returns the number applied to the index
+    bool truncate(uint64_t through); // Drop the records up to through, once a checkpoint includes them
+
+private:
+    struct Record { // One record read back from the log
+        uint64_t sequence; // Sequence number
+        std::string payload; // Entries, after the sequence number
+    };
+    bool read(std::vector<Record>& records, size_t& validBytes) const; // Read every intact record
+
+    std::string path; // Log file
+    int fd; // Open log file, or -1
+    uint64_t sequence; // Last sequence number used
+    size_t bytes; // Size of the log file
+};
+
+#endif // WRITEAHEADLOG_H // End of include guard